@@ -0,0 +1,489 @@
+// compress.cc
+//	Routines to compress chunks of file data, and to read and write
+//	compressed files a chunk at a time.  See compress.h.
+//
+//	A compressed chunk is a sequence of runs, each of which is
+//
+//	   a token byte: the number of literals in the high four bits,
+//		and the length of the copy less LZMinMatch in the low four
+//	   if either of those is 15 or more, the rest of it follows (the
+//		literals' before them, the copy's after the offset), as
+//		bytes of 255 ended by one smaller byte
+//	   the literals
+//	   the offset of the copy, back from the current position, in two
+//		bytes (least significant first)
+//
+//	The last run has no copy: it ends with its literals, and with
+//	the chunk.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "compress.h"
+#include "filehdr.h"
+#include "openfile.h"
+#include "filesys.h"
+#include "synchdisk.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// LZHash
+// 	Hash the LZMinMatch bytes at "p", to find where they were seen
+//	before.
+//----------------------------------------------------------------------
+
+static int LZHash(char *p)
+{
+    unsigned int v;
+
+    memcpy(&v, p, sizeof(v));
+    return (int)((v * 2654435761U) >> (32 - LZHashBits));
+}
+
+//----------------------------------------------------------------------
+// LZPutLength/LZGetLength
+// 	Write (read) the part of a length that did not fit in its four
+//	bits of the token.  FALSE if the output (input) runs out.
+//----------------------------------------------------------------------
+
+static bool LZPutLength(int n, char *to, int *op, int room)
+{
+    for (; n >= 255; n -= 255)
+    {
+        if (*op >= room)
+            return FALSE;
+        to[(*op)++] = (char)255;
+    }
+    if (*op >= room)
+        return FALSE;
+    to[(*op)++] = (char)n;
+    return TRUE;
+}
+
+static bool LZGetLength(char *from, int *ip, int length, int *n)
+{
+    int b;
+
+    do
+    {
+        if (*ip >= length)
+            return FALSE;
+        b = (unsigned char)from[(*ip)++];
+        *n += b;
+    } while (b == 255);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// LZPutRun
+// 	Write one run: "numLiterals" literals, followed by a copy of
+//	"copyLength" bytes from "offset" back, or by nothing if
+//	"copyLength" is 0.  FALSE if "to" runs out of room.
+//----------------------------------------------------------------------
+
+static bool LZPutRun(char *literals, int numLiterals, int offset,
+                     int copyLength, char *to, int *op, int room)
+{
+    int copy = (copyLength > 0) ? copyLength - LZMinMatch : 0;
+
+    if (*op >= room)
+        return FALSE;
+    to[(*op)++] = (char)((min(numLiterals, 15) << 4) | min(copy, 15));
+    if (numLiterals >= 15 && !LZPutLength(numLiterals - 15, to, op, room))
+        return FALSE;
+    if (*op + numLiterals > room)
+        return FALSE;
+    memcpy(to + *op, literals, numLiterals);
+    *op += numLiterals;
+    if (copyLength == 0)
+        return TRUE; // the last run
+    if (*op + 2 > room)
+        return FALSE;
+    to[(*op)++] = (char)(offset & 0xff);
+    to[(*op)++] = (char)((offset >> 8) & 0xff);
+    if (copy >= 15 && !LZPutLength(copy - 15, to, op, room))
+        return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// LZCodec::Compress
+// 	Compress "length" bytes, greedily: at each position, look up the
+//	last place the next LZMinMatch bytes hashed to, and if they are
+//	the same there, copy as much as matches.
+//
+//	"from" -- the data
+//	"length" -- how much of it (at most a chunk)
+//	"to" -- where to put the compressed data
+//	"room" -- how much of that there is
+//----------------------------------------------------------------------
+
+int LZCodec::Compress(char *from, int length, char *to, int room)
+{
+    short seen[1 << LZHashBits]; // last position with each hash
+    int ip = 0, anchor = 0, op = 0;
+
+    ASSERT(length <= 0x7fff); // positions fit in a short
+    for (int i = 0; i < (1 << LZHashBits); i++)
+        seen[i] = -1;
+    while (ip + LZMinMatch <= length)
+    {
+        int h = LZHash(from + ip);
+        int ref = seen[h];
+        int n = LZMinMatch;
+
+        seen[h] = ip;
+        if (ref < 0 || memcmp(from + ref, from + ip, LZMinMatch) != 0)
+        {
+            ip++;
+            continue;
+        }
+        while (ip + n < length && from[ref + n] == from[ip + n])
+            n++;
+        if (!LZPutRun(from + anchor, ip - anchor, ip - ref, n, to, &op, room))
+            return -1;
+        ip += n;
+        anchor = ip;
+    }
+    if (anchor < length &&
+        !LZPutRun(from + anchor, length - anchor, 0, 0, to, &op, room))
+        return -1;
+    return op;
+}
+
+//----------------------------------------------------------------------
+// LZCodec::Decompress
+// 	Undo Compress, checking every length and offset against the
+//	buffers, so a damaged chunk is noticed instead of overrunning
+//	them.
+//
+//	"from" -- the compressed data
+//	"length" -- how much of it
+//	"to" -- where to put the data
+//	"expect" -- how much data there should be
+//----------------------------------------------------------------------
+
+bool LZCodec::Decompress(char *from, int length, char *to, int expect)
+{
+    int ip = 0, op = 0;
+
+    while (ip < length)
+    {
+        int token = (unsigned char)from[ip++];
+        int n = token >> 4;
+        int offset;
+
+        if (n == 15 && !LZGetLength(from, &ip, length, &n))
+            return FALSE;
+        if (ip + n > length || op + n > expect)
+            return FALSE;
+        memcpy(to + op, from + ip, n);
+        ip += n;
+        op += n;
+        if (ip == length)
+            break; // the last run has no copy
+        if (ip + 2 > length)
+            return FALSE;
+        offset = (unsigned char)from[ip] | ((unsigned char)from[ip + 1] << 8);
+        ip += 2;
+        n = (token & 15) + LZMinMatch;
+        if ((token & 15) == 15 && !LZGetLength(from, &ip, length, &n))
+            return FALSE;
+        if (offset == 0 || offset > op || op + n > expect)
+            return FALSE;
+        for (; n > 0; n--, op++) // byte by byte: the copy may overlap
+            to[op] = to[op - offset];
+    }
+    return op == expect;
+}
+
+//----------------------------------------------------------------------
+// CompressedFile::MapSectors
+// 	Return how many sectors the chunk map of a file of "length"
+//	bytes takes.
+//----------------------------------------------------------------------
+
+int CompressedFile::MapSectors(int length)
+{
+    int numChunks = divRoundUp(length, CompressChunk);
+
+    return divRoundUp(numChunks * sizeof(ChunkEntry), SectorSize);
+}
+
+//----------------------------------------------------------------------
+// CompressedFile::Format
+// 	Write the chunk map of a new compressed file: no chunk has been
+//	written yet.  FileSystem::Create gives the file just enough data
+//	blocks for the map.
+//
+//	"hdr" -- the header of the file, already marked compressed
+//----------------------------------------------------------------------
+
+void CompressedFile::Format(FileHeader *hdr)
+{
+    int n = MapSectors(hdr->ContentLength());
+    int numEntries = n * SectorSize / sizeof(ChunkEntry);
+    ChunkEntry *map = new ChunkEntry[numEntries];
+    int *sectors = new int[n];
+
+    for (int i = 0; i < numEntries; i++)
+    {
+        map[i].block = -1;
+        map[i].bytes = 0;
+    }
+    for (int i = 0; i < n; i++)
+        sectors[i] = hdr->ByteToSector(i * SectorSize);
+    if (n > 0)
+        kernel->synchDisk->WriteSectors(sectors, n, (char *)map, HeaderIO);
+    delete[] sectors;
+    delete[] map;
+}
+
+//----------------------------------------------------------------------
+// CompressedFile::CompressedFile
+// 	Get ready to read and write a compressed file, by reading its
+//	chunk map into memory.
+//
+//	"hdr" -- the header of the file, which OpenFile keeps
+//	"hdrSector" -- where it is on disk
+//----------------------------------------------------------------------
+
+CompressedFile::CompressedFile(FileHeader *hdr, int hdrSector)
+{
+    this->hdr = hdr;
+    this->hdrSector = hdrSector;
+    length = hdr->ContentLength();
+    numChunks = divRoundUp(length, CompressChunk);
+    mapSectors = MapSectors(length);
+    map = new ChunkEntry[mapSectors * SectorSize / sizeof(ChunkEntry)];
+    Transfer(0, mapSectors, (char *)map, FALSE, HeaderIO, NULL);
+    chunk = new char[CompressChunk];
+    cached = -1;
+}
+
+CompressedFile::~CompressedFile()
+{
+    delete[] chunk;
+    delete[] map;
+}
+
+//----------------------------------------------------------------------
+// CompressedFile::ReadAt/WriteAt
+// 	Read/write a portion of the file, starting at "position", a
+//	chunk at a time.  The chunk last used is kept uncompressed, so
+//	reading or writing a chunk in small pieces reads it only once.
+//	A write compresses every chunk it touches back to disk, and then
+//	writes the map entries of those chunks.
+//
+//	"into" -- the buffer to contain the data read
+//	"from" -- the buffer containing the data to write
+//	"numBytes" -- the number of bytes to transfer
+//	"position" -- the offset within the file of the first byte
+//	"stats" -- the counters of the OpenFile
+//----------------------------------------------------------------------
+
+int CompressedFile::ReadAt(char *into, int numBytes, int position,
+                           FileStats *stats)
+{
+    int done = 0;
+
+    if ((numBytes <= 0) || (position >= length))
+        return 0; // check request
+    if ((position + numBytes) > length)
+        numBytes = length - position;
+    DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position << " from compressed file of length " << length);
+
+    while (done < numBytes)
+    {
+        int c = (position + done) / CompressChunk;
+        int offset = position + done - c * CompressChunk;
+        int n = min(ChunkLength(c) - offset, numBytes - done);
+
+        LoadChunk(c, stats);
+        bcopy(chunk + offset, into + done, n);
+        done += n;
+    }
+    stats->bytesRead += numBytes;
+    return numBytes;
+}
+
+int CompressedFile::WriteAt(char *from, int numBytes, int position,
+                            FileStats *stats)
+{
+    int done = 0;
+
+    if ((numBytes <= 0) || (position >= length))
+        return 0; // check request
+    if ((position + numBytes) > length)
+        numBytes = length - position;
+    DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position << " to compressed file of length " << length);
+
+    while (done < numBytes)
+    {
+        int c = (position + done) / CompressChunk;
+        int offset = position + done - c * CompressChunk;
+        int n = min(ChunkLength(c) - offset, numBytes - done);
+
+        if (n < ChunkLength(c))
+            LoadChunk(c, stats); // keep the rest of the chunk
+        bcopy(from + done, chunk + offset, n);
+        cached = c;
+        if (!StoreChunk(c, stats))
+            break; // disk full
+        done += n;
+    }
+    if (done > 0)
+        WriteMap(position / CompressChunk,
+                 (position + done - 1) / CompressChunk, stats);
+    stats->bytesWritten += done;
+    return done;
+}
+
+//----------------------------------------------------------------------
+// CompressedFile::ChunkLength
+// 	Return how many bytes of the file chunk "c" holds.
+//----------------------------------------------------------------------
+
+int CompressedFile::ChunkLength(int c)
+{
+    return min(CompressChunk, length - c * CompressChunk);
+}
+
+//----------------------------------------------------------------------
+// CompressedFile::LoadChunk
+// 	Read chunk "c", and decompress it into "chunk", unless it is
+//	there already.
+//----------------------------------------------------------------------
+
+void CompressedFile::LoadChunk(int c, FileStats *stats)
+{
+    ChunkEntry *entry = &map[c];
+    int n = ChunkLength(c);
+    int numSectors;
+    bool intact;
+    char *buf;
+
+    if (cached == c)
+        return;
+    cached = c;
+    if (entry->block < 0)
+    {
+        memset(chunk, 0, n); // never written
+        return;
+    }
+    numSectors = divRoundUp(entry->bytes, SectorSize);
+    buf = new char[numSectors * SectorSize];
+    Transfer(entry->block, numSectors, buf, FALSE, DataIO, stats);
+    if (entry->bytes == n)
+        bcopy(buf, chunk, n); // stored as it is
+    else
+    {
+        intact = LZCodec::Decompress(buf, entry->bytes, chunk, n);
+        ASSERT(intact);
+    }
+    delete[] buf;
+}
+
+//----------------------------------------------------------------------
+// CompressedFile::StoreChunk
+// 	Compress "chunk", which holds chunk "c", and write it to disk:
+//	where it was, if it still fits or is at the end of the file, and
+//	otherwise at the end.  The map entry is updated in memory only.
+//	Return FALSE if the file needed to grow and the disk is full.
+//----------------------------------------------------------------------
+
+bool CompressedFile::StoreChunk(int c, FileStats *stats)
+{
+    ChunkEntry *entry = &map[c];
+    int n = ChunkLength(c);
+    int end = hdr->FileLength() / SectorSize; // data blocks in use
+    int have = (entry->block < 0) ? 0 : divRoundUp(entry->bytes, SectorSize);
+    int block = entry->block;
+    int bytes, need;
+    char *buf = new char[CompressChunk];
+
+    bytes = LZCodec::Compress(chunk, n, buf, n - 1);
+    if (bytes < 0)
+    {   // it doesn't get any smaller
+        bcopy(chunk, buf, n);
+        bytes = n;
+    }
+    need = divRoundUp(bytes, SectorSize);
+    memset(buf + bytes, 0, need * SectorSize - bytes);
+
+    if (need > have)
+    {
+        if (block < 0 || block + have != end)
+            block = end; // move it to the end
+        if (!kernel->fileSystem->GrowFile(hdr, hdrSector,
+                                          (block + need) * SectorSize))
+        {
+            cached = -1; // "chunk" is not what the disk has
+            delete[] buf;
+            return FALSE;
+        }
+    }
+    DEBUG(dbgFile, "Chunk " << c << ": " << n << " bytes stored in " << bytes << " at block " << block);
+    Transfer(block, need, buf, TRUE, DataIO, stats);
+    entry->block = block;
+    entry->bytes = bytes;
+    delete[] buf;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// CompressedFile::WriteMap
+// 	Write back the sectors of the map that hold the entries of chunks
+//	"first" to "last".
+//----------------------------------------------------------------------
+
+void CompressedFile::WriteMap(int first, int last, FileStats *stats)
+{
+    int perSector = SectorSize / sizeof(ChunkEntry);
+    int firstSector = first / perSector;
+    int lastSector = last / perSector;
+
+    Transfer(firstSector, lastSector - firstSector + 1,
+             (char *)map + firstSector * SectorSize, TRUE, HeaderIO, stats);
+}
+
+//----------------------------------------------------------------------
+// CompressedFile::Transfer
+// 	Read or write "count" data blocks of the file, from "block" on,
+//	in one request, so sectors on different disks go in parallel.
+//	Data blocks count in "stats" as sectors read or written; the map,
+//	like the header, only when read.
+//
+//	"buf" -- where the blocks are (count * SectorSize bytes)
+//	"writing" -- TRUE to write them, FALSE to read them
+//	"category" -- DataIO for chunks, HeaderIO for the map
+//	"stats" -- the counters to update, or NULL
+//----------------------------------------------------------------------
+
+void CompressedFile::Transfer(int block, int count, char *buf, bool writing,
+                              DiskCategory category, FileStats *stats)
+{
+    int headerReads = kernel->stats->diskReads[HeaderIO];
+    int *sectors;
+
+    if (count == 0)
+        return;
+    sectors = new int[count];
+    for (int i = 0; i < count; i++)
+        sectors[i] = hdr->ByteToSector((block + i) * SectorSize);
+    if (writing)
+        kernel->synchDisk->WriteSectors(sectors, count, buf, category);
+    else
+        kernel->synchDisk->ReadSectors(sectors, count, buf, category);
+    delete[] sectors;
+
+    if (stats == NULL)
+        return;
+    stats->headerReads += kernel->stats->diskReads[HeaderIO] - headerReads;
+    if (category == DataIO && writing)
+        stats->sectorsWritten += count;
+    else if (category == DataIO)
+        stats->sectorsRead += count;
+}
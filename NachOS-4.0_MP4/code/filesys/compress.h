@@ -0,0 +1,125 @@
+// compress.h
+//	Data structures for compressed files: files whose contents are
+//	stored in fixed size chunks, each compressed on its own, so that
+//	reading the file moves fewer sectors than it has bytes.
+//
+//	The data blocks of a compressed file (as FileHeader sees them)
+//	start with the chunk map: for each chunk of CompressChunk bytes,
+//	the block its compressed bytes start at, and how many of them
+//	there are.  The chunks themselves follow, each in as few whole
+//	sectors as it needs.  The map is read when the file is opened, so
+//	a read only fetches the sectors of the chunks it touches, and
+//	decompresses just those.
+//
+//	A chunk that never was written has no sectors, and reads as
+//	zeros.  A chunk that doesn't get smaller is stored as it is.
+//	A chunk that gets bigger when it is rewritten moves to the end of
+//	the file, unless it is there already, in which case the file just
+//	grows under it; writing a file from start to end therefore packs
+//	the chunks one after the other.  The sectors a chunk moves away
+//	from stay with the file until it is removed.
+//
+//	The length of a compressed file is set when it is created (the
+//	chunk map is sized for it), and Fallocate does not apply to it.
+//	Like the header, the map is kept in memory while the file is open,
+//	so a compressed file should not be written through one OpenFile
+//	while another has it open.
+//
+//	The codec is a byte oriented LZ77 in the style of LZ4: a sequence
+//	of literal runs, each followed by a copy of at least LZMinMatch
+//	bytes from earlier in the chunk.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "copyright.h"
+#include "disk.h"
+#include "stats.h"
+
+class FileHeader;
+class FileStats;
+
+#define CompressChunk (8 * SectorSize) // bytes compressed together
+#define LZMinMatch 4                   // shortest copy the codec encodes
+#define LZHashBits 10                  // size of its match finder
+
+// The codec.  Chunks are small, so offsets always fit in two bytes.
+
+class LZCodec
+{
+public:
+    static int Compress(char *from, int length, char *to, int room);
+                       // Compress "length" bytes into at most "room"
+                       //  bytes of "to"; return how many, or -1 if
+                       //  they don't fit
+    static bool Decompress(char *from, int length, char *to, int expect);
+                       // Undo Compress; FALSE unless "from" holds
+                       //  exactly "expect" bytes of data
+};
+
+// Where one chunk is, as stored in the chunk map.
+
+class ChunkEntry
+{
+public:
+    int block; // data block the chunk starts at, -1 if never written
+    int bytes; // its size on disk; the length of the chunk if stored
+               //  as it is
+};
+
+// The following class reads and writes the contents of one open
+// compressed file.  OpenFile hands ReadAt/WriteAt to it, with the
+// file already locked.
+
+class CompressedFile
+{
+public:
+    CompressedFile(FileHeader *hdr, int hdrSector);
+                       // Read the chunk map of the file whose header
+                       //  is "hdr", at "hdrSector"
+    ~CompressedFile();
+
+    static int MapSectors(int length);
+                       // Sectors of chunk map a file of "length"
+                       //  bytes needs
+    static void Format(FileHeader *hdr);
+                       // Write an empty map into a new file, whose
+                       //  blocks are already allocated
+
+    int ReadAt(char *into, int numBytes, int position, FileStats *stats);
+    int WriteAt(char *from, int numBytes, int position, FileStats *stats);
+                       // As OpenFile::ReadAt/WriteAt, counting the
+                       //  I/O in "stats"
+
+private:
+    FileHeader *hdr;    // Header of the file
+    int hdrSector;      // Where it is, to write it back as it grows
+    int length;         // Bytes in the file, uncompressed
+    int numChunks;      // Chunks they make up
+    int mapSectors;     // Sectors the map takes
+    ChunkEntry *map;    // The map, as on disk (mapSectors of it)
+
+    char *chunk;        // One chunk, uncompressed
+    int cached;         // Which one, or -1
+
+    int ChunkLength(int c);  // Bytes in chunk "c" (the last one may
+                             //  be short)
+    void LoadChunk(int c, FileStats *stats);
+                             // Get chunk "c" into "chunk"
+    bool StoreChunk(int c, FileStats *stats);
+                             // Compress "chunk" back to chunk "c";
+                             //  FALSE if the disk is full
+    void WriteMap(int first, int last, FileStats *stats);
+                             // Write back the map sectors holding the
+                             //  entries of chunks "first" to "last"
+    void Transfer(int block, int count, char *buf, bool writing,
+                  DiskCategory category, FileStats *stats);
+                             // Read/write "count" data blocks from
+                             //  "block" on
+};
+
+#endif // COMPRESS_H
@@ -0,0 +1,503 @@
+// dedup.cc
+//	Routines to keep the reference count of every sector and the
+//	hint table, and to decide where the data blocks written by
+//	OpenFile go.  See dedup.h.
+//
+//	The counts take 512KB and the hint table 128KB, so both are read
+//	a sector at a time, the first time they are needed; a sector of
+//	them that was never written is all zeros, and isn't read at all.
+//	What Place and Written change is written back before they return;
+//	what freeing sectors changes, with the free map.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "dedup.h"
+#include "pbitmap.h"
+#include "filehdr.h"
+#include "filesys.h"
+#include "synchdisk.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// HashSector
+// 	Return a 32 bit hash (FNV-1a) of the SectorSize bytes of "data".
+//----------------------------------------------------------------------
+
+static unsigned HashSector(char *data)
+{
+    unsigned hash = 2166136261u;
+
+    for (int i = 0; i < SectorSize; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//----------------------------------------------------------------------
+// FileIO
+// 	Read or write "count" sectors of the deduplication file whose
+//	header is "hdr", from sector "first" of the file on.
+//----------------------------------------------------------------------
+
+static void FileIO(FileHeader *hdr, int first, int count, char *data,
+                   bool writing)
+{
+    int *sectors = new int[count];
+
+    for (int i = 0; i < count; i++)
+        sectors[i] = hdr->ByteToSector((first + i) * SectorSize);
+    if (writing)
+        kernel->synchDisk->WriteSectors(sectors, count, data, DedupIO);
+    else
+        kernel->synchDisk->ReadSectors(sectors, count, data, DedupIO);
+    delete[] sectors;
+}
+
+//----------------------------------------------------------------------
+// DedupTable::DedupTable
+// 	Read the start of the deduplication file (but not the counts or
+//	the hints, which are read as they are needed).
+//
+//	"fileSystem" -- where to fetch the free map from
+//	"sector" -- header of the deduplication file
+//----------------------------------------------------------------------
+
+DedupTable::DedupTable(FileSystem *fileSystem, int sector)
+{
+    char buf[DedupHeadSectors * SectorSize];
+
+    this->fileSystem = fileSystem;
+    hdr = new FileHeader;
+    hdr->FetchFrom(sector);
+    lock = new Lock("dedup table");
+
+    FileIO(hdr, 0, DedupHeadSectors, buf, FALSE);
+    memcpy((char *)&head, buf, sizeof(DedupHead));
+    headDirty = FALSE;
+    refs = new unsigned char[NumSectors];
+    hints = new DedupHint[DedupBuckets];
+    loaded = new Bitmap(DedupTableSectors);
+    dirty = new Bitmap(DedupTableSectors);
+    busy = new Bitmap(NumSectors);
+    DEBUG(dbgFile, "Dedup table: " << (head.enabled ? "on" : "off") << ", "
+                   << head.tracked << " sectors counted, " << head.saved
+                   << " blocks sharing them");
+}
+
+DedupTable::~DedupTable()
+{
+    delete hdr;
+    delete lock;
+    delete[] refs;
+    delete[] hints;
+    delete loaded;
+    delete dirty;
+    delete busy;
+}
+
+//----------------------------------------------------------------------
+// DedupTable::Format
+// 	Allocate the deduplication file on a disk being formatted, and
+//	write its start: deduplication off, and no sector of counts or
+//	hints written yet, so none of the rest need be.
+//
+//	"freeMap" -- the free map of the new file system
+//	"sector" -- where to put the header
+//----------------------------------------------------------------------
+
+void DedupTable::Format(PersistentBitmap *freeMap, int sector)
+{
+    FileHeader *hdr = new FileHeader;
+    char buf[DedupHeadSectors * SectorSize];
+
+    freeMap->Mark(sector);
+    ASSERT(hdr->Allocate(freeMap, DedupFileSize));
+    hdr->WriteBack(sector);
+    memset(buf, 0, sizeof(buf));
+    FileIO(hdr, 0, DedupHeadSectors, buf, TRUE);
+    delete hdr;
+}
+
+//----------------------------------------------------------------------
+// DedupTable::TableSector/Changed
+// 	Return sector "t" of the counts and hints (the counts come
+//	first), reading it if it isn't in memory yet.  Changed marks it
+//	to be written back, and as written for good.
+//----------------------------------------------------------------------
+
+char *DedupTable::TableSector(int t)
+{
+    char *data;
+
+    if (t < RefSectors)
+        data = (char *)&refs[t * RefsPerSector];
+    else
+        data = (char *)&hints[(t - RefSectors) * HintsPerSector];
+    if (!loaded->Test(t))
+    {
+        if (head.written[t / BitsInWord] & (1 << (t % BitsInWord)))
+            FileIO(hdr, DedupHeadSectors + t, 1, data, FALSE);
+        else
+            memset(data, 0, SectorSize);
+        loaded->Mark(t);
+    }
+    return data;
+}
+
+void DedupTable::Changed(int t)
+{
+    dirty->Mark(t);
+    if (!(head.written[t / BitsInWord] & (1 << (t % BitsInWord))))
+    {
+        head.written[t / BitsInWord] |= 1 << (t % BitsInWord);
+        headDirty = TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// DedupTable::RefsOf/SetRefs
+// 	Get (set) the count of "sector", keeping the totals of the head
+//	up to date.
+//----------------------------------------------------------------------
+
+int DedupTable::RefsOf(int sector)
+{
+    TableSector(sector / RefsPerSector);
+    return refs[sector];
+}
+
+void DedupTable::SetRefs(int sector, int count)
+{
+    int old = RefsOf(sector);
+
+    ASSERT(count >= 0 && count <= MaxRefs);
+    if (count == old)
+        return;
+    head.tracked += (count > 0) - (old > 0);
+    head.shared += (count > 1) - (old > 1);
+    head.saved += max(count - 1, 0) - max(old - 1, 0);
+    refs[sector] = count;
+    Changed(sector / RefsPerSector);
+    headDirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// DedupTable::HintFor/Lookup
+// 	HintFor returns the entry of the hint table for "hash".  Lookup
+//	returns the sector it names if that sector holds "data" (whose
+//	hash is "hash") and can take one more block, or -1.
+//----------------------------------------------------------------------
+
+DedupHint *DedupTable::HintFor(unsigned hash)
+{
+    int b = hash % DedupBuckets;
+
+    TableSector(RefSectors + b / HintsPerSector);
+    return &hints[b];
+}
+
+int DedupTable::Lookup(char *data, unsigned hash)
+{
+    DedupHint *hint = HintFor(hash);
+    char buf[SectorSize];
+    int count;
+
+    if (hint->sector <= 0 || hint->hash != hash)
+        return -1;
+    count = RefsOf(hint->sector);
+    if (count == 0 || count == MaxRefs || busy->Test(hint->sector))
+        return -1; // freed since, full, or being written
+    kernel->synchDisk->ReadSector(hint->sector, buf, DedupIO);
+    if (memcmp(buf, data, SectorSize) != 0)
+        return -1; // overwritten since, or a collision
+    return hint->sector;
+}
+
+//----------------------------------------------------------------------
+// DedupTable::Involves
+// 	Return TRUE if a write of the "count" blocks at "sectors" has to
+//	go through Place: deduplication is on, or one of them has a count
+//	left from when it was.  Otherwise the write leaves the table as
+//	it is, and OpenFile writes the blocks in place.
+//----------------------------------------------------------------------
+
+bool DedupTable::Involves(int *sectors, int count)
+{
+    bool involved;
+
+    lock->Acquire();
+    involved = head.enabled;
+    for (int i = 0; !involved && i < count; i++)
+        if (RefsOf(sectors[i]) > 0)
+            involved = TRUE;
+    lock->Release();
+    return involved;
+}
+
+//----------------------------------------------------------------------
+// DedupTable::Place
+// 	Called by OpenFile before it writes "count" data blocks, at most
+//	DedupPool of them: decide where each goes.  "sectors" holds
+//	where the blocks are now, and "data" what is to be written.
+//
+//	A block whose contents are on disk already is pointed at them,
+//	and not written.  A shared block that is not gets a sector of
+//	its own from the pool.  Any other block is written in place.
+//	The sectors blocks move away from, when nothing else points at
+//	them, go to the pool; what the pool can't hold goes back to the
+//	free map, and so does the pool, down to DedupPoolLow.
+//
+//	Return FALSE, having changed nothing, if the pool can't have
+//	enough sectors for the shared blocks: the disk is full.
+//----------------------------------------------------------------------
+
+bool DedupTable::Place(int *sectors, int count, char *data, bool *write)
+{
+    PersistentBitmap *freeMap = NULL;
+    int *original = new int[count];
+    int *spare = new int[count + DedupPool]; // to give back
+    int numSpare = 0, needed, found, old, i, j;
+
+    ASSERT(count <= DedupPool);
+    memcpy(original, sectors, count * sizeof(int));
+
+    lock->Acquire();
+    for (needed = i = 0; i < count; i++)
+        if (RefsOf(sectors[i]) >= 2)
+            needed++;
+    if (needed > head.poolSize)
+    {
+        lock->Release(); // the free map lock comes first
+        freeMap = fileSystem->FetchFreeMap();
+        lock->Acquire();
+        for (needed = i = 0; i < count; i++)
+            if (RefsOf(sectors[i]) >= 2)
+                needed++;
+        while (head.poolSize < max(needed, DedupPoolLow) &&
+               freeMap->NumClear() > 0) // not what others reserved
+        {
+            int sector = freeMap->FindAndSet();
+
+            if (sector < 0)
+                break;
+            head.pool[head.poolSize++] = sector;
+            headDirty = TRUE;
+        }
+        if (needed > head.poolSize)
+        {
+            WriteDirty();
+            lock->Release();
+            fileSystem->ReleaseFreeMap(freeMap, TRUE);
+            delete[] original;
+            delete[] spare;
+            return FALSE;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        char *block = &data[i * SectorSize];
+
+        old = sectors[i];
+        write[i] = FALSE;
+        found = head.enabled ? Lookup(block, HashSector(block)) : -1;
+        for (j = 0; found >= 0 && j < count; j++)
+            if (j != i && original[j] == found)
+                found = -1; // it may change in this very write
+        if (found == old)
+            continue; // it holds these bytes already
+        if (found >= 0)
+        {   // found on disk: share it
+            DEBUG(dbgFile, "Dedup: block at " << old << " found at " << found);
+            SetRefs(found, RefsOf(found) + 1);
+            sectors[i] = found;
+            head.hits++;
+            headDirty = TRUE;
+            if (RefsOf(old) >= 2)
+                SetRefs(old, RefsOf(old) - 1);
+            else
+            {
+                SetRefs(old, 0);
+                if (head.poolSize < DedupPool)
+                    head.pool[head.poolSize++] = old;
+                else
+                    spare[numSpare++] = old;
+            }
+        }
+        else if (RefsOf(old) >= 2)
+        {   // shared, and the new contents are not: copy on write
+            DEBUG(dbgFile, "Dedup: copy of shared sector " << old);
+            SetRefs(old, RefsOf(old) - 1);
+            sectors[i] = head.pool[--head.poolSize];
+            SetRefs(sectors[i], head.enabled ? 1 : 0);
+            head.copies++;
+            headDirty = TRUE;
+            write[i] = TRUE;
+        }
+        else
+        {   // ours alone: write in place
+            SetRefs(old, head.enabled ? 1 : 0);
+            write[i] = TRUE;
+        }
+        if (write[i])
+            busy->Mark(sectors[i]);
+    }
+    if (numSpare > 0)
+        while (head.poolSize > DedupPoolLow)
+        {
+            spare[numSpare++] = head.pool[--head.poolSize];
+            headDirty = TRUE;
+        }
+    WriteDirty();
+    lock->Release();
+
+    if (numSpare > 0)
+    {   // PersistentBitmap::Clear comes back to us, so not locked;
+        // their counts are 0, so they are freed (unless a snapshot
+        // needs them)
+        if (freeMap == NULL)
+            freeMap = fileSystem->FetchFreeMap();
+        for (i = 0; i < numSpare; i++)
+            freeMap->Clear(spare[i]);
+    }
+    if (freeMap != NULL)
+        fileSystem->ReleaseFreeMap(freeMap, TRUE);
+    delete[] original;
+    delete[] spare;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DedupTable::Written
+// 	The blocks Place said to write (those with "write" set) are on
+//	disk: other blocks may share them from now on, so, if
+//	deduplication is on, each becomes the hint for its hash.
+//----------------------------------------------------------------------
+
+void DedupTable::Written(int *sectors, int count, char *data, bool *write)
+{
+    lock->Acquire();
+    for (int i = 0; i < count; i++)
+    {
+        if (!write[i])
+            continue;
+        busy->Clear(sectors[i]);
+        if (head.enabled && RefsOf(sectors[i]) > 0)
+        {
+            unsigned hash = HashSector(&data[i * SectorSize]);
+            DedupHint *hint = HintFor(hash);
+
+            hint->hash = hash;
+            hint->sector = sectors[i];
+            Changed(RefSectors + (hash % DedupBuckets) / HintsPerSector);
+        }
+    }
+    WriteDirty();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// DedupTable::Freed
+// 	"sector" is being freed.  Take one off its count, and return TRUE
+//	if other blocks still point at it.
+//----------------------------------------------------------------------
+
+bool DedupTable::Freed(int sector)
+{
+    int count;
+
+    lock->Acquire();
+    count = RefsOf(sector);
+    if (count > 0)
+        SetRefs(sector, count - 1);
+    lock->Release();
+    return count >= 2;
+}
+
+//----------------------------------------------------------------------
+// DedupTable::Flush
+// 	Write back the counts that changed since the last time, along
+//	with the free map that freed their sectors.
+//----------------------------------------------------------------------
+
+void DedupTable::Flush()
+{
+    lock->Acquire();
+    WriteDirty();
+    lock->Release();
+}
+
+void DedupTable::WriteDirty()
+{
+    int count = DedupTableSectors - dirty->NumClear();
+
+    if (count > 0)
+    {
+        int *sectors = new int[count];
+        char *buf = new char[count * SectorSize];
+
+        count = 0;
+        for (int t = 0; t < DedupTableSectors; t++)
+            if (dirty->Test(t))
+            {
+                sectors[count] = hdr->ByteToSector((DedupHeadSectors + t) *
+                                                   SectorSize);
+                memcpy(&buf[count * SectorSize], TableSector(t), SectorSize);
+                dirty->Clear(t);
+                count++;
+            }
+        kernel->synchDisk->WriteSectors(sectors, count, buf, DedupIO);
+        delete[] sectors;
+        delete[] buf;
+    }
+    if (headDirty)
+    {
+        char buf[DedupHeadSectors * SectorSize];
+
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, (char *)&head, sizeof(DedupHead));
+        FileIO(hdr, 0, DedupHeadSectors, buf, TRUE);
+        headDirty = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// DedupTable::Enable
+// 	Turn deduplication of new writes on or off.  Blocks shared
+//	already stay shared either way.
+//----------------------------------------------------------------------
+
+void DedupTable::Enable(bool on)
+{
+    lock->Acquire();
+    head.enabled = on;
+    headDirty = TRUE;
+    WriteDirty();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// DedupTable::Report
+// 	Print how many blocks the counted sectors hold, the ratio of the
+//	two, and what that saves a cache of data sectors: each shared
+//	sector is cached once, however many blocks point at it.
+//----------------------------------------------------------------------
+
+void DedupTable::Report()
+{
+    lock->Acquire();
+    printf("Dedup: %s, %d blocks in %d sectors, ratio %.2f, %d sectors shared\n",
+           head.enabled ? "on" : "off", head.tracked + head.saved,
+           head.tracked, head.tracked == 0 ? 1.0 :
+           (double)(head.tracked + head.saved) / head.tracked, head.shared);
+    printf("Dedup: %d blocks found on disk, %d copied on write, "
+           "%d bytes of cache saved\n", head.hits, head.copies,
+           head.saved * SectorSize);
+    lock->Release();
+}
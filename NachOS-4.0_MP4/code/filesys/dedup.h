@@ -0,0 +1,156 @@
+// dedup.h
+//	Data structures for sector deduplication: data blocks of files
+//	(or of one file) that hold the same bytes share one sector, so a
+//	disk full of copies of the same programs and data files stores
+//	each sector of them once.
+//
+//	Every sector has a reference count, kept in a file of its own
+//	alongside the free map: 0 for a sector deduplication knows
+//	nothing about (headers, directories, compressed files, data
+//	written while it was off), otherwise how many data blocks point
+//	at it.  Freeing a sector with a count of 2 or more just takes one
+//	off; the sector stays allocated for the other blocks.
+//
+//	While deduplication is on, each data block OpenFile writes is
+//	hashed, and looked up in a hint table: one entry per hash bucket,
+//	the last sector written with contents of that hash.  If the hint
+//	still has a count, and its sector (read back to make sure, since
+//	the hash is only 32 bits) holds the same bytes, the block is
+//	pointed at it instead of being written, and the sector the block
+//	had goes to a pool of spare sectors.
+//
+//	A block whose sector is shared is never written in place: it is
+//	pointed at another sector that holds the new contents (copy on
+//	write) -- one found in the hint table, or one from the pool.  So
+//	the counts and the pool are kept up whether deduplication is on
+//	or off; turning it off only stops new sharing.
+//
+//	The pool saves fetching the free map (512 sectors) for every
+//	block that moves.  It is filled from the free map, and given back
+//	to it, DedupPoolLow sectors at a time.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include "copyright.h"
+#include "bitmap.h"
+#include "disk.h"
+#include "synch.h"
+
+class FileHeader;
+class FileSystem;
+class PersistentBitmap;
+
+#define DedupBuckets 16384 // entries of the hint table
+#define DedupPool 256      // most spare sectors kept for blocks that move
+#define DedupPoolLow 32    // what the pool is filled up, or given back, to
+#define MaxRefs 255        // counts are unsigned chars
+
+#define RefsPerSector SectorSize
+#define HintsPerSector ((int)(SectorSize / sizeof(DedupHint)))
+#define RefSectors (NumSectors / RefsPerSector)
+#define HintSectors (DedupBuckets / HintsPerSector)
+#define DedupTableSectors (RefSectors + HintSectors)
+
+// One entry of the hint table.
+
+class DedupHint
+{
+public:
+    unsigned hash; // Hash of the contents of "sector", when written
+    int sector;    // 0 if none (sector 0 never holds data)
+};
+
+// The start of the deduplication file; the counts follow, then the
+// hint table.
+
+class DedupHead
+{
+public:
+    int enabled;  // Are new writes deduplicated?
+    int tracked;  // Sectors with a count
+    int shared;   // Of those, the ones with a count of 2 or more
+    int saved;    // Blocks that share a sector with an earlier one:
+                  //  the sum of (count - 1)
+    int hits;     // Blocks written that were found on disk already
+    int copies;   // Shared blocks copied on write
+    int poolSize; // Entries of "pool" in use
+    int pool[DedupPool]; // Spare sectors, allocated in the free map
+    unsigned written[DedupTableSectors / BitsInWord];
+                  // Which sectors of counts and hints were ever
+                  //  written; the others are zeros
+};
+
+#define DedupHeadSectors ((int)divRoundUp(sizeof(DedupHead), SectorSize))
+#define DedupFileSize ((DedupHeadSectors + DedupTableSectors) * SectorSize)
+
+// The following class keeps the counts and the hint table.  OpenFile
+// asks it where the blocks it writes go, PersistentBitmap tells it
+// what is freed, and FileSystem turns it on and off.  Its lock comes
+// after the free map lock (see filelock.h).
+
+class DedupTable
+{
+public:
+    DedupTable(FileSystem *fileSystem, int sector);
+                       // Read the table whose file has its header at
+                       //  "sector"
+    ~DedupTable();
+
+    static void Format(PersistentBitmap *freeMap, int sector);
+                       // Allocate and write an empty table, on a disk
+                       //  being formatted
+
+    bool Involves(int *sectors, int count);
+                       // Must a write of the blocks at "sectors" go
+                       //  through Place?  Not if deduplication is off
+                       //  and none of them is counted
+    bool Place(int *sectors, int count, char *data, bool *write);
+                       // Decide where the "count" blocks of "data",
+                       //  now at "sectors", go: change "sectors" for
+                       //  the blocks that move, and set "write" for
+                       //  the ones to write.  FALSE if a shared block
+                       //  needs a sector and the disk is full
+    void Written(int *sectors, int count, char *data, bool *write);
+                       // The blocks Place said to write are on disk
+    bool Freed(int sector);
+                       // "sector" is being freed; TRUE if other blocks
+                       //  still point at it, so it must stay allocated
+    void Flush();      // The free map is being written back: write
+                       //  back what changed with it
+
+    void Enable(bool on);  // Turn deduplication on or off
+    void Report();         // Print what it saves
+
+private:
+    FileSystem *fileSystem; // To fetch the free map for the pool
+    FileHeader *hdr;        // Header of the deduplication file
+    Lock *lock;             // Protects all of the below
+
+    DedupHead head;         // The start of the file, in memory
+    bool headDirty;
+    unsigned char *refs;    // Count of every sector and the hint
+    DedupHint *hints;       //  table, as far as loaded: one bit per
+    Bitmap *loaded;         //  sector of them, and which of them
+    Bitmap *dirty;          //  changed
+    Bitmap *busy;           // Sectors Place said to write, until
+                            //  Written: no block may be pointed at
+                            //  them meanwhile
+
+    char *TableSector(int t);      // Sector "t" of counts and hints,
+                                   //  loading it
+    void Changed(int t);           // Sector "t" must be written back
+    int RefsOf(int sector);
+    void SetRefs(int sector, int count);
+    DedupHint *HintFor(unsigned hash);
+    int Lookup(char *data, unsigned hash);
+                            // A sector with a count holding "data",
+                            //  or -1
+    void WriteDirty();      // Write back whatever changed
+};
+
+#endif // DEDUP_H
@@ -0,0 +1,280 @@
+// defrag.cc
+//	Routines to find fragmented files and move each of them into a
+//	contiguous run of sectors.  See defrag.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "defrag.h"
+#include "filehdr.h"
+#include "treewalk.h"
+#include "synchdisk.h"
+#include "disktrace.h"
+#include "main.h"
+
+// The following class keeps what the defragmenter needs to know about
+// one file: where its header is, and where its data blocks are now.
+
+class DefragFile
+{
+public:
+    DefragFile(char *path, DirectoryEntry *entry, FileHeader *hdr);
+    ~DefragFile();
+
+    int Breaks();             // discontiguities in the data sectors
+
+    char *path;               // absolute name, for debugging
+    int hdrSector;            // sector of the (first) file header
+    bool isDir;               // is it a directory?
+    int numSectors;           // how many data blocks it has
+    int *sectors;             // the sector of each block, in order
+    int reads;                // sectors of it read in the trace
+};
+
+DefragFile::DefragFile(char *path, DirectoryEntry *entry, FileHeader *hdr)
+{
+    this->path = new char[strlen(path) + 1];
+    strcpy(this->path, path);
+    hdrSector = entry->sector;
+    isDir = entry->isDir;
+    numSectors = hdr->Capacity() / SectorSize;
+    sectors = new int[numSectors];
+    for (int i = 0; i < numSectors; i++)
+        sectors[i] = hdr->ByteToSector(i * SectorSize);
+    reads = 0;
+}
+
+DefragFile::~DefragFile()
+{
+    delete[] sectors;
+    delete[] path;
+}
+
+int DefragFile::Breaks()
+{
+    int breaks = 0;
+
+    for (int i = 1; i < numSectors; i++)
+        if (sectors[i] != sectors[i - 1] + 1)
+            breaks++;
+    return breaks;
+}
+
+//----------------------------------------------------------------------
+// DefragOrder
+// 	Compare two files for the order Run moves them in: the most
+//	read first, and among those read as often, the most fragmented.
+//----------------------------------------------------------------------
+
+static int DefragOrder(DefragFile *x, DefragFile *y)
+{
+    if (x->reads != y->reads)
+        return (x->reads > y->reads) ? -1 : 1;
+    if (x->Breaks() != y->Breaks())
+        return (x->Breaks() > y->Breaks()) ? -1 : 1;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Defragmenter
+// 	Set up a defragmenter, with no files yet.
+//
+//	"freeMap" -- the in-core bitmap of free sectors
+//	"freeMapFile" -- the file it is stored in
+//----------------------------------------------------------------------
+
+Defragmenter::Defragmenter(PersistentBitmap *freeMap, OpenFile *freeMapFile)
+{
+    this->freeMap = freeMap;
+    this->freeMapFile = freeMapFile;
+    files = new List<DefragFile *>;
+    remap = new int[NumSectors];
+    for (int i = 0; i < NumSectors; i++)
+        remap[i] = i;
+    sectorsMoved = 0;
+}
+
+Defragmenter::~Defragmenter()
+{
+    while (!files->IsEmpty())
+        delete files->RemoveFront();
+    delete files;
+    delete[] remap;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Scan
+// 	Read the headers of every file and directory below "root", and
+//	remember where their data is.  Files of less than two blocks
+//	can't be fragmented, and are left out.
+//
+//	"root" -- contents of the directory, which the scan deletes
+//	"rootPath" -- its absolute name
+//----------------------------------------------------------------------
+
+void Defragmenter::Scan(Directory *root, char *rootPath)
+{
+    TreeWalk *walk = new TreeWalk(root, rootPath);
+    FileHeader *hdr = new FileHeader;
+    DirectoryEntry entry;
+    char path[MaxWalkPath];
+    int size, depth;
+
+    while (walk->Next(path, &entry, &size, &depth))
+    {
+        hdr->FetchFrom(entry.sector);
+        if (hdr->Capacity() > SectorSize)
+            files->Append(new DefragFile(path, &entry, hdr));
+    }
+    delete hdr;
+    delete walk;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::CountReads
+// 	Count the sectors of each file that were read in a disk trace,
+//	to move the files that are read most first.  The trace must
+//	have been recorded on this file system, with the same number
+//	of disks.
+//
+//	"traceName" -- the UNIX file the trace is in
+//----------------------------------------------------------------------
+
+bool Defragmenter::CountReads(char *traceName)
+{
+    DiskTraceRecord *records;
+    DefragFile **owner;
+    int numRecords, numDisks = kernel->synchDisk->NumDisks();
+
+    records = DiskReplayer::Load(traceName, &numRecords);
+    if (records == NULL)
+        return FALSE;
+
+    owner = new DefragFile *[NumSectors]; // which file has each sector
+    for (int i = 0; i < NumSectors; i++)
+        owner[i] = NULL;
+    for (ListIterator<DefragFile *> it(files); !it.IsDone(); it.Next())
+        for (int i = 0; i < it.Item()->numSectors; i++)
+            owner[it.Item()->sectors[i]] = it.Item();
+
+    for (int i = 0; i < numRecords; i++)
+    {
+        int sector = records[i].sector * numDisks + records[i].unit;
+        if (!records[i].writing && sector < NumSectors &&
+            owner[sector] != NULL)
+            owner[sector]->reads++;
+    }
+    delete[] owner;
+    delete[] records;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Run
+// 	Move every fragmented file into a contiguous run, in order of
+//	how often it is read.  A file for which there is no free run
+//	long enough stays where it is; files moved before it may have
+//	freed one for those that come after.
+//----------------------------------------------------------------------
+
+int Defragmenter::Run()
+{
+    SortedList<DefragFile *> *order = new SortedList<DefragFile *>(DefragOrder);
+    int moved = 0;
+
+    for (ListIterator<DefragFile *> it(files); !it.IsDone(); it.Next())
+        order->Insert(it.Item());
+    while (!order->IsEmpty())
+    {
+        DefragFile *file = order->RemoveFront();
+        if (file->Breaks() > 0 && Move(file))
+            moved++;
+    }
+    delete order;
+    return moved;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Move
+// 	Copy one file to a contiguous run of free sectors, and point its
+//	headers there, in the order described in defrag.h.
+//
+//	"file" -- the file to move
+//----------------------------------------------------------------------
+
+bool Defragmenter::Move(DefragFile *file)
+{
+    DiskCategory category = file->isDir ? DirectoryIO : DataIO;
+    int n = file->numSectors;
+    int start = freeMap->FindContiguous(n);
+    int *newSectors;
+    char *buffer;
+    FileHeader *hdr;
+
+    if (start == -1)
+    {
+        DEBUG(dbgFile, "No run of " << n << " sectors for " << file->path);
+        return FALSE;
+    }
+    DEBUG(dbgFile, "Moving " << file->path << " (" << file->Breaks()
+                             << " breaks) to sectors " << start << "-"
+                             << start + n - 1);
+
+    newSectors = new int[n];
+    for (int i = 0; i < n; i++)
+    {
+        newSectors[i] = start + i;
+        freeMap->Mark(start + i);
+    }
+    freeMap->WriteBack(freeMapFile);
+
+    buffer = new char[DefragBatch * SectorSize];
+    for (int i = 0; i < n; i += DefragBatch)
+    {
+        int count = min(DefragBatch, n - i);
+        kernel->synchDisk->ReadSectors(file->sectors + i, count, buffer,
+                                       category);
+        kernel->synchDisk->WriteSectors(newSectors + i, count, buffer,
+                                        category);
+    }
+    delete[] buffer;
+
+    hdr = new FileHeader;
+    hdr->FetchFrom(file->hdrSector);
+    hdr->Relocate(newSectors);
+    hdr->WriteBack(file->hdrSector);
+    delete hdr;
+
+    for (int i = 0; i < n; i++)
+    {
+        ASSERT(freeMap->Test(file->sectors[i]));
+        freeMap->Clear(file->sectors[i]);
+        remap[file->sectors[i]] = newSectors[i];
+    }
+    freeMap->WriteBack(freeMapFile);
+
+    delete[] file->sectors;
+    file->sectors = newSectors;
+    sectorsMoved += n;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Score
+// 	Return the fragmentation score of the files found by Scan: their
+//	discontiguities, as a percentage of the most they could have.
+//----------------------------------------------------------------------
+
+double Defragmenter::Score()
+{
+    int breaks = 0, most = 0;
+
+    for (ListIterator<DefragFile *> it(files); !it.IsDone(); it.Next())
+    {
+        breaks += it.Item()->Breaks();
+        most += it.Item()->numSectors - 1;
+    }
+    return most ? 100.0 * breaks / most : 0.0;
+}
@@ -0,0 +1,88 @@
+// defrag.h
+//	Data structures to defragment the file system: find the files
+//	whose data is scattered over the disk, and copy each of them
+//	into one contiguous run of free sectors.
+//
+//	How fragmented a file is is the number of discontiguities in its
+//	list of data sectors: places where the next block of the file is
+//	not in the next sector, so reading the file sequentially costs a
+//	seek.  The fragmentation score of the file system is how many
+//	of those there are, as a percentage of the most there could be
+//	(one between every two blocks of every file).
+//
+//	Files are moved one at a time, in an order that keeps the disk
+//	consistent at every step:
+//
+//	   1. the new run is marked in use, and the free map written back
+//	   2. the data is copied to the new run
+//	   3. the headers are pointed at the new run and written back
+//	   4. the old sectors are cleared, and the free map written back
+//
+//	Until step 3 the old copy is the file; during it, both copies
+//	hold the same data and are both in use; after it, the worst a
+//	crash can do is leak the old sectors.
+//
+//	Contiguous runs are a limited resource, so the files that are
+//	read most often go first.  How often that is comes from a disk
+//	trace (see disktrace.h) of a typical workload; without one, the
+//	most fragmented files go first.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef DEFRAG_H
+#define DEFRAG_H
+
+#include "copyright.h"
+#include "list.h"
+#include "directory.h"
+#include "pbitmap.h"
+#include "openfile.h"
+
+#define DefragBatch 64 // sectors copied with one batch of requests
+
+class DefragFile; // a file the defragmenter knows of (see defrag.cc)
+
+// The following class defragments the files below one directory.
+// Call Scan, optionally CountReads, and then Run.
+
+class Defragmenter
+{
+public:
+    Defragmenter(PersistentBitmap *freeMap, OpenFile *freeMapFile);
+                       // Defragment using (and keeping up to date)
+                       // the in-core "freeMap", which is written
+                       // back to "freeMapFile" whenever it changes
+    ~Defragmenter();
+
+    void Scan(Directory *root, char *rootPath);
+                       // Find every file and directory below "root",
+                       // already read from "rootPath"; the scan
+                       // deletes "root" when done with it
+    bool CountReads(char *traceName);
+                       // Count how many times each file was read in
+                       // a disk trace; FALSE if it can't be read
+    int Run();         // Move the fragmented files, and return how
+                       // many were moved
+
+    double Score();    // Fragmentation score, in percent
+    int NumMoved() { return sectorsMoved; }
+                       // Data sectors copied so far
+    int *Remap() { return remap; }
+                       // Where every sector of the disk went, eg.
+                       // for DiskReplayer::SetRemap
+
+private:
+    PersistentBitmap *freeMap; // Free sectors
+    OpenFile *freeMapFile;     // Where they are kept on disk
+    List<DefragFile *> *files; // Every file found by Scan
+    int *remap;                // New location of each sector
+    int sectorsMoved;          // Data sectors copied by Run
+
+    bool Move(DefragFile *file);
+                       // Copy one file to a contiguous run; FALSE
+                       // if the disk has no run that long
+};
+
+#endif // DEFRAG_H
@@ -10,10 +10,15 @@
 //	The constructor initializes an empty directory of a certain size;
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
+//	WriteBack writes only the sectors whose entries changed, so
+//	adding, removing or renaming a file costs one sector write (two
+//	when the entry straddles a sector boundary), not the whole table.
 //
 //	Also, this implementation has the restriction that the size
 //	of the directory cannot expand.  In other words, once all the
 //	entries in the directory are used, no more files can be created.
+//	Directories that need more entries are created indexed instead;
+//	their entries live in a B+-tree (see dirindex.h).
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -23,7 +28,11 @@
 #include "utility.h"
 #include "filehdr.h"
 #include "directory.h"
+#include "dirindex.h"
+#include "pbitmap.h"
 #include "debug.h"
+#include "filelock.h"
+#include "main.h"
 
 //----------------------------------------------------------------------
 // Directory::Directory
@@ -45,6 +54,13 @@ Directory::Directory(int size)
     tableSize = size;
     for (int i = 0; i < tableSize; i++)
         table[i].inUse = FALSE;
+    index = NULL;
+
+    // a new directory is not on disk yet: all of it must be written
+    numSectors = divRoundUp(size * sizeof(DirectoryEntry), SectorSize);
+    dirty = new bool[numSectors];
+    for (int i = 0; i < numSectors; i++)
+        dirty[i] = TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -55,6 +71,8 @@ Directory::Directory(int size)
 Directory::~Directory()
 {
     delete[] table;
+    delete[] dirty;
+    delete index;
 }
 
 //----------------------------------------------------------------------
@@ -66,10 +84,50 @@ Directory::~Directory()
 
 void Directory::FetchFrom(OpenFile *file) //讀取file(now directory)
 {
+    file->SetCategory(DirectoryIO);
     (void)file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    CheckIndex();
     // DEBUG('f', "Finish Directory::FetchFrom");
 }
 
+//----------------------------------------------------------------------
+// Directory::LoadFrom
+// 	Initialize the directory from a copy of its contents that is
+//	already in memory, eg. read with SynchDisk::ReadSectors along
+//	with other directories.
+//
+//	"data" -- the first DirectoryFileSize bytes of the directory file,
+//		or its first sector if that is the root of an index
+//----------------------------------------------------------------------
+
+void Directory::LoadFrom(char *data)
+{
+    if (DirectoryIndex::IsIndex(data))
+        memcpy(table, data, SectorSize);
+    else
+        memcpy(table, data, tableSize * sizeof(DirectoryEntry));
+    CheckIndex();
+}
+
+//----------------------------------------------------------------------
+// Directory::CheckIndex
+// 	If what was just read into the table is the root of an index,
+//	use the index from now on.
+//----------------------------------------------------------------------
+
+void Directory::CheckIndex()
+{
+    for (int i = 0; i < numSectors; i++)
+        dirty[i] = FALSE; // same as on disk
+    delete index;
+    index = NULL;
+    if (DirectoryIndex::IsIndex((char *)table))
+    {
+        index = new DirectoryIndex((char *)table);
+        memset(table, 0, sizeof(DirectoryEntry) * tableSize);
+    }
+}
+
 //----------------------------------------------------------------------
 // Directory::WriteBack
 // 	Write any modifications to the directory back to disk
@@ -79,7 +137,39 @@ void Directory::FetchFrom(OpenFile *file) //讀取file(now directory)
 
 void Directory::WriteBack(OpenFile *file)
 {
-    (void)file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int tableBytes = tableSize * sizeof(DirectoryEntry);
+
+    if (index != NULL)
+        return; // its nodes were written as they changed
+    file->SetCategory(DirectoryIO);
+    for (int first = 0; first < numSectors; first++)
+    {
+        int last = first;
+
+        if (!dirty[first])
+            continue;
+        while (last + 1 < numSectors && dirty[last + 1])
+            last++; // one request for a run of changed sectors
+        int offset = first * SectorSize;
+        int length = min((last + 1) * SectorSize, tableBytes) - offset;
+        (void)file->WriteAt((char *)table + offset, length, offset);
+        for (; first <= last; first++)
+            dirty[first] = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::MarkDirty
+// 	Note that entry "i" of the table changed, so WriteBack writes
+//	the sector(s) it is in.
+//----------------------------------------------------------------------
+
+void Directory::MarkDirty(int i)
+{
+    int offset = i * sizeof(DirectoryEntry);
+
+    dirty[offset / SectorSize] = TRUE;
+    dirty[(offset + sizeof(DirectoryEntry) - 1) / SectorSize] = TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -98,16 +188,42 @@ int Directory::FindIndex(char *name)
     return -1; // name not in directory
 }
 
+//----------------------------------------------------------------------
+// Directory::Lookup
+// 	Look up a file name in this directory (not below it), in the
+//	table or the index.  Return FALSE if it isn't there.
+//
+//	"name" -- the file name to look up
+//	"entry" -- where to copy its entry
+//----------------------------------------------------------------------
+
+bool Directory::Lookup(char *name, DirectoryEntry *entry)
+{
+    int i;
+
+    if (index != NULL)
+        return index->Find(name, entry);
+    if ((i = FindIndex(name)) == -1)
+        return FALSE;
+    *entry = table[i];
+    return TRUE;
+}
+
 //----------------------------------------------------------------------
 // Directory::Find
 // 	Look up file name in directory, and return the disk sector number
 //	where the file's header is stored. Return -1 if the name isn't
 //	in the directory.
 //
+//	Each subdirectory on the path is locked for reading from the
+//	moment it is read until the lookup below it is done, so no
+//	Create or Remove in it can change it under the lookup.
+//
 //	"name" -- the file name to look up
+//	"isDir" -- if not NULL, set to whether "name" is a directory
 //----------------------------------------------------------------------
 
-int Directory::Find(char *name)
+int Directory::Find(char *name, bool *isDir)
 {
     char *findCur;
     char cpyName[256]; //最大可以到256
@@ -115,20 +231,27 @@ int Directory::Find(char *name)
     if (name[0] == '/') findCur = strtok(cpyName+1, "/"); //分段並取當前第一個為需要到達的位置
     else findCur = strtok(cpyName, "/");
     if (findCur == NULL) findCur = cpyName; // last in path
-    int i = FindIndex(findCur); //找是否有這個檔案 若是沒有會回傳-1
+    DirectoryEntry entry;
 
-    if (i != -1) { //找到了 需要繼續往下找
+    if (Lookup(findCur, &entry)) { //找到了 需要繼續往下找
         char findNxt[256]; //存下一層
-        if (strlen(name) - (strlen(findCur) + 1) == 0) return table[i].sector;
+        if (strlen(name) - (strlen(findCur) + 1) == 0) {
+            if (isDir != NULL) *isDir = entry.isDir;
+            return entry.sector;
+        }
         // return if the current is the last //已經是最後一層了 可以return
 
         strcpy(findNxt, name + strlen(findCur) + 1); //將下一層的目錄複製到findNxt
 
-        if (!table[i].isDir) return -1; //找到的不是目錄也不是檔案
+        if (!entry.isDir) return -1; //找到的不是目錄也不是檔案
         Directory* subDir = new Directory(NumDirEntries);
-        OpenFile* dirFile = new OpenFile(table[i].sector);
+        FileLock *lock = kernel->fileLocks->Get(entry.sector);
+        lock->rw->AcquireRead();
+        OpenFile* dirFile = new OpenFile(entry.sector); // header as locked
         subDir->FetchFrom(dirFile);  //讀取該檔案資訊
-        int findSec = subDir->Find(findNxt);
+        int findSec = subDir->Find(findNxt, isDir);
+        lock->rw->ReleaseRead();
+        kernel->fileLocks->Put(lock);
         delete dirFile;
         delete subDir;
         return findSec;
@@ -136,6 +259,29 @@ int Directory::Find(char *name)
     return -1; //沒找到
 }
 
+//----------------------------------------------------------------------
+// Directory::NextEntry
+// 	Iterate over the entries in use.  Start with "*cursor" set to 0;
+//	each call copies the next entry into "entry" and moves the cursor
+//	past it.  Return FALSE when there are no more entries.
+//
+//	"cursor" -- position in the table (or index) to continue from
+//	"entry" -- where to copy the entry found
+//----------------------------------------------------------------------
+
+bool Directory::NextEntry(int *cursor, DirectoryEntry *entry)
+{
+    if (index != NULL)
+        return index->NextEntry(cursor, entry);
+    for (; *cursor < tableSize; (*cursor)++)
+        if (table[*cursor].inUse)
+        {
+            *entry = table[(*cursor)++];
+            return TRUE;
+        }
+    return FALSE;
+}
+
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
@@ -145,9 +291,12 @@ int Directory::Find(char *name)
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//	"isDir" -- whether the file is a directory
+//	"freeMap" -- where an indexed directory takes new nodes from
 //----------------------------------------------------------------------
 
-bool Directory::Add(char *name, int newSector, bool isDir)
+bool Directory::Add(char *name, int newSector, bool isDir,
+                    PersistentBitmap *freeMap)
 {
     DEBUG('f', "Adding path " << name);
     char *findCur, cpyName[256];
@@ -157,8 +306,9 @@ bool Directory::Add(char *name, int newSector, bool isDir)
     if (findCur == NULL) findCur = cpyName; // last in path
 
     char findNxt[256];
-    int i; //已經存在了 不能再新增
-    if ((i = FindIndex(findCur)) != -1 && strlen(name) - (strlen(findCur) + 1) == 0) {
+    DirectoryEntry entry; //已經存在了 不能再新增
+    bool found = Lookup(findCur, &entry);
+    if (found && strlen(name) - (strlen(findCur) + 1) == 0) {
         DEBUG('f', "Already exist and can't fit target name anymore: " << name);
         return FALSE;
     }
@@ -168,11 +318,12 @@ bool Directory::Add(char *name, int newSector, bool isDir)
     if (strlen(name) - (strlen(findCur) + 1) > 0) {
         // *(findNxt+strlen(findNxt)) = '/';
         // while (strtok(NULL, "/"));
+        if (!found || !entry.isDir) return FALSE; // no such directory
         strcpy(findNxt, name + strlen(findCur) + 1); //往下遞迴
         Directory* subDir = new Directory(NumDirEntries);
-        OpenFile* dirFile = new OpenFile(table[i].sector);
+        OpenFile* dirFile = new OpenFile(entry.sector);
         subDir->FetchFrom(dirFile);
-        bool success = subDir->Add(findNxt, newSector, isDir);
+        bool success = subDir->Add(findNxt, newSector, isDir, freeMap);
         subDir->WriteBack(dirFile);
         delete dirFile;
         delete subDir;
@@ -180,6 +331,8 @@ bool Directory::Add(char *name, int newSector, bool isDir)
     }
 
     //在目前的檔案夾中新增檔案
+    if (index != NULL)
+        return index->Insert(findCur, newSector, isDir, freeMap);
     for (int i = 0; i < tableSize; i++)
         if (!table[i].inUse) //在空的table放入檔案
         {
@@ -187,6 +340,7 @@ bool Directory::Add(char *name, int newSector, bool isDir)
             strncpy(table[i].name, findCur, FileNameMaxLen);
             table[i].sector = newSector;
             table[i].isDir = isDir;
+            MarkDirty(i);
             if (isDir) {
                 DEBUG('f', "Create sub-dir " << table[i].name << " " << table[i].sector);
                 // Directory* subDir = new Directory(NumDirEntries);
@@ -218,9 +372,10 @@ bool Directory::Remove(char *name)
     if (name[0] == '/') findCur = strtok(cpyName+1, "/");
     else findCur = strtok(cpyName, "/");
     if (findCur == NULL) findCur = cpyName; // last in path
-    int i = FindIndex(findCur);
+    DirectoryEntry entry;
+    bool found = Lookup(findCur, &entry);
 
-    if (i == -1 && strlen(name) - (strlen(findCur) + 1) == 0)
+    if (!found && strlen(name) - (strlen(findCur) + 1) == 0)
         return FALSE; // name not in directory
 
     char findNxt[256];
@@ -229,9 +384,10 @@ bool Directory::Remove(char *name)
         // *(findNxt+strlen(findNxt)) = '/';
         // while (strtok(NULL, "/"));
         // findNxt = name + strlen(findCur) + 1;
+        if (!found || !entry.isDir) return FALSE; // no such directory
         strcpy(findNxt, name + strlen(findCur) + 1);
         Directory* subDir = new Directory(NumDirEntries);
-        OpenFile* dirFile = new OpenFile(table[i].sector);
+        OpenFile* dirFile = new OpenFile(entry.sector);
         subDir->FetchFrom(dirFile);
         bool success = subDir->Remove(findNxt);
         subDir->WriteBack(dirFile);
@@ -240,46 +396,74 @@ bool Directory::Remove(char *name)
         return success;
     }
     
+    if (index != NULL)
+        return index->Remove(findCur);
+    int i = FindIndex(findCur);
     table[i].inUse = FALSE;
+    MarkDirty(i);
     return TRUE;
 }
 
 //----------------------------------------------------------------------
-// Directory::List
-// 	List all the file names in the directory.
+// Directory::RenameEntry
+// 	Rename a file of this directory (not below it) by changing the
+//	name in its entry, so WriteBack writes one sector and the rename
+//	happens all at once.  Return FALSE, changing nothing, if that
+//	can't be done: the file isn't there, "to" is, the directory is
+//	indexed (names are placed by hash), or the name straddles two
+//	sectors.  The caller then adds the new name and removes the old.
+//
+//	"from" -- the file's name
+//	"to" -- its new name
 //----------------------------------------------------------------------
 
-void Directory::List()
+bool Directory::RenameEntry(char *from, char *to)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse)
-            printf("%s\n", table[i].name);
-            // printf("%s %d\n", table[i].name, table[i].sector);
+    int i, offset;
+
+    if (from[0] == '/') from++;
+    if (to[0] == '/') to++;
+    if (index != NULL || (i = FindIndex(from)) == -1 || FindIndex(to) != -1)
+        return FALSE;
+    offset = (char *)table[i].name - (char *)table;
+    if (offset / SectorSize != (offset + FileNameMaxLen) / SectorSize)
+        return FALSE;
+
+    DEBUG('f', "Renaming " << from << " to " << to << " in place");
+    memset(table[i].name, 0, FileNameMaxLen + 1);
+    strncpy(table[i].name, to, FileNameMaxLen);
+    dirty[offset / SectorSize] = TRUE; // the rest of the entry is as it was
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::Deallocate
+// 	Give back the sectors an indexed directory keeps outside its
+//	file (see dirindex.h), before the directory itself is removed.
+//	A table directory has none.
+//
+//	"freeMap" -- the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+void Directory::Deallocate(PersistentBitmap *freeMap)
+{
+    if (index != NULL)
+        index->Deallocate(freeMap);
 }
 
 //----------------------------------------------------------------------
-// Directory::RecursiveList
+// Directory::List
 // 	List all the file names in the directory.
 //----------------------------------------------------------------------
-//以遞迴方式將目前 directory 之下的 file 和 subdirectory 全部 print 出來。
-//依 lvl 作為目前 subdirectory 的層數，在該 subdirectory 之下的 file 和 directory 前做 padding
-void Directory::RecursiveList(int lvl)
+
+void Directory::List()
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse) {
-            for (int j=0; j<lvl; j++) printf("    "); // padding
-            if (table[i].isDir) {
-                printf("[D] %s\n", table[i].name);
-                OpenFile *subDirFile = new OpenFile(table[i].sector);
-                Directory *subDir = new Directory(NumDirEntries);
-                subDir->FetchFrom(subDirFile);
-                subDir->RecursiveList(lvl+1);
-                delete subDirFile;
-                delete subDir;
-            }
-            else 
-                printf("[F] %s\n", table[i].name);
-        }
+    DirectoryEntry entry;
+    int cursor = 0;
+
+    while (NextEntry(&cursor, &entry))
+        printf("%s\n", entry.name);
+        // printf("%s %d\n", entry.name, entry.sector);
 }
 
 //----------------------------------------------------------------------
@@ -291,15 +475,16 @@ void Directory::RecursiveList(int lvl)
 void Directory::Print()
 {
     FileHeader *hdr = new FileHeader;
+    DirectoryEntry entry;
+    int cursor = 0;
 
     printf("Directory contents:\n");
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse)
-        {
-            printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
-            hdr->FetchFrom(table[i].sector);
-            hdr->Print();
-        }
+    while (NextEntry(&cursor, &entry))
+    {
+        printf("Name: %s, Sector: %d\n", entry.name, entry.sector);
+        hdr->FetchFrom(entry.sector);
+        hdr->Print();
+    }
     printf("\n");
     delete hdr;
 }
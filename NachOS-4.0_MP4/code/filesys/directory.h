@@ -6,6 +6,10 @@
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//      A directory may instead keep its entries in an index (see
+//	dirindex.h), chosen when the directory is created; Directory
+//	notices which kind it has when it reads it.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -19,6 +23,9 @@
 
 #include "openfile.h"
 
+class DirectoryIndex;
+class PersistentBitmap;
+
 #define FileNameMaxLen 9 // for simplicity, we assume \
                          // file names are <= 9 characters long
 #define NumDirEntries 64
@@ -43,6 +50,19 @@ public:
     bool isDir;                    // directory(1) or file(0)
 };
 
+// The following class describes a directory entry to a user program, as
+// returned by the ReadDir system call.  Its layout must match DirEntry
+// in userprog/syscall.h.
+
+class DirectoryInfo
+{
+public:
+    char name[FileNameMaxLen + 3]; // '\0' terminated, padded to a word
+    int sector;                    // Location of the FileHeader
+    int isDir;                     // directory(1) or file(0)
+    int size;                      // Length in bytes
+};
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
@@ -61,20 +81,36 @@ public:
     ~Directory();        // De-allocate the directory
 
     void FetchFrom(OpenFile *file); // Init directory contents from disk
+    void LoadFrom(char *data);      // Init directory contents from a
+                                    //  copy already in memory
     void WriteBack(OpenFile *file); // Write modifications to
                                     // directory contents back to disk
 
-    int Find(char *name); // Find the sector number of the
-                          // FileHeader for file: "name"
+    int Find(char *name, bool *isDir = NULL); // Find the sector number of the
+                          // FileHeader for file: "name"; also
+                          // tell whether it is a directory
+
+    bool NextEntry(int *cursor, DirectoryEntry *entry);
+                          // Copy out the next entry in use at or
+                          // after "*cursor", and advance the cursor
 
-    bool Add(char *name, int newSector, bool isDir); // Add a file name into the directory
+    bool Add(char *name, int newSector, bool isDir,
+             PersistentBitmap *freeMap); // Add a file name into the
+                                         //  directory; an index may
+                                         //  need new nodes
 
     bool Remove(char *name); // Remove a file from the directory
 
+    bool RenameEntry(char *from, char *to); // Rename a file of this
+                                            //  directory by rewriting
+                                            //  its entry in place
+
+    bool IsIndexed() { return index != NULL; } // Is it an index?
+    void Deallocate(PersistentBitmap *freeMap); // Free what an index
+                                                //  keeps outside the file
+
     void List();  // Print the names of all the files
                   //  in the directory
-    void RecursiveList(int lvl);  // Print the names of all the files 
-                          //  in the directory recursively
     void Print(); // Verbose print of the contents
                   //  of the directory -- all the file
                   //  names and their contents.
@@ -90,9 +126,20 @@ private:
     int tableSize;         // Number of directory entries
     DirectoryEntry *table; // Table of pairs:
                            // <file name, file header location>
+    DirectoryIndex *index; // The entries, if the directory is
+                           // indexed; NULL if they are in "table"
+    int numSectors;        // Sectors the table takes on disk
+    bool *dirty;           // Which of them changed since the table
+                           // was read; only those are written back
 
     int FindIndex(char *name); // Find the index into the directory
                                //  table corresponding to "name"
+    bool Lookup(char *name, DirectoryEntry *entry);
+                               // Copy out the entry for "name", in
+                               //  this directory only
+    void CheckIndex();         // Switch to the index if what was
+                               //  read into "table" is one
+    void MarkDirty(int i);     // Entry "i" of the table changed
 };
 
 #endif // DIRECTORY_H
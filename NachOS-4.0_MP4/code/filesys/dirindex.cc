@@ -0,0 +1,480 @@
+// dirindex.cc
+//	Routines to keep the entries of an indexed directory in a B+-tree.
+//	See dirindex.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "dirindex.h"
+#include "synchdisk.h"
+#include "debug.h"
+#include "main.h"
+
+// What InsertAt did
+enum InsertResult
+{
+    InsertDone,     // the name is in, nothing else to do
+    InsertSplit,    // the name is in, but the node split: the caller
+                    //  must add the new sibling to the parent
+    InsertDuplicate // the name was there already; nothing changed
+};
+
+//----------------------------------------------------------------------
+// NameHash
+// 	Hash a file name (FNV-1a), for the order of an index.
+//----------------------------------------------------------------------
+
+static int NameHash(char *name)
+{
+    unsigned int hash = 2166136261u;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    return (int)(hash & 0x7fffffff);
+}
+
+//----------------------------------------------------------------------
+// CompareKey
+// 	Order two names the way an index does: by hash, and names with
+//	the same hash by name.  Return <0, 0 or >0, like strcmp.
+//----------------------------------------------------------------------
+
+static int CompareKey(int hash1, char *name1, int hash2, char *name2)
+{
+    if (hash1 != hash2)
+        return (hash1 < hash2) ? -1 : 1;
+    return strncmp(name1, name2, FileNameMaxLen);
+}
+
+//----------------------------------------------------------------------
+// ChildFor
+// 	Return the child of an internal node that holds (or would hold)
+//	a name.
+//----------------------------------------------------------------------
+
+static int ChildFor(IndexNode *node, int hash, char *name)
+{
+    int child = node->next;
+
+    for (int i = 0; i < node->count; i++)
+    {
+        if (CompareKey(hash, name, node->keys[i].hash, node->keys[i].name) < 0)
+            break;
+        child = node->keys[i].child;
+    }
+    return child;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::DirectoryIndex
+// 	Set up access to an existing index.
+//
+//	"rootData" -- the contents of the root node's sector
+//----------------------------------------------------------------------
+
+DirectoryIndex::DirectoryIndex(char *rootData)
+{
+    ASSERT(sizeof(IndexNode) <= SectorSize);
+    memcpy(&root, rootData, sizeof(IndexNode));
+    ASSERT(root.magic == IndexMagic);
+    leaf.self = -1;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::IsIndex
+// 	Return TRUE if "data", the start of a directory's file, is the
+//	root node of an index.
+//----------------------------------------------------------------------
+
+bool DirectoryIndex::IsIndex(char *data)
+{
+    int magic;
+
+    memcpy(&magic, data, sizeof(int));
+    return magic == IndexMagic;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Format
+// 	Write an empty index -- a root that is an empty leaf -- for a new
+//	directory.
+//
+//	"sector" -- the only data sector of the directory's file
+//----------------------------------------------------------------------
+
+void DirectoryIndex::Format(int sector)
+{
+    char buf[SectorSize];
+    IndexNode *node = (IndexNode *)buf;
+
+    memset(buf, 0, SectorSize);
+    node->magic = IndexMagic;
+    node->self = sector;
+    node->height = 1;
+    node->isLeaf = TRUE;
+    node->count = 0;
+    node->next = -1;
+    kernel->synchDisk->WriteSector(sector, buf, DirectoryIO);
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::ReadNode/WriteNode
+// 	Read (write) one node of the tree.  The root, and the leaf that
+//	NextEntry is in, are served from (kept up to date in) memory.
+//----------------------------------------------------------------------
+
+void DirectoryIndex::ReadNode(int sector, IndexNode *node)
+{
+    char buf[SectorSize];
+
+    if (sector == root.self)
+        *node = root;
+    else if (sector == leaf.self)
+        *node = leaf;
+    else
+    {
+        kernel->synchDisk->ReadSector(sector, buf, DirectoryIO);
+        memcpy(node, buf, sizeof(IndexNode));
+        ASSERT(node->magic == IndexMagic && node->self == sector);
+    }
+}
+
+void DirectoryIndex::WriteNode(IndexNode *node)
+{
+    char buf[SectorSize];
+
+    memset(buf, 0, SectorSize);
+    memcpy(buf, node, sizeof(IndexNode));
+    kernel->synchDisk->WriteSector(node->self, buf, DirectoryIO);
+    if (node->self == root.self)
+        root = *node;
+    if (node->self == leaf.self)
+        leaf = *node;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::NewNode
+// 	Start an empty node, in a sector taken from the free map.  The
+//	caller has checked that there is one.
+//----------------------------------------------------------------------
+
+void DirectoryIndex::NewNode(IndexNode *node, bool isLeaf,
+                             PersistentBitmap *freeMap)
+{
+    memset(node, 0, sizeof(IndexNode));
+    node->magic = IndexMagic;
+    node->self = freeMap->FindAndSet();
+    ASSERT(node->self >= 0);
+    node->isLeaf = isLeaf;
+    node->next = -1;
+    DEBUG(dbgFile, "New index node " << node->self);
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::FindLeaf
+// 	Walk down from the root to the leaf for a name.
+//----------------------------------------------------------------------
+
+void DirectoryIndex::FindLeaf(int hash, char *name, IndexNode *node)
+{
+    *node = root;
+    while (!node->isLeaf)
+        ReadNode(ChildFor(node, hash, name), node);
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Find
+// 	Look up a name, reading one node per level below the root.
+//
+//	"name" -- the file name to look up
+//	"entry" -- where to copy its entry
+//----------------------------------------------------------------------
+
+bool DirectoryIndex::Find(char *name, DirectoryEntry *entry)
+{
+    IndexNode node;
+
+    FindLeaf(NameHash(name), name, &node);
+    for (int i = 0; i < node.count; i++)
+        if (!strncmp(node.entries[i].name, name, FileNameMaxLen))
+        {
+            entry->inUse = TRUE;
+            entry->sector = node.entries[i].sector;
+            strncpy(entry->name, node.entries[i].name, FileNameMaxLen + 1);
+            entry->isDir = node.entries[i].isDir;
+            return TRUE;
+        }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Insert
+// 	Add a name to the index.  Every node on the way down may split,
+//	and the root then moves to a new node, so make sure first that
+//	the free map has a sector for each.
+//
+//	"name" -- the file name
+//	"sector" -- where its file header is
+//	"isDir" -- whether it is a directory
+//	"freeMap" -- where to take new nodes from
+//----------------------------------------------------------------------
+
+bool DirectoryIndex::Insert(char *name, int sector, bool isDir,
+                            PersistentBitmap *freeMap)
+{
+    IndexNode node, left, newRoot;
+    IndexEntry entry;
+    IndexKey key, up;
+    int result;
+
+    if (freeMap->NumClear() < (root.height + 1) * ClusterSectors)
+        return FALSE; // no room for the splits
+
+    memset(&entry, 0, sizeof(entry));
+    entry.sector = sector;
+    strncpy(entry.name, name, FileNameMaxLen);
+    entry.isDir = isDir;
+    memset(&key, 0, sizeof(key));
+    key.hash = NameHash(name);
+    strncpy(key.name, name, FileNameMaxLen);
+
+    node = root;
+    result = InsertAt(&node, &key, &entry, &up, freeMap);
+    if (result == InsertSplit)
+    {   // the root holds the left half now; move it out, and make
+        // the root the parent of both halves
+        left = root;
+        left.self = freeMap->FindAndSet();
+        ASSERT(left.self >= 0);
+        WriteNode(&left);
+
+        memset(&newRoot, 0, sizeof(newRoot));
+        newRoot.magic = IndexMagic;
+        newRoot.self = root.self;
+        newRoot.height = root.height + 1;
+        newRoot.isLeaf = FALSE;
+        newRoot.count = 1;
+        newRoot.next = left.self;
+        newRoot.keys[0] = up;
+        WriteNode(&newRoot);
+        DEBUG(dbgFile, "Index " << root.self << " grows to height " << root.height);
+    }
+    return result != InsertDuplicate;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::InsertAt
+// 	Insert a name into the subtree below "node", which has been read
+//	already.  If "node" has to split, it keeps the lower half, and
+//	the key of the new sibling is returned in "up".
+//----------------------------------------------------------------------
+
+int DirectoryIndex::InsertAt(IndexNode *node, IndexKey *key,
+                             IndexEntry *entry, IndexKey *up,
+                             PersistentBitmap *freeMap)
+{
+    IndexNode right;
+    int pos = 0;
+
+    if (node->isLeaf)
+    {
+        IndexEntry all[IndexLeafSize + 1];
+        int total = node->count + 1, half;
+
+        while (pos < node->count)
+        {
+            int cmp = CompareKey(key->hash, key->name,
+                                 NameHash(node->entries[pos].name),
+                                 node->entries[pos].name);
+            if (cmp == 0)
+                return InsertDuplicate;
+            if (cmp < 0)
+                break;
+            pos++;
+        }
+        if (node->count < IndexLeafSize)
+        {
+            for (int i = node->count; i > pos; i--)
+                node->entries[i] = node->entries[i - 1];
+            node->entries[pos] = *entry;
+            node->count++;
+            WriteNode(node);
+            return InsertDone;
+        }
+
+        // split: the lower half stays, the upper half moves right
+        for (int i = 0, j = 0; i < total; i++)
+            all[i] = (i == pos) ? *entry : node->entries[j++];
+        half = total - total / 2;
+        NewNode(&right, TRUE, freeMap);
+        node->count = half;
+        right.count = total - half;
+        for (int i = 0; i < total; i++)
+        {
+            if (i < half)
+                node->entries[i] = all[i];
+            else
+                right.entries[i - half] = all[i];
+        }
+        right.next = node->next;
+        node->next = right.self;
+        WriteNode(&right);
+        WriteNode(node);
+
+        memset(up, 0, sizeof(IndexKey));
+        up->hash = NameHash(right.entries[0].name);
+        strncpy(up->name, right.entries[0].name, FileNameMaxLen);
+        up->child = right.self;
+        return InsertSplit;
+    }
+
+    IndexNode child;
+    IndexKey childUp, all[IndexOrder];
+    int result, half = IndexOrder / 2;
+
+    ReadNode(ChildFor(node, key->hash, key->name), &child);
+    result = InsertAt(&child, key, entry, &childUp, freeMap);
+    if (result != InsertSplit)
+        return result;
+
+    // the child split; add its new sibling after it
+    while (pos < node->count &&
+           CompareKey(childUp.hash, childUp.name,
+                      node->keys[pos].hash, node->keys[pos].name) > 0)
+        pos++;
+    if (node->count < IndexOrder - 1)
+    {
+        for (int i = node->count; i > pos; i--)
+            node->keys[i] = node->keys[i - 1];
+        node->keys[pos] = childUp;
+        node->count++;
+        WriteNode(node);
+        return InsertDone;
+    }
+
+    // split: the middle key moves up, and its child becomes the
+    // leftmost child of the new sibling
+    for (int i = 0, j = 0; i < IndexOrder; i++)
+        all[i] = (i == pos) ? childUp : node->keys[j++];
+    NewNode(&right, FALSE, freeMap);
+    node->count = half;
+    for (int i = 0; i < half; i++)
+        node->keys[i] = all[i];
+    right.next = all[half].child;
+    right.count = IndexOrder - 1 - half;
+    for (int i = 0; i < right.count; i++)
+        right.keys[i] = all[half + 1 + i];
+    WriteNode(&right);
+    WriteNode(node);
+
+    *up = all[half];
+    up->child = right.self;
+    return InsertSplit;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Remove
+// 	Remove a name from its leaf.  The leaf is not merged with its
+//	neighbours, even if it ends up empty (see dirindex.h).
+//
+//	"name" -- the file name to remove
+//----------------------------------------------------------------------
+
+bool DirectoryIndex::Remove(char *name)
+{
+    IndexNode node;
+
+    FindLeaf(NameHash(name), name, &node);
+    for (int i = 0; i < node.count; i++)
+        if (!strncmp(node.entries[i].name, name, FileNameMaxLen))
+        {
+            for (int j = i + 1; j < node.count; j++)
+                node.entries[j - 1] = node.entries[j];
+            node.count--;
+            WriteNode(&node);
+            return TRUE;
+        }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::NextEntry
+// 	Iterate over the names in hash order, one leaf at a time.  Start
+//	with "*cursor" set to 0; afterwards it says which leaf, and where
+//	in it, to continue from.
+//
+//	If the root was a leaf when the cursor was taken, and has split
+//	since, the cursor no longer points into a leaf; the iteration
+//	then ends early.
+//----------------------------------------------------------------------
+
+bool DirectoryIndex::NextEntry(int *cursor, DirectoryEntry *entry)
+{
+    int slot;
+
+    if (*cursor == 0)
+    {   // start at the leftmost leaf
+        ReadNode(root.self, &leaf);
+        while (!leaf.isLeaf)
+            ReadNode(leaf.next, &leaf);
+        slot = 0;
+    }
+    else
+    {
+        ReadNode(*cursor / IndexCursorSlots, &leaf);
+        slot = *cursor % IndexCursorSlots;
+    }
+
+    while (leaf.isLeaf)
+    {
+        if (slot < leaf.count)
+        {
+            entry->inUse = TRUE;
+            entry->sector = leaf.entries[slot].sector;
+            strncpy(entry->name, leaf.entries[slot].name, FileNameMaxLen + 1);
+            entry->isDir = leaf.entries[slot].isDir;
+            *cursor = leaf.self * IndexCursorSlots + slot + 1;
+            return TRUE;
+        }
+        *cursor = leaf.self * IndexCursorSlots + slot;
+        if (leaf.next == -1)
+            return FALSE;
+        ReadNode(leaf.next, &leaf);
+        slot = 0;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Deallocate
+// 	Give back every node of the index except the root, which is the
+//	data of the directory's file, and goes with it.
+//
+//	"freeMap" -- the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+void DirectoryIndex::Deallocate(PersistentBitmap *freeMap)
+{
+    if (root.isLeaf)
+        return;
+    FreeSubtree(root.next, freeMap);
+    for (int i = 0; i < root.count; i++)
+        FreeSubtree(root.keys[i].child, freeMap);
+}
+
+void DirectoryIndex::FreeSubtree(int sector, PersistentBitmap *freeMap)
+{
+    IndexNode node;
+
+    ReadNode(sector, &node);
+    if (!node.isLeaf)
+    {
+        FreeSubtree(node.next, freeMap);
+        for (int i = 0; i < node.count; i++)
+            FreeSubtree(node.keys[i].child, freeMap);
+    }
+    ASSERT(freeMap->Test(sector));
+    freeMap->Clear(sector);
+}
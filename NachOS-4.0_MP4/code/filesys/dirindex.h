@@ -0,0 +1,131 @@
+// dirindex.h
+//	Data structures for indexed directories: directories whose entries
+//	are kept in a B+-tree of sector-sized nodes, ordered by a hash of
+//	the file name, instead of in one fixed table.
+//
+//	Finding a name in a table directory reads the whole table (ten
+//	sectors), and the table never holds more than NumDirEntries names.
+//	An indexed directory holds as many names as the disk has room for
+//	nodes, and finding, adding or removing one reads one node per
+//	level of the tree: with six entries per leaf and six children per
+//	internal node, three sectors cover 216 names, five cover 7776.
+//
+//	The root node is the only data sector of the directory's file, so
+//	it never moves: when it splits, its contents go to a new node, and
+//	it becomes the parent of that node and of the new sibling.  The
+//	other nodes are allocated straight from the free map, and given
+//	back by Deallocate when the directory is removed.
+//
+//	Removing a name never merges nodes.  A leaf may end up empty, but
+//	it stays in the tree, so the tree only gets taller with the most
+//	names the directory ever held, and a NextEntry cursor, which
+//	points into a leaf, stays meaningful.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+
+#include "copyright.h"
+#include "directory.h"
+#include "pbitmap.h"
+
+#define IndexMagic 0x58444e49 // "INDX"; a table directory starts with
+                              // a bool, so it can't start with this
+#define IndexLeafSize 6       // entries in a leaf
+#define IndexOrder 6          // children of an internal node
+#define IndexCursorSlots 8    // a NextEntry cursor is
+                              // leaf sector * IndexCursorSlots + slot
+
+// One name in a leaf.
+
+class IndexEntry
+{
+public:
+    int sector;                    // Location of the FileHeader
+    char name[FileNameMaxLen + 1]; // '\0' terminated
+    char isDir;                    // directory(1) or file(0)
+};
+
+// One separator in an internal node: "child" holds the names from this
+// key (included) up to the next key of the node (excluded).
+
+class IndexKey
+{
+public:
+    int hash;                      // NameHash of "name"
+    int child;                     // sector of the node to the right
+    char name[FileNameMaxLen + 1];
+};
+
+// A node of the tree, as stored in its sector.
+
+class IndexNode
+{
+public:
+    int magic;  // IndexMagic
+    int self;   // sector the node is stored in
+    int height; // in the root: levels of the tree, 1 for a lone leaf
+    int isLeaf; // leaf(1) or internal node(0)
+    int count;  // entries (leaf) or keys (internal node) in use
+    int next;   // leaf: the next leaf to the right, or -1;
+                // internal node: the child left of every key
+    union
+    {
+        IndexEntry entries[IndexLeafSize];
+        IndexKey keys[IndexOrder - 1];
+    };
+};
+
+// The following class is the index of one directory.  Directory uses it
+// in place of its table when the directory's file holds an index.
+
+class DirectoryIndex
+{
+public:
+    DirectoryIndex(char *rootData); // Use the index whose root node
+                                    //  is "rootData"
+    ~DirectoryIndex() {}
+
+    static bool IsIndex(char *data); // Is "data" the root node of an
+                                     //  index, rather than a table?
+    static void Format(int sector);  // Write an empty index, whose
+                                     //  root is "sector"
+
+    bool Find(char *name, DirectoryEntry *entry);
+                       // Copy out the entry for "name"; FALSE if
+                       // there is none
+    bool Insert(char *name, int sector, bool isDir, PersistentBitmap *freeMap);
+                       // Add "name"; FALSE if it is there already, or
+                       // the free map has no room for new nodes
+    bool Remove(char *name);
+                       // Remove "name"; FALSE if it isn't there
+    bool NextEntry(int *cursor, DirectoryEntry *entry);
+                       // As Directory::NextEntry, in hash order
+    void Deallocate(PersistentBitmap *freeMap);
+                       // Free every node but the root
+
+private:
+    IndexNode root; // Copy of the root, kept up to date
+    IndexNode leaf; // Copy of the last leaf NextEntry read, or
+                    //  self == -1
+
+    void ReadNode(int sector, IndexNode *node);
+    void WriteNode(IndexNode *node);
+                       // Read/write a node, keeping the copies
+                       //  above up to date
+    void NewNode(IndexNode *node, bool isLeaf, PersistentBitmap *freeMap);
+                       // Start an empty node in a new sector
+    void FindLeaf(int hash, char *name, IndexNode *node);
+                       // Read the leaf that holds (or would hold)
+                       //  "name" into "node"
+    int InsertAt(IndexNode *node, IndexKey *key, IndexEntry *entry,
+                 IndexKey *up, PersistentBitmap *freeMap);
+                       // Insert into the subtree below "node"
+    void FreeSubtree(int sector, PersistentBitmap *freeMap);
+                       // Free a node and every node below it
+};
+
+#endif // DIRINDEX_H
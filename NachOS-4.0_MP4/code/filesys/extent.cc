@@ -0,0 +1,517 @@
+// extent.cc
+//	Routines to keep the free extents of the disk in two AVL trees,
+//	and to find runs of free clusters in them.  See extent.h.
+//
+//	Each extent is a node of both trees at once, with a set of links
+//	for each; the trees are only ever changed by adding and dropping
+//	whole extents, since changing an extent's length would move it
+//	in the tree ordered by length.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "extent.h"
+#include "debug.h"
+
+#define ByStart 0  // which tree: ordered by start,
+#define ByLength 1 //  or by length, then start
+
+// The following class is one run of free clusters, and its place in
+// each of the trees.
+
+class Extent
+{
+public:
+    Extent(int start, int length);
+
+    int start;                   // first cluster of the run
+    int length;                  // how many clusters
+    Extent *left[2], *right[2];  // children, in each tree
+    int height[2];               // height of the subtree, in each tree
+    int longest;                 // longest run in the subtree by start
+};
+
+Extent::Extent(int start, int length)
+{
+    this->start = start;
+    this->length = length;
+    left[ByStart] = right[ByStart] = left[ByLength] = right[ByLength] = NULL;
+    height[ByStart] = height[ByLength] = 1;
+    longest = length;
+}
+
+//----------------------------------------------------------------------
+// Before
+// 	Is extent "a" ordered before "b" in tree "t"?
+//----------------------------------------------------------------------
+
+static bool Before(Extent *a, Extent *b, int t)
+{
+    if (t == ByLength && a->length != b->length)
+        return a->length < b->length;
+    return a->start < b->start;
+}
+
+//----------------------------------------------------------------------
+// Height/Update/RotateLeft/RotateRight/Balance
+// 	The usual AVL bookkeeping, for tree "t".  Update recomputes a
+//	node's height, and in the tree by start its longest run, from
+//	its children; Balance rotates a node whose subtrees differ in
+//	height by two, and returns the new root of its subtree.
+//----------------------------------------------------------------------
+
+static int Height(Extent *node, int t)
+{
+    return (node == NULL) ? 0 : node->height[t];
+}
+
+static void Update(Extent *node, int t)
+{
+    Extent *l = node->left[t], *r = node->right[t];
+
+    node->height[t] = 1 + max(Height(l, t), Height(r, t));
+    if (t == ByStart)
+    {
+        node->longest = node->length;
+        if (l != NULL && l->longest > node->longest)
+            node->longest = l->longest;
+        if (r != NULL && r->longest > node->longest)
+            node->longest = r->longest;
+    }
+}
+
+static Extent *RotateLeft(Extent *node, int t)
+{
+    Extent *r = node->right[t];
+
+    node->right[t] = r->left[t];
+    r->left[t] = node;
+    Update(node, t);
+    Update(r, t);
+    return r;
+}
+
+static Extent *RotateRight(Extent *node, int t)
+{
+    Extent *l = node->left[t];
+
+    node->left[t] = l->right[t];
+    l->right[t] = node;
+    Update(node, t);
+    Update(l, t);
+    return l;
+}
+
+static Extent *Balance(Extent *node, int t)
+{
+    int diff;
+
+    Update(node, t);
+    diff = Height(node->left[t], t) - Height(node->right[t], t);
+    if (diff > 1)
+    {
+        Extent *l = node->left[t];
+        if (Height(l->left[t], t) < Height(l->right[t], t))
+            node->left[t] = RotateLeft(l, t);
+        return RotateRight(node, t);
+    }
+    if (diff < -1)
+    {
+        Extent *r = node->right[t];
+        if (Height(r->right[t], t) < Height(r->left[t], t))
+            node->right[t] = RotateRight(r, t);
+        return RotateLeft(node, t);
+    }
+    return node;
+}
+
+//----------------------------------------------------------------------
+// Insert/RemoveFirst/Remove
+// 	Put "extent" into tree "t" (take the first extent, or "extent",
+//	out of it), and return the new root.
+//----------------------------------------------------------------------
+
+static Extent *Insert(Extent *root, Extent *extent, int t)
+{
+    if (root == NULL)
+    {
+        extent->left[t] = extent->right[t] = NULL;
+        Update(extent, t);
+        return extent;
+    }
+    if (Before(extent, root, t))
+        root->left[t] = Insert(root->left[t], extent, t);
+    else
+        root->right[t] = Insert(root->right[t], extent, t);
+    return Balance(root, t);
+}
+
+static Extent *RemoveFirst(Extent *root, Extent **first, int t)
+{
+    if (root->left[t] == NULL)
+    {
+        *first = root;
+        return root->right[t];
+    }
+    root->left[t] = RemoveFirst(root->left[t], first, t);
+    return Balance(root, t);
+}
+
+static Extent *Remove(Extent *root, Extent *extent, int t)
+{
+    Extent *next;
+
+    ASSERT(root != NULL); // it must be in the tree
+    if (root == extent)
+    {
+        if (root->left[t] == NULL)
+            return root->right[t];
+        if (root->right[t] == NULL)
+            return root->left[t];
+        root->right[t] = RemoveFirst(root->right[t], &next, t);
+        next->left[t] = root->left[t];
+        next->right[t] = root->right[t];
+        return Balance(next, t);
+    }
+    if (Before(extent, root, t))
+        root->left[t] = Remove(root->left[t], extent, t);
+    else
+        root->right[t] = Remove(root->right[t], extent, t);
+    return Balance(root, t);
+}
+
+//----------------------------------------------------------------------
+// FirstAfter/LastUpTo
+// 	Return the extent of at least "count" clusters that starts first
+//	after cluster "near" (last at or before it), in the tree by start
+//	rooted at "node"; or NULL.  Subtrees whose longest run is too
+//	short are skipped.
+//----------------------------------------------------------------------
+
+static Extent *FirstAfter(Extent *node, int near, int count)
+{
+    Extent *found;
+
+    if (node == NULL || node->longest < count)
+        return NULL;
+    if (node->start > near)
+    {
+        found = FirstAfter(node->left[ByStart], near, count);
+        if (found != NULL)
+            return found;
+        if (node->length >= count)
+            return node;
+    }
+    return FirstAfter(node->right[ByStart], near, count);
+}
+
+static Extent *LastUpTo(Extent *node, int near, int count)
+{
+    Extent *found;
+
+    if (node == NULL || node->longest < count)
+        return NULL;
+    if (node->start <= near)
+    {
+        found = LastUpTo(node->right[ByStart], near, count);
+        if (found != NULL)
+            return found;
+        if (node->length >= count)
+            return node;
+    }
+    return LastUpTo(node->left[ByStart], near, count);
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::FreeExtents
+// 	Initialize an empty set of extents, for a disk of "numClusters"
+//	clusters.  Best fit is the policy until told otherwise.
+//----------------------------------------------------------------------
+
+FreeExtents::FreeExtents(int numClusters)
+{
+    this->numClusters = numClusters;
+    byStart = byLength = NULL;
+    numExtents = numFree = 0;
+    policy = BestFit;
+}
+
+FreeExtents::~FreeExtents()
+{
+    DeleteAll(byStart);
+}
+
+void FreeExtents::DeleteAll(Extent *tree)
+{
+    if (tree == NULL)
+        return;
+    DeleteAll(tree->left[ByStart]);
+    DeleteAll(tree->right[ByStart]);
+    delete tree;
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Rebuild
+// 	Throw the extents away, and find them again in "freeMap", a
+//	bitmap with a bit for each cluster (as PersistentBitmap keeps
+//	it, so its own Test, in sectors, is not the one wanted).
+//----------------------------------------------------------------------
+
+void FreeExtents::Rebuild(const Bitmap *freeMap)
+{
+    int start = -1;
+
+    DeleteAll(byStart);
+    byStart = byLength = NULL;
+    numExtents = numFree = 0;
+    for (int i = 0; i < numClusters; i++)
+    {
+        if (!freeMap->Test(i))
+        {
+            if (start < 0)
+                start = i;
+            continue;
+        }
+        if (start >= 0)
+            Add(start, i - start);
+        start = -1;
+    }
+    if (start >= 0)
+        Add(start, numClusters - start);
+    DEBUG(dbgFile, "Free extents: " << numExtents << ", " << numFree
+                   << " clusters, the longest " << Largest());
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Check
+// 	Return TRUE if the extents are exactly the runs of clear bits of
+//	"freeMap" (a bitmap of clusters, as for Rebuild): each run is an
+//	extent, and there are no others.
+//----------------------------------------------------------------------
+
+bool FreeExtents::Check(const Bitmap *freeMap)
+{
+    int start = -1, runs = 0, clusters = 0;
+    Extent *extent;
+
+    for (int i = 0; i <= numClusters; i++)
+    {
+        if (i < numClusters && !freeMap->Test(i))
+        {
+            if (start < 0)
+                start = i;
+            continue;
+        }
+        if (start < 0)
+            continue;
+        extent = Containing(start);
+        if (extent == NULL || extent->start != start ||
+            extent->length != i - start)
+        {
+            DEBUG(dbgFile, "Free extents: no extent for the run at "
+                           << start << " of " << i - start);
+            return FALSE;
+        }
+        runs++;
+        clusters += i - start;
+        start = -1;
+    }
+    return runs == numExtents && clusters == numFree;
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Add/Drop
+// 	Put a new extent into both trees (take one out of both, and
+//	delete it).
+//----------------------------------------------------------------------
+
+void FreeExtents::Add(int start, int length)
+{
+    Extent *extent = new Extent(start, length);
+
+    byStart = Insert(byStart, extent, ByStart);
+    byLength = Insert(byLength, extent, ByLength);
+    numExtents++;
+    numFree += length;
+}
+
+void FreeExtents::Drop(Extent *extent)
+{
+    byStart = Remove(byStart, extent, ByStart);
+    byLength = Remove(byLength, extent, ByLength);
+    numExtents--;
+    numFree -= extent->length;
+    delete extent;
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Containing
+// 	Return the extent that cluster "cluster" is in, or NULL if it
+//	is not free.
+//----------------------------------------------------------------------
+
+Extent *FreeExtents::Containing(int cluster)
+{
+    Extent *node = byStart, *found = NULL;
+
+    while (node != NULL)
+    {
+        if (node->start <= cluster)
+        {
+            found = node;
+            node = node->right[ByStart];
+        }
+        else
+            node = node->left[ByStart];
+    }
+    if (found != NULL && cluster < found->start + found->length)
+        return found;
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Allocated
+// 	Cluster "cluster" is now in use: split its extent around it.
+//	Nothing changes if it was in use already, eg. a cluster of
+//	several well-known headers marked once for each.
+//----------------------------------------------------------------------
+
+void FreeExtents::Allocated(int cluster)
+{
+    Extent *extent = Containing(cluster);
+    int start, end;
+
+    if (extent == NULL)
+        return;
+    start = extent->start;
+    end = start + extent->length;
+    Drop(extent);
+    if (cluster > start)
+        Add(start, cluster - start);
+    if (cluster + 1 < end)
+        Add(cluster + 1, end - cluster - 1);
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Freed
+// 	Cluster "cluster" is free again: merge it with the extents on
+//	either side of it, if there are any.
+//----------------------------------------------------------------------
+
+void FreeExtents::Freed(int cluster)
+{
+    Extent *before = NULL, *after = NULL;
+    int start = cluster, length = 1;
+
+    ASSERT(cluster >= 0 && cluster < numClusters);
+    if (Containing(cluster) != NULL)
+        return; // free already
+    if (cluster > 0)
+        before = Containing(cluster - 1);
+    if (cluster + 1 < numClusters)
+        after = Containing(cluster + 1);
+    if (before != NULL)
+    {
+        start = before->start;
+        length += before->length;
+        Drop(before);
+    }
+    if (after != NULL)
+    {
+        length += after->length;
+        Drop(after);
+    }
+    Add(start, length);
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Find
+// 	Return the first cluster of a run of "count" free clusters, or -1
+//	if there is none.  Which run depends on the policy:
+//
+//	   FirstFit -- the lowest one
+//	   BestFit -- the start of the shortest extent that holds it
+//	   NearestFit -- the one nearest cluster "near" (best fit if
+//		"near" is -1)
+//----------------------------------------------------------------------
+
+int FreeExtents::Find(int count, int near)
+{
+    Extent *extent;
+
+    ASSERT(count > 0);
+    switch (policy)
+    {
+    case FirstFit:
+        extent = FirstAfter(byStart, -1, count);
+        return (extent == NULL) ? -1 : extent->start;
+    case NearestFit:
+        if (near >= 0)
+            return NearestRun(count, near);
+        // no place to be near: fall through
+    default:
+        return BestRun(count);
+    }
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::BestRun
+// 	Return the start of the shortest extent of at least "count"
+//	clusters (the lowest, of those as short), or -1.
+//----------------------------------------------------------------------
+
+int FreeExtents::BestRun(int count)
+{
+    Extent *node = byLength, *found = NULL;
+
+    while (node != NULL)
+    {
+        if (node->length >= count)
+        {
+            found = node;
+            node = node->left[ByLength];
+        }
+        else
+            node = node->right[ByLength];
+    }
+    return (found == NULL) ? -1 : found->start;
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::NearestRun
+// 	Return the first cluster of the run of "count" free clusters
+//	nearest cluster "near": "near" itself if the run can start
+//	there, else the start of the next extent long enough, or the
+//	end of the one before, whichever is closer.  -1 if there is
+//	no such run.
+//----------------------------------------------------------------------
+
+int FreeExtents::NearestRun(int count, int near)
+{
+    Extent *at = Containing(near);
+    Extent *after, *before;
+    int beforeStart;
+
+    if (at != NULL && at->start + at->length - near >= count)
+        return near;
+    after = FirstAfter(byStart, near, count);
+    before = LastUpTo(byStart, near, count);
+    if (before == NULL)
+        return (after == NULL) ? -1 : after->start;
+    beforeStart = before->start + before->length - count;
+    if (after != NULL && after->start - near <= near - beforeStart)
+        return after->start;
+    return beforeStart;
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Largest
+// 	Return the length of the longest extent, 0 if there is none.
+//----------------------------------------------------------------------
+
+int FreeExtents::Largest()
+{
+    return (byStart == NULL) ? 0 : byStart->longest;
+}
@@ -0,0 +1,91 @@
+// extent.h
+//	Data structures to find runs of free clusters without scanning
+//	the free map.
+//
+//	The free map answers "is this cluster free?", but finding a run
+//	of 200 free clusters in it, or the one nearest some cluster,
+//	means reading it bit by bit.  The free extents are kept in core
+//	as well: every maximal run of free clusters, in two balanced
+//	trees, one ordered by where the run starts and one by how long
+//	it is.  Then
+//
+//	   best fit -- the shortest run that is long enough -- is one
+//		walk down the tree by length, so that small files fill
+//		small holes and the long runs are kept for long files
+//	   nearest fit -- the run closest to a given cluster, eg. just
+//		past the end of a file being grown -- is one walk down
+//		the tree by start, each node of which knows the longest
+//		run below it
+//
+//	The extents are built from the free map when the file system is
+//	mounted, and the free map tells them of every cluster it marks
+//	and clears (see PersistentBitmap), so a run they don't have is
+//	not there.  A copy of the free map that was changed and then
+//	thrown away, the operation having failed, leaves them ahead of
+//	the map on disk; they are built again from that (see
+//	FileSystem::ReleaseFreeMap).  -fragstat checks them against the
+//	free map.
+//
+//	First fit, the lowest run that is long enough, as the free map
+//	used to find it, is still there for comparison.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef EXTENT_H
+#define EXTENT_H
+
+#include "copyright.h"
+#include "bitmap.h"
+
+// Where new runs of clusters go
+enum AllocPolicy { FirstFit, BestFit, NearestFit };
+
+class Extent; // a run of free clusters (see extent.cc)
+
+// The following class keeps the free extents of the disk.  The
+// caller holds the free map lock.
+
+class FreeExtents
+{
+public:
+    FreeExtents(int numClusters); // No extents until Rebuild
+    ~FreeExtents();
+
+    void Rebuild(const Bitmap *freeMap);
+                        // Start over from a bitmap of clusters
+    void Allocated(int cluster); // The free map marked "cluster"
+    void Freed(int cluster);     //  ... or cleared it
+    bool Check(const Bitmap *freeMap);
+                        // Are these the runs of "freeMap"?
+
+    void SetPolicy(AllocPolicy how) { policy = how; }
+    AllocPolicy Policy() { return policy; }
+    int Find(int count, int near);
+                        // First cluster of a free run of "count"
+                        //  clusters, by the policy; nearest to
+                        //  "near" if it is >= 0.  -1 if none.
+
+    int NumExtents() { return numExtents; }
+    int Largest();      // Clusters in the longest run
+    int NumFree() { return numFree; }
+
+private:
+    int numClusters;    // Size of the disk, in clusters
+    Extent *byStart;    // Root of the tree ordered by start
+    Extent *byLength;   // Root of the tree ordered by length, then start
+    int numExtents;     // Runs in the trees
+    int numFree;        // Clusters in them
+    AllocPolicy policy;
+
+    void Add(int start, int length);
+    void Drop(Extent *extent);
+    Extent *Containing(int cluster);
+                        // The run "cluster" is in, or NULL
+    int BestRun(int count);
+    int NearestRun(int count, int near);
+    void DeleteAll(Extent *tree);
+};
+
+#endif // EXTENT_H
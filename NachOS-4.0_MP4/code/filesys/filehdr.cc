@@ -7,8 +7,12 @@
 //	table of pointers -- each entry in the table points to the
 //	disk sector containing that portion of the file data
 //	(in other words, there are no indirect or doubly indirect
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector,
+//	blocks).  A data block is a cluster of ClusterSectors sectors
+//	(see pbitmap.h), and the table points to its first sector;
+//	the rest follow it on disk.  Chained headers take a cluster
+//	each too, though they use only its first sector.  The table
+//	size is chosen so that the file header will be just big enough
+//	to fit in one disk sector.
 //
 //      Unlike in a real system, we do not keep track of file permissions,
 //	ownership, last modification date, etc., in the file header.
@@ -39,26 +43,60 @@
 FileHeader::FileHeader()
 {
 	//MP4-2
-	// nextFileHeader = NULL;
+	nextFileHeader = NULL;
 	nextFileHeaderSector = -1;
 
 	numBytes = -1;
 	numSectors = -1;
+	uncompressedLength = -1;
 	memset(dataSectors, -1, sizeof(dataSectors));
 }
 
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileHeader::~FileHeader
-//	Currently, there is not need to do anything in destructor function.
-//	However, if you decide to add some "in-core" data in header
-//	Always remember to deallocate their space or you will leak memory
+//	Free the in-core copy of the rest of the header chain, if we
+//	ever fetched it.
 //----------------------------------------------------------------------
 FileHeader::~FileHeader()
 {
-	// nothing to do now
-	//MP4-2
-	// if(nextFileHeader != NULL) delete nextFileHeader;
+	if (nextFileHeader != NULL)
+		delete nextFileHeader;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::SectorsNeeded
+// 	Return how many sectors a file of "fileSize" bytes occupies,
+//	besides its first header: every data cluster, plus one cluster
+//	for each additional header in the chain.
+//----------------------------------------------------------------------
+
+int FileHeader::SectorsNeeded(int fileSize)
+{
+	int numHeaders = divRoundUp(fileSize, MaxFileSize);
+
+	return (divRoundUp(fileSize, ClusterSize) + (numHeaders > 1 ? numHeaders - 1 : 0))
+		   * ClusterSectors;
+}
+
+//----------------------------------------------------------------------
+// TakeSector
+// 	Return the first sector of the next cluster of a reserved run
+//	and advance the run, or fall back to the first free cluster if
+//	there is no run.
+//
+//	"run" is the first sector of the run not used yet, or -1
+//----------------------------------------------------------------------
+
+static int TakeSector(PersistentBitmap *freeMap, int *run)
+{
+	int sector = *run;
+
+	if (sector < 0)
+		return freeMap->FindAndSet();
+	freeMap->Mark(sector);
+	*run += ClusterSectors;
+	return sector;
 }
 
 //----------------------------------------------------------------------
@@ -70,23 +108,55 @@ FileHeader::~FileHeader()
 //	
 //	"freeMap" is the bit map of free disk sectors
 //	"fileSize" is the bit map of free disk sectors
+//	"near" is where the file should preferably be, eg. right after
+//		its header, or -1 (see extent.h)
+//----------------------------------------------------------------------
+
+bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize, int near)
+{
+	int total = SectorsNeeded(fileSize);
+	int dataRun = -1, headerRun = -1;
+
+	if (freeMap->NumClear() < total)
+		return FALSE; // not enough space
+
+	// Try to lay the whole file out in one run: all the data clusters
+	// first, in file order, followed by the chained headers.  If the
+	// disk is too fragmented, fall back to first-fit, one cluster at a time.
+	if (total > 0)
+	{
+		int start = freeMap->FindContiguous(total, near);
+		if (start >= 0)
+		{
+			dataRun = start;
+			headerRun = start + divRoundUp(fileSize, ClusterSize) * ClusterSectors;
+		}
+	}
+	DEBUG('f', "Allocate " << fileSize << " bytes, " << total << " sectors, run at " << dataRun);
+	return AllocateChain(freeMap, fileSize, &dataRun, &headerRun);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateChain
+// 	Fill in this header, and the headers chained after it, for
+//	"fileSize" bytes of data.  The chained headers are written back
+//	here; the first one is written back by the caller.
+//
+//	"dataRun", "headerRun" -- next sectors of the reserved run to use
+//		for data and for headers, or -1 to use FindAndSet
 //----------------------------------------------------------------------
 
-bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
+bool FileHeader::AllocateChain(PersistentBitmap *freeMap, int fileSize,
+							   int *dataRun, int *headerRun)
 {
 	//MP4-2
-	// numBytes = fileSize; //需要檢查numbytes是否小於現在的最大直
-	//std::cout << "in allocate\n" ;
 	if(fileSize <= MaxFileSize) numBytes = fileSize;
 	else numBytes = MaxFileSize;
-	DEBUG('f', "Allocate " << fileSize << " file header");
-	numSectors = divRoundUp(numBytes, SectorSize);
-	if (freeMap->NumClear() < numSectors)
-		return FALSE; // not enough space
+	numSectors = divRoundUp(numBytes, ClusterSize);
 
 	for (int i = 0; i < numSectors; i++)
 	{
-		dataSectors[i] = freeMap->FindAndSet();
+		dataSectors[i] = TakeSector(freeMap, dataRun);
 		DEBUG('f', "Allocate sector " << dataSectors[i]);
 
 		// since we checked that there was enough free space,
@@ -95,25 +165,109 @@ bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 	}
 
 	//MP4-2
-	// nextFileHeaderSector = -1;
 	if(fileSize > MaxFileSize){
-		nextFileHeaderSector = freeMap->FindAndSet();
+		nextFileHeaderSector = TakeSector(freeMap, headerRun);
 
 		DEBUG('f', "Set next file header at sector " << nextFileHeaderSector);
-		if(nextFileHeaderSector == -1) return false;
+		if(nextFileHeaderSector == -1) return FALSE;
 
-		FileHeader* nextFileHeader = new FileHeader;
-		bool success = nextFileHeader->Allocate(freeMap, fileSize-MaxFileSize);
+		nextFileHeader = new FileHeader;
+		bool success = nextFileHeader->AllocateChain(freeMap, fileSize-MaxFileSize, dataRun, headerRun);
 		nextFileHeader->WriteBack(nextFileHeaderSector);
-		delete nextFileHeader;
 		return success;
 	}
 	DEBUG('f', "Finish allocating header, size: " << numBytes << ", sectorNum: " << numSectors << ", next header: " << nextFileHeaderSector);
+	return TRUE;
+}
 
-	//std::cout << "out allocate\n" ;
+//----------------------------------------------------------------------
+// FileHeader::Reserve
+// 	Allocate data blocks for the first "length" bytes of an existing
+//	file, if it does not have them yet.  The new blocks (and any new
+//	chained headers) are laid out in one run when the free map has
+//	one long enough, like Allocate does, so a file preallocated
+//	before it is written is read back sequentially; the run is
+//	looked for near the end of the blocks the file has already.
+//	Return FALSE, changing nothing, if the disk is too full.
+//
+//	The length of the file becomes "length" if that is longer, unless
+//	"keepSize" is set: then the blocks stay reserved past the end of
+//	the file, and writes that append to the file grow it into them
+//	(see OpenFile::WriteAt).
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"length" is how many bytes of the file need space
+//	"keepSize" is TRUE to leave the length of the file alone
+//----------------------------------------------------------------------
+
+bool FileHeader::Reserve(PersistentBitmap *freeMap, int length, bool keepSize)
+{
+	int have = divRoundUp(Capacity(), ClusterSize); // in clusters
+	int want = divRoundUp(length, ClusterSize);
+	int dataRun = -1, headerRun = -1;
+
+	if (want > have)
+	{
+		int near = (have > 0) ? ByteToSector((have - 1) * ClusterSize) + ClusterSectors : -1;
+		int oldHeaders = (have > NumDirect) ? divRoundUp(have, NumDirect) : 1;
+		int newHeaders = (want > NumDirect) ? divRoundUp(want, NumDirect) : 1;
+		int total = ((want - have) + (newHeaders - oldHeaders)) * ClusterSectors;
+
+		if (freeMap->NumClear() < total)
+			return FALSE; // not enough space
+		int start = freeMap->FindContiguous(total, near);
+		if (start >= 0)
+		{
+			dataRun = start;
+			headerRun = start + (want - have) * ClusterSectors;
+		}
+		DEBUG('f', "Reserve " << want - have << " more clusters, run at " << dataRun);
+		GrowChain(freeMap, want, &dataRun, &headerRun);
+	}
+	if (!keepSize && length > FileLength())
+		SetLength(length);
 	return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::GrowChain
+// 	Add data blocks to this header, and to headers chained after it
+//	(chaining new ones as needed), until the chain holds "blocks"
+//	data blocks.  The chained headers are written back here; the
+//	first one is written back by the caller.
+//
+//	"dataRun", "headerRun" -- next sectors of the reserved run to use
+//		for data and for headers, or -1 to use FindAndSet
+//----------------------------------------------------------------------
+
+void FileHeader::GrowChain(PersistentBitmap *freeMap, int blocks,
+						   int *dataRun, int *headerRun)
+{
+	int mine = (blocks < NumDirect) ? blocks : NumDirect;
+
+	while (numSectors < mine)
+	{
+		dataSectors[numSectors] = TakeSector(freeMap, dataRun);
+		ASSERT(dataSectors[numSectors] >= 0);
+		numSectors++;
+	}
+	if (blocks <= NumDirect)
+		return;
+
+	if (nextFileHeaderSector == -1)
+	{
+		nextFileHeaderSector = TakeSector(freeMap, headerRun);
+		ASSERT(nextFileHeaderSector >= 0);
+		if (nextFileHeader != NULL)
+			delete nextFileHeader;
+		nextFileHeader = new FileHeader;
+		nextFileHeader->numBytes = 0;
+		nextFileHeader->numSectors = 0;
+	}
+	NextHeader()->GrowChain(freeMap, blocks - NumDirect, dataRun, headerRun);
+	nextFileHeader->WriteBack(nextFileHeaderSector);
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
 // 	De-allocate all the space allocated for data blocks for this file.
@@ -123,20 +277,31 @@ bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 
 void FileHeader::Deallocate(PersistentBitmap *freeMap)
 {
-	//	std::cout << "in deallocate \n";
+	DeallocateOwn(freeMap);
+	//MP4-2
+	if(nextFileHeaderSector != -1) {
+		NextHeader()->Deallocate(freeMap);
+		ASSERT(freeMap->Test(nextFileHeaderSector));
+		freeMap->Clear(nextFileHeaderSector); // the chained header itself
+	}
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DeallocateOwn
+// 	De-allocate the data blocks this header points at itself, leaving
+//	the rest of the chain alone, so that a long file can be freed a
+//	few headers at a time (see orphan.h).
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+void FileHeader::DeallocateOwn(PersistentBitmap *freeMap)
+{
 	for (int i = 0; i < numSectors; i++)
 	{
 		ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
 		freeMap->Clear((int)dataSectors[i]);
 	}
-	//MP4-2
-	if(nextFileHeaderSector != -1) {
-		FileHeader* nextFileHeader = new FileHeader;
-		nextFileHeader->FetchFrom(nextFileHeaderSector);
-		nextFileHeader->Deallocate(freeMap);
-		delete nextFileHeader;
-	}
-	//std::cout << "out deallocate \n";
 }
 
 //----------------------------------------------------------------------
@@ -148,51 +313,89 @@ void FileHeader::Deallocate(PersistentBitmap *freeMap)
 
 void FileHeader::FetchFrom(int sector)
 {
-	//std::cout << "in fetchfrom \n";
-	// kernel->synchDisk->ReadSector(sector, (char *)this+sizeof(FileHeader*));
-	kernel->synchDisk->ReadSector(sector, (char *)this);
-
-	/*
-		MP4 Hint:	
-		After you add some in-core informations, you will need to rebuild the header's structure
-	*/	
-	//MP4-2
-	//std::cout << nextFileHeaderSector << std::endl;
-	// if(nextFileHeaderSector != -1){ //接下來還有東西需要讀取
-	// 	DEBUG('f', "From sector " << sector << " find next header " << nextFileHeaderSector)
-	// 	nextFileHeader = new FileHeader; //可能存在另一個block
-	// 	nextFileHeader->FetchFrom(nextFileHeaderSector);
-	// }
-	//std::cout << "out fetchfrom \n";
+	char buf[SectorSize];
+
+	kernel->synchDisk->ReadSector(sector, buf, HeaderIO);
+	LoadFrom(buf);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::LoadFrom
+// 	Initialize the file header from a copy of its sector that is
+//	already in memory, eg. one of many read together with
+//	SynchDisk::ReadSectors.  The rest of the chain, if any, is
+//	still fetched when it is first needed.
+//
+//	"buf" is the contents of the file header's sector
+//----------------------------------------------------------------------
+
+void FileHeader::LoadFrom(char *buf)
+{
+	int offset = 0;
+
+	// rebuild the disk part; the in-core part refers to whatever
+	// chain we had before, so throw it away
+	memcpy(&nextFileHeaderSector, buf + offset, sizeof(int));
+	offset += sizeof(int);
+	memcpy(&numBytes, buf + offset, sizeof(int));
+	offset += sizeof(int);
+	memcpy(&numSectors, buf + offset, sizeof(int));
+	offset += sizeof(int);
+	memcpy(&uncompressedLength, buf + offset, sizeof(int));
+	offset += sizeof(int);
+	memcpy(dataSectors, buf + offset, sizeof(dataSectors));
+
+	if (nextFileHeader != NULL)
+	{
+		delete nextFileHeader;
+		nextFileHeader = NULL;
+	}
 }
 
 //----------------------------------------------------------------------
 // FileHeader::WriteBack
 // 	Write the modified contents of the file header back to disk.
+//	Only the disk part is written; headers further down the chain
+//	are written back by whoever modified them.
 //
 //	"sector" is the disk sector to contain the file header
 //----------------------------------------------------------------------
 
 void FileHeader::WriteBack(int sector)
 {
-	//MP4-2
+	char buf[SectorSize];
+	int offset = 0;
+
+	memcpy(buf + offset, &nextFileHeaderSector, sizeof(int));
+	offset += sizeof(int);
+	memcpy(buf + offset, &numBytes, sizeof(int));
+	offset += sizeof(int);
+	memcpy(buf + offset, &numSectors, sizeof(int));
+	offset += sizeof(int);
+	memcpy(buf + offset, &uncompressedLength, sizeof(int));
+	offset += sizeof(int);
+	memcpy(buf + offset, dataSectors, sizeof(dataSectors));
 
-	kernel->synchDisk->WriteSector(sector, ((char *)this));
-	// if(nextFileHeaderSector != NULL) {
-	// 	FileHeader* nextFileHeader = new FileHeader;
-	// 	nextFileHeader->WriteBack(nextFileHeaderSector);
-	// } //MP4-2
-
-	//std::cout << "out write back \n";
-
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you may not want to write all fields into disk.
-		Use this instead:
-		char buf[SectorSize];
-		memcpy(buf + offset, &dataToBeWritten, sizeof(dataToBeWritten));
-		...
-	*/
+	kernel->synchDisk->WriteSector(sector, buf, HeaderIO);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::NextHeader
+// 	Return the next header in the chain, reading it from disk the
+//	first time it is needed.  Keeping the chain in memory means that
+//	walking to the end of a long file costs one disk read per header
+//	for as long as the file is open, instead of one per access.
+//----------------------------------------------------------------------
+
+FileHeader *FileHeader::NextHeader()
+{
+	ASSERT(nextFileHeaderSector != -1);
+	if (nextFileHeader == NULL)
+	{
+		nextFileHeader = new FileHeader;
+		nextFileHeader->FetchFrom(nextFileHeaderSector);
+	}
+	return nextFileHeader;
 }
 
 //----------------------------------------------------------------------
@@ -207,15 +410,10 @@ void FileHeader::WriteBack(int sector)
 
 int FileHeader::ByteToSector(int offset)
 {
-    int sector = offset / SectorSize;
-    if (sector >= NumDirect) {
-		FileHeader* nextFileHeader = new FileHeader;
-		nextFileHeader->FetchFrom(nextFileHeaderSector);
-		int b2sec = nextFileHeader->ByteToSector(offset - MaxFileSize); 
-		delete nextFileHeader;
-		return b2sec;
-	}
-    else return (dataSectors[sector]);
+    int block = offset / ClusterSize;
+    if (block >= NumDirect)
+		return NextHeader()->ByteToSector(offset - MaxFileSize);
+    else return dataSectors[block] + (offset % ClusterSize) / SectorSize;
 }
 
 //----------------------------------------------------------------------
@@ -225,15 +423,98 @@ int FileHeader::ByteToSector(int offset)
 
 int FileHeader::FileLength()
 {
-	//return numBytes;
-	// DEBUG('f', "Get file length: " << numBytes << ", next header: " << nextFileHeaderSector);
 	if(nextFileHeaderSector == -1) return numBytes;
-	else {
-		FileHeader* nextFileHeader = new FileHeader;
-		nextFileHeader->FetchFrom(nextFileHeaderSector);
-		int length = numBytes + nextFileHeader->FileLength();
-		delete nextFileHeader;
-		return length;
+	return numBytes + NextHeader()->FileLength();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ContentLength
+// 	Return the number of bytes a user of the file sees.  The data
+//	blocks of a compressed file hold its chunk map and compressed
+//	chunks (see compress.h), so this is not their length.
+//----------------------------------------------------------------------
+
+int FileHeader::ContentLength()
+{
+	if (IsCompressed()) return uncompressedLength;
+	return FileLength();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Capacity
+// 	Return how many bytes the file's data blocks hold.  This is
+//	more than its length when space was reserved past the end.
+//----------------------------------------------------------------------
+
+int FileHeader::Capacity()
+{
+	if(nextFileHeaderSector == -1) return numSectors * ClusterSize;
+	return numSectors * ClusterSize + NextHeader()->Capacity();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::SetLength
+// 	Change the length of the file, which must fit in its capacity.
+//	Each header counts the bytes of the sectors it points to; the
+//	chained headers are written back here, the first one by the
+//	caller.
+//
+//	"length" is the new length of the file in bytes
+//----------------------------------------------------------------------
+
+void FileHeader::SetLength(int length)
+{
+	ASSERT(length >= 0 && length <= Capacity());
+	numBytes = (length < MaxFileSize) ? length : MaxFileSize;
+	if (nextFileHeaderSector != -1)
+	{
+		NextHeader()->SetLength(length - numBytes);
+		nextFileHeader->WriteBack(nextFileHeaderSector);
+	}
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Remap
+// 	Point the data block holding byte "offset" at "sector", which
+//	must hold its data (see DedupTable::Place).  A chained header
+//	that changes is written back here; return TRUE if this one did,
+//	for the caller to write back.  Only a disk of one-sector
+//	clusters deduplicates.
+//----------------------------------------------------------------------
+
+bool FileHeader::Remap(int offset, int sector)
+{
+	int block = offset / SectorSize;
+
+	ASSERT(ClusterSectors == 1);
+	if (block >= NumDirect)
+	{
+		if (NextHeader()->Remap(offset - MaxFileSize, sector))
+			nextFileHeader->WriteBack(nextFileHeaderSector);
+		return FALSE;
+	}
+	dataSectors[block] = sector;
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Relocate
+// 	Point the file's data blocks at other sectors, which must hold
+//	the same data (see Defragmenter::Move).  Only a disk of one-sector
+//	clusters is defragmented.  The chained headers are
+//	written back here, the first one by the caller.
+//
+//	"sectors" is the new sector of each data block, in file order
+//----------------------------------------------------------------------
+
+void FileHeader::Relocate(int *sectors)
+{
+	for (int i = 0; i < numSectors; i++)
+		dataSectors[i] = sectors[i];
+	if (nextFileHeaderSector != -1)
+	{
+		NextHeader()->Relocate(sectors + numSectors);
+		nextFileHeader->WriteBack(nextFileHeaderSector);
 	}
 }
 
@@ -249,6 +530,8 @@ void FileHeader::Print()
 	char *data = new char[SectorSize];
 
 	printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
+	if (IsCompressed())
+		printf("Compressed, %d bytes before compression\n", uncompressedLength);
 	for (i = 0; i < numSectors; i++)
 		printf("%d ", dataSectors[i]);
 		printf("\n");
@@ -265,12 +548,8 @@ void FileHeader::Print()
 	// 	}
 	// 	printf("\n");
 	// }
-	if(nextFileHeaderSector != -1) {
-		FileHeader* nextFileHeader = new FileHeader;
-		nextFileHeader->FetchFrom(nextFileHeaderSector);
-		nextFileHeader->Print();
-		delete nextFileHeader;
-	} //MP4-2
+	if(nextFileHeaderSector != -1)
+		NextHeader()->Print(); //MP4-2
 
 	delete[] data;
 }
@@ -17,13 +17,14 @@
 #include "disk.h"
 #include "pbitmap.h"
 
-#define NumDirect ((SectorSize - 3 * sizeof(int)) / sizeof(int)) //MP4-2
-#define MaxFileSize (NumDirect * SectorSize)
+#define NumDirect ((int) ((SectorSize - 4 * sizeof(int)) / sizeof(int))) //MP4-2
+#define MaxFileSize ((int) (NumDirect * ClusterSize)) // bytes of data per header
 
 // The following class defines the Nachos "file header" (in UNIX terms,
 // the "i-node"), describing where on disk to find all of the data in the file.
 // The file header is organized as a simple table of pointers to
-// data blocks.
+// data blocks.  A data block is a cluster (see pbitmap.h), and its
+// pointer is the cluster's first sector.
 //
 // The file header data structure can be stored in memory or on disk.
 // When it is on disk, it is stored in a single sector -- this means
@@ -42,25 +43,65 @@ public:
 	FileHeader(); // dummy constructor to keep valgrind happy
 	~FileHeader();
 
-	bool Allocate(PersistentBitmap *bitMap, int fileSize); // Initialize a file header,
+	bool Allocate(PersistentBitmap *bitMap, int fileSize, int near = -1);
+														   // Initialize a file header,
 														   //  including allocating space
 														   //  on disk for the file data
+														   //  (contiguously, if the free
+														   //  map has a long enough run,
+														   //  and near "near" if >= 0)
 	void Deallocate(PersistentBitmap *bitMap);			   // De-allocate this file's
 														   //  data blocks
+	void DeallocateOwn(PersistentBitmap *freeMap);		   // De-allocate the data
+														   //  blocks of this header
+														   //  only, not of the rest
+														   //  of the chain
+	bool Reserve(PersistentBitmap *freeMap, int length, bool keepSize);
+														   // Make sure the first
+														   //  "length" bytes have data
+														   //  blocks; grow the file to
+														   //  "length" unless "keepSize"
 
 	void FetchFrom(int sectorNumber); // Initialize file header from disk
+	void LoadFrom(char *data);		  // Initialize file header from a
+									  //  copy of its sector in memory
 	void WriteBack(int sectorNumber); // Write modifications to file header
 									  //  back to disk
 
+	int NextSector() { return nextFileHeaderSector; }
+								  // Sector of the next header of the
+								  // chain, or -1
 	int ByteToSector(int offset); // Convert a byte offset into the file
 								  // to the disk sector containing
-								  // the byte
+								  // the byte (within its cluster)
 
 	int FileLength(); // Return the length of the file
 					  // in bytes
+	int ContentLength(); // The same, but for a compressed
+						 //  file, its length before
+						 //  compression
+	bool IsCompressed() { return uncompressedLength >= 0; }
+	void SetCompressed(int length) { uncompressedLength = length; }
+						 // Hold "length" bytes compressed
+						 //  (see compress.h)
+	int Capacity();	  // Return how many bytes the file
+					  // can hold without allocating
+	void SetLength(int length); // Change the length of the file,
+								//  within its capacity
+	void Relocate(int *sectors); // Point the data blocks at new
+								 //  sectors, in file order
+	bool Remap(int offset, int sector); // Point one data block at a
+										//  new sector; TRUE if this
+										//  header changed
 
 	void Print(); // Print the contents of the file.
 
+	static int SectorsNeeded(int fileSize); // Number of sectors (data plus
+											//  chained headers, not counting
+											//  the first header) a file of
+											//  "fileSize" bytes occupies,
+											//  in whole clusters
+
 private:
 	/*
 		MP4 hint:
@@ -71,19 +112,39 @@ private:
 		In order to implement a data structure, you will need to add some "in-core" data
 		to maintain data structure.
 		
-		Disk Part - numBytes, numSectors, dataSectors occupy exactly 128 bytes and will be
-		written to a sector on disk.
-		In-core part - none
+		Disk Part - nextFileHeaderSector, numBytes, numSectors, uncompressedLength,
+		dataSectors occupy exactly 128 bytes and will be written to a sector on disk.
+		In-core part - nextFileHeader
 		
 	*/
 	//MP4-2
-	// FileHeader* nextFileHeader; //指向下一個header
 	int nextFileHeaderSector; //指向下一個header存的位置
 
 	int numBytes;				// Number of bytes in the file
-	int numSectors;				// Number of data sectors in the file
+	int numSectors;				// Number of data blocks (clusters)
+								// this header points to
+	int uncompressedLength;		// In the first header of a compressed
+								// file, its length before compression;
+								// -1 otherwise
 	int dataSectors[NumDirect]; // Disk sector numbers for each data
 								// block in the file
+
+	// in-core part
+	FileHeader *nextFileHeader; // Cached copy of the header at
+								// nextFileHeaderSector, fetched the
+								// first time the chain is walked
+
+	FileHeader *NextHeader(); // Return nextFileHeader, fetching it
+							  // from disk if it is not cached yet
+	bool AllocateChain(PersistentBitmap *freeMap, int fileSize,
+					   int *dataRun, int *headerRun);
+							  // Allocate this header and the rest of
+							  // the chain, taking sectors from the
+							  // reserved runs when they are >= 0
+	void GrowChain(PersistentBitmap *freeMap, int blocks,
+				   int *dataRun, int *headerRun);
+							  // Add data blocks (and chained headers)
+							  // until the chain holds "blocks" of them
 };
 
 #endif // FILEHDR_H
@@ -0,0 +1,91 @@
+// filelock.cc
+//	Routines to find the lock of a file in use.  See filelock.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "filelock.h"
+
+FileLock::FileLock(int sector)
+{
+    this->sector = sector;
+    users = 0;
+    removed = FALSE;
+    handles = 0;
+    version = 0;
+    rw = new RWLock("file");
+}
+
+FileLock::~FileLock()
+{
+    delete rw;
+}
+
+FileLockTable::FileLockTable()
+{
+    tableLock = new Lock("file lock table");
+    locks = new List<FileLock *>;
+}
+
+FileLockTable::~FileLockTable()
+{
+    while (!locks->IsEmpty())
+        delete locks->RemoveFront();
+    delete locks;
+    delete tableLock;
+}
+
+//----------------------------------------------------------------------
+// FileLockTable::Get
+// 	Return the lock of a file, starting one if nobody uses the file
+//	yet.  The lock stays the same until every Get is matched by a
+//	Put, so threads waiting for it all wait on the same one.  The
+//	lock of a removed file is not handed out again: an OpenFile of
+//	the file may keep it, while its header sector goes to another.
+//
+//	"sector" -- where the file header is
+//----------------------------------------------------------------------
+
+FileLock *FileLockTable::Get(int sector)
+{
+    FileLock *lock = NULL;
+
+    tableLock->Acquire();
+    ListIterator<FileLock *> it(locks); // starts at the first entry: not
+                                        //  before the table is ours
+    for (; !it.IsDone(); it.Next())
+        if (it.Item()->sector == sector && !it.Item()->removed)
+        {
+            lock = it.Item();
+            break;
+        }
+    if (lock == NULL)
+    {
+        lock = new FileLock(sector);
+        locks->Append(lock);
+    }
+    lock->users++;
+    tableLock->Release();
+    return lock;
+}
+
+//----------------------------------------------------------------------
+// FileLockTable::Put
+// 	Done with a lock returned by Get.  The last user deletes it; the
+//	next Get of the sector, maybe of another file by then, starts a
+//	new one.
+//----------------------------------------------------------------------
+
+void FileLockTable::Put(FileLock *lock)
+{
+    tableLock->Acquire();
+    ASSERT(lock->users > 0);
+    if (--lock->users == 0)
+    {
+        locks->Remove(lock);
+        delete lock;
+    }
+    tableLock->Release();
+}
@@ -0,0 +1,77 @@
+// filelock.h
+//	Data structures to let several threads use the file system at once.
+//
+//	Every file (and directory) in use has a reader-writer lock, found
+//	by the sector of its file header:
+//
+//	   OpenFile::ReadAt holds it for reading, and OpenFile::WriteAt
+//	   for writing, so reads of one file go on in parallel, and never
+//	   see half of a write.
+//
+//	   Looking up a path holds the lock of each directory on the way
+//	   for reading; changing a directory (Create, Remove, Rename)
+//	   holds its lock for writing from the moment it is read until it
+//	   is written back.  Lookups in other directories, and reads of
+//	   any file, go on while the change waits for the disk.
+//
+//	Besides these, the free map has a plain lock of its own (see
+//	FileSystem::FetchFreeMap), held while sectors are allocated or
+//	freed.
+//
+//	To avoid deadlock, a thread takes the locks of directories in
+//	order of depth in the tree, and of sector among directories of
+//	the same depth; then the lock of the file it works on; then the
+//	lock of the orphan list (orphan.h); then the free map lock; then
+//	the lock of the deduplication table (dedup.h);
+//	and the lock of the snapshot table (snapshot.h) last of all.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FILELOCK_H
+#define FILELOCK_H
+
+#include "copyright.h"
+#include "list.h"
+#include "synch.h"
+
+// The lock of one file, and how many users know of it.
+
+class FileLock
+{
+public:
+    FileLock(int sector);
+    ~FileLock();
+
+    int sector;   // Location of the file header
+    int users;    // Get calls not yet matched by Put
+    bool removed; // The file was removed while we waited for it
+    int handles;  // Directory handles open on it, which keep it
+                  //  from being removed (FileSystem::OpenDirectory)
+    int version;  // Goes up whenever the header is written back, so
+                  //  an OpenFile knows its copy is out of date
+    RWLock *rw;   // The lock itself
+};
+
+// The following class finds the lock of a file.  Locks exist only while
+// someone uses them, so there are never more than the files in use.
+// Every OpenFile keeps a reference to the lock of its file for as long
+// as it is open.
+
+class FileLockTable
+{
+public:
+    FileLockTable();
+    ~FileLockTable();
+
+    FileLock *Get(int sector); // The lock of the file whose header is
+                               //  at "sector"; keep it until Put
+    void Put(FileLock *lock);  // Done with it
+
+private:
+    Lock *tableLock;          // Protects the list
+    List<FileLock *> *locks;  // Every lock in use
+};
+
+#endif // FILELOCK_H
@@ -16,7 +16,11 @@
 //      Both the bitmap and the directory are represented as normal
 //	files.  Their file headers are located in specific sectors
 //	(sector 0 and sector 1), so that the file system can find them
-//	on bootup.
+//	on bootup.  So are those of the two files that keep snapshots
+//	(sectors 2 and 3, see snapshot.h), of the one that keeps the
+//	reference counts of shared sectors (sector 4, see dedup.h), and
+//	of the list of removed files still to free (sector 5, see
+//	orphan.h).
 //
 //	The file system assumes that the bitmap and directory files are
 //	kept "open" continuously while Nachos is running.
@@ -28,9 +32,14 @@
 //	modified part of the directory and/or bitmap, we simply discard
 //	the changed version, without writing it back to disk.
 //
+//	Several threads may use the file system at once: each directory
+//	and file in use has a reader-writer lock, and the free map a lock
+//	of its own (see filelock.h for who holds what, and in which
+//	order).  Batches (BeginBatch) and Defragment are meant for one
+//	thread working alone.
+//
 // 	Our implementation at this point has the following restrictions:
 //
-//	   there is no synchronization for concurrent accesses
 //	   files have a fixed size, set when the file is created
 //	   files cannot be bigger than about 3KB in size
 //	   there is no hierarchical directory structure, and only a limited
@@ -49,8 +58,20 @@
 #include "disk.h"
 #include "pbitmap.h"
 #include "directory.h"
+#include "dirindex.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "treewalk.h"
+#include "defrag.h"
+#include "disktrace.h"
+#include "synchdisk.h"
+#include "filelock.h"
+#include "compress.h"
+#include "snapshot.h"
+#include "dedup.h"
+#include "orphan.h"
+#include "extent.h"
+#include "main.h"
 
 // Sectors containing the file headers for the bitmap of free sectors,
 // and the directory of files.  These file headers are placed in well-known
@@ -58,10 +79,23 @@
 #define FreeMapSector 0
 #define DirectorySector 1
 
+// Sectors containing the file headers of the generation map and of the
+// snapshot table, kept alongside the free map (see snapshot.h).
+#define GenMapSector 2
+#define SnapshotSector 3
+
+// Sector containing the file header of the deduplication table (see
+// dedup.h).
+#define DedupSector 4
+
+// Sector containing the file header of the orphan list (see orphan.h).
+#define OrphanSector 5
+
 // Initial file sizes for the bitmap and directory; until the file system
 // supports extensible files, the directory size sets the maximum number
-// of files that can be loaded onto the disk.
-#define FreeMapFileSize (NumSectors / BitsInByte)
+// of files that can be loaded onto the disk.  The bitmap has a bit per
+// cluster, so the length of its file tells the cluster size.
+#define FreeMapFileSize (NumSectors / BitsInByte / ClusterSectors)
 // #define NumDirEntries 10
 // #define DirectoryFileSize (sizeof(DirectoryEntry) * NumDirEntries)
 
@@ -73,24 +107,44 @@
 //	not all of the sectors marked as free).
 //
 //	If format = FALSE, we just have to open the files
-//	representing the bitmap and the directory.
+//	representing the bitmap and the directory.  The cluster size is
+//	the one the disk was formatted with, whatever "clusterSectors"
+//	says.
 //
 //	"format" -- should we initialize the disk?
+//	"clusterSectors" -- sectors per cluster, a power of two
 //----------------------------------------------------------------------
 
-FileSystem::FileSystem(bool format)
+FileSystem::FileSystem(bool format, int clusterSectors)
 {
     DEBUG(dbgFile, "Initializing the file system.");
+    for (int i = 0; i < 20; i++) openFileTable[i] = NULL;
+    for (int i = 0; i < 20; i++) openFileUsers[i] = 0;
+    for (int i = 0; i < 20; i++) openFileClosed[i] = FALSE;
+    for (int i = 0; i < 20; i++) dirHandleTable[i] = NULL;
+    fileStats = new ::List<FileStats *>;
+    batchFreeMap = NULL;
+    batchRoot = NULL;
+    batchFreeMapDirty = batchRootDirty = FALSE;
+    freeMapLock = new Lock("free map");
+    openFileLock = new Lock("open file table");
+    openFileDone = new Condition("open file done");
+    heldFreeMap = NULL;
+    heldFreeMapUsers = 0;
+    heldFreeMapDirty = FALSE;
+    freeSectors = -1;
+    reservedSectors = 0;
+
     if (format)
     {
+        ClusterSectors = clusterSectors; // before the free map is sized
         PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
         FileHeader *mapHdr = new FileHeader;
         FileHeader *dirHdr = new FileHeader;
 
-        DEBUG(dbgFile, "Formatting the file system.");
-
-        for (int i = 0; i < 20; i++) openFileTable[i] = NULL; 
+        DEBUG(dbgFile, "Formatting the file system, " << ClusterSectors
+                       << " sectors per cluster.");
 
         // First, allocate space for FileHeaders for the directory and bitmap
         // (make sure no one else grabs these!)
@@ -102,6 +156,9 @@ FileSystem::FileSystem(bool format)
 
         ASSERT(mapHdr->Allocate(freeMap, FreeMapFileSize));
         ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize));
+        DedupTable::Format(freeMap, DedupSector);
+        OrphanList::Format(freeMap, OrphanSector);
+        SnapshotTable::Format(freeMap, GenMapSector, SnapshotSector);
 
         // Flush the bitmap and directory FileHeaders back to disk
         // We need to do this before we can "Open" the file, since open
@@ -128,6 +185,7 @@ FileSystem::FileSystem(bool format)
         DEBUG(dbgFile, "Writing bitmap and directory back to disk.");
         freeMap->WriteBack(freeMapFile); // flush changes to disk
         directory->WriteBack(directoryFile);
+        freeSectors = freeMap->NumClear();
 
         if (debug->IsEnabled('f'))
         {
@@ -143,10 +201,36 @@ FileSystem::FileSystem(bool format)
     else
     {
         // if we are not formatting the disk, just open the files representing
-        // the bitmap and directory; these are left open while Nachos is running
+        // the bitmap and directory; these are left open while Nachos is running.
+        // The length of the bitmap gives the cluster size, which the
+        // headers need before any file is read.
+        FileHeader *mapHdr = new FileHeader;
+
+        mapHdr->FetchFrom(FreeMapSector);
+        ClusterSectors = NumSectors / BitsInByte / mapHdr->FileLength();
+        ASSERT(ClusterSectors >= 1 && ClusterSectors <= MaxClusterSectors);
+        delete mapHdr;
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
     }
+
+    // From now on, every sector allocated or written goes by the
+    // snapshot table.
+    snapshots = new SnapshotTable(this, GenMapSector, SnapshotSector);
+    kernel->synchDisk->SetSnapshots(snapshots);
+    dedup = new DedupTable(this, DedupSector);
+
+    // Runs of free clusters are looked up in the free extents, built
+    // from the free map now and kept up to date by it from then on.
+    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+    extents = new FreeExtents(NumSectors / ClusterSectors);
+    extents->Rebuild(freeMap);
+    delete freeMap;
+
+    // Finish freeing the files a crash (or a halt) left on the orphan
+    // list, before anything else is allocated.
+    orphans = new OrphanList(this, OrphanSector);
+    orphans->ReclaimAll();
 }
 
 //----------------------------------------------------------------------
@@ -155,12 +239,66 @@ FileSystem::FileSystem(bool format)
 //----------------------------------------------------------------------
 FileSystem::~FileSystem()
 {
+    ASSERT(batchFreeMap == NULL && batchRoot == NULL); // batches must be ended while the disk still runs
+    for (int i = 0; i < 20; i++)
+        if (openFileTable[i] != NULL) delete openFileTable[i];
     delete freeMapFile;
     delete directoryFile;
+    while (!fileStats->IsEmpty())
+        delete fileStats->RemoveFront();
+    delete fileStats;
+    delete freeMapLock;
+    delete openFileDone;
+    delete openFileLock;
+    delete snapshots;
+    delete dedup;
+    delete orphans;
+    delete extents;
+}
+
+//----------------------------------------------------------------------
+// SplitPath
+// 	Split an absolute path into the path of its directory, copied to
+//	"parent", and its last component.  Return the last component,
+//	with its leading '/', as the Directory operations expect it; or
+//	NULL if the path has no last component.
+//----------------------------------------------------------------------
+
+static char *SplitPath(char *path, char *parent)
+{
+    char *slash = strrchr(path, '/');
+
+    if (slash == NULL || slash[1] == '\0')
+        return NULL;
+    if (slash == path)
+        strcpy(parent, "/");
+    else
+    {
+        strncpy(parent, path, slash - path);
+        parent[slash - path] = '\0';
+    }
+    return slash;
+}
+
+//----------------------------------------------------------------------
+// PathDepth
+// 	Return how deep in the tree a directory is: 0 for the root, 1
+//	for the directories in it, and so on.  Directories are locked
+//	in order of depth (see filelock.h).
+//----------------------------------------------------------------------
+
+static int PathDepth(char *path)
+{
+    int depth = 0;
+
+    for (; *path != '\0'; path++)
+        if (*path == '/' && path[1] != '\0')
+            depth++;
+    return depth;
 }
 
 //----------------------------------------------------------------------
-// FileSystem::Create
+// FileSystem::Create/CreateIn
 // 	Create a file in the Nachos file system (similar to UNIX create).
 //	Since we can't increase the size of files dynamically, we have
 //	to give Create the initial size of the file.
@@ -176,108 +314,152 @@ FileSystem::~FileSystem()
 //	Return TRUE if everything goes ok, otherwise, return FALSE.
 //
 // 	Create fails if:
+//		the directory to create it in doesn't exist
 //   		file is already in directory
 //	 	no free space for file header
 //	 	no free entry for file in directory
 //	 	no free space for data blocks for the file
 //
-// 	Note that this implementation assumes there is no concurrent access
-//	to the file system!
+//	The directory is locked for writing from the moment it is read
+//	until it is written back, so that concurrent Creates in it can't
+//	undo each other's entries.
+//
+//	CreateIn takes "name" as a path from the directory whose header
+//	is at "base" (see CreateAt); Create, from the root.
 //
 //	"name" -- name of file to be created
 //	"initialSize" -- size of file to be created
+//	"isDir" -- create a directory instead of a file
+//	"indexed" -- make the directory an index (see dirindex.h) rather
+//		than a table; its file is then one sector, whatever
+//		"initialSize" says
+//	"compressed" -- store the file compressed (see compress.h); its
+//		data blocks then start out holding just the chunk map
 //----------------------------------------------------------------------
 
-int FileSystem::Create(char *name, int initialSize, bool isDir)
+int FileSystem::Create(char *name, int initialSize, bool isDir, bool indexed,
+                       bool compressed)
+{
+    return CreateIn(DirectorySector, name, initialSize, isDir, indexed,
+                    compressed);
+}
+
+int FileSystem::CreateIn(int base, char *name, int initialSize, bool isDir,
+                         bool indexed, bool compressed)
 {
     Directory *directory;
     PersistentBitmap *freeMap;
     FileHeader *hdr;
+    OpenFile *dirFile;
+    FileLock *dirLock;
+    char parent[256];
+    char *leaf = SplitPath(name, parent); //將要建立的名字存到leaf
     int sector; 
     int success;
+    int dataSize = initialSize; // bytes of data blocks to allocate
 
-    char tmpName[256];
-    strncpy(tmpName, name, sizeof(char)*(strlen(name)+1)); //將要建立的名字存到file name
-    // cout << tmpName;
+    if (isDir && indexed)
+        initialSize = dataSize = SectorSize; // just the root of the index
+    if (isDir)
+        compressed = FALSE;
+    if (compressed)
+        dataSize = CompressedFile::MapSectors(initialSize) * SectorSize;
     DEBUG(dbgFile, "Creating file " << name << " size " << initialSize);
 
-    directory = new Directory(NumDirEntries); //讀取現在的directory
-    directory->FetchFrom(directoryFile);
+    if (leaf == NULL || (dirLock = LockDirectoryAt(base, parent)) == NULL)
+        return 0; // no such directory
+    directory = FetchDirectoryAt(dirLock->sector, &dirFile); //讀取現在的directory
 
-    if (directory->Find(tmpName) != -1) { //檢查是否已經存在
+    if (directory->Find(leaf) != -1) { //檢查是否已經存在
         DEBUG(dbgFile, "File " << name << " is already in directory");
         success = 0; // file is already in directory
-        // Remove(name);
     } 
     else
     {
         DEBUG(dbgFile, "Start creating");
-        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+        freeMap = FetchFreeMap();
         sector = freeMap->FindAndSet(); // find a sector to hold the file header //找尋新的空間
+        hdr = new FileHeader;
         if (sector == -1) //無可用空間
             success = 0; // no free block for file header
-        else if (!directory->Add(name, sector, isDir)) //加入directory失敗 //sector = 現在有空的(剛剛在FindAndSet找到的)
+        else if (!hdr->Allocate(freeMap, dataSize, sector + ClusterSectors))
+        {
+            freeMap->Clear(sector);
+            success = 0; // no space on disk for data
+        }
+        else if (!directory->Add(leaf, sector, isDir, freeMap)) //加入directory失敗 //sector = 現在有空的(剛剛在FindAndSet找到的)
+        {
+            hdr->Deallocate(freeMap); // undo, in case the map is batched
+            freeMap->Clear(sector);
             success = 0; // no space in directory
+        }
         else
         {
-            DEBUG(dbgFile, "Allocate file size " << initialSize);
-            hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, initialSize))
-                success = 0; // no space on disk for data
-            else
-            {
-                success = 1;
-                
-                // everthing worked, flush all changes back to disk
-                DEBUG(dbgFile, "WriteBack file header " << sector << " length " << hdr->FileLength());
-                hdr->WriteBack(sector);
-                if (isDir) { //是否建立的是directory
-                    Directory* subDir = new Directory(NumDirEntries);
-                    OpenFile* dirFile = new OpenFile(sector);
-                    subDir->WriteBack(dirFile);
-                    delete subDir;
-                    delete dirFile;  
-                }
-                DEBUG(dbgFile, "WriteBack directory file");
-                directory->WriteBack(directoryFile);
-                DEBUG(dbgFile, "WriteBack free map file");
-                freeMap->WriteBack(freeMapFile);
+            success = 1;
+
+            // everthing worked, flush all changes back to disk
+            DEBUG(dbgFile, "WriteBack file header " << sector << " length " << hdr->FileLength());
+            if (compressed)
+                hdr->SetCompressed(initialSize);
+            hdr->WriteBack(sector);
+            if (compressed)
+                CompressedFile::Format(hdr);
+            else if (isDir && indexed)
+                DirectoryIndex::Format(hdr->ByteToSector(0));
+            else if (isDir) { //是否建立的是directory
+                Directory* subDir = new Directory(NumDirEntries);
+                OpenFile* dirFile = new OpenFile(sector);
+                subDir->WriteBack(dirFile);
+                delete subDir;
+                delete dirFile;  
             }
-            delete hdr;
         }
-        delete freeMap;
+        delete hdr;
+        ReleaseFreeMap(freeMap, success);
     }
-    delete directory;
+    ReleaseDirectoryAt(directory, dirFile, success);
+    UnlockFile(dirLock);
     return success;
 }
 
 //----------------------------------------------------------------------
-// FileSystem::Open
+// FileSystem::Open/OpenIn
 // 	Open a file for reading and writing.
 //	To open a file:
 //	  Find the location of the file's header, using the directory
 //	  Bring the header into memory
 //
+//	OpenIn looks "name" up from the directory whose header is at
+//	"base" (see OpenAt); Open, from the root.
+//
 //	"name" -- the text name of the file to be opened
 //----------------------------------------------------------------------
 
 OpenFile * FileSystem::Open(char *name)
 {
-    Directory *directory = new Directory(NumDirEntries);
+    return OpenIn(DirectorySector, name);
+}
+
+OpenFile *FileSystem::OpenIn(int base, char *name)
+{
+    int directoryReads = kernel->stats->diskReads[DirectoryIO];
     OpenFile *openFile = NULL;
     int sector;
 
     DEBUG(dbgFile, "Opening file" << name);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
+    sector = FindAt(base, name, NULL);
     if (sector >= 0)
+    {
         openFile = new OpenFile(sector); // name was found in directory
-    delete directory;
+        openFile->Stats()->directoryReads +=
+            kernel->stats->diskReads[DirectoryIO] - directoryReads;
+        openFile->SetTotals(StatsFor(name));
+    }
     return openFile; // return NULL if not found
 }
 
 //----------------------------------------------------------------------
-// FileSystem::Remove
+// FileSystem::Remove/RemoveIn
 // 	Delete a file from the file system.  This requires:
 //	    Remove it from the directory
 //	    Delete the space for its header
@@ -287,41 +469,383 @@ OpenFile * FileSystem::Open(char *name)
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
 //	in the file system.
 //
+//	Besides its directory, the file itself is locked for writing, so
+//	reads and writes of it that started already finish first, and
+//	threads waiting for its lock find that it is gone.
+//
+//	A file (not a directory) only leaves its directory here: once the
+//	directory is on disk, the file goes on the orphan list, to be
+//	freed in the background (see orphan.h).  Directories, files
+//	removed while batching (whose directory isn't on disk until
+//	EndBatch) and files that don't fit on the list are freed before
+//	Remove returns.
+//
+//	A directory that a handle is open on (see OpenDirectory) is not
+//	removed.
+//
+//	RemoveIn takes "name" as a path from the directory whose header
+//	is at "base" (see RemoveAt); Remove, from the root.
+//
 //	"name" -- the text name of the file to be removed
 //----------------------------------------------------------------------
 
 bool FileSystem::Remove(char *name)
+{
+    return RemoveIn(DirectorySector, name);
+}
+
+bool FileSystem::RemoveIn(int base, char *name)
 {
     Directory *directory;
     PersistentBitmap *freeMap;
     FileHeader *fileHdr;
+    OpenFile *dirFile;
+    FileLock *dirLock, *fileLock;
+    char parent[256];
+    char *leaf = SplitPath(name, parent);
+    bool isDir = FALSE;
     int sector;
 
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
+    if (leaf == NULL || (dirLock = LockDirectoryAt(base, parent)) == NULL)
+        return FALSE; // no such directory
+    directory = FetchDirectoryAt(dirLock->sector, &dirFile);
+    sector = directory->Find(leaf, &isDir);
     if (sector == -1)
     {
-        delete directory;
+        ReleaseDirectoryAt(directory, dirFile, FALSE);
+        UnlockFile(dirLock);
         return FALSE; // file not found
     }
+    fileLock = LockFile(sector);
+    ASSERT(fileLock != NULL); // only we can remove it: we hold its directory
+    if (fileLock->handles > 0)
+    {
+        ReleaseDirectoryAt(directory, dirFile, FALSE);
+        UnlockFile(fileLock);
+        UnlockFile(dirLock);
+        return FALSE; // a directory handle still refers to it
+    }
+    directory->Remove(leaf);
+    fileLock->removed = TRUE;
+
+    if (!isDir && batchFreeMap == NULL)
+    {   // the name goes first, so a crash can only leak the file
+        ReleaseDirectoryAt(directory, dirFile, TRUE);
+        directory = NULL;
+        if (orphans->Add(sector))
+        {
+            UnlockFile(fileLock);
+            UnlockFile(dirLock);
+            return TRUE;
+        }
+    }
     fileHdr = new FileHeader;
     fileHdr->FetchFrom(sector);
 
-    freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+    freeMap = FetchFreeMap();
 
+    if (isDir)
+    {   // an index keeps nodes outside its file
+        OpenFile *removedFile;
+        Directory *removed = FetchDirectoryAt(sector, &removedFile);
+        removed->Deallocate(freeMap);
+        ReleaseDirectoryAt(removed, removedFile, FALSE);
+    }
     fileHdr->Deallocate(freeMap); // remove data blocks
     freeMap->Clear(sector);       // remove header block
-    directory->Remove(name);
 
-    freeMap->WriteBack(freeMapFile);     // flush to disk
-    directory->WriteBack(directoryFile); // flush to disk
+    ReleaseFreeMap(freeMap, TRUE);  // flush to disk
+    if (directory != NULL)
+        ReleaseDirectoryAt(directory, dirFile, TRUE);   // flush to disk
+    UnlockFile(fileLock);
+    UnlockFile(dirLock);
     delete fileHdr;
-    delete directory;
-    delete freeMap;
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Rename
+// 	Give a file or directory a new name, without touching its header
+//	or its data: only directory entries change.  Return 1 on
+//	success, 0 if "from" doesn't exist, "to" does, the directory of
+//	"to" doesn't exist or is full, or a directory would move below
+//	itself.
+//
+//	Within one (table) directory, the entry is renamed in place: one
+//	sector is written, all at once.  Otherwise the entry is added to
+//	the destination directory, which is written back, and then
+//	removed from the source, which is written back; each write
+//	covers only the sectors of the entry.  A crash in between
+//	leaves the file under both names, never under none.
+//
+//	Both directories are locked for writing throughout.
+//
+//	"from" -- absolute path of the file
+//	"to" -- its new absolute path
+//----------------------------------------------------------------------
+
+int FileSystem::Rename(char *from, char *to)
+{
+    char fromParent[256], toParent[256];
+    char *fromLeaf = SplitPath(from, fromParent);
+    char *toLeaf = SplitPath(to, toParent);
+    Directory *fromDir, *toDir;
+    OpenFile *fromFile, *toFile;
+    FileLock *fromLock, *toLock;
+    PersistentBitmap *freeMap = NULL;
+    bool isDir = FALSE, success;
+    int sector, length = strlen(from);
+
+    if (fromLeaf == NULL || toLeaf == NULL ||
+        (!strncmp(to, from, length) && to[length] == '/'))
+        return 0; // a directory can't move below itself
+    if (!LockDirectories(fromParent, toParent, &fromLock, &toLock))
+        return 0; // no such directory
+
+    fromDir = FetchDirectoryAt(fromLock->sector, &fromFile);
+    if (toLock == fromLock)
+    {
+        toDir = fromDir;
+        toFile = fromFile;
+    }
+    else
+        toDir = FetchDirectoryAt(toLock->sector, &toFile);
+    sector = fromDir->Find(fromLeaf, &isDir);
+    success = sector != -1 && toDir->Find(toLeaf) == -1;
+
+    if (success)
+    {
+        DEBUG(dbgFile, "Renaming " << from << " to " << to);
+    }
+    if (success && !(toDir == fromDir && fromDir->RenameEntry(fromLeaf, toLeaf)))
+    {
+        if (toDir->IsIndexed())
+            freeMap = FetchFreeMap(); // it may need new nodes
+        success = toDir->Add(toLeaf, sector, isDir, freeMap);
+        if (success)
+        {   // the new name goes to disk before the old one goes
+            if (toFile != NULL)
+                toDir->WriteBack(toFile);
+            else if (toDir != batchRoot)
+                toDir->WriteBack(directoryFile);
+            fromDir->Remove(fromLeaf);
+        }
+        if (freeMap != NULL)
+            ReleaseFreeMap(freeMap, success);
+    }
+    if (toDir != fromDir)
+        ReleaseDirectoryAt(toDir, toFile, success);
+    ReleaseDirectoryAt(fromDir, fromFile, success);
+    if (toLock != fromLock)
+        UnlockFile(toLock);
+    UnlockFile(fromLock);
+    return success ? 1 : 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Fallocate
+// 	Reserve disk space for the first "length" bytes of an existing
+//	file, in one contiguous run if the disk has one, so it can be
+//	written (and later read) sequentially.  Return FALSE if the file
+//	doesn't exist, is a directory, is compressed (its space depends
+//	on what is written, see compress.h), or the disk is too full.
+//
+//	Files that are open already read the new header before their
+//	next write (see OpenFile::Refresh), so they don't write back the
+//	old one over it.
+//
+//	"name" -- the text name of the file
+//	"length" -- how many bytes need space
+//	"keepSize" -- if TRUE, do not change the length of the file; the
+//		space past its end is filled by writes that append
+//----------------------------------------------------------------------
+
+bool FileSystem::Fallocate(char *name, int length, bool keepSize)
+{
+    Directory *directory;
+    PersistentBitmap *freeMap;
+    FileHeader *hdr;
+    FileLock *fileLock;
+    bool isDir = FALSE, success;
+    int sector;
+
+    directory = FetchRoot();
+    sector = directory->Find(name, &isDir);
+    ReleaseRoot(directory, FALSE);
+    if (sector == -1 || isDir || length < 0)
+        return FALSE;
+    if ((fileLock = LockFile(sector)) == NULL)
+        return FALSE; // removed since we found it
+
+    DEBUG(dbgFile, "Reserving " << length << " bytes for " << name);
+    hdr = new FileHeader;
+    hdr->FetchFrom(sector);
+    if (hdr->IsCompressed())
+        success = FALSE;
+    else
+    {
+        freeMap = FetchFreeMap();
+        success = hdr->Reserve(freeMap, length, keepSize);
+        if (success)
+        {
+            hdr->WriteBack(sector);
+            fileLock->version++;
+        }
+        ReleaseFreeMap(freeMap, success);
+    }
+    UnlockFile(fileLock);
+    delete hdr;
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::GrowFile
+// 	Give an open file data blocks for its first "length" bytes, and
+//	make that its length, as a compressed file needs when the chunks
+//	written to it take more room (see CompressedFile::StoreChunk),
+//	and an OpenFile when it flushes the data written past the end of
+//	the file (see OpenFile::Flush).  The caller has the file locked
+//	for writing.  Return FALSE if the disk is too full.
+//
+//	The blocks are laid out in one run if the free map has one, so
+//	data written a little at a time still ends up contiguous when it
+//	is allocated all at once.
+//
+//	The caller's "hdr" must be up to date (see OpenFile::Refresh);
+//	the file's lock version goes up, so that every other OpenFile
+//	of the file reads the new header before it writes.
+//
+//	"hdr" -- the header of the file, as the OpenFile keeps it
+//	"hdrSector" -- where to write it back
+//	"length" -- how many bytes of data blocks it needs
+//	"reserved" -- sectors set aside for it by ReserveSectors, which
+//		are given back first
+//----------------------------------------------------------------------
+
+bool FileSystem::GrowFile(FileHeader *hdr, int hdrSector, int length,
+                          int reserved)
+{
+    PersistentBitmap *freeMap = FetchFreeMap();
+    bool success;
+
+    reservedSectors -= reserved;
+    freeMap->SetReserved(reservedSectors);
+    success = hdr->Reserve(freeMap, length, FALSE);
+
+    if (success)
+    {
+        FileLock *fileLock = kernel->fileLocks->Get(hdrSector);
+
+        hdr->WriteBack(hdrSector);
+        fileLock->version++; // other opens of the file read it again
+        kernel->fileLocks->Put(fileLock);
+    }
+    ReleaseFreeMap(freeMap, success);
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Defragment
+// 	Move every fragmented file and directory into a contiguous run
+//	of sectors (see defrag.h), and print the fragmentation score
+//	before and after.  No file may be open, and no other thread
+//	may use the file system meanwhile.
+//
+//	With a disk trace of a typical workload, the files it reads most
+//	are moved first, and the trace is replayed twice through the
+//	latency model: once as recorded, and once with every sector
+//	where the defragmenter moved it, to show the disk time saved.
+//
+//	"traceName" -- the trace, recorded with -trace, or NULL
+//	"modelSpec" -- the latency model to replay it with (diskmodel.h)
+//----------------------------------------------------------------------
+
+void FileSystem::Defragment(char *traceName, char *modelSpec)
+{
+    PersistentBitmap *freeMap;
+    Defragmenter *defrag;
+    double before;
+    int moved;
+
+    if (ClusterSectors > 1)
+    {   // it moves files a sector at a time
+        printf("Defragment: not with clusters of %d sectors\n",
+               ClusterSectors);
+        return;
+    }
+    freeMap = FetchFreeMap();
+    defrag = new Defragmenter(freeMap, freeMapFile);
+    defrag->Scan(FetchDirectory("/"), "/");
+    if (traceName != NULL && !defrag->CountReads(traceName))
+        traceName = NULL;
+    before = defrag->Score();
+    moved = defrag->Run();
+    printf("Defragment: fragmentation %.1f%% before, %.1f%% after; "
+           "%d files (%d sectors) moved\n",
+           before, defrag->Score(), moved, defrag->NumMoved());
+
+    if (traceName != NULL)
+    {
+        DiskReplayer *replayer = new DiskReplayer(modelSpec, "fifo", 0);
+        double oldLatency;
+
+        replayer->Replay(traceName);
+        oldLatency = replayer->TotalLatency();
+        replayer->SetRemap(defrag->Remap(), kernel->synchDisk->NumDisks());
+        replayer->Replay(traceName);
+        printf("Defragment: %.0f of %.0f disk ticks saved on %s\n",
+               oldLatency - replayer->TotalLatency(), oldLatency, traceName);
+        delete replayer;
+    }
+    delete defrag;
+    ReleaseFreeMap(freeMap, FALSE); // already written back as it changed
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FragmentationReport
+// 	Print the fragmentation score of the files (see defrag.h), and
+//	how the free space is split up: how many extents, and the
+//	longest.  The files removed so far are freed first, so that
+//	their space counts.  The free extents are checked against the
+//	free map, and rebuilt, with a complaint, if they don't match.
+//----------------------------------------------------------------------
+
+void FileSystem::FragmentationReport()
+{
+    PersistentBitmap *freeMap;
+    Defragmenter *defrag;
+
+    ReclaimOrphans();
+    freeMap = FetchFreeMap();
+    defrag = new Defragmenter(freeMap, freeMapFile);
+    defrag->Scan(FetchDirectory("/"), "/");
+    if (!extents->Check(freeMap))
+    {   // a change to the free map they didn't hear of
+        printf("Free extents out of step with the free map; rebuilt\n");
+        extents->Rebuild(freeMap);
+    }
+    printf("Fragmentation: %.1f%% of files; free space: %d sectors in "
+           "%d extents, the longest %d sectors\n", defrag->Score(),
+           extents->NumFree() * ClusterSectors, extents->NumExtents(),
+           extents->Largest() * ClusterSectors);
+    delete defrag;
+    ReleaseFreeMap(freeMap, FALSE);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::SetAllocation
+// 	Place the runs of clusters allocated from now on by "policy":
+//	first, best or nearest fit (see extent.h).  The policy is not
+//	kept on disk; best fit is the default.
+//----------------------------------------------------------------------
+
+void FileSystem::SetAllocation(AllocPolicy policy)
+{
+    freeMapLock->Acquire();
+    extents->SetPolicy(policy);
+    freeMapLock->Release();
+}
+
 //----------------------------------------------------------------------
 // FileSystem::List
 // 	List all the files in the target directory.
@@ -329,8 +853,7 @@ bool FileSystem::Remove(char *name)
 
 void FileSystem::List(char* name)
 {
-    Directory *directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
+    Directory *directory = FetchRoot();
     
     int dirSector = directory->Find(name);
     if (!strcmp(name, "/")) directory->List();
@@ -342,30 +865,144 @@ void FileSystem::List(char* name)
         delete subDir;
         delete subDirFile;    
     }
-    delete directory;
+    ReleaseRoot(directory, FALSE);
 }
 
 //----------------------------------------------------------------------
 // FileSystem::RecursiveList
-// 	List all the files in the target directory.
+// 	List all the files and directories under the target directory,
+//	each directory followed by its contents, indented one level.
+//
+//	"name" -- absolute path of the directory, "/" for the root
 //----------------------------------------------------------------------
 
-void FileSystem::RecursiveList(char* name) //先尋找目標 directory，然後對該 directory 呼叫 RecursiveList。
+void FileSystem::RecursiveList(char* name)
+{
+    Directory *directory = FetchDirectory(name);
+    DirectoryEntry entry;
+    char path[MaxWalkPath];
+    int size, depth;
+
+    if (directory == NULL)
+        return;
+    TreeWalk *walk = new TreeWalk(directory, name);
+    while (walk->Next(path, &entry, &size, &depth))
+    {
+        for (int j = 0; j < depth; j++)
+            printf("    "); // padding
+        printf("%s %s\n", entry.isDir ? "[D]" : "[F]", entry.name);
+    }
+    delete walk;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReadDir
+// 	Copy up to "count" entries of directory "name" into "entries",
+//	starting at "*cursor", and move the cursor past them, so the next
+//	call continues where this one stopped.  The headers of the
+//	entries are read in one batch, for their sizes.  Return how many
+//	entries were copied (0 at the end of the directory), or -1 if
+//	"name" is not a directory.
+//
+//	"name" -- absolute path of the directory, "/" for the root
+//	"entries" -- where to put the entries
+//	"count" -- how many fit there
+//	"cursor" -- position to continue from; 0 to start
+//
+//	The directory is locked for reading while its entries are
+//	copied, so that a batch never sees half of a Create or Remove.
+//----------------------------------------------------------------------
+
+int FileSystem::ReadDir(char *name, DirectoryInfo *entries, int count,
+                        int *cursor)
+{
+    int dirSector = FindDirectory(name);
+    Directory *directory;
+    OpenFile *dirFile;
+    FileLock *dirLock;
+    DirectoryEntry entry;
+    int sectors[NumDirEntries];
+    char *headers;
+    FileHeader *hdr;
+    int n = 0;
+
+    if (dirSector == -1 || *cursor < 0)
+        return -1;
+    dirLock = kernel->fileLocks->Get(dirSector);
+    dirLock->rw->AcquireRead();
+    if (dirLock->removed)
+        n = -1;
+    else
+    {
+        directory = FetchDirectoryAt(dirSector, &dirFile);
+        while (n < count && n < NumDirEntries && directory->NextEntry(cursor, &entry))
+        {
+            strncpy(entries[n].name, entry.name, FileNameMaxLen);
+            entries[n].name[FileNameMaxLen] = '\0';
+            entries[n].sector = entry.sector;
+            entries[n].isDir = entry.isDir;
+            sectors[n++] = entry.sector;
+        }
+        ReleaseDirectoryAt(directory, dirFile, FALSE);
+    }
+    dirLock->rw->ReleaseRead();
+    kernel->fileLocks->Put(dirLock);
+
+    if (n > 0)
+    {
+        headers = new char[n * SectorSize];
+        hdr = new FileHeader;
+        kernel->synchDisk->ReadSectors(sectors, n, headers, HeaderIO);
+        for (int i = 0; i < n; i++)
+        {
+            hdr->LoadFrom(headers + i * SectorSize);
+            entries[i].size = hdr->ContentLength();
+        }
+        delete hdr;
+        delete[] headers;
+    }
+    return n;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FetchDirectory
+// 	Read the contents of the directory "name" into a new in-core
+//	Directory, so the caller can walk it with Directory::NextEntry.
+//	Return NULL if "name" does not exist or is a plain file.
+//
+//	"name" -- absolute path of the directory, "/" for the root
+//----------------------------------------------------------------------
+
+Directory *FileSystem::FetchDirectory(char *name)
 {
     Directory *directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    
-    int dirSector = directory->Find(name);
-    if (!strcmp(name, "/")) directory->RecursiveList(0);
-    else {
-        OpenFile *subDirFile = new OpenFile(dirSector);
-        Directory *subDir = new Directory(NumDirEntries);
-        subDir->FetchFrom(subDirFile);
-        subDir->RecursiveList(0);
-        delete subDir;
-        delete subDirFile;    
+    Directory *root;
+    OpenFile *dirFile;
+    bool isDir = FALSE;
+    int sector;
+
+    if (!strcmp(name, "/"))
+    {
+        if (batchRoot != NULL && batchRootDirty)
+        {
+            batchRoot->WriteBack(directoryFile); // make the disk copy current
+            batchRootDirty = FALSE;
+        }
+        directory->FetchFrom(directoryFile);
+        return directory;
     }
-    delete directory;
+    root = FetchRoot();
+    sector = root->Find(name, &isDir);
+    ReleaseRoot(root, FALSE);
+    if (sector == -1 || !isDir)
+    {
+        delete directory;
+        return NULL;
+    }
+    dirFile = new OpenFile(sector);
+    directory->FetchFrom(dirFile);
+    delete dirFile;
+    return directory;
 }
 
 //----------------------------------------------------------------------
@@ -385,6 +1022,7 @@ void FileSystem::Print()
     PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile, NumSectors);
     Directory *directory = new Directory(NumDirEntries);
 
+    printf("Clusters of %d sectors\n", ClusterSectors);
     printf("Bit map file header:\n");
     bitHdr->FetchFrom(FreeMapSector);
     bitHdr->Print();
@@ -404,41 +1042,778 @@ void FileSystem::Print()
     delete directory;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::ReserveSectors
+// 	Set aside "count" free sectors for data an OpenFile holds, to be
+//	allocated when it is flushed (see OpenFile::Flush).  Return FALSE
+//	if fewer than that are free and not reserved already: the write
+//	fails now, rather than the flush later.
+//
+//	Only the count is kept, so no sector is chosen, and the free map
+//	is not read -- except the first time, to count its free sectors.
+//	From then on, the count is kept up to date by ReleaseFreeMap.
+//----------------------------------------------------------------------
+
+bool FileSystem::ReserveSectors(int count)
+{
+    bool held = freeMapLock->IsHeldByCurrentThread();
+    bool success;
+
+    if (held) // in the middle of an operation: its map is the count
+        success = heldFreeMap->NumClear() >= count;
+    else
+    {
+        freeMapLock->Acquire();
+        if (freeSectors < 0)
+        {
+            PersistentBitmap *freeMap = batchFreeMap;
+
+            if (freeMap == NULL)
+                freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+            freeSectors = freeMap->NumFree();
+            if (freeMap != batchFreeMap)
+                delete freeMap;
+        }
+        success = freeSectors - reservedSectors >= count;
+    }
+    if (success)
+    {
+        reservedSectors += count;
+        if (held)
+            heldFreeMap->SetReserved(reservedSectors);
+    }
+    if (!held)
+        freeMapLock->Release();
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::NumFreeSectors
+// 	Return how many sectors of the disk are free, and not reserved
+//	for data waiting to be flushed.
+//----------------------------------------------------------------------
+
+int FileSystem::NumFreeSectors()
+{
+    PersistentBitmap *freeMap = FetchFreeMap();
+    int numFree = freeMap->NumClear();
+
+    ReleaseFreeMap(freeMap, FALSE);
+    return numFree;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReclaimOrphans
+// 	Finish freeing every removed file that is still on the orphan
+//	list, so that NumFreeSectors counts their sectors as free.
+//----------------------------------------------------------------------
+
+void FileSystem::ReclaimOrphans()
+{
+    orphans->ReclaimAll();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::BeginBatch
+// 	Start a batch of metadata operations.  Until EndBatch, Create and
+//	Remove work on one in-core copy of the free map and of the root
+//	directory, instead of fetching both from disk and writing both
+//	back on every call.  With a 64MB disk the free map alone is 512
+//	sectors, so this is what makes bulk imports affordable.
+//
+//	The price is that a crash in the middle of a batch loses every
+//	change made to the free map and the root directory since
+//	BeginBatch.
+//----------------------------------------------------------------------
+
+void FileSystem::BeginBatch()
+{
+    if (batchFreeMap != NULL)
+        return; // already batching
+    DEBUG(dbgFile, "Begin metadata batch");
+    batchFreeMap = new PersistentBitmap(freeMapFile, NumSectors);
+    batchFreeMap->SetSnapshots(snapshots);
+    batchFreeMap->SetDedup(dedup);
+    batchFreeMap->SetExtents(extents);
+    batchRoot = new Directory(NumDirEntries);
+    batchRoot->FetchFrom(directoryFile);
+    batchFreeMapDirty = batchRootDirty = FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::EndBatch
+// 	Flush whatever the batch changed back to disk, and go back to
+//	fetching the free map and root directory on every operation.
+//----------------------------------------------------------------------
+
+void FileSystem::EndBatch()
+{
+    if (batchFreeMap == NULL)
+        return;
+    DEBUG(dbgFile, "End metadata batch");
+    if (batchFreeMapDirty)
+        batchFreeMap->WriteBack(freeMapFile);
+    else if (batchFreeMap->Changed())
+    {   // only failed operations changed it (see ReleaseFreeMap)
+        PersistentBitmap *onDisk = new PersistentBitmap(freeMapFile, NumSectors);
+        extents->Rebuild(onDisk);
+        delete onDisk;
+    }
+    if (batchRootDirty)
+        batchRoot->WriteBack(directoryFile);
+    delete batchFreeMap;
+    delete batchRoot;
+    batchFreeMap = NULL;
+    batchRoot = NULL;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::TakeSnapshot
+// 	Freeze the file system, as it is on disk now, as snapshot "name".
+//	Nothing is copied: the sectors are copied as they are overwritten
+//	(see snapshot.h).  Return FALSE if the name is in use or too long,
+//	if there are too many snapshots, or if a batch is in progress,
+//	since its changes are not on disk yet.  A snapshot keeps track
+//	of single sectors, so a disk with bigger clusters can't have any.
+//----------------------------------------------------------------------
+
+bool FileSystem::TakeSnapshot(char *name)
+{
+    bool success;
+
+    if (batchFreeMap != NULL || ClusterSectors > 1)
+        return FALSE;
+    freeMapLock->Acquire(); // no sectors change hands meanwhile
+    success = snapshots->Take(name);
+    freeMapLock->Release();
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::DeleteSnapshot
+// 	Delete snapshot "name", freeing the sectors that no other snapshot
+//	needs.  Return FALSE if there is no such snapshot.
+//----------------------------------------------------------------------
+
+bool FileSystem::DeleteSnapshot(char *name)
+{
+    PersistentBitmap *freeMap = FetchFreeMap();
+    bool success = snapshots->Delete(name, freeMap);
+
+    ReleaseFreeMap(freeMap, success);
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ViewSnapshot
+// 	From now on, read snapshot "name" rather than the live file system.
+//	The snapshot is read-only: nothing may be written while viewing it.
+//	Return FALSE if there is no such snapshot.
+//----------------------------------------------------------------------
+
+bool FileSystem::ViewSnapshot(char *name)
+{
+    if (!snapshots->View(name))
+        return FALSE;
+    delete directoryFile; // its header, as the snapshot has it
+    directoryFile = new OpenFile(DirectorySector);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ListSnapshots
+// 	Print every snapshot.
+//----------------------------------------------------------------------
+
+void FileSystem::ListSnapshots()
+{
+    snapshots->List();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::SetDedup
+// 	Turn deduplication of the data blocks written from now on on or
+//	off.  The setting is kept on disk, so it lasts until changed.
+//	Sectors are shared one at a time, so return FALSE, leaving it
+//	off, on a disk with bigger clusters.
+//----------------------------------------------------------------------
+
+bool FileSystem::SetDedup(bool on)
+{
+    if (on && ClusterSectors > 1)
+        return FALSE;
+    dedup->Enable(on);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::DedupReport
+// 	Print how much deduplication saves, on disk and in a cache.
+//----------------------------------------------------------------------
+
+void FileSystem::DedupReport()
+{
+    dedup->Report();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FetchFreeMap/FetchRoot
+// 	Return the free map (root directory) to use for one operation:
+//	the batched in-core copy, or a fresh copy read from disk.
+//
+//	The free map is locked until ReleaseFreeMap, so that only one
+//	thread at a time allocates or frees sectors.  The thread holding
+//	it may fetch it again, when a write in the middle of its operation
+//	makes the snapshots copy a sector: it gets the same copy, and only
+//	the outermost ReleaseFreeMap writes it back.
+//----------------------------------------------------------------------
+
+PersistentBitmap *FileSystem::FetchFreeMap()
+{
+    if (freeMapLock->IsHeldByCurrentThread())
+    {
+        ASSERT(heldFreeMap != NULL);
+        heldFreeMapUsers++;
+        return heldFreeMap;
+    }
+    freeMapLock->Acquire();
+    if (batchFreeMap != NULL)
+        heldFreeMap = batchFreeMap;
+    else
+    {
+        heldFreeMap = new PersistentBitmap(freeMapFile, NumSectors);
+        heldFreeMap->SetSnapshots(snapshots);
+        heldFreeMap->SetDedup(dedup);
+        heldFreeMap->SetExtents(extents);
+    }
+    heldFreeMap->SetReserved(reservedSectors);
+    return heldFreeMap;
+}
+
+Directory *FileSystem::FetchRoot()
+{
+    Directory *directory;
+
+    if (batchRoot != NULL)
+        return batchRoot;
+    directory = new Directory(NumDirEntries);
+    directory->FetchFrom(directoryFile);
+    return directory;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReleaseFreeMap/ReleaseRoot
+// 	Finish with a copy returned by FetchFreeMap (FetchRoot).  If the
+//	operation "modified" it, it is written back to disk -- right away,
+//	or at EndBatch if we are batching.  Otherwise it is discarded,
+//	and if it was changed all the same, the free extents are built
+//	again from the map on disk.
+//----------------------------------------------------------------------
+
+void FileSystem::ReleaseFreeMap(PersistentBitmap *freeMap, bool modified)
+{
+    ASSERT(freeMap == heldFreeMap);
+    if (heldFreeMapUsers > 0)
+    {
+        heldFreeMapUsers--;
+        heldFreeMapDirty = heldFreeMapDirty || modified;
+        return;
+    }
+    modified = modified || heldFreeMapDirty;
+    heldFreeMap = NULL;
+    heldFreeMapDirty = FALSE;
+    if (modified)
+        freeSectors = freeMap->NumFree();
+    if (freeMap == batchFreeMap)
+        batchFreeMapDirty = batchFreeMapDirty || modified;
+    else
+    {
+        if (modified)
+            freeMap->WriteBack(freeMapFile);
+        else if (freeMap->Changed())
+        {   // a failed operation: the extents heard of changes that
+            // are thrown away, so go back to the map on disk
+            PersistentBitmap *onDisk =
+                new PersistentBitmap(freeMapFile, NumSectors);
+            extents->Rebuild(onDisk);
+            delete onDisk;
+        }
+        delete freeMap;
+    }
+    freeMapLock->Release();
+}
+
+void FileSystem::ReleaseRoot(Directory *directory, bool modified)
+{
+    if (directory == batchRoot)
+    {
+        batchRootDirty = batchRootDirty || modified;
+        return;
+    }
+    if (modified)
+        directory->WriteBack(directoryFile);
+    delete directory;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FetchDirectoryAt/ReleaseDirectoryAt
+// 	Like FetchRoot/ReleaseRoot, for any directory, found by the
+//	sector of its header.  "*dirFile" is set to the file to write
+//	the directory back to, or NULL for the root.
+//----------------------------------------------------------------------
+
+Directory *FileSystem::FetchDirectoryAt(int sector, OpenFile **dirFile)
+{
+    Directory *directory;
+
+    *dirFile = NULL;
+    if (sector == DirectorySector)
+        return FetchRoot();
+    *dirFile = new OpenFile(sector);
+    directory = new Directory(NumDirEntries);
+    directory->FetchFrom(*dirFile);
+    return directory;
+}
+
+void FileSystem::ReleaseDirectoryAt(Directory *directory, OpenFile *dirFile,
+                                    bool modified)
+{
+    if (dirFile == NULL)
+    {
+        ReleaseRoot(directory, modified);
+        return;
+    }
+    if (modified)
+        directory->WriteBack(dirFile);
+    delete directory;
+    delete dirFile;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindAt
+// 	Look "name" up from the directory whose header is at "base", and
+//	return the sector of its header, or -1 if it isn't there.  A
+//	directory other than the root is locked for reading meanwhile,
+//	as Directory::Find locks the ones below it; once it is removed,
+//	nothing is found in it.
+//
+//	"isDir" -- if not NULL, set to whether "name" is a directory
+//----------------------------------------------------------------------
+
+int FileSystem::FindAt(int base, char *name, bool *isDir)
+{
+    FileLock *lock = NULL;
+    Directory *directory;
+    OpenFile *dirFile;
+    int sector = -1;
+
+    if (base != DirectorySector)
+    {
+        lock = kernel->fileLocks->Get(base);
+        lock->rw->AcquireRead();
+    }
+    if (lock == NULL || !lock->removed)
+    {
+        directory = FetchDirectoryAt(base, &dirFile);
+        sector = directory->Find(name, isDir);
+        ReleaseDirectoryAt(directory, dirFile, FALSE);
+    }
+    if (lock != NULL)
+    {
+        lock->rw->ReleaseRead();
+        kernel->fileLocks->Put(lock);
+    }
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindDirectory/FindDirectoryAt
+// 	Return the sector of the header of directory "name", or -1 if
+//	it is not a directory.
+//
+//	"name" -- path of the directory from the root (from the directory
+//		whose header is at "base"), "/" for that directory itself
+//----------------------------------------------------------------------
+
+int FileSystem::FindDirectory(char *name)
+{
+    return FindDirectoryAt(DirectorySector, name);
+}
+
+int FileSystem::FindDirectoryAt(int base, char *name)
+{
+    bool isDir = FALSE;
+    int sector;
+
+    if (!strcmp(name, "/"))
+        return base;
+    sector = FindAt(base, name, &isDir);
+    return isDir ? sector : -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LockFile/UnlockFile
+// 	Lock the file (or directory) whose header is at "sector" for
+//	writing, and let go of it.  LockFile returns NULL if the file
+//	was removed while we waited for it.
+//----------------------------------------------------------------------
+
+FileLock *FileSystem::LockFile(int sector)
+{
+    FileLock *lock = kernel->fileLocks->Get(sector);
+
+    lock->rw->AcquireWrite();
+    if (lock->removed)
+    {
+        UnlockFile(lock);
+        return NULL;
+    }
+    return lock;
+}
+
+void FileSystem::UnlockFile(FileLock *lock)
+{
+    lock->rw->ReleaseWrite();
+    kernel->fileLocks->Put(lock);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LockDirectory/LockDirectories
+// 	Find one (two) directories by name, and lock them for writing,
+//	in the order described in filelock.h.  Return NULL (FALSE) if a
+//	directory doesn't exist, or was removed while we waited for it.
+//	The two directories may be the same; then "*second" is "*first".
+//	LockDirectoryAt finds the directory from the one whose header is
+//	at "base", rather than from the root.
+//----------------------------------------------------------------------
+
+FileLock *FileSystem::LockDirectory(char *name)
+{
+    return LockDirectoryAt(DirectorySector, name);
+}
+
+FileLock *FileSystem::LockDirectoryAt(int base, char *name)
+{
+    int sector = FindDirectoryAt(base, name);
+
+    return (sector == -1) ? NULL : LockFile(sector);
+}
+
+bool FileSystem::LockDirectories(char *first, char *second,
+                                 FileLock **firstLock, FileLock **secondLock)
+{
+    int firstSector = FindDirectory(first);
+    int secondSector = FindDirectory(second);
+    int firstDepth = PathDepth(first), secondDepth = PathDepth(second);
+    bool inOrder;
+
+    if (firstSector == -1 || secondSector == -1)
+        return FALSE;
+    if (firstSector == secondSector)
+    {
+        *firstLock = *secondLock = LockFile(firstSector);
+        return *firstLock != NULL;
+    }
+    inOrder = (firstDepth < secondDepth) ||
+              (firstDepth == secondDepth && firstSector < secondSector);
+    if (inOrder)
+    {
+        *firstLock = LockFile(firstSector);
+        *secondLock = (*firstLock == NULL) ? NULL : LockFile(secondSector);
+    }
+    else
+    {
+        *secondLock = LockFile(secondSector);
+        *firstLock = (*secondLock == NULL) ? NULL : LockFile(firstSector);
+    }
+    if (*firstLock != NULL && *secondLock != NULL)
+        return TRUE;
+    if (*firstLock != NULL)
+        UnlockFile(*firstLock);
+    if (*secondLock != NULL)
+        UnlockFile(*secondLock);
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StatsFor
+// 	Return the I/O counters kept for the file "name", creating them
+//	the first time the name is opened.
+//----------------------------------------------------------------------
+
+FileStats *FileSystem::StatsFor(char *name)
+{
+    ListIterator<FileStats *> iter(fileStats);
+    FileStats *stats;
+
+    for (; !iter.IsDone(); iter.Next())
+        if (!strcmp(iter.Item()->name, name))
+            return iter.Item();
+    stats = new FileStats(name);
+    fileStats->Append(stats);
+    return stats;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PrintStats
+// 	Print the I/O counters of every file that was opened by name,
+//	including the ones still open, as a table or a JSON array.
+//----------------------------------------------------------------------
+
+void FileSystem::PrintStats(bool json)
+{
+    ListIterator<FileStats *> iter(fileStats);
+    bool first = TRUE;
+
+    openFileLock->Acquire();
+    for (int i = 0; i < 20; i++)
+        if (openFileTable[i] != NULL)
+            openFileTable[i]->FlushStats();
+    openFileLock->Release();
+
+    if (json)
+        printf("[");
+    else
+        printf("  %-20s %10s %10s %8s %8s %8s %8s\n", "file", "bytes rd",
+               "bytes wr", "sect rd", "sect wr", "hdr rd", "dir rd");
+    for (; !iter.IsDone(); iter.Next())
+    {
+        if (json && !first)
+            printf(", ");
+        iter.Item()->Print(json);
+        first = FALSE;
+    }
+    if (json)
+        printf("]");
+}
+
 int FileSystem::WriteFile(char *buffer, int size, OpenFileId id){
-    OpenFile *openFile = openFileTable[id];
+    OpenFile *openFile = UseOpenFile(id);
     if (!openFile) return -1;
-    return openFile->Write(buffer, size);
+    int written = openFile->Write(buffer, size); // may wait for the disk
+    DoneWithOpenFile(id);
+    return written;
 }
 
 int FileSystem::ReadFile(char *buffer, int size, OpenFileId id){
-    OpenFile *openFile = openFileTable[id];
+    OpenFile *openFile = UseOpenFile(id);
     if (!openFile) return -1;
-    return openFile->Read(buffer, size);
+    int read = openFile->Read(buffer, size); // may wait for the disk
+    DoneWithOpenFile(id);
+    return read;
 }
 
 OpenFileId FileSystem::OpenAFile(char *name) {
+    return AddOpenFile(Open(name)); // may wait for the disk
+}
+
+//----------------------------------------------------------------------
+// FileSystem::AddOpenFile
+// 	Give "openFile" a slot of the open file table, and return its
+//	OpenFileId; or -1, deleting it, if the table is full (or if it is
+//	NULL, the file not being found).
+//----------------------------------------------------------------------
+
+OpenFileId FileSystem::AddOpenFile(OpenFile *openFile) {
+    OpenFileId id = -1;
+
+    if (openFile == NULL) return -1;
+    openFileLock->Acquire();    // the table is shared by every thread
     for(int i = 0; i < 20 ; i++){
         if(openFileTable[i] == NULL){
-            // int fileDescriptor = OpenForReadWrite(name, FALSE);
-            // if (fileDescriptor == -1) return -1;
-
-            openFileTable[i] = Open(name);
-            if (openFileTable[i]) return i;
-            else return -1;
+            openFileTable[i] = openFile;
+            id = i;
+            break;
         }
     }
-    return -1;
+    openFileLock->Release();
+    if (id == -1) delete openFile; // no free slot
+    return id;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::UseOpenFile/DoneWithOpenFile
+// 	Return the file OpenFileId "id" is open on, or NULL if it is not
+//	open, counting one more user of it until DoneWithOpenFile.  A
+//	file being closed gets no new users, and CloseFile waits for the
+//	last of them to be done.
+//----------------------------------------------------------------------
+
+OpenFile *FileSystem::UseOpenFile(OpenFileId id) {
+    OpenFile *openFile = NULL;
+
+    if (id < 0 || id >= 20) return NULL;
+    openFileLock->Acquire();
+    if (openFileTable[id] != NULL && !openFileClosed[id]) {
+        openFile = openFileTable[id];
+        openFileUsers[id]++;
+    }
+    openFileLock->Release();
+    return openFile;
 }
+
+void FileSystem::DoneWithOpenFile(OpenFileId id) {
+    openFileLock->Acquire();
+    ASSERT(openFileUsers[id] > 0);
+    if (--openFileUsers[id] == 0 && openFileClosed[id])
+        openFileDone->Broadcast(openFileLock); // let CloseFile go on
+    openFileLock->Release();
+}
+
+int FileSystem::SeekFile(int position, OpenFileId id){
+    OpenFile *openFile = UseOpenFile(id);
+    int result = -1;
+    if (!openFile) return -1;
+    if (position >= 0 && position <= openFile->Length()) {
+        openFile->Seek(position);
+        result = 1;
+    }
+    DoneWithOpenFile(id);
+    return result;
+}
+
 int FileSystem::CloseFile(OpenFileId id){
     if(id < 0 || id >= 20) return -1;
-    if(openFileTable[id] == NULL) return -1;
-
+    openFileLock->Acquire();
     OpenFile *ClosedFile = openFileTable[id];
-    openFileTable[id] = NULL;
+    if (ClosedFile == NULL || openFileClosed[id]) {
+        openFileLock->Release();
+        return -1; // not open, or another thread is closing it
+    }
+    openFileClosed[id] = TRUE;  // no new users
+    while (openFileUsers[id] > 0)
+        openFileDone->Wait(openFileLock);
+    openFileTable[id] = NULL;   // the slot is free from now on
+    openFileClosed[id] = FALSE;
+    openFileLock->Release();
 
+    bool flushed = ClosedFile->Flush(); // the data held back may not fit
     delete ClosedFile; //Close(ClosedFile);
 
+    return flushed ? 1 : -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenDirectory/CloseDirectory
+// 	Open a handle on directory "name" (an absolute path), for
+//	OpenAt, CreateAt and RemoveAt to look paths up from, and close
+//	it.  The handle keeps the directory's lock, and while it is open
+//	the directory can't be removed, so its header sector can't be
+//	taken by another file.  Return the handle, or -1 if "name" is
+//	not a directory or there are too many handles; CloseDirectory
+//	returns 1, or -1 if "id" is not a handle.
+//----------------------------------------------------------------------
+
+int FileSystem::OpenDirectory(char *name)
+{
+    int sector = FindDirectory(name);
+    FileLock *lock;
+    int id = -1;
+
+    if (sector == -1 || (lock = LockFile(sector)) == NULL)
+        return -1; // no such directory, or removed meanwhile
+    openFileLock->Acquire();
+    for (int i = 0; i < 20; i++)
+        if (dirHandleTable[i] == NULL)
+        {
+            dirHandleTable[i] = lock;
+            id = i;
+            break;
+        }
+    openFileLock->Release();
+    if (id == -1)
+    {
+        UnlockFile(lock);
+        return -1; // no free slot
+    }
+    lock->handles++;
+    kernel->fileLocks->Get(sector); // the handle's own reference
+    UnlockFile(lock);
+    return id;
+}
+
+int FileSystem::CloseDirectory(int id)
+{
+    FileLock *lock;
+
+    if (id < 0 || id >= 20) return -1;
+    openFileLock->Acquire();
+    lock = dirHandleTable[id];
+    dirHandleTable[id] = NULL;
+    openFileLock->Release();
+    if (lock == NULL) return -1;
+
+    lock->rw->AcquireWrite(); // Remove reads "handles" holding it
+    lock->handles--;
+    UnlockFile(lock);
     return 1;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::HandleBase
+// 	Return the sector of the directory header a path given to
+//	OpenAt, CreateAt or RemoveAt starts from, and copy the path to
+//	"path", with a leading '/', as CreateIn and the others take it.
+//	As with UNIX openat, an absolute "name" starts from the root,
+//	whatever "id" is.  Return -1 if "id" is not a directory handle,
+//	or if the path doesn't fit in the 256 bytes of "path".
+//----------------------------------------------------------------------
+
+int FileSystem::HandleBase(int id, char *name, char *path)
+{
+    int base = -1;
+
+    if (name[0] == '/')
+    {
+        if (strlen(name) > 255) return -1;
+        strcpy(path, name);
+        return DirectorySector;
+    }
+    if (strlen(name) > 254) return -1;
+    path[0] = '/';
+    strcpy(path + 1, name);
+    if (id < 0 || id >= 20) return -1;
+    openFileLock->Acquire();
+    if (dirHandleTable[id] != NULL)
+        base = dirHandleTable[id]->sector;
+    openFileLock->Release();
+    return base;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenAt/CreateAt/RemoveAt
+// 	OpenAFile, Create and Remove for the syscalls of the same names:
+//	"name" is a path from the directory that handle "id" is open on,
+//	so a program working deep in the tree doesn't walk down to it
+//	from the root every time.  Return what OpenAFile, Create and
+//	Remove do; -1 (0 for CreateAt and RemoveAt) for a bad handle.
+//----------------------------------------------------------------------
+
+OpenFileId FileSystem::OpenAt(int id, char *name)
+{
+    char path[256];
+    int base = HandleBase(id, name, path);
+
+    if (base == -1) return -1;
+    return AddOpenFile(OpenIn(base, path));
+}
+
+int FileSystem::CreateAt(int id, char *name, int size)
+{
+    char path[256];
+    int base = HandleBase(id, name, path);
+
+    if (base == -1) return 0;
+    return CreateIn(base, path, size, FALSE);
+}
+
+int FileSystem::RemoveAt(int id, char *name)
+{
+    char path[256];
+    int base = HandleBase(id, name, path);
+
+    if (base == -1) return 0;
+    return RemoveIn(base, path);
+}
+
 #endif // FILESYS_STUB
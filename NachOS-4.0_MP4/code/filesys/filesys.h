@@ -37,12 +37,24 @@
 #include "sysdep.h"
 #include "openfile.h"
 #include "directory.h"
+#include "list.h"
+#include "extent.h"
 
 #define NumDirEntries 64
 #define DirectoryFileSize (sizeof(DirectoryEntry) * NumDirEntries)
 
 typedef int OpenFileId;
 
+class PersistentBitmap;
+class FileHeader;
+class FileLock;
+class Lock;
+class Condition;
+class SnapshotTable;
+class DedupTable;
+class OrphanList;
+class FreeExtents;
+
 #ifdef FILESYS_STUB // Temporarily implement file system calls as
 // calls to UNIX, until the real file system
 // implementation is available
@@ -84,25 +96,61 @@ public:
 class FileSystem
 {
 public:
-	FileSystem(bool format); // Initialize the file system.
+	FileSystem(bool format, int clusterSectors = 1);
+							 // Initialize the file system.
 							 // Must be called *after* "synchDisk"
 							 // has been initialized.
 							 // If "format", there is nothing on
 							 // the disk, so initialize the directory
-							 // and the bitmap of free blocks.
+							 // and the bitmap of free blocks, with
+							 // clusters of "clusterSectors" sectors.
 	// MP4 mod tag
 	~FileSystem();
 
-	int Create(char *name, int initialSize, bool isDir);
-	// Create a file (UNIX creat)
+	int Create(char *name, int initialSize, bool isDir, bool indexed = FALSE,
+			   bool compressed = FALSE);
+	// Create a file (UNIX creat); a
+	//  directory may be indexed, a
+	//  file compressed
 
 	OpenFile *Open(char *name); // Open a file (UNIX open)
 
 	bool Remove(char *name); // Delete a file (UNIX unlink)
+	int Rename(char *from, char *to); // Give a file or directory a new
+									  //  name, maybe in another
+									  //  directory (UNIX rename)
+
+	bool Fallocate(char *name, int length, bool keepSize);
+							 // Reserve contiguous space for a
+							 //  file (Linux fallocate)
+	bool GrowFile(FileHeader *hdr, int hdrSector, int length,
+				  int reserved = 0);
+							 // Add data blocks to an open,
+							 //  locked file, maybe into
+							 //  sectors reserved for it
+	bool ReserveSectors(int count); // Set free sectors aside for
+									//  data not allocated yet
+	void Defragment(char *traceName, char *modelSpec);
+							 // Move fragmented files into
+							 //  contiguous runs, and report
+							 //  what it saves on a trace
+	void FragmentationReport();	 // Print how fragmented the files
+							 //  and the free space are
+	void SetAllocation(AllocPolicy policy);
+							 // Choose where new runs of
+							 //  clusters go (see extent.h)
 
 	void List(char *name); // List all the files in the target directory
 
 	void RecursiveList(char* name); // List all the files and directories under the target directory
+
+	int ReadDir(char *name, DirectoryInfo *entries, int count, int *cursor);
+									// Copy out a batch of the entries of
+									//  directory "name", from "*cursor" on
+
+	Directory *FetchDirectory(char *name); // Read directory "name" into
+										   //  memory, NULL if it is not
+										   //  a directory; caller deletes it
 	
 	void Print(); // List all the files and their contents
 
@@ -112,10 +160,56 @@ public:
 
 	OpenFileId OpenAFile(char *name); // Open a file (System call)
 
+	int SeekFile(int position, OpenFileId id); // Move the position of an open file
+
 	int CloseFile(OpenFileId id); // Close a file
 
+	int OpenDirectory(char *name); // Open a handle on a directory,
+								   //  to look paths up from
+	int CloseDirectory(int id);	   // Close a directory handle
+	OpenFileId OpenAt(int id, char *name); // Open, Create and Remove
+	int CreateAt(int id, char *name, int size); // a path from a
+	int RemoveAt(int id, char *name);	   //  directory handle (UNIX
+										   //  openat, unlinkat)
+
 	// int CreateDirectory(char*name); // Create new directory
 
+	int NumFreeSectors(); // How many sectors are not in use
+	void ReclaimOrphans(); // Free the files removed so far now,
+						   //  rather than in the background
+
+	void PrintStats(bool json); // Print the I/O counters of every file
+								//  opened by name, as a table or JSON
+
+	void BeginBatch(); // Keep the free map and the root directory in
+					   // memory across Create/Remove calls
+	void EndBatch();   // Write them back once, and stop batching
+
+	bool TakeSnapshot(char *name);	 // Freeze the file system as it
+									 //  is now (see snapshot.h)
+	bool DeleteSnapshot(char *name); // Forget a snapshot, freeing the
+									 //  sectors only it needed
+	bool ViewSnapshot(char *name);	 // Read a snapshot, instead of
+									 //  the live file system, from
+									 //  now on
+	void ListSnapshots();			 // Print the snapshots
+	bool SetDedup(bool on);			 // Share the sectors of data
+									 //  blocks written with the same
+									 //  bytes, or stop (see dedup.h)
+	void DedupReport();				 // Print what sharing saves
+	DedupTable *Dedup() { return dedup; } // Where data blocks go
+
+	PersistentBitmap *FetchFreeMap(); // Get the free map for an
+									  //  operation, locked; a thread
+									  //  that holds it already (the
+									  //  snapshots copying a sector
+									  //  in the middle of an
+									  //  operation) gets the same one
+	void ReleaseFreeMap(PersistentBitmap *freeMap, bool modified);
+									  // Done with it; write it back
+									  // if "modified", now or at
+									  // the end of the batch
+
 private:
 	OpenFile *freeMapFile;	 // Bit map of free disk blocks,
 							 // represented as a file
@@ -123,6 +217,79 @@ private:
 							 // file names, represented as a file
 	OpenFile *openFileTable[20]; 	 // Current opening files
 							 // indexed by OpenFileId
+	int openFileUsers[20];	 // Reads, writes and seeks under
+							 // way on each
+	bool openFileClosed[20]; // Being closed: no new users, and
+							 // Close waits for the ones left
+	FileLock *dirHandleTable[20];	 // Locks of the directories
+							 // handles are open on
+	OpenFileId AddOpenFile(OpenFile *openFile);
+							 // Put a file in openFileTable
+	OpenFile *UseOpenFile(OpenFileId id);
+	void DoneWithOpenFile(OpenFileId id);
+							 // Look an OpenFileId up, so that
+							 // a Close meanwhile doesn't
+							 // delete the file, and let go
+	int HandleBase(int id, char *name, char *path);
+							 // Where a path given with a
+							 // directory handle starts
+
+	int CreateIn(int base, char *name, int initialSize, bool isDir,
+				 bool indexed = FALSE, bool compressed = FALSE);
+	OpenFile *OpenIn(int base, char *name);
+	bool RemoveIn(int base, char *name);
+							 // Create, Open and Remove, from
+							 // the directory whose header is
+							 // at "base"
+	int FindAt(int base, char *name, bool *isDir);
+							 // Look a path up from a directory
+
+	::List<FileStats *> *fileStats; // I/O counters of files opened by name
+									// (:: since List is also a method)
+	FileStats *StatsFor(char *name); // Find (or start) the counters of
+									 //  file "name"
+
+	PersistentBitmap *batchFreeMap; // In-core free map and root
+	Directory *batchRoot;			 // directory while batching,
+	bool batchFreeMapDirty;		 // NULL otherwise
+	bool batchRootDirty;
+
+	Directory *FetchRoot();			  // The same for the root
+	void ReleaseRoot(Directory *directory, bool modified);
+									  // directory
+	Directory *FetchDirectoryAt(int sector, OpenFile **dirFile);
+	void ReleaseDirectoryAt(Directory *directory, OpenFile *dirFile,
+							bool modified);
+									  // The same for any directory,
+									  // with the file to write it to
+									  // (NULL for the root)
+	int FindDirectory(char *name);	  // Sector of a directory's header
+	int FindDirectoryAt(int base, char *name);
+
+	Lock *freeMapLock;				  // Held from FetchFreeMap to
+									  //  ReleaseFreeMap
+	PersistentBitmap *heldFreeMap;	  // What FetchFreeMap returned,
+	int heldFreeMapUsers;			  //  how many more times, and if
+	bool heldFreeMapDirty;			  //  they modified it
+	int freeSectors;				  // Free in the map on disk, -1
+									  //  until counted
+	int reservedSectors;			  // Of those, set aside by
+									  //  ReserveSectors
+	SnapshotTable *snapshots;		  // Generations and snapshots
+	DedupTable *dedup;				  // Sector reference counts
+	OrphanList *orphans;			  // Removed files still to free
+	FreeExtents *extents;			  // Runs of free clusters
+	Lock *openFileLock;				  // Protects openFileTable
+	Condition *openFileDone;		  // Signaled when the last user of
+									  //  a file being closed is done
+	FileLock *LockFile(int sector);	  // Lock a file or directory for
+	void UnlockFile(FileLock *lock);  //  writing, and let go of it
+	FileLock *LockDirectory(char *name);
+	FileLock *LockDirectoryAt(int base, char *name);
+	bool LockDirectories(char *first, char *second,
+						 FileLock **firstLock, FileLock **secondLock);
+									  // Find and lock directories, in
+									  //  the order of filelock.h
 };
 
 #endif // FILESYS
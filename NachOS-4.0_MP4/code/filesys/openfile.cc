@@ -17,30 +17,87 @@
 #include "filehdr.h"
 #include "openfile.h"
 #include "synchdisk.h"
+#include "filelock.h"
+#include "compress.h"
+#include "filesys.h"
+#include "dedup.h"
 
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+//	into memory while the file is open, and the chunk map too, if the
+//	file is compressed.  Keep the lock of the file too: other opens
+//	of it change the header on disk, and its version tells us so.
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 
 OpenFile::OpenFile(int sector)
 {
+    int headerReads = kernel->stats->diskReads[HeaderIO];
+
+    fileLock = kernel->fileLocks->Get(sector);
+    hdrVersion = fileLock->version; // before the read: a change in
+                                    //  between is read again later
     hdr = new FileHeader;
     hdr->FetchFrom(sector);
+    hdrSector = sector;
+    packed = hdr->IsCompressed() ? new CompressedFile(hdr, sector) : NULL;
     seekPosition = 0;
+    category = DataIO;
+    totals = NULL;
+    pending = NULL;
+    pendingStart = pendingBytes = pendingReserved = 0;
+    stats.headerReads += kernel->stats->diskReads[HeaderIO] - headerReads;
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
-// 	Close a Nachos file, de-allocating any in-memory data structures.
+// 	Close a Nachos file, de-allocating any in-memory data structures,
+//	after writing out the data it holds back.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
+    Flush();
+    if (pending != NULL)
+        delete[] pending;
+    FlushStats();
+    if (packed != NULL)
+        delete packed;
     delete hdr;
+    kernel->fileLocks->Put(fileLock);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::SetCategory
+// 	Say what this file holds, so that its disk requests are counted
+//	under the right category.  Directories and the free map are
+//	files too, but their I/O isn't "data".
+//----------------------------------------------------------------------
+
+void OpenFile::SetCategory(DiskCategory what)
+{
+    category = what;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::SetTotals/FlushStats
+// 	The counters of an OpenFile are added into "fileTotals" when the
+//	file is closed, or earlier by FlushStats.
+//----------------------------------------------------------------------
+
+void OpenFile::SetTotals(FileStats *fileTotals)
+{
+    totals = fileTotals;
+}
+
+void OpenFile::FlushStats()
+{
+    if (totals == NULL)
+        return;
+    totals->Add(&stats);
+    stats.Clear();
 }
 
 //----------------------------------------------------------------------
@@ -97,6 +154,8 @@ int OpenFile::Write(char *into, int numBytes)
 //	   We read in all of the full or partial sectors that are part of the
 //	   request, but we only copy the part we are interested in.
 //	For WriteAt:
+//	   A write that starts at or before the end of the file may grow
+//	   the file, into sectors reserved for it by FileSystem::Fallocate.
 //	   We must first read in any sectors that will be partially written,
 //	   so that we don't overwrite the unmodified portion.  We then copy
 //	   in the data that will be modified, and write back all the full
@@ -107,14 +166,104 @@ int OpenFile::Write(char *into, int numBytes)
 //	"numBytes" -- the number of bytes to transfer
 //	"position" -- the offset within the file of the first byte to be
 //			read/written
+//
+//	Reads hold the lock of the file for reading, and writes for
+//	writing, so a read never sees part of a write, and a write that
+//	grows the file does it alone.
+//
+//	A compressed file is read and written a chunk at a time by its
+//	CompressedFile instead (see compress.h).  The data blocks of any
+//	other file are written where the deduplication table says, which
+//	may not be where they were (see dedup.h).
 //----------------------------------------------------------------------
 
 int OpenFile::ReadAt(char *into, int numBytes, int position)
+{
+    int result;
+
+    if (fileLock->version != hdrVersion)
+    {   // another open grew the file: read its header first
+        fileLock->rw->AcquireWrite();
+        Refresh();
+        fileLock->rw->ReleaseWrite();
+    }
+    fileLock->rw->AcquireRead();
+    result = ReadLocked(into, numBytes, position);
+    fileLock->rw->ReleaseRead();
+    return result;
+}
+
+int OpenFile::WriteAt(char *from, int numBytes, int position)
+{
+    int result = 0;
+
+    fileLock->rw->AcquireWrite();
+    if (Refresh())
+        result = WriteLocked(from, numBytes, position);
+    fileLock->rw->ReleaseWrite();
+    return result;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Refresh/WriteHeader
+// 	Each OpenFile has its own copy of the header, and another open of
+//	the file (or Fallocate) may have grown the file since it was
+//	read.  Writing back a stale copy would cut off what the other
+//	one added, and reading with it would miss that, so before a read
+//	or a write Refresh reads the header again if its version went up.  Data in the write buffer
+//	was meant for the end of the file as it was, which has blocks
+//	now, so it is flushed into them.  Return FALSE if that fails.
+//
+//	WriteHeader writes our copy back, with a new version for the
+//	others.  The caller holds the file for writing.
+//
+//	A compressed file keeps its chunk map as well as the header, and
+//	is not read again.
+//----------------------------------------------------------------------
+
+bool OpenFile::Refresh()
+{
+    if (fileLock->version == hdrVersion || packed != NULL)
+        return TRUE;
+    DEBUG(dbgFile, "Header of the file at " << hdrSector << " changed");
+    hdrVersion = fileLock->version;
+    hdr->FetchFrom(hdrSector);
+    stats.headerReads++;
+    if (pendingBytes > 0 && pendingStart != hdr->Capacity())
+        return FlushLocked();
+    return TRUE;
+}
+
+void OpenFile::WriteHeader()
+{
+    hdr->WriteBack(hdrSector);
+    hdrVersion = ++fileLock->version;
+}
+
+int OpenFile::ReadLocked(char *into, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
+    int *sectors, headerReads;
     char *buf;
 
+    if (packed != NULL)
+        return packed->ReadAt(into, numBytes, position, &stats);
+    if (pendingBytes > 0 && numBytes > 0 && position + numBytes > pendingStart)
+    {   // some of it is still in the write buffer
+        int start = max(position, pendingStart);
+        int end = min(position + numBytes, pendingStart + pendingBytes);
+        int result = 0;
+
+        if (start >= end)
+            return 0;
+        if (position < pendingStart)
+            result = ReadLocked(into, pendingStart - position, position);
+        bcopy(&pending[start - pendingStart], &into[start - position],
+              end - start);
+        stats.bytesRead += end - start;
+        return result + end - start;
+    }
     if ((numBytes <= 0) || (position >= fileLength))
         return 0; // check request
     if ((position + numBytes) > fileLength)
@@ -127,11 +276,18 @@ int OpenFile::ReadAt(char *into, int numBytes, int position)
 
     DEBUG(dbgFile, "FirstSector: " << firstSector << ", LastSector: " << lastSector);
 
-    // read in all the full and partial sectors that we need
+    // read in all the full and partial sectors that we need, in one
+    // request so that sectors on different disks are read in parallel
     buf = new char[numSectors * SectorSize];
+    sectors = new int[numSectors];
+    headerReads = kernel->stats->diskReads[HeaderIO];
     for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize),
-                                      &buf[(i - firstSector) * SectorSize]);
+        sectors[i - firstSector] = hdr->ByteToSector(i * SectorSize);
+    stats.headerReads += kernel->stats->diskReads[HeaderIO] - headerReads;
+    kernel->synchDisk->ReadSectors(sectors, numSectors, buf, category);
+    stats.sectorsRead += numSectors;
+    stats.bytesRead += numBytes;
+    delete[] sectors;
 
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
@@ -140,15 +296,29 @@ int OpenFile::ReadAt(char *into, int numBytes, int position)
     return numBytes;
 }
 
-int OpenFile::WriteAt(char *from, int numBytes, int position)
+int OpenFile::WriteLocked(char *from, int numBytes, int position)
 {
     // DEBUG(dbgFile, "In OpenFile::WriteAt(): get file length");
     int fileLength = hdr->FileLength();
     // DEBUG(dbgFile, "In OpenFile::WriteAt(): out get file length " << fileLength);
     int i, firstSector, lastSector, numSectors;
     bool firstAligned, lastAligned;
+    int *sectors, headerReads, bytesRead, done;
     char *buf;
+    DedupTable *dedup = NULL;
 
+    if (packed != NULL)
+        return packed->WriteAt(from, numBytes, position, &stats);
+    if (category == DataIO && numBytes > 0 && position <= Length() &&
+        position + numBytes > hdr->Capacity())
+        return WriteGrowing(from, numBytes, position);
+    if ((numBytes > 0) && (position <= fileLength) &&
+        ((position + numBytes) > fileLength) && (hdr->Capacity() > fileLength))
+    {   // append into space reserved past the end (see FileHeader::Reserve)
+        fileLength = min(position + numBytes, hdr->Capacity());
+        hdr->SetLength(fileLength);
+        WriteHeader();
+    }
     if ((numBytes <= 0) || (position >= fileLength))
         return 0; // check request
     if ((position + numBytes) > fileLength)
@@ -167,31 +337,290 @@ int OpenFile::WriteAt(char *from, int numBytes, int position)
     lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
 
     // read in first and last sector, if they are to be partially modified
+    // (the sectors count as read, but the bytes were not read by our user)
+    bytesRead = stats.bytesRead;
     if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);
+        ReadLocked(buf, SectorSize, firstSector * SectorSize);
     if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize],
+        ReadLocked(&buf[(lastSector - firstSector) * SectorSize],
                SectorSize, lastSector * SectorSize);
+    stats.bytesRead = bytesRead;
 
     // copy in the bytes we want to change
     bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
 
     // write modified sectors back
+    sectors = new int[numSectors];
+    headerReads = kernel->stats->diskReads[HeaderIO];
     for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize),
-                                       &buf[(i - firstSector) * SectorSize]);
+        sectors[i - firstSector] = hdr->ByteToSector(i * SectorSize);
+    stats.headerReads += kernel->stats->diskReads[HeaderIO] - headerReads;
+    if (category == DataIO && kernel->fileSystem != NULL)
+        dedup = kernel->fileSystem->Dedup();
+    if (dedup != NULL && !dedup->Involves(sectors, numSectors))
+        dedup = NULL; // off, and none of them shared: write in place
+    if (dedup == NULL)
+    {
+        kernel->synchDisk->WriteSectors(sectors, numSectors, buf, category);
+        stats.sectorsWritten += numSectors;
+    }
+    else
+    {
+        done = WriteBlocks(dedup, sectors, numSectors, buf, firstSector);
+        if (done < numSectors) // the disk is full
+            numBytes = max(0, min(numBytes, done * SectorSize -
+                                  (position - firstSector * SectorSize)));
+    }
+    stats.bytesWritten += numBytes;
+    delete[] sectors;
     delete[] buf;
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::WriteGrowing
+// 	Write "numBytes" bytes at "position", past the data blocks of the
+//	file: what falls within them is written as usual, and the rest
+//	goes to the write buffer, reserving the sectors (data and chained
+//	headers) it will need.  A full buffer is flushed, and the write
+//	goes on.  Return the number of bytes written: fewer than asked
+//	if the disk can't hold more.
+//----------------------------------------------------------------------
+
+int OpenFile::WriteGrowing(char *from, int numBytes, int position)
+{
+    int capacity = hdr->Capacity();
+    int done = 0, inFile, start, end, need;
+
+    if (position < capacity)
+    {   // the part that has blocks already
+        done = WriteLocked(from, capacity - position, position);
+        if (done < capacity - position)
+            return done;
+    }
+    inFile = done;
+    if (pending == NULL)
+        pending = new char[WriteBufferSectors * SectorSize];
+    if (pendingBytes == 0)
+        pendingStart = capacity;
+    ASSERT(pendingStart == capacity && hdr->FileLength() == capacity);
+
+    start = position + done - pendingStart;
+    end = min(position + numBytes - pendingStart,
+              WriteBufferSectors * SectorSize);
+    if (end > start)
+    {
+        need = FileHeader::SectorsNeeded(pendingStart +
+                                         divRoundUp(end, SectorSize) * SectorSize)
+               - FileHeader::SectorsNeeded(pendingStart) - pendingReserved;
+        if (need > 0)
+        {
+            if (!kernel->fileSystem->ReserveSectors(need))
+                return done; // the disk is full
+            pendingReserved += need;
+        }
+        if (end > pendingBytes)
+            memset(&pending[pendingBytes], 0, end - pendingBytes);
+        bcopy(&from[done], &pending[start], end - start);
+        pendingBytes = max(pendingBytes, end);
+        stats.bytesWritten += end - start;
+        done += end - start;
+    }
+    if (done < numBytes)
+    {   // the buffer is full
+        if (!FlushLocked())
+            return inFile; // what was buffered is lost
+        done += WriteLocked(&from[done], numBytes - done, position + done);
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Flush
+// 	Allocate data blocks for what the write buffer holds, all at
+//	once, and write it there.  The sectors were reserved as it was
+//	written, so this shouldn't run out of room; if it does all the
+//	same, the buffered data is dropped, and FALSE returned.
+//----------------------------------------------------------------------
+
+bool OpenFile::Flush()
+{
+    bool success;
+
+    if (pendingBytes == 0)
+        return TRUE;
+    fileLock->rw->AcquireWrite();
+    success = Refresh() && FlushLocked();
+    fileLock->rw->ReleaseWrite();
+    return success;
+}
+
+bool OpenFile::FlushLocked()
+{
+    int bytes = pendingBytes, bytesWritten = stats.bytesWritten;
+    bool success;
+
+    if (bytes == 0)
+        return TRUE;
+    DEBUG(dbgFile, "Flushing " << bytes << " bytes at " << pendingStart);
+    success = kernel->fileSystem->GrowFile(hdr, hdrSector, pendingStart + bytes,
+                                           pendingReserved);
+    pendingBytes = pendingReserved = 0; // so the write goes to the blocks,
+                                        //  or, failing, is dropped; the
+                                        //  reservation is given back
+                                        //  either way
+    if (!success)
+    {
+        DEBUG(dbgFile, "No room to flush " << bytes << " bytes");
+        return FALSE;
+    }
+    hdrVersion = fileLock->version; // GrowFile wrote our header
+    WriteLocked(pending, bytes, pendingStart);
+    stats.bytesWritten = bytesWritten; // counted when they were buffered
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::WriteBlocks
+// 	Write "numSectors" data blocks, from block "firstSector" of the
+//	file on, now at "sectors", with the contents in "buf" -- DedupPool
+//	of them at a time, since that is what the deduplication table
+//	takes.  The table says which go to another sector, and which need
+//	not be written at all; the header is changed to match, and written
+//	back if it changed.
+//
+//	Return how many blocks were written: fewer than "numSectors" if
+//	the disk is full.
+//----------------------------------------------------------------------
+
+int OpenFile::WriteBlocks(DedupTable *dedup, int *sectors, int numSectors,
+                          char *buf, int firstSector)
+{
+    int *original = new int[numSectors];
+    bool *write = new bool[numSectors];
+    int *targets = new int[DedupPool];
+    char *data = new char[DedupPool * SectorSize];
+    bool hdrChanged = FALSE;
+    int i, j, n, count;
+
+    memcpy(original, sectors, numSectors * sizeof(int));
+    for (i = 0; i < numSectors; i += n)
+    {
+        n = min(DedupPool, numSectors - i);
+        if (!dedup->Place(&sectors[i], n, &buf[i * SectorSize], &write[i]))
+            break;
+        count = 0;
+        for (j = i; j < i + n; j++)
+        {
+            if (sectors[j] != original[j] &&
+                hdr->Remap((firstSector + j) * SectorSize, sectors[j]))
+                hdrChanged = TRUE;
+            if (write[j])
+            {
+                targets[count] = sectors[j];
+                bcopy(&buf[j * SectorSize], &data[count * SectorSize],
+                      SectorSize);
+                count++;
+            }
+        }
+        if (count > 0)
+            kernel->synchDisk->WriteSectors(targets, count, data, category);
+        stats.sectorsWritten += count;
+        dedup->Written(&sectors[i], n, &buf[i * SectorSize], &write[i]);
+    }
+    if (hdrChanged)
+        WriteHeader();
+    delete[] original;
+    delete[] write;
+    delete[] targets;
+    delete[] data;
+    return min(i, numSectors);
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
-// 	Return the number of bytes in the file.
+// 	Return the number of bytes in the file, counting what other
+//	opens of it have appended (see OpenFile::Refresh).
 //----------------------------------------------------------------------
 
 int OpenFile::Length()
 {
-    return hdr->FileLength();
+    int length;
+
+    fileLock->rw->AcquireWrite();
+    Refresh();
+    if (pendingBytes > 0)
+        length = pendingStart + pendingBytes;
+    else
+        length = hdr->ContentLength();
+    fileLock->rw->ReleaseWrite();
+    return length;
+}
+
+//----------------------------------------------------------------------
+// FileStats::FileStats
+// 	Initialize the counters of a file to zero.
+//
+//	"fileName" -- name to report them under, or NULL
+//----------------------------------------------------------------------
+
+FileStats::FileStats(char *fileName)
+{
+    name = NULL;
+    if (fileName != NULL)
+    {
+        name = new char[strlen(fileName) + 1];
+        strcpy(name, fileName);
+    }
+    Clear();
+}
+
+FileStats::~FileStats()
+{
+    if (name != NULL)
+        delete[] name;
+}
+
+//----------------------------------------------------------------------
+// FileStats::Add/Clear
+// 	Accumulate the counters of "other" into ours; reset ours.
+//----------------------------------------------------------------------
+
+void FileStats::Add(FileStats *other)
+{
+    bytesRead += other->bytesRead;
+    bytesWritten += other->bytesWritten;
+    sectorsRead += other->sectorsRead;
+    sectorsWritten += other->sectorsWritten;
+    headerReads += other->headerReads;
+    directoryReads += other->directoryReads;
+}
+
+void FileStats::Clear()
+{
+    bytesRead = bytesWritten = 0;
+    sectorsRead = sectorsWritten = 0;
+    headerReads = directoryReads = 0;
+}
+
+//----------------------------------------------------------------------
+// FileStats::Print
+// 	Print the counters as one row of the table printed by
+//	FileSystem::PrintStats, or as a JSON object.
+//----------------------------------------------------------------------
+
+void FileStats::Print(bool json)
+{
+    if (json)
+        printf("{\"name\": \"%s\", \"bytesRead\": %d, \"bytesWritten\": %d, "
+               "\"sectorsRead\": %d, \"sectorsWritten\": %d, "
+               "\"headerReads\": %d, \"directoryReads\": %d}",
+               name, bytesRead, bytesWritten, sectorsRead, sectorsWritten,
+               headerReads, directoryReads);
+    else
+        printf("  %-20s %10d %10d %8d %8d %8d %8d\n", name, bytesRead,
+               bytesWritten, sectorsRead, sectorsWritten, headerReads,
+               directoryReads);
 }
 
 #endif //FILESYS_STUB
@@ -9,9 +9,20 @@
 //
 //	The other is the "real" implementation, that turns these
 //	operations into read and write disk sector requests.
-//	In this baseline implementation of the file system, we don't
-//	worry about concurrent accesses to the file system
-//	by different threads.
+//	Each ReadAt or WriteAt holds the lock of the file for as long as
+//	it takes (see filelock.h), so threads can share a file; but the
+//	position used by Read and Write belongs to one OpenFile, which
+//	threads should not share.
+//
+//	A write may append to a file past the data blocks it has.  The
+//	new data is kept in a buffer in the OpenFile, with only a count
+//	of sectors reserved for it (see FileSystem::ReserveSectors), and
+//	blocks are allocated for all of it at once when the buffer fills
+//	or the file is flushed or closed, in one run if the disk has one
+//	(delayed allocation).  A write fails, rather than the flush, if
+//	the disk can't hold it.  Until the flush, only this OpenFile sees
+//	the data, so a file should not grow through one OpenFile while
+//	another reads it.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -73,7 +84,38 @@ private:
 };
 
 #else // FILESYS
+#include "stats.h"
+
 class FileHeader;
+class CompressedFile;
+class DedupTable;
+class FileLock;
+
+#define WriteBufferSectors 128 // data held back for delayed allocation
+
+// The following class counts the I/O done on behalf of one Nachos file.
+// Each OpenFile keeps its own counts while it is open; files opened by
+// name also have a FileStats kept by the file system, which collects the
+// counts of every open of that name (see FileSystem::PrintStats).
+
+class FileStats
+{
+public:
+	FileStats(char *fileName = NULL); // All counters start at zero
+	~FileStats();
+
+	void Add(FileStats *other); // Add the counters of "other" to ours
+	void Clear();				// Reset the counters to zero
+	void Print(bool json);		// One table row, or one JSON object
+
+	char *name;			// File name, if opened by name
+	int bytesRead;		// Bytes read and written by the
+	int bytesWritten;	//  users of the file
+	int sectorsRead;	// Data sectors moved to do that
+	int sectorsWritten;
+	int headerReads;	// File header sectors read
+	int directoryReads; // Directory sectors read to find the file
+};
 
 class OpenFile
 {
@@ -101,9 +143,55 @@ public:
 				  // than the UNIX idiom -- lseek to
 				  // end of file, tell, lseek back
 
+	bool Flush(); // Allocate blocks for the data written past the
+				  // end of the file, and write it out;
+				  // FALSE if the disk had no room left
+
+	void SetCategory(DiskCategory what); // Count our disk requests as
+										 //  "what" (data by default)
+	FileStats *Stats() { return &stats; } // I/O done through this OpenFile
+	void SetTotals(FileStats *fileTotals); // Where to add our counts
+	void FlushStats();					   // Add them there now
+
 private:
 	FileHeader *hdr;  // Header for this file
+	int hdrSector;	  // Where it is on disk, to write it
+					  //  back when the file grows
 	int seekPosition; // Current position within the file
+	CompressedFile *packed; // How to read and write the file,
+							//  if it is compressed; NULL if not
+
+	DiskCategory category; // What our disk requests are for
+	FileStats stats;	   // Counters since the last FlushStats
+	FileStats *totals;	   // Counters for the file as a whole, or NULL
+
+	char *pending;		   // Data past the blocks of the file, not
+						   //  allocated yet (WriteBufferSectors
+						   //  of it), or NULL
+	int pendingStart;	   // Where in the file it starts: what the
+						   //  blocks of the file hold
+	int pendingBytes;	   // How much of it there is
+	int pendingReserved;   // Sectors reserved for it
+
+	FileLock *fileLock;	   // Lock of the file, ours while it is open
+	int hdrVersion;		   // fileLock->version when "hdr" was read
+	bool Refresh();		   // Read "hdr" again if another OpenFile
+						   //  (or Fallocate) changed it; FALSE if
+						   //  the write buffer couldn't be flushed
+	void WriteHeader();	   // Write "hdr" back, and say it changed
+
+	int ReadLocked(char *into, int numBytes, int position);
+	int WriteLocked(char *from, int numBytes, int position);
+						   // ReadAt/WriteAt, with the file
+						   //  locked already
+	int WriteGrowing(char *from, int numBytes, int position);
+						   // WriteLocked, for a write past the
+						   //  blocks of the file
+	bool FlushLocked();	   // Flush, with the file locked already
+	int WriteBlocks(DedupTable *dedup, int *sectors, int numSectors,
+					char *buf, int firstSector);
+						   // Write data blocks where "dedup"
+						   //  says; how many it found room for
 };
 
 #endif // FILESYS
@@ -0,0 +1,228 @@
+// orphan.cc
+//	Routines to keep the orphan list, and to free the files on it.
+//	See orphan.h.
+//
+//	The list is small (4KB), so it is read whole when the file system
+//	is mounted, and each change writes just the sectors it touched:
+//	the entry, then the count at the start of the file.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "orphan.h"
+#include "pbitmap.h"
+#include "filehdr.h"
+#include "filesys.h"
+#include "synchdisk.h"
+#include "thread.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// ReclaimThread
+// 	Entry point of the thread that frees orphans, so that Fork can
+//	call OrphanList::Run.
+//----------------------------------------------------------------------
+
+static void ReclaimThread(OrphanList *list)
+{
+    list->Run();
+}
+
+//----------------------------------------------------------------------
+// OrphanList::OrphanList
+// 	Read the orphan list.  The thread that frees orphans is only
+//	started once a file is added.
+//
+//	"fileSystem" -- where to fetch the free map from
+//	"sector" -- header of the orphan list's file
+//----------------------------------------------------------------------
+
+OrphanList::OrphanList(FileSystem *fileSystem, int sector)
+{
+    char buf[SectorSize];
+
+    this->fileSystem = fileSystem;
+    hdr = new FileHeader;
+    hdr->FetchFrom(sector);
+    lock = new Lock("orphan list");
+    reclaimer = NULL;
+    work = new Semaphore("orphans to free", 0);
+
+    kernel->synchDisk->ReadSector(hdr->ByteToSector(0), buf, OrphanIO);
+    memcpy(&count, buf, sizeof(int));
+    orphans = new int[MaxOrphans];
+    for (int i = 0; i < count; i += OrphansPerSector)
+        kernel->synchDisk->ReadSector(
+            hdr->ByteToSector((1 + i / OrphansPerSector) * SectorSize),
+            (char *)&orphans[i], OrphanIO);
+    DEBUG(dbgFile, "Orphan list: " << count << " files to free");
+}
+
+OrphanList::~OrphanList()
+{
+    delete hdr;
+    delete lock;
+    delete work;
+    delete[] orphans;
+}
+
+//----------------------------------------------------------------------
+// OrphanList::Format
+// 	Allocate the orphan list's file on a disk being formatted, and
+//	write its count: no entries, so none of the rest need be.
+//
+//	"freeMap" -- the free map of the new file system
+//	"sector" -- where to put the header
+//----------------------------------------------------------------------
+
+void OrphanList::Format(PersistentBitmap *freeMap, int sector)
+{
+    FileHeader *hdr = new FileHeader;
+    char buf[SectorSize];
+
+    freeMap->Mark(sector);
+    ASSERT(hdr->Allocate(freeMap, OrphanFileSize));
+    hdr->WriteBack(sector);
+    memset(buf, 0, sizeof(buf));
+    kernel->synchDisk->WriteSector(hdr->ByteToSector(0), buf, OrphanIO);
+    delete hdr;
+}
+
+//----------------------------------------------------------------------
+// OrphanList::WriteEntry
+// 	Write the sector holding entry "i", if it is in use, and then the
+//	count: an entry added is on disk before the count covers it.
+//----------------------------------------------------------------------
+
+void OrphanList::WriteEntry(int i)
+{
+    char buf[SectorSize];
+    int first = i - i % OrphansPerSector;
+
+    if (i < count)
+        kernel->synchDisk->WriteSector(
+            hdr->ByteToSector((1 + i / OrphansPerSector) * SectorSize),
+            (char *)&orphans[first], OrphanIO);
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, &count, sizeof(int));
+    kernel->synchDisk->WriteSector(hdr->ByteToSector(0), buf, OrphanIO);
+}
+
+//----------------------------------------------------------------------
+// OrphanList::Add
+// 	Put a removed file on the list, and wake up the thread that frees
+//	orphans (starting it, the first time).  The file must be out of
+//	its directory on disk already, so a crash can't free a file that
+//	still has a name.  Return FALSE if the list is full; the caller
+//	then frees the file itself.
+//
+//	"sector" -- the file's header
+//----------------------------------------------------------------------
+
+bool OrphanList::Add(int sector)
+{
+    lock->Acquire();
+    if (count == MaxOrphans)
+    {
+        lock->Release();
+        return FALSE;
+    }
+    orphans[count++] = sector;
+    WriteEntry(count - 1);
+    if (reclaimer == NULL)
+    {
+        reclaimer = new Thread("orphan reclaimer", kernel->threadNum++);
+        reclaimer->Fork((VoidFunctionPtr)ReclaimThread, (void *)this);
+    }
+    lock->Release();
+    work->V();
+    DEBUG(dbgFile, "Orphaned the file with header " << sector);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OrphanList::Reclaim
+// 	Free up to ReclaimHeaders headers of the chain of the last file
+//	on the list, and their data blocks.  The entry moves on to the
+//	header after them (or goes, if there is none) on disk first, and
+//	only then does the free map change, so a crash in between leaks
+//	the batch rather than freeing it twice.
+//
+//	Return FALSE if the list was empty.
+//----------------------------------------------------------------------
+
+bool OrphanList::Reclaim()
+{
+    FileHeader *batch[ReclaimHeaders];
+    int sectors[ReclaimHeaders];
+    PersistentBitmap *freeMap;
+    int n, i;
+
+    lock->Acquire();
+    if (count == 0)
+    {
+        lock->Release();
+        return FALSE;
+    }
+    i = count - 1;
+    sectors[0] = orphans[i];
+    for (n = 0; n < ReclaimHeaders && sectors[n] != -1; n++)
+    {
+        batch[n] = new FileHeader;
+        batch[n]->FetchFrom(sectors[n]);
+        if (n + 1 < ReclaimHeaders)
+            sectors[n + 1] = batch[n]->NextSector();
+    }
+    orphans[i] = batch[n - 1]->NextSector();
+    if (orphans[i] == -1)
+        count--;
+    WriteEntry(i);
+
+    freeMap = fileSystem->FetchFreeMap();
+    for (int j = 0; j < n; j++)
+    {
+        batch[j]->DeallocateOwn(freeMap);
+        ASSERT(freeMap->Test(sectors[j]));
+        freeMap->Clear(sectors[j]);
+        delete batch[j];
+    }
+    fileSystem->ReleaseFreeMap(freeMap, TRUE);
+    DEBUG(dbgFile, "Freed " << n << " headers of an orphan, "
+                   << count << " files left to free");
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OrphanList::ReclaimAll
+// 	Free every file on the list before returning: when the file
+//	system is mounted, and when a caller needs an exact count of
+//	free sectors.
+//----------------------------------------------------------------------
+
+void OrphanList::ReclaimAll()
+{
+    while (Reclaim())
+        ;
+}
+
+//----------------------------------------------------------------------
+// OrphanList::Run
+// 	Free orphans for as long as Nachos runs.  Nachos threads have no
+//	priorities, so the thread gives way to the others after every
+//	batch instead; with nothing to free, it waits for Add.  A thread
+//	waiting doesn't keep Nachos from halting.
+//----------------------------------------------------------------------
+
+void OrphanList::Run()
+{
+    for (;;)
+    {
+        work->P();
+        while (Reclaim())
+            kernel->currentThread->Yield();
+    }
+}
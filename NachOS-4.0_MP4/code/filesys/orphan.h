@@ -0,0 +1,83 @@
+// orphan.h
+//	Data structures for freeing the sectors of removed files in the
+//	background.
+//
+//	Removing a big file used to free every one of its sectors before
+//	Remove returned.  Now Remove just takes the name out of its
+//	directory, and puts the file's header sector on the orphan list,
+//	a file of its own next to the free map; a kernel thread frees the
+//	file afterwards, a batch of chained headers at a time, yielding to
+//	other threads between batches.
+//
+//	Each entry of the list is the first header of the chain still to
+//	free.  A batch moves the entry on to the header after the ones it
+//	frees, and writes the list, before it clears them in the free map:
+//	a crash in between can only leak the batch, never free sectors
+//	twice.  Mounting the file system frees whatever is still on the
+//	list, so a crash leaves nothing half reclaimed.
+//
+//	When the list is full, Remove frees the file itself, as before.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef ORPHAN_H
+#define ORPHAN_H
+
+#include "copyright.h"
+#include "disk.h"
+#include "synch.h"
+
+class FileHeader;
+class FileSystem;
+class PersistentBitmap;
+class Thread;
+
+#define MaxOrphans 1024    // files waiting to be freed
+#define ReclaimHeaders 64  // chained headers (each with up to NumDirect
+                           //  data sectors) freed per batch
+
+#define OrphansPerSector ((int)(SectorSize / sizeof(int)))
+#define OrphanFileSize ((1 + MaxOrphans / OrphansPerSector) * SectorSize)
+
+// The following class keeps the orphan list, and the thread that
+// empties it.  FileSystem::Remove adds to it.  Its lock comes after
+// the file locks, and before the free map lock (see filelock.h).
+
+class OrphanList
+{
+public:
+    OrphanList(FileSystem *fileSystem, int sector);
+                       // Read the list whose file has its header at
+                       //  "sector"
+    ~OrphanList();
+
+    static void Format(PersistentBitmap *freeMap, int sector);
+                       // Allocate and write an empty list, on a disk
+                       //  being formatted
+
+    bool Add(int sector); // Free the file whose header is at "sector"
+                          //  in the background; FALSE if the list is
+                          //  full
+    bool Reclaim();       // Free one batch; FALSE if there was nothing
+                          //  to free
+    void ReclaimAll();    // Free everything on the list, right now
+    int NumOrphans() { return count; }
+
+    void Run();           // Body of the reclaiming thread
+
+private:
+    FileSystem *fileSystem; // To fetch the free map
+    FileHeader *hdr;        // Header of the orphan list's file
+    Lock *lock;             // Protects all of the below
+
+    int count;              // Entries of "orphans" in use
+    int *orphans;           // First header still to free, of each file
+    Thread *reclaimer;      // The reclaiming thread, once started
+    Semaphore *work;        // Signalled when a file is added
+
+    void WriteEntry(int i); // Write entry "i", and the count, to disk
+};
+
+#endif // ORPHAN_H
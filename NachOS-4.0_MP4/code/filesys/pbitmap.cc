@@ -8,19 +8,31 @@
 
 #include "copyright.h"
 #include "pbitmap.h"
+#include "snapshot.h"
+#include "dedup.h"
+#include "extent.h"
+
+int ClusterSectors = 1;
 
 //----------------------------------------------------------------------
 // PersistentBitmap::PersistentBitmap(int)
 // 	Initialize a bitmap with "numItems" bits, so that every bit is clear.
 //	it can be added somewhere on a list.
 //
-//	"numItems" is the number of bits in the bitmap.
+//	"numItems" is the number of sectors the bitmap covers; there is
+//	a bit for each cluster of them.
 //
 //      This constructor does not initialize the bitmap from a disk file
 //----------------------------------------------------------------------
 
-PersistentBitmap::PersistentBitmap(int numItems) : Bitmap(numItems)
+PersistentBitmap::PersistentBitmap(int numItems)
+    : Bitmap(numItems / ClusterSectors)
 {
+    snapshots = NULL;
+    dedup = NULL;
+    extents = NULL;
+    reserved = 0;
+    changed = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -28,18 +40,25 @@ PersistentBitmap::PersistentBitmap(int numItems) : Bitmap(numItems)
 // 	Initialize a persistent bitmap with "numItems" bits,
 //      so that every bit is clear.
 //
-//	"numItems" is the number of bits in the bitmap.
+//	"numItems" is the number of sectors the bitmap covers.
 //      "file" refers to an open file containing the bitmap (written
 //        by a previous call to PersistentBitmap::WriteBack
 //
 //      This constructor initializes the bitmap from a disk file
 //----------------------------------------------------------------------
 
-PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems) : Bitmap(numItems)
+PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems)
+    : Bitmap(numItems / ClusterSectors)
 {
     // map has already been initialized by the BitMap constructor,
     // but we will just overwrite that with the contents of the
     // map found in the file
+    snapshots = NULL;
+    dedup = NULL;
+    extents = NULL;
+    reserved = 0;
+    changed = FALSE;
+    file->SetCategory(BitmapIO);
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
 }
 
@@ -61,7 +80,9 @@ PersistentBitmap::~PersistentBitmap()
 
 void PersistentBitmap::FetchFrom(OpenFile *file)
 {
+    file->SetCategory(BitmapIO);
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    changed = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -73,5 +94,119 @@ void PersistentBitmap::FetchFrom(OpenFile *file)
 
 void PersistentBitmap::WriteBack(OpenFile *file)
 {
+    if (snapshots != NULL)
+        snapshots->Flush();
+    if (dedup != NULL)
+        dedup->Flush();
+    file->SetCategory(BitmapIO);
     file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    changed = FALSE;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Mark/FindAndSet
+// 	Allocate the cluster of a sector (a free one, chosen as
+//	FindContiguous would), as Bitmap does, and give it the current
+//	write generation of the snapshot table, if there is one.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::Mark(int which)
+{
+    Bitmap::Mark(which / ClusterSectors);
+    changed = TRUE;
+    if (extents != NULL)
+        extents->Allocated(which / ClusterSectors);
+    if (snapshots != NULL)
+        snapshots->Allocated(which);
+}
+
+int PersistentBitmap::FindAndSet()
+{
+    int which = FindRun(1, -1);
+
+    if (which < 0)
+        return -1;
+    which *= ClusterSectors;
+    Mark(which);
+    return which;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindContiguous
+// 	Return the first sector of a run of free clusters that holds
+//	"count" sectors, or -1 if there is none.  Without the extents,
+//	it is the lowest run; with them, the run their policy picks,
+//	near sector "near" if that is >= 0 (see extent.h).
+//----------------------------------------------------------------------
+
+int PersistentBitmap::FindContiguous(int count, int near) const
+{
+    int which = FindRun(divRoundUp(count, ClusterSectors),
+                        (near < 0) ? -1 : near / ClusterSectors);
+
+    return (which < 0) ? -1 : which * ClusterSectors;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindRun
+// 	Return the first of "count" free clusters in a row, or -1.  With
+//	the extents, whatever they say goes: every change to the bitmap
+//	is passed on to them, so a run they don't know of is not there.
+//----------------------------------------------------------------------
+
+int PersistentBitmap::FindRun(int count, int near) const
+{
+    int which;
+
+    if (extents == NULL)
+        return Bitmap::FindContiguous(count);
+    which = extents->Find(count, near);
+    for (int i = 0; which >= 0 && i < count; i++)
+        ASSERT(!Bitmap::Test(which + i)); // out of step with the bitmap
+    return which;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Clear
+// 	Free the cluster of a sector, unless other data blocks still share it, or a
+//	snapshot still sees it; then it stays allocated until the last
+//	block lets go of it, or the snapshot is deleted.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::Clear(int which)
+{
+    if (dedup != NULL && dedup->Freed(which))
+        return;
+    if (snapshots != NULL && snapshots->Freed(this, which))
+        return;
+    ClearSpare(which);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindAndSetSpare/ClearSpare
+// 	Allocate (free) a sector the snapshots keep for themselves, a
+//	copy of an old block or one of their pool, as Bitmap does: it
+//	has no generation to set, and no snapshot or other block to
+//	keep it.  The extents still hear of it.
+//----------------------------------------------------------------------
+
+int PersistentBitmap::FindAndSetSpare()
+{
+    int which = FindRun(1, -1);
+
+    if (which < 0)
+        return -1;
+    Bitmap::Mark(which);
+    changed = TRUE;
+    if (extents != NULL)
+        extents->Allocated(which);
+    return which * ClusterSectors;
+}
+
+void PersistentBitmap::ClearSpare(int which)
+{
+    Bitmap::Clear(which / ClusterSectors);
+    changed = TRUE;
+    if (extents != NULL)
+        extents->Freed(which / ClusterSectors);
 }
@@ -15,11 +15,33 @@
 
 #include "copyright.h"
 #include "bitmap.h"
+#include "disk.h"
 #include "openfile.h"
 
+class SnapshotTable;
+class DedupTable;
+class FreeExtents;
+
+// Disk space is allocated a cluster at a time: ClusterSectors
+// consecutive sectors, starting at a multiple of ClusterSectors.  It
+// is a power of two, chosen when the disk is formatted (see
+// FileSystem::FileSystem); 1 unless asked otherwise.
+extern int ClusterSectors;
+#define MaxClusterSectors 32
+#define ClusterSize (ClusterSectors * SectorSize)
+
 // The following class defines a persistent bitmap.  It inherits all
 // the behavior of a bitmap (see bitmap.h), adding the ability to
-// be read from and stored to the disk.
+// be read from and stored to the disk.  The free map also tells the
+// snapshots (see snapshot.h) which sectors it allocates and frees, and
+// the deduplication table (see dedup.h) which it frees, and the free
+// extents (see extent.h) both, and finds runs through them.  Sectors set
+// aside for data not yet written (see OpenFile::Flush) don't count as
+// clear.
+//
+// There is a bit for each cluster, but the interface is in sectors:
+// a cluster is marked (cleared, tested) by any of its sectors, and
+// the sectors returned are the first of their clusters.
 
 class PersistentBitmap : public Bitmap
 {
@@ -31,6 +53,43 @@ public:
 
     void FetchFrom(OpenFile *file); // read bitmap from the disk
     void WriteBack(OpenFile *file); // write bitmap contents to disk
+
+    void SetSnapshots(SnapshotTable *table) { snapshots = table; }
+    void SetDedup(DedupTable *table) { dedup = table; }
+    void SetExtents(FreeExtents *index) { extents = index; }
+                                    // tell "table" ("index") about
+                                    //  changes
+    void SetReserved(int count) { reserved = count; }
+                                    // "count" free sectors are spoken
+                                    //  for already
+    int NumFree() { return Bitmap::NumClear() * ClusterSectors; }
+                                    // free sectors
+    int NumClear() { return NumFree() - reserved; }
+                                    // free sectors nobody reserved
+    bool Test(int which) const { return Bitmap::Test(which / ClusterSectors); }
+    int FindContiguous(int count, int near = -1) const;
+                                    // as in Bitmap, but in sectors,
+                                    //  and placed by the extents'
+                                    //  policy, near "near" if >= 0
+    void Mark(int which);           // as in Bitmap, but a sector a
+    void Clear(int which);          // snapshot still sees, or other
+    int FindAndSet();               // blocks share, is not cleared
+    int FindAndSetSpare();          // as in Bitmap, for the snapshots'
+    void ClearSpare(int which);     //  own copies and pool: only the
+                                    //  extents are told
+    bool Changed() { return changed; }
+                                    // marked or cleared since it was
+                                    //  read or written back
+
+private:
+    SnapshotTable *snapshots;       // or NULL
+    DedupTable *dedup;              // or NULL
+    FreeExtents *extents;           // or NULL
+    int reserved;                   // free sectors reserved
+    bool changed;
+
+    int FindRun(int count, int near) const;
+                                    // FindContiguous, in clusters
 };
 
 #endif // PBITMAP_H
@@ -0,0 +1,581 @@
+// snapshot.cc
+//	Routines to keep the generation of every sector, and to take,
+//	delete and read filesystem snapshots.  See snapshot.h.
+//
+//	The generation map is 1MB, so it is read a sector at a time, the
+//	first time a sector it covers is allocated, written or freed.  The
+//	records and the list of snapshots are read whole when the file
+//	system is mounted.  Everything that changes is written back with
+//	the free map, or, after copies, right away.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "snapshot.h"
+#include "pbitmap.h"
+#include "filehdr.h"
+#include "filesys.h"
+#include "synchdisk.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// TableIO
+// 	Read or write "count" sectors of the file whose header is "hdr",
+//	from sector "first" of the file on, to or from "data".
+//----------------------------------------------------------------------
+
+static void TableIO(FileHeader *hdr, int first, int count, char *data,
+                    bool writing)
+{
+    int *sectors = new int[count];
+
+    for (int i = 0; i < count; i++)
+        sectors[i] = hdr->ByteToSector((first + i) * SectorSize);
+    if (writing)
+        kernel->synchDisk->WriteSectors(sectors, count, data, SnapshotIO);
+    else
+        kernel->synchDisk->ReadSectors(sectors, count, data, SnapshotIO);
+    delete[] sectors;
+}
+
+//----------------------------------------------------------------------
+// WriteChanged
+// 	Write back the sectors of "data" marked in "dirty" (which has
+//	"numSectors" bits), as sectors "first" on of the file whose header
+//	is "hdr", and clear their marks.
+//----------------------------------------------------------------------
+
+static void WriteChanged(FileHeader *hdr, int first, char *data,
+                         Bitmap *dirty, int numSectors)
+{
+    int count = numSectors - dirty->NumClear();
+    int *sectors;
+    char *buf;
+
+    if (count == 0)
+        return;
+    sectors = new int[count];
+    buf = new char[count * SectorSize];
+    count = 0;
+    for (int i = 0; i < numSectors; i++)
+        if (dirty->Test(i))
+        {
+            sectors[count] = hdr->ByteToSector((first + i) * SectorSize);
+            memcpy(&buf[count * SectorSize], &data[i * SectorSize], SectorSize);
+            dirty->Clear(i);
+            count++;
+        }
+    kernel->synchDisk->WriteSectors(sectors, count, buf, SnapshotIO);
+    delete[] sectors;
+    delete[] buf;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::SnapshotTable
+// 	Read the snapshot table (but not the generation map, which is
+//	read as it is needed).
+//
+//	"fileSystem" -- where to fetch the free map from
+//	"genSector" -- header of the generation map
+//	"tableSector" -- header of the snapshot table
+//----------------------------------------------------------------------
+
+SnapshotTable::SnapshotTable(FileSystem *fileSystem, int genSector,
+                             int tableSector)
+{
+    char buf[SnapshotHeadSectors * SectorSize];
+
+    this->fileSystem = fileSystem;
+    genHdr = new FileHeader;
+    genHdr->FetchFrom(genSector);
+    tableHdr = new FileHeader;
+    tableHdr->FetchFrom(tableSector);
+    lock = new Lock("snapshot table");
+
+    gens = new unsigned short[NumSectors];
+    genLoaded = new Bitmap(NumSectors / GensPerSector);
+    genDirty = new Bitmap(NumSectors / GensPerSector);
+
+    TableIO(tableHdr, 0, SnapshotHeadSectors, buf, FALSE);
+    memcpy((char *)&head, buf, sizeof(SnapshotHead));
+    preserved = new PreservedSector[MaxPreserved];
+    if (head.numPreserved > 0)
+        TableIO(tableHdr, SnapshotHeadSectors,
+                divRoundUp(head.numPreserved, RecordsPerSector),
+                (char *)preserved, FALSE);
+    headDirty = FALSE;
+    recordDirty = new Bitmap(MaxPreserved / RecordsPerSector);
+    viewGen = -1;
+    DEBUG(dbgFile, "Snapshot table: " << head.numSnapshots << " snapshots, "
+                   << head.numPreserved << " preserved sectors, generation "
+                   << head.currentGen);
+}
+
+SnapshotTable::~SnapshotTable()
+{
+    delete genHdr;
+    delete tableHdr;
+    delete lock;
+    delete[] gens;
+    delete genLoaded;
+    delete genDirty;
+    delete[] preserved;
+    delete recordDirty;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Format
+// 	Allocate the generation map and the snapshot table on a disk being
+//	formatted, and write them: no snapshots, and generation 0 for every
+//	sector in use so far.  The generations of the other sectors are
+//	set when they are allocated, so the rest of the map is not written.
+//
+//	"freeMap" -- the free map of the new file system
+//	"genSector", "tableSector" -- where to put the two headers
+//----------------------------------------------------------------------
+
+void SnapshotTable::Format(PersistentBitmap *freeMap, int genSector,
+                           int tableSector)
+{
+    FileHeader *genHdr = new FileHeader;
+    FileHeader *tableHdr = new FileHeader;
+    char head[SnapshotHeadSectors * SectorSize];
+    int numGenSectors = NumSectors / GensPerSector;
+    int *sectors = new int[numGenSectors];
+    char *zeros;
+    int count = 0;
+
+    freeMap->Mark(genSector);
+    freeMap->Mark(tableSector);
+    ASSERT(genHdr->Allocate(freeMap, GenMapFileSize));
+    ASSERT(tableHdr->Allocate(freeMap, SnapshotFileSize));
+    genHdr->WriteBack(genSector);
+    tableHdr->WriteBack(tableSector);
+
+    memset(head, 0, sizeof(head));
+    ((SnapshotHead *)head)->currentGen = 1;
+    TableIO(tableHdr, 0, SnapshotHeadSectors, head, TRUE);
+
+    for (int g = 0; g < numGenSectors; g++)
+        for (int i = 0; i < GensPerSector; i++)
+            if (freeMap->Test(g * GensPerSector + i))
+            {
+                sectors[count++] = genHdr->ByteToSector(g * SectorSize);
+                break;
+            }
+    zeros = new char[count * SectorSize];
+    memset(zeros, 0, count * SectorSize);
+    kernel->synchDisk->WriteSectors(sectors, count, zeros, SnapshotIO);
+
+    delete[] zeros;
+    delete[] sectors;
+    delete genHdr;
+    delete tableHdr;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::GenOf/SetGen
+// 	Get (set) the generation of "sector", reading the sector of the
+//	generation map it is in if it isn't in memory yet.
+//----------------------------------------------------------------------
+
+int SnapshotTable::GenOf(int sector)
+{
+    int g = sector / GensPerSector;
+
+    if (!genLoaded->Test(g))
+    {
+        kernel->synchDisk->ReadSector(genHdr->ByteToSector(g * SectorSize),
+                                      (char *)&gens[g * GensPerSector],
+                                      SnapshotIO);
+        genLoaded->Mark(g);
+    }
+    return gens[sector];
+}
+
+void SnapshotTable::SetGen(int sector, int gen)
+{
+    GenOf(sector);
+    gens[sector] = gen;
+    genDirty->Mark(sector / GensPerSector);
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Find
+// 	Return the index of snapshot "name", or -1 if there is none.
+//----------------------------------------------------------------------
+
+int SnapshotTable::Find(char *name)
+{
+    for (int s = 0; s < head.numSnapshots; s++)
+        if (!strncmp(head.snapshots[s].name, name, FileNameMaxLen))
+            return s;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Shared
+// 	Return TRUE if the newest snapshot (and so maybe older ones) sees
+//	the current contents of "sector": it was last written before the
+//	snapshot was taken.
+//----------------------------------------------------------------------
+
+bool SnapshotTable::Shared(int sector)
+{
+    if (head.numSnapshots == 0)
+        return FALSE;
+    return GenOf(sector) <= head.snapshots[head.numSnapshots - 1].gen;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Sees
+// 	Return TRUE if snapshot "s" sees the contents "record" preserves.
+//----------------------------------------------------------------------
+
+bool SnapshotTable::Sees(int s, PreservedSector *record)
+{
+    return record->born <= head.snapshots[s].gen &&
+           head.snapshots[s].gen < record->died;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::AddRecord/RemoveRecord
+// 	Add a preserved sector record at the end, or remove record "i" by
+//	moving the last one into its place.
+//----------------------------------------------------------------------
+
+void SnapshotTable::AddRecord(int sector, int copy, int born, int died)
+{
+    PreservedSector *record;
+
+    ASSERT(head.numPreserved < MaxPreserved);
+    record = &preserved[head.numPreserved];
+    record->sector = sector;
+    record->copy = copy;
+    record->born = born;
+    record->died = died;
+    recordDirty->Mark(head.numPreserved / RecordsPerSector);
+    head.numPreserved++;
+    headDirty = TRUE;
+}
+
+void SnapshotTable::RemoveRecord(int i)
+{
+    int last = --head.numPreserved;
+
+    preserved[i] = preserved[last];
+    recordDirty->Mark(i / RecordsPerSector);
+    recordDirty->Mark(last / RecordsPerSector);
+    headDirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Drop
+// 	Delete snapshot "s": give back the sectors of the records no other
+//	snapshot sees, and, with the last snapshot, the sectors kept aside
+//	for copies.  They are cleared with ClearSpare, since
+//	PersistentBitmap::Clear would ask to keep them again.
+//----------------------------------------------------------------------
+
+void SnapshotTable::Drop(int s, PersistentBitmap *freeMap)
+{
+    int i, t;
+    bool needed;
+
+    DEBUG(dbgFile, "Deleting snapshot " << head.snapshots[s].name);
+    for (i = 0; i < head.numPreserved;)
+    {
+        if (Sees(s, &preserved[i]))
+        {
+            needed = FALSE;
+            for (t = 0; t < head.numSnapshots; t++)
+                if (t != s && Sees(t, &preserved[i]))
+                    needed = TRUE;
+            if (!needed)
+            {
+                freeMap->ClearSpare(preserved[i].copy);
+                RemoveRecord(i);
+                continue; // a new record is at "i" now
+            }
+        }
+        i++;
+    }
+    for (i = s; i < head.numSnapshots - 1; i++)
+        head.snapshots[i] = head.snapshots[i + 1];
+    head.numSnapshots--;
+    if (head.numSnapshots == 0)
+    {
+        while (head.poolSize > 0)
+            freeMap->ClearSpare(head.pool[--head.poolSize]);
+    }
+    headDirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Allocated
+// 	Note that "sector" now holds data of the current generation.
+//----------------------------------------------------------------------
+
+void SnapshotTable::Allocated(int sector)
+{
+    lock->Acquire();
+    SetGen(sector, head.currentGen);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Freed
+// 	"sector" is being freed in "freeMap".  If a snapshot sees it, keep
+//	it, with a record saying its contents died now, and return TRUE.
+//	If there is no room left for the record, the oldest snapshot goes.
+//----------------------------------------------------------------------
+
+bool SnapshotTable::Freed(PersistentBitmap *freeMap, int sector)
+{
+    bool keep;
+
+    lock->Acquire();
+    while (Shared(sector) && head.numPreserved == MaxPreserved)
+    {
+        printf("Snapshot %s deleted: no room left to keep it\n",
+               head.snapshots[0].name);
+        Drop(0, freeMap);
+    }
+    keep = Shared(sector);
+    if (keep)
+        AddRecord(sector, sector, GenOf(sector), head.currentGen);
+    lock->Release();
+    return keep;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Flush
+// 	Write back the generations and records that changed since the
+//	last time, along with the free map that allocated their sectors.
+//----------------------------------------------------------------------
+
+void SnapshotTable::Flush()
+{
+    lock->Acquire();
+    WriteDirty();
+    lock->Release();
+}
+
+void SnapshotTable::WriteDirty()
+{
+    WriteChanged(genHdr, 0, (char *)gens, genDirty, NumSectors / GensPerSector);
+    WriteChanged(tableHdr, SnapshotHeadSectors, (char *)preserved, recordDirty,
+                 MaxPreserved / RecordsPerSector);
+    if (headDirty)
+    {
+        char buf[SnapshotHeadSectors * SectorSize];
+
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, (char *)&head, sizeof(SnapshotHead));
+        TableIO(tableHdr, 0, SnapshotHeadSectors, buf, TRUE);
+        headDirty = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::CopyOut
+// 	Copy the contents of "sector" to a sector of the pool, or else of
+//	"freeMap", and record that snapshots find them there.  Return
+//	FALSE if there is no sector, or no record, to spare.
+//----------------------------------------------------------------------
+
+bool SnapshotTable::CopyOut(int sector, PersistentBitmap *freeMap)
+{
+    char data[SectorSize];
+    int copy = -1;
+
+    if (head.numPreserved == MaxPreserved)
+        return FALSE;
+    if (head.poolSize > 0)
+    {
+        copy = head.pool[--head.poolSize];
+        headDirty = TRUE;
+    }
+    else if (freeMap != NULL && freeMap->NumClear() > 0)
+        copy = freeMap->FindAndSetSpare(); // not a live sector: no
+                                           // generation to set;
+                                           // and not one reserved
+    if (copy < 0)
+        return FALSE;
+
+    DEBUG(dbgFile, "Snapshot copy of sector " << sector << " to " << copy);
+    kernel->synchDisk->ReadSector(sector, data, SnapshotIO);
+    kernel->synchDisk->WriteSector(copy, data, SnapshotIO);
+    AddRecord(sector, copy, GenOf(sector), head.currentGen);
+    SetGen(sector, head.currentGen);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::BeforeWrite
+// 	Called by SynchDisk before it writes "sectors": copy aside the
+//	ones a snapshot sees, and write the records of the copies.
+//
+//	Copies come from the pool, as long as it lasts, so that a write
+//	doesn't have to read and write the whole free map for a sector
+//	or two.  Otherwise the free map is fetched (it may be held by
+//	this thread already, in the middle of an operation: FetchFreeMap
+//	hands it over again), and the pool is filled up from it.
+//----------------------------------------------------------------------
+
+void SnapshotTable::BeforeWrite(int *sectors, int count)
+{
+    PersistentBitmap *freeMap = NULL;
+    int needed = 0, i;
+
+    ASSERT(viewGen < 0); // snapshots are read-only
+    if (head.numSnapshots == 0)
+        return;
+
+    lock->Acquire();
+    for (i = 0; i < count; i++)
+        if (Shared(sectors[i]))
+            needed++;
+    if (needed == 0)
+    {
+        lock->Release();
+        return;
+    }
+    if (needed > head.poolSize || head.numPreserved + needed > MaxPreserved)
+    {
+        lock->Release(); // the free map lock comes first
+        freeMap = fileSystem->FetchFreeMap();
+        lock->Acquire();
+    }
+
+    for (i = 0; i < count; i++)
+        while (Shared(sectors[i]) && !CopyOut(sectors[i], freeMap))
+        {
+            printf("Snapshot %s deleted: no room left to keep it\n",
+                   head.snapshots[0].name);
+            Drop(0, freeMap);
+        }
+    if (freeMap != NULL && head.numSnapshots > 0)
+        while (head.poolSize < SnapshotPool &&
+               freeMap->NumClear() > 0) // not what others reserved
+        {
+            int sector = freeMap->FindAndSetSpare();
+
+            if (sector < 0)
+                break;
+            head.pool[head.poolSize++] = sector;
+            headDirty = TRUE;
+        }
+    WriteDirty();
+    lock->Release();
+    if (freeMap != NULL)
+        fileSystem->ReleaseFreeMap(freeMap, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Translate
+// 	Return the sector that holds what the snapshot being viewed sees
+//	as "sector".
+//----------------------------------------------------------------------
+
+int SnapshotTable::Translate(int sector)
+{
+    if (viewGen < 0)
+        return sector;
+    for (int i = 0; i < head.numPreserved; i++)
+        if (preserved[i].sector == sector && preserved[i].born <= viewGen &&
+            viewGen < preserved[i].died)
+            return preserved[i].copy;
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Take
+// 	Freeze the file system as it is on disk now, as snapshot "name".
+//	Return FALSE if the name is taken or too long, or there is no
+//	room for another snapshot.
+//----------------------------------------------------------------------
+
+bool SnapshotTable::Take(char *name)
+{
+    SnapshotInfo *snapshot;
+
+    lock->Acquire();
+    if (strlen(name) > FileNameMaxLen || Find(name) >= 0 ||
+        head.numSnapshots == MaxSnapshots || head.currentGen == MaxGeneration)
+    {
+        lock->Release();
+        return FALSE;
+    }
+    snapshot = &head.snapshots[head.numSnapshots++];
+    snapshot->gen = head.currentGen++;
+    strncpy(snapshot->name, name, FileNameMaxLen + 1);
+    headDirty = TRUE;
+    WriteDirty();
+    lock->Release();
+    DEBUG(dbgFile, "Took snapshot " << name << " of generation " << snapshot->gen);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::Delete
+// 	Delete snapshot "name", giving its sectors back to "freeMap".
+//	Return FALSE if there is no such snapshot.
+//----------------------------------------------------------------------
+
+bool SnapshotTable::Delete(char *name, PersistentBitmap *freeMap)
+{
+    int s;
+
+    lock->Acquire();
+    s = Find(name);
+    if (s >= 0)
+        Drop(s, freeMap);
+    lock->Release();
+    return s >= 0;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::View
+// 	From now on, have SynchDisk read snapshot "name" instead of the
+//	live file system.  Return FALSE if there is no such snapshot.
+//----------------------------------------------------------------------
+
+bool SnapshotTable::View(char *name)
+{
+    int s;
+
+    lock->Acquire();
+    s = Find(name);
+    if (s >= 0)
+        viewGen = head.snapshots[s].gen;
+    lock->Release();
+    return s >= 0;
+}
+
+//----------------------------------------------------------------------
+// SnapshotTable::List
+// 	Print every snapshot, oldest first, with how many preserved
+//	sectors it sees.
+//----------------------------------------------------------------------
+
+void SnapshotTable::List()
+{
+    lock->Acquire();
+    printf("Snapshots: %d, %d sectors preserved, generation %d\n",
+           head.numSnapshots, head.numPreserved, head.currentGen);
+    for (int s = 0; s < head.numSnapshots; s++)
+    {
+        int count = 0;
+
+        for (int i = 0; i < head.numPreserved; i++)
+            if (Sees(s, &preserved[i]))
+                count++;
+        printf("  %-10s generation %5d, %d sectors preserved\n",
+               head.snapshots[s].name, head.snapshots[s].gen, count);
+    }
+    lock->Release();
+}
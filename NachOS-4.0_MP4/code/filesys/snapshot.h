@@ -0,0 +1,175 @@
+// snapshot.h
+//	Data structures for filesystem snapshots: read-only images of the
+//	whole file system, as it was when each snapshot was taken.
+//
+//	Every sector in use has a write generation, kept alongside the
+//	free map in a file of its own (the generation map): the value
+//	the file system's generation counter had when the sector was
+//	allocated or last written.  Taking a snapshot just records the
+//	current generation under a name and moves the counter on, so it
+//	writes only the few sectors at the start of the snapshot table,
+//	whatever the size of the file system.
+//
+//	A sector whose generation is not newer than the newest snapshot
+//	is part of that snapshot (and maybe of older ones).  Before it is
+//	overwritten, its old contents are copied to a free sector, and a
+//	preserved sector record notes where they went, and between which
+//	generations they were the current contents.  When such a sector
+//	is freed, it just stays allocated, with a record that says so.
+//	The live file system keeps its sector numbers, so no header,
+//	directory or index node has to be updated when a sector is
+//	copied; reading a snapshot goes to the preserved copy of each
+//	sector that has one, and to the sector itself otherwise.
+//
+//	Deleting a snapshot gives back the sectors of records that no
+//	other snapshot can see.
+//
+//	There are at most MaxSnapshots snapshots, and MaxPreserved
+//	records.  When the records, or the disk, run out, the oldest
+//	snapshot is deleted to make room, as a volume manager drops a
+//	snapshot that overflows.  Generations are 16 bits, so about
+//	65000 snapshots can be taken over the life of a disk.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "copyright.h"
+#include "bitmap.h"
+#include "disk.h"
+#include "directory.h"
+#include "synch.h"
+
+class FileHeader;
+class FileSystem;
+class PersistentBitmap;
+
+#define MaxSnapshots 16     // snapshots kept at once
+#define MaxPreserved 8192   // preserved sector records
+#define SnapshotPool 32     // sectors kept aside for copies, so that
+                            // most copies need not fetch the free map
+#define MaxGeneration 65535 // generations are unsigned shorts
+
+#define GensPerSector ((int)(SectorSize / sizeof(unsigned short)))
+#define GenMapFileSize (NumSectors * (int)sizeof(unsigned short))
+#define RecordsPerSector ((int)(SectorSize / sizeof(PreservedSector)))
+
+// One snapshot, as stored in the snapshot table.
+
+class SnapshotInfo
+{
+public:
+    int gen;                       // Generation it froze
+    char name[FileNameMaxLen + 3]; // '\0' terminated, padded to a word
+};
+
+// Where the contents of one sector, as some snapshots see it, went.
+
+class PreservedSector
+{
+public:
+    int sector; // Sector of the live file system
+    int copy;   // Where its contents are kept (maybe "sector" itself,
+                //  if it was freed rather than overwritten)
+    int born;   // Generation the contents were written in
+    int died;   // Generation they were replaced (or freed) in: the
+                //  snapshots with born <= gen < died see them
+};
+
+// The start of the snapshot table; the records follow, from sector
+// SnapshotHeadSectors of the table's file on.
+
+class SnapshotHead
+{
+public:
+    int currentGen;                 // Generation of writes right now
+    int numSnapshots;               // Entries of "snapshots" in use,
+    SnapshotInfo snapshots[MaxSnapshots]; // oldest first
+    int numPreserved;               // Records in use
+    int poolSize;                   // Entries of "pool" in use
+    int pool[SnapshotPool];         // Free sectors taken for copies
+};
+
+#define SnapshotHeadSectors ((int)divRoundUp(sizeof(SnapshotHead), SectorSize))
+#define SnapshotFileSize ((SnapshotHeadSectors + MaxPreserved / RecordsPerSector) \
+                          * SectorSize)
+
+// The following class keeps the generation map and the snapshot table.
+// PersistentBitmap tells it what is allocated and freed, SynchDisk
+// what is about to be written or read, and FileSystem takes, deletes
+// and mounts snapshots through it.  Its lock comes after the free map
+// lock (see filelock.h).
+
+class SnapshotTable
+{
+public:
+    SnapshotTable(FileSystem *fileSystem, int genSector, int tableSector);
+                       // Read the table whose files have their headers
+                       //  at "genSector" and "tableSector"
+    ~SnapshotTable();
+
+    static void Format(PersistentBitmap *freeMap, int genSector,
+                       int tableSector);
+                       // Allocate and write an empty table, on a disk
+                       //  being formatted
+
+    void Allocated(int sector); // "sector" was just allocated
+    bool Freed(PersistentBitmap *freeMap, int sector);
+                       // "sector" is being freed; TRUE if a snapshot
+                       //  needs it, so it must stay allocated
+    void Flush();      // The free map is being written back: write
+                       //  back what changed with it
+
+    void BeforeWrite(int *sectors, int count);
+                       // Copy aside what snapshots see of "sectors",
+                       //  which are about to be written
+    bool Viewing() { return viewGen >= 0; }
+    int Translate(int sector); // Where to read "sector" of the
+                               //  snapshot being viewed
+
+    bool Take(char *name);     // Freeze the file system as "name"
+    bool Delete(char *name, PersistentBitmap *freeMap);
+                               // Forget "name", freeing what only it
+                               //  needed
+    bool View(char *name);     // Read snapshot "name" from now on,
+                               //  instead of the live file system
+    void List();               // Print every snapshot
+
+private:
+    FileSystem *fileSystem; // To fetch the free map for copies
+    FileHeader *genHdr;     // Headers of the generation map and of
+    FileHeader *tableHdr;   //  the snapshot table
+    Lock *lock;             // Protects all of the below
+
+    unsigned short *gens;   // Generation of every sector, as far as
+    Bitmap *genLoaded;      //  loaded: one bit per generation map
+    Bitmap *genDirty;       //  sector, and which of them changed
+
+    SnapshotHead head;      // The table, in memory
+    PreservedSector *preserved;
+    bool headDirty;
+    Bitmap *recordDirty;    // Which sectors of records changed
+
+    int viewGen;            // Generation of the snapshot being
+                            //  viewed, or -1
+
+    int GenOf(int sector);  // Generation of "sector", loading it
+    void SetGen(int sector, int gen);
+    int Find(char *name);   // Index of snapshot "name", or -1
+    bool Shared(int sector); // Does a snapshot see "sector" as it is?
+    void AddRecord(int sector, int copy, int born, int died);
+    void RemoveRecord(int i);
+    bool Sees(int s, PreservedSector *record);
+                            // Does snapshot "s" see "record"?
+    void Drop(int s, PersistentBitmap *freeMap);
+                            // Delete snapshot "s"
+    bool CopyOut(int sector, PersistentBitmap *freeMap);
+                            // Copy "sector" aside; FALSE if there is
+                            //  no room
+    void WriteDirty();      // Write back whatever changed
+};
+
+#endif // SNAPSHOT_H
@@ -8,7 +8,8 @@
 //	Use a semaphore to synchronize the interrupt handlers with the
 //	pending requests.  And, because the physical disk can only
 //	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	exclusion.  When sectors are striped over several physical
+//	disks, each disk gets its own semaphore and lock.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -16,19 +17,80 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "snapshot.h"
+#include "main.h"
+
+// The following class holds one raw disk of a SynchDisk, together with
+// the semaphore a thread waits on for the disk's interrupt, and the lock
+// that keeps other threads from sending it a request in the meantime.
+
+class DiskUnit : public CallBackObj
+{
+public:
+    DiskUnit(int unit, char *modelSpec, bool mapImage, bool sparse);
+    ~DiskUnit();
+
+    void CallBack(); // Called by the disk device interrupt handler
+
+    Disk *disk;           // Raw disk device
+    Semaphore *semaphore; // To synchronize requesting thread
+                          // with the interrupt handler
+    Lock *lock;           // Only one read/write request
+                          // can be sent to the disk at a time
+};
 
 //----------------------------------------------------------------------
-// SynchDisk::SynchDisk
-// 	Initialize the synchronous interface to the physical disk, in turn
-//	initializing the physical disk.
+// DiskUnit::DiskUnit
+// 	Initialize one raw disk, and the synchronization around it.
 //
+//	"unit" -- which disk of the machine this is
+//	"modelSpec" -- its latency model (see diskmodel.h)
+//	"mapImage", "sparse" -- how to keep its UNIX file (see Disk)
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+DiskUnit::DiskUnit(int unit, char *modelSpec, bool mapImage, bool sparse)
 {
     semaphore = new Semaphore("synch disk", 0);
     lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    disk = new Disk(this, unit, modelSpec, mapImage, sparse);
+}
+
+DiskUnit::~DiskUnit()
+{
+    delete disk;
+    delete lock;
+    delete semaphore;
+}
+
+//----------------------------------------------------------------------
+// DiskUnit::CallBack
+// 	Disk interrupt handler.  Wake up the thread waiting for the disk
+//	request to finish.
+//----------------------------------------------------------------------
+
+void DiskUnit::CallBack()
+{
+    semaphore->V();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SynchDisk
+// 	Initialize the synchronous interface to the physical disks, in turn
+//	initializing the physical disks.
+//
+//	"numDisks" -- how many physical disks to stripe sectors over
+//	"modelSpec" -- latency model of each physical disk
+//	"mapImage" -- have the disks mmap their UNIX files
+//	"sparse" -- have the disks keep all-zero sectors out of their UNIX files
+//----------------------------------------------------------------------
+
+SynchDisk::SynchDisk(int numDisks, char *modelSpec, bool mapImage, bool sparse)
+{
+    ASSERT(numDisks >= 1 && numDisks <= MaxDisks);
+    this->numDisks = numDisks;
+    for (int i = 0; i < numDisks; i++)
+        units[i] = new DiskUnit(i, modelSpec, mapImage, sparse);
+    snapshots = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -39,9 +101,8 @@ SynchDisk::SynchDisk()
 
 SynchDisk::~SynchDisk()
 {
-    delete disk;
-    delete lock;
-    delete semaphore;
+    for (int i = 0; i < numDisks; i++)
+        delete units[i];
 }
 
 //----------------------------------------------------------------------
@@ -51,14 +112,12 @@ SynchDisk::~SynchDisk()
 //
 //	"sectorNumber" -- the disk sector to read
 //	"data" -- the buffer to hold the contents of the disk sector
+//	"category" -- what the sector holds, for the statistics
 //----------------------------------------------------------------------
 
-void SynchDisk::ReadSector(int sectorNumber, char *data)
+void SynchDisk::ReadSector(int sectorNumber, char *data, DiskCategory category)
 {
-    lock->Acquire(); // only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P(); // wait for interrupt
-    lock->Release();
+    Transfer(&sectorNumber, 1, data, FALSE, category);
 }
 
 //----------------------------------------------------------------------
@@ -68,23 +127,253 @@ void SynchDisk::ReadSector(int sectorNumber, char *data)
 //
 //	"sectorNumber" -- the disk sector to be written
 //	"data" -- the new contents of the disk sector
+//	"category" -- what the sector holds, for the statistics
 //----------------------------------------------------------------------
 
-void SynchDisk::WriteSector(int sectorNumber, char *data)
+void SynchDisk::WriteSector(int sectorNumber, char *data, DiskCategory category)
 {
-    lock->Acquire(); // only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P(); // wait for interrupt
-    lock->Release();
+    Transfer(&sectorNumber, 1, data, TRUE, category);
 }
 
 //----------------------------------------------------------------------
-// SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// SynchDisk::ReadSectors/WriteSectors
+// 	Read (write) a list of sectors into (from) a buffer.  Return only
+//	after all of them have been transferred.  Sectors on different
+//	physical disks are transferred at the same time.
+//
+//	"sectorNumbers" -- the disk sectors to transfer, in buffer order
+//	"count" -- how many sectors
+//	"data" -- the buffer, "count" * SectorSize bytes
+//	"category" -- what the sectors hold, for the statistics
 //----------------------------------------------------------------------
 
-void SynchDisk::CallBack()
+void SynchDisk::ReadSectors(int *sectorNumbers, int count, char *data,
+                            DiskCategory category)
 {
-    semaphore->V();
+    Transfer(sectorNumbers, count, data, FALSE, category);
+}
+
+void SynchDisk::WriteSectors(int *sectorNumbers, int count, char *data,
+                             DiskCategory category)
+{
+    Transfer(sectorNumbers, count, data, TRUE, category);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Locate
+// 	Find which physical disk holds "sectorNumber", and where on it.
+//----------------------------------------------------------------------
+
+void SynchDisk::Locate(int sectorNumber, int *unit, int *physical)
+{
+    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    *unit = sectorNumber % numDisks;
+    *physical = sectorNumber / numDisks;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Transfer
+// 	Carry out a list of sector requests, in rounds: each round sends
+//	every physical disk as many of its pending requests as it can take
+//	at once (its QueueDepth), and then waits until they have all
+//	finished.  Each disk sees its own requests in list order.
+//
+//	We hold the lock of every disk involved for the whole transfer.
+//	Locks are always acquired in unit order, so two transfers can't
+//	deadlock.
+//
+//	Snapshots get to see the request first, before any lock is taken:
+//	the free map, the orphan list, the snapshot table and the
+//	deduplication table themselves are not part of any snapshot, so
+//	their sectors are left alone.
+//----------------------------------------------------------------------
+
+void SynchDisk::Transfer(int *sectorNumbers, int count, char *data, bool writing,
+                         DiskCategory category)
+{
+    int *queue = new int[count]; // request indexes, grouped by unit
+    int first[MaxDisks], length[MaxDisks], next[MaxDisks];
+    int issued[MaxDisks];        // requests sent to each unit this round
+    int unit, physical, i, u, n;
+    int *viewed = NULL;          // sectors of the snapshot being viewed
+    bool busy;
+
+    if (snapshots != NULL && category != BitmapIO && category != SnapshotIO &&
+        category != DedupIO && category != OrphanIO)
+    {
+        if (writing)
+            snapshots->BeforeWrite(sectorNumbers, count);
+        else if (snapshots->Viewing())
+        {
+            viewed = new int[count];
+            for (i = 0; i < count; i++)
+                viewed[i] = snapshots->Translate(sectorNumbers[i]);
+            sectorNumbers = viewed;
+        }
+    }
+
+    if (writing)
+        kernel->stats->diskWrites[category] += count;
+    else
+        kernel->stats->diskReads[category] += count;
+
+    for (u = 0; u < numDisks; u++)
+        length[u] = 0;
+    for (i = 0; i < count; i++)
+    {
+        Locate(sectorNumbers[i], &unit, &physical);
+        length[unit]++;
+    }
+    for (u = 0; u < numDisks; u++)
+        first[u] = next[u] = (u == 0) ? 0 : first[u - 1] + length[u - 1];
+    for (i = 0; i < count; i++)
+    {
+        Locate(sectorNumbers[i], &unit, &physical);
+        queue[next[unit]++] = i;
+    }
+    for (u = 0; u < numDisks; u++)
+        next[u] = first[u]; // now: next request to send to each unit
+
+    for (u = 0; u < numDisks; u++)
+        if (length[u] > 0)
+            units[u]->lock->Acquire(); // only one disk I/O at a time
+    for (;;)
+    {
+        busy = FALSE;
+        for (u = 0; u < numDisks; u++)
+        {
+            issued[u] = 0;
+            while (issued[u] < units[u]->disk->QueueDepth() &&
+                   next[u] < first[u] + length[u])
+            {
+                i = queue[next[u]++];
+                Locate(sectorNumbers[i], &unit, &physical);
+                if (writing)
+                    units[u]->disk->WriteRequest(physical, &data[i * SectorSize]);
+                else
+                    units[u]->disk->ReadRequest(physical, &data[i * SectorSize]);
+                issued[u]++;
+                busy = TRUE;
+            }
+        }
+        if (!busy)
+            break;
+        for (u = 0; u < numDisks; u++)
+            for (n = 0; n < issued[u]; n++)
+                units[u]->semaphore->P(); // wait for interrupt
+    }
+    for (u = 0; u < numDisks; u++)
+        if (length[u] > 0)
+            units[u]->lock->Release();
+    delete[] queue;
+    if (viewed != NULL)
+        delete[] viewed;
+}
+
+//----------------------------------------------------------------------
+// UnitFileName
+// 	Put the name of physical disk "unit"'s part of the UNIX file
+//	"name" into "unitName" (256 bytes): "name" itself for the first
+//	disk, "name_<unit>" for the others.
+//----------------------------------------------------------------------
+
+static void UnitFileName(char *name, int unit, char *unitName)
+{
+    if (unit == 0)
+        strncpy(unitName, name, 255);
+    else
+        snprintf(unitName, 256, "%s_%d", name, unit);
+    unitName[255] = '\0';
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SaveSnapshot/LoadSnapshot
+// 	Save the disk to, or restore it from, the snapshot file "name",
+//	with no other request in progress.  Each physical disk has its own
+//	snapshot file, so a striped disk must be restored with the same
+//	number of disks it was saved with.
+//----------------------------------------------------------------------
+
+int SynchDisk::SaveSnapshot(char *name)
+{
+    char unitName[256];
+    int count = 0;
+
+    for (int u = 0; u < numDisks; u++)
+    {
+        UnitFileName(name, u, unitName);
+        units[u]->lock->Acquire();
+        count += units[u]->disk->SaveSnapshot(unitName);
+        units[u]->lock->Release();
+    }
+    return count;
+}
+
+bool SynchDisk::LoadSnapshot(char *name)
+{
+    char unitName[256];
+    bool success = TRUE;
+
+    for (int u = 0; u < numDisks && success; u++)
+    {
+        UnitFileName(name, u, unitName);
+        units[u]->lock->Acquire();
+        success = units[u]->disk->LoadSnapshot(unitName);
+        units[u]->lock->Release();
+    }
+    return success;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SaveDelta/ApplyDelta
+// 	Save the sectors written after generation "since" to the delta
+//	file "name", or write the sectors of delta "name" to the disk
+//	(see Disk).  Each physical disk has its own delta file, as it has
+//	its own snapshot file.  Return the number of sectors, or -1 if
+//	"since" is not over yet, or "name" is not a delta.
+//
+//	All physical disks close their generations together, so they
+//	agree on the generation numbers.
+//----------------------------------------------------------------------
+
+int SynchDisk::SaveDelta(char *name, int since)
+{
+    char unitName[256];
+    int count = 0, n;
+
+    if (since < 0 || since >= Generation())
+        return -1;
+    for (int u = 0; u < numDisks; u++)
+    {
+        UnitFileName(name, u, unitName);
+        units[u]->lock->Acquire();
+        n = units[u]->disk->SaveDelta(unitName, since);
+        units[u]->lock->Release();
+        ASSERT(n >= 0);
+        count += n;
+    }
+    return count;
+}
+
+int SynchDisk::ApplyDelta(char *name)
+{
+    char unitName[256];
+    int count = 0, n;
+
+    for (int u = 0; u < numDisks; u++)
+    {
+        UnitFileName(name, u, unitName);
+        units[u]->lock->Acquire();
+        n = units[u]->disk->ApplyDelta(unitName);
+        units[u]->lock->Release();
+        if (n < 0)
+            return -1;
+        count += n;
+    }
+    return count;
+}
+
+int SynchDisk::Generation()
+{
+    return units[0]->disk->Generation();
 }
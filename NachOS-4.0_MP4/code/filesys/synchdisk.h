@@ -12,9 +12,15 @@
 #define SYNCHDISK_H
 
 #include "disk.h"
+#include "stats.h"
 #include "synch.h"
 #include "callback.h"
 
+#define MaxDisks 8 // most raw disks a SynchDisk can stripe across
+
+class DiskUnit;
+class SnapshotTable;
+
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
 // requests to read or write portions of the disk return immediately,
@@ -25,32 +31,78 @@
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
 // returning.
+//
+// The synchronous disk may be built out of several raw disks, with
+// sectors striped across them one at a time (RAID-0): sector s lives
+// on disk s % numDisks, at sector s / numDisks.  Each raw disk has its
+// own head, latency and interrupts, so requests to different disks
+// proceed in parallel -- from different threads, or from one thread
+// using ReadSectors/WriteSectors.  With one disk, this is exactly the
+// original single-disk SynchDisk.  Raw disks whose latency model
+// takes several requests at once (flash) are kept that busy, too.
+//
+// Once the file system has a snapshot table, every write of file system
+// sectors goes by it first, to copy aside what snapshots still see, and
+// every read, while a snapshot is viewed, goes to the sectors holding
+// the snapshot's contents (see snapshot.h).
 
-class SynchDisk : public CallBackObj
+class SynchDisk
 {
 public:
-    SynchDisk();  // Initialize a synchronous disk,
-                  // by initializing the raw Disk.
+    SynchDisk(int numDisks = 1, char *modelSpec = "hdd",
+              bool mapImage = FALSE, bool sparse = FALSE);
+                  // Initialize a synchronous disk,
+                  // by initializing the raw Disks.
     ~SynchDisk(); // De-allocate the synch disk data
 
-    void ReadSector(int sectorNumber, char *data);
+    void ReadSector(int sectorNumber, char *data,
+                    DiskCategory category = DataIO);
     // Read/write a disk sector, returning
     // only once the data is actually read
     // or written.  These call
     // Disk::ReadRequest/WriteRequest and
     // then wait until the request is done.
-    void WriteSector(int sectorNumber, char *data);
+    // The request is counted in the
+    // statistics as "category".
+    void WriteSector(int sectorNumber, char *data,
+                     DiskCategory category = DataIO);
 
-    void CallBack(); // Called by the disk device interrupt
-                     // handler, to signal that the
-                     // current disk operation is complete.
+    void ReadSectors(int *sectorNumbers, int count, char *data,
+                     DiskCategory category = DataIO);
+    void WriteSectors(int *sectorNumbers, int count, char *data,
+                      DiskCategory category = DataIO);
+    // Read/write "count" sectors, not
+    // necessarily contiguous, to/from
+    // consecutive SectorSize pieces of
+    // "data", keeping every raw disk busy
+
+    int NumDisks() { return numDisks; } // How many raw disks there are
+
+    void SetSnapshots(SnapshotTable *table) { snapshots = table; }
+                                  // Have writes and reads go by "table"
+
+    int SaveSnapshot(char *name);  // Save/restore a compact copy of
+    bool LoadSnapshot(char *name); // the disk (see Disk); disk units
+                                   // after the first use "name_<unit>"
+    int SaveDelta(char *name, int since);
+    int ApplyDelta(char *name);    // Save/apply the sectors written
+                                   // after generation "since", the same
+                                   // way
+    int Generation();              // The generation being written, which
+                                   // the next snapshot or delta closes
 
 private:
-    Disk *disk;           // Raw disk device
-    Semaphore *semaphore; // To synchronize requesting thread
-                          // with the interrupt handler
-    Lock *lock;           // Only one read/write request
-                          // can be sent to the disk at a time
+    int numDisks;                 // Number of raw disks striped over
+    DiskUnit *units[MaxDisks];    // Raw disk devices, and what it takes
+                                  // to wait for each of them
+    SnapshotTable *snapshots;     // Snapshots of the file system, or NULL
+
+    void Locate(int sectorNumber, int *unit, int *physical);
+                                  // Where a sector is stored
+    void Transfer(int *sectorNumbers, int count, char *data, bool writing,
+                  DiskCategory category);
+                                  // Do the requests of ReadSectors or
+                                  // WriteSectors
 };
 
 #endif // SYNCHDISK_H
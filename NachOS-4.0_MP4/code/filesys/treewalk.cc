@@ -0,0 +1,200 @@
+// treewalk.cc
+//	Routines to walk a directory tree, prefetching a directory's
+//	headers and subdirectories in batches.  See treewalk.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "treewalk.h"
+#include "filehdr.h"
+#include "synchdisk.h"
+#include "main.h"
+
+// The following class keeps track of one directory of the walk: its
+// entries, where we are in them, and what was prefetched for them.
+
+class WalkFrame
+{
+public:
+    WalkFrame(char *path);
+    ~WalkFrame();
+
+    char path[MaxWalkPath];   // name of the directory, "" for the root
+    int numEntries;           // how many entries it has
+    int next;                 // which one Next returns next
+    DirectoryEntry *entries;  // the entries, in directory order
+    int *sizes;               // length of each entry
+    Directory **children;     // contents of each subdirectory,
+                              // until the walk enters it
+};
+
+WalkFrame::WalkFrame(char *path)
+{
+    snprintf(this->path, MaxWalkPath, "%s", strcmp(path, "/") ? path : "");
+    numEntries = next = 0;
+    entries = NULL;
+    sizes = NULL;
+    children = NULL;
+}
+
+WalkFrame::~WalkFrame()
+{
+    for (int i = 0; i < numEntries; i++)
+        delete children[i];
+    delete[] children;
+    delete[] sizes;
+    delete[] entries;
+}
+
+//----------------------------------------------------------------------
+// TreeWalk::TreeWalk
+// 	Start walking the tree below a directory.
+//
+//	"root" -- contents of the directory, which the walk now owns
+//	"rootPath" -- its absolute name, used to build the entries' paths
+//----------------------------------------------------------------------
+
+TreeWalk::TreeWalk(Directory *root, char *rootPath)
+{
+    depth = 0;
+    frames[0] = Enter(root, rootPath);
+}
+
+TreeWalk::~TreeWalk()
+{
+    for (; depth >= 0; depth--)
+        delete frames[depth];
+}
+
+//----------------------------------------------------------------------
+// TreeWalk::Enter
+// 	Set up the walk of one directory.  Read the file headers of all
+//	its entries with one batch of disk requests, to learn their
+//	lengths and where their data is, and then the contents of all
+//	its subdirectories with another.
+//
+//	"directory" -- contents of the directory
+//	"path" -- its absolute name
+//----------------------------------------------------------------------
+
+WalkFrame *TreeWalk::Enter(Directory *directory, char *path)
+{
+    WalkFrame *frame = new WalkFrame(path);
+    int sectorsPerDirectory = divRoundUp(DirectoryFileSize, SectorSize);
+    int capacity = NumDirEntries, numEntries = 0, numSectors = 0, cursor = 0;
+    int *headerSectors, *dataSectors, *sectorsRead;
+    char *headers, *contents;
+    FileHeader *hdr;
+
+    // an indexed directory may have any number of entries
+    frame->entries = new DirectoryEntry[capacity];
+    while (directory->NextEntry(&cursor, &frame->entries[numEntries]))
+        if (++numEntries == capacity)
+        {
+            DirectoryEntry *more = new DirectoryEntry[capacity * 2];
+            memcpy(more, frame->entries, capacity * sizeof(DirectoryEntry));
+            delete[] frame->entries;
+            frame->entries = more;
+            capacity *= 2;
+        }
+    delete directory;
+    frame->numEntries = numEntries;
+    frame->sizes = new int[numEntries];
+    frame->children = new Directory *[numEntries];
+    for (int i = 0; i < numEntries; i++)
+        frame->children[i] = NULL;
+    if (numEntries == 0)
+        return frame;
+
+    headerSectors = new int[numEntries];
+    for (int i = 0; i < numEntries; i++)
+        headerSectors[i] = frame->entries[i].sector;
+    headers = new char[numEntries * SectorSize];
+    kernel->synchDisk->ReadSectors(headerSectors, numEntries, headers, HeaderIO);
+
+    // a table directory is read whole; of an indexed one, only the
+    // root of the index is in its file
+    hdr = new FileHeader;
+    dataSectors = new int[numEntries * sectorsPerDirectory];
+    sectorsRead = new int[numEntries];
+    for (int i = 0; i < numEntries; i++)
+    {
+        hdr->LoadFrom(headers + i * SectorSize);
+        frame->sizes[i] = hdr->ContentLength();
+        if (frame->entries[i].isDir)
+        {
+            int n = min(sectorsPerDirectory,
+                        divRoundUp(hdr->Capacity(), SectorSize));
+            for (int j = 0; j < n; j++)
+                dataSectors[numSectors++] = hdr->ByteToSector(j * SectorSize);
+            sectorsRead[i] = n;
+        }
+    }
+
+    if (numSectors > 0)
+    {
+        contents = new char[numSectors * SectorSize];
+        kernel->synchDisk->ReadSectors(dataSectors, numSectors, contents,
+                                       DirectoryIO);
+        for (int i = 0, next = 0; i < numEntries; i++)
+        {
+            if (!frame->entries[i].isDir)
+                continue;
+            frame->children[i] = new Directory(NumDirEntries);
+            frame->children[i]->LoadFrom(contents + next * SectorSize);
+            next += sectorsRead[i];
+        }
+        delete[] contents;
+    }
+    delete[] sectorsRead;
+    delete[] dataSectors;
+    delete[] headers;
+    delete[] headerSectors;
+    delete hdr;
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// TreeWalk::Next
+// 	Return the next file or directory of the walk.  Entries of a
+//	directory come right after the directory itself.
+//
+//	"path" -- where to put the entry's absolute name (MaxWalkPath
+//		bytes); a directory whose name was cut short to fit is
+//		returned, but not entered
+//	"entry" -- where to copy its directory entry
+//	"size" -- where to put its length in bytes
+//	"depth" -- where to put its depth, 0 for entries of the root
+//----------------------------------------------------------------------
+
+bool TreeWalk::Next(char *path, DirectoryEntry *entry, int *size, int *depth)
+{
+    while (this->depth >= 0)
+    {
+        WalkFrame *frame = frames[this->depth];
+
+        if (frame->next == frame->numEntries)
+        {   // done with this directory
+            delete frame;
+            this->depth--;
+            continue;
+        }
+        int i = frame->next++;
+        *entry = frame->entries[i];
+        bool fits = snprintf(path, MaxWalkPath, "%s/%.*s", frame->path,
+                             FileNameMaxLen, entry->name) < MaxWalkPath;
+        *size = frame->sizes[i];
+        *depth = this->depth;
+        if (frame->children[i] != NULL && this->depth + 1 < MaxWalkDepth &&
+            fits)
+        {   // its entries come next
+            frames[this->depth + 1] = Enter(frame->children[i], path);
+            frame->children[i] = NULL;
+            this->depth++;
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
@@ -0,0 +1,61 @@
+// treewalk.h
+//	Data structures to walk a whole directory tree inside the kernel,
+//	visiting every file and directory below some directory, in the
+//	same (depth first) order as a recursive listing.
+//
+//	Each directory is read only once.  When the walk enters a
+//	directory, it reads the headers of all of its entries in one
+//	batch (for their sizes), and then the contents of all of its
+//	subdirectories in another, so the requests go out together --
+//	to several disks at once if the disk is striped, or to several
+//	channels of a flash device -- instead of one small directory at
+//	a time.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TREEWALK_H
+#define TREEWALK_H
+
+#include "copyright.h"
+#include "directory.h"
+
+#define MaxWalkDepth 64 // deeper directories are listed, not entered
+#define MaxWalkPath (MaxWalkDepth * (FileNameMaxLen + 1) + 1)
+                        // size of a path the walk returns; a directory
+                        //  whose path won't fit is not entered either
+
+class WalkFrame; // a directory being walked (see treewalk.cc)
+
+// The following class walks the tree below one directory.  Call Next
+// until it returns FALSE.
+
+class TreeWalk
+{
+public:
+    TreeWalk(Directory *root, char *rootPath);
+                       // Walk the tree below "root", already read
+                       // from the directory named "rootPath"; the
+                       // walk deletes "root" when done with it
+    ~TreeWalk();
+
+    bool Next(char *path, DirectoryEntry *entry, int *size, int *depth);
+                       // Return the next file or directory: its full
+                       // path (MaxWalkPath bytes), its entry, its
+                       // length, and how far
+                       // below the root it is (0 for the root's
+                       // entries).  FALSE when there are no more.
+
+private:
+    WalkFrame *frames[MaxWalkDepth]; // The directories being walked,
+                                     // from the root down
+    int depth;                       // Index of the innermost one,
+                                     // -1 when the walk is over
+
+    WalkFrame *Enter(Directory *directory, char *path);
+                       // Start on a directory, prefetching the
+                       // headers and subdirectories of its entries
+};
+
+#endif // TREEWALK_H
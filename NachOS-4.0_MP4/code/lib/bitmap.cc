@@ -142,6 +142,47 @@ int Bitmap::NumClear() const
     return count;
 }
 
+//----------------------------------------------------------------------
+// Bitmap::FindContiguous
+// 	Return the number of the first bit of the lowest run of "count"
+//	consecutive clear bits.  The bits are left untouched; the caller
+//	marks the ones it actually uses.
+//
+//	Words that are completely set are skipped a word at a time, so
+//	that searching a mostly full map stays cheap.
+//
+//	If there is no such run, return -1.
+//
+//	"count" is the length of the run we are looking for.
+//----------------------------------------------------------------------
+
+int Bitmap::FindContiguous(int count) const
+{
+    int runStart = 0, runLength = 0;
+
+    ASSERT(count > 0);
+
+    for (int i = 0; i < numBits; i++)
+    {
+        if ((i % BitsInWord) == 0 && map[i / BitsInWord] == ~0u)
+        {
+            runLength = 0;           // whole word in use, skip it
+            i += BitsInWord - 1;
+            continue;
+        }
+        if (Test(i))
+        {
+            runLength = 0;
+            continue;
+        }
+        if (runLength == 0)
+            runStart = i;
+        if (++runLength == count)
+            return runStart;
+    }
+    return -1;
+}
+
 //----------------------------------------------------------------------
 // Bitmap::Print
 // 	Print the contents of the bitmap, for debugging.
@@ -180,6 +221,8 @@ void Bitmap::SelfTest()
     ASSERT(Test(0) && Test(31));
 
     ASSERT(FindAndSet() == 1);
+    ASSERT(FindContiguous(29) == 2);  // bits 2..30 are clear
+    ASSERT(FindContiguous(30) == 32); // bit 31 breaks the first run
     Clear(0);
     Clear(1);
     Clear(31);
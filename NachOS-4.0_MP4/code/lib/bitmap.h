@@ -44,6 +44,10 @@ public:
         // effect, set the bit.
         // If no bits are clear, return -1.
     int NumClear() const; // Return the number of clear bits
+    int FindContiguous(int count) const; // Return the first bit of a run
+        // of "count" clear bits, or -1 if
+        // there is no such run.  Does not
+        // set any bits.
 
     void Print() const; // Print contents of bitmap
     void SelfTest();    // Test whether bitmap is working
@@ -33,6 +33,9 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <cerrno>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #ifdef SOLARIS
 // KMS
@@ -40,6 +43,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef LINUX	 // for fallocate() and SEEK_DATA, used with sparse files
+#include <fcntl.h>
+#endif
+
 #ifdef LINUX	 // at this point, linux doesn't support mprotect 
 #define NO_MPROT     
 #endif
@@ -149,6 +156,21 @@ UDelay(unsigned int useconds)
 
 }
 
+//----------------------------------------------------------------------
+// WallClock
+// 	Return the host's time of day, in seconds (with microseconds),
+//	to measure how long Nachos itself takes to run.
+//----------------------------------------------------------------------
+
+double
+WallClock()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1000000.0;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -299,17 +321,19 @@ PollFile(int fd)
 //----------------------------------------------------------------------
 // OpenForWrite
 // 	Open a file for writing.  Create it if it doesn't exist; truncate it 
-//	if it does already exist.  Return the file descriptor.
+//	if it does already exist.  Return the file descriptor, or error
+//	if it can't be created.
 //
 //	"name" -- file name
+//	"crashOnError" -- abort if it can't, rather than return -1
 //----------------------------------------------------------------------
 
 int
-OpenForWrite(char *name)
+OpenForWrite(char *name, bool crashOnError)
 {
     int fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0666);
 
-    ASSERT(fd >= 0); 
+    ASSERT(!crashOnError || fd >= 0); 
     return fd;
 }
 
@@ -379,6 +403,26 @@ Lseek(int fd, int offset, int whence)
     ASSERT(retVal >= 0);
 }
 
+//----------------------------------------------------------------------
+// ReadAtOffset/WriteAtOffset
+// 	Read/write characters at "offset" in an open file, in a single
+//	system call, without moving the file position.  Abort on error.
+//----------------------------------------------------------------------
+
+void
+ReadAtOffset(int fd, char *buffer, int nBytes, int offset)
+{
+    int retVal = pread(fd, buffer, nBytes, offset);
+    ASSERT(retVal == nBytes);
+}
+
+void
+WriteAtOffset(int fd, char *buffer, int nBytes, int offset)
+{
+    int retVal = pwrite(fd, buffer, nBytes, offset);
+    ASSERT(retVal == nBytes);
+}
+
 //----------------------------------------------------------------------
 // Tell
 // 	Report the current location within an open file.
@@ -420,6 +464,150 @@ Unlink(char *name)
     return unlink(name);
 }
 
+//----------------------------------------------------------------------
+// Truncate
+// 	Set the length of an open file to "length" bytes.  Anything
+//	beyond the old end of file reads as zeroes.  Abort on error.
+//----------------------------------------------------------------------
+
+void
+Truncate(int fd, int length)
+{
+    int retVal = ftruncate(fd, length);
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// PunchHole
+// 	Turn "length" bytes at "offset" of an open file into a hole, so
+//	they read as zeroes without occupying host storage.  Return FALSE
+//	if the host file system doesn't support holes.
+//----------------------------------------------------------------------
+
+bool
+PunchHole(int fd, int offset, int length)
+{
+#if defined(LINUX) && defined(FALLOC_FL_PUNCH_HOLE)
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                     offset, length) == 0;
+#else
+    return FALSE;
+#endif
+}
+
+//----------------------------------------------------------------------
+// SeekData
+// 	Return the first offset at or after "offset" in an open file that
+//	is not inside a hole, or -1 if there is no data after "offset".
+//	Without host support for this, every offset may hold data.
+//----------------------------------------------------------------------
+
+int
+SeekData(int fd, int offset)
+{
+#if defined(LINUX) && defined(SEEK_DATA)
+    off_t next = lseek(fd, offset, SEEK_DATA);
+
+    if (next < 0)
+        return (errno == ENXIO) ? -1 : offset;
+    return (int) next;
+#else
+    return offset;
+#endif
+}
+
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "length" bytes of the open file "fd" into our
+//	address space, shared with the file.  Return NULL if the host
+//	can't do it; callers are expected to fall back to read/write.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int length)
+{
+    void *addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    return (addr == MAP_FAILED) ? NULL : (char *) addr;
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Undo MapFile.  The contents stay in the file.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int length)
+{
+    (void) munmap(addr, length);
+}
+
+//----------------------------------------------------------------------
+// IsDirectory
+// 	Return TRUE if "name" exists and is a directory.
+//----------------------------------------------------------------------
+
+bool
+IsDirectory(char *name)
+{
+    struct stat info;
+
+    return stat(name, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+//----------------------------------------------------------------------
+// OpenDirectory
+// 	Open a directory for reading its entries.  Return NULL on error.
+//----------------------------------------------------------------------
+
+void *
+OpenDirectory(char *name)
+{
+    return (void *) opendir(name);
+}
+
+//----------------------------------------------------------------------
+// ReadDirectory
+// 	Return the name of the next entry in an open directory, skipping
+//	"." and "..".  The name is only valid until the next call.
+//	Return NULL when there are no more entries.
+//----------------------------------------------------------------------
+
+char *
+ReadDirectory(void *dir)
+{
+    struct dirent *entry;
+
+    while ((entry = readdir((DIR *) dir)) != NULL) {
+	if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+	    return entry->d_name;
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// CloseDirectory
+// 	Close a directory opened by OpenDirectory.
+//----------------------------------------------------------------------
+
+void
+CloseDirectory(void *dir)
+{
+    (void) closedir((DIR *) dir);
+}
+
+//----------------------------------------------------------------------
+// MakeDirectory
+// 	Create the directory "name".  Return TRUE if it exists afterwards,
+//	whether or not we were the ones to create it.
+//----------------------------------------------------------------------
+
+bool
+MakeDirectory(char *name)
+{
+    return mkdir(name, 0777) == 0 || IsDirectory(name);
+}
+
 //----------------------------------------------------------------------
 // OpenSocket
 // 	Open an interprocess communication (IPC) connection.  For now, 
@@ -24,6 +24,7 @@ extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
 extern void UDelay(unsigned int usec);// rcgood - to avoid spinners.
+extern double WallClock();		// host seconds since the epoch
 
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(void (*cleanup)(int));
@@ -43,16 +44,41 @@ extern bool PollFile(int fd);
 
 // File operations: open/read/write/lseek/close, and check for error
 // For simulating the disk and the console devices.
-extern int OpenForWrite(char *name);
+extern int OpenForWrite(char *name, bool crashOnError = TRUE);
 extern int OpenForReadWrite(char *name, bool crashOnError);
 extern void Read(int fd, char *buffer, int nBytes);
 extern int ReadPartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, char *buffer, int nBytes);
 extern void Lseek(int fd, int offset, int whence);
+extern void ReadAtOffset(int fd, char *buffer, int nBytes, int offset);
+extern void WriteAtOffset(int fd, char *buffer, int nBytes, int offset);
 extern int Tell(int fd);
 extern int Close(int fd);
 extern bool Unlink(char *name);
 
+// Sparse file support.  PunchHole zeroes a range, freeing the host
+// storage behind it if it can; it returns FALSE if the host can't, in
+// which case the caller should write zeroes.  SeekData returns the
+// first offset >= "offset" that may hold data, or -1 past the last data.
+extern void Truncate(int fd, int length);
+extern bool PunchHole(int fd, int offset, int length);
+extern int SeekData(int fd, int offset);
+
+// Map the first "length" bytes of an open file into memory, shared,
+// so that stores go to the file.  MapFile returns NULL on error.
+extern char *MapFile(int fd, int length);
+extern void UnmapFile(char *addr, int length);
+
+// Walk or create a directory of the host file system, for bulk import
+// and export.
+// ReadDirectory returns the next entry name ("." and ".." are skipped),
+// or NULL when there are no more.
+extern bool IsDirectory(char *name);
+extern void *OpenDirectory(char *name);
+extern char *ReadDirectory(void *dir);
+extern void CloseDirectory(void *dir);
+extern bool MakeDirectory(char *name);
+
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
 extern "C" {
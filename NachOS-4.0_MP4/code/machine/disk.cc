@@ -18,6 +18,7 @@
 #include "debug.h"
 #include "sysdep.h"
 #include "main.h"
+#include "disktrace.h"
 
 // We put a magic number at the front of the UNIX file representing the
 // disk, to make it less likely we will accidentally treat a useful file
@@ -27,6 +28,37 @@ const int MagicNumber = 0x456789ab;
 const int MagicSize = sizeof(int);
 const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 
+// Snapshot files start with this header, followed by "count" sector
+// numbers in increasing order, followed by the contents of those sectors.
+
+const int SnapshotMagic = 0x4e534e50;
+struct SnapshotHeader {
+    int magic;
+    int sectorSize;
+    int numSectors;
+    int count;
+};
+
+// The changed-block map is this header, followed by the generation of
+// the last write to each sector.  Delta files are laid out like
+// snapshots, with the generations they cover in the header.
+
+const int ChangeMagic = 0x4b54432e;
+struct ChangeHeader {
+    int magic;
+    int generation;
+};
+
+const int DeltaMagic = 0x544c4544;
+struct DeltaHeader {
+    int magic;
+    int sectorSize;
+    int numSectors;
+    int since;      // the sectors written after this generation ...
+    int upTo;       // ... up to and including this one
+    int count;
+};
+
 //----------------------------------------------------------------------
 // Disk::Disk()
 // 	Initialize a simulated disk.  Open the UNIX file (creating it
@@ -34,19 +66,31 @@ const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 // 	ok to treat it as Nachos disk storage.
 //
 //	"toCall" -- object to call when disk read/write request completes
+//	"unit" -- which of this machine's disks; unit 0 is DISK_<machine id>,
+//		the others are DISK_<machine id>_<unit>
+//	"modelSpec" -- name of the latency model (see diskmodel.h)
+//	"mapImage" -- map the UNIX file into memory, if the host lets us
+//	"sparse" -- keep all-zero sectors out of the UNIX file
 //----------------------------------------------------------------------
 
-Disk::Disk(CallBackObj *toCall)
+Disk::Disk(CallBackObj *toCall, int unit, char *modelSpec, bool mapImage,
+           bool sparse)
 {
     int magicNum;
     int tmp = 0;
+    bool created = FALSE;
 
     DEBUG(dbgDisk, "Initializing the disk.");
     callWhenDone = toCall;
+    model = DiskModel::Create(modelSpec);
+    ASSERT(model != NULL);
     lastSector = 0;
-    bufferInit = 0;
+    this->unit = unit;
 
-    sprintf(diskname, "DISK_%d", kernel->hostName);
+    if (unit == 0)
+        sprintf(diskname, "DISK_%d", kernel->hostName);
+    else
+        sprintf(diskname, "DISK_%d_%d", kernel->hostName, unit);
     fileno = OpenForReadWrite(diskname, FALSE);
     if (fileno >= 0)
     { // file exists, check magic number
@@ -62,19 +106,37 @@ Disk::Disk(CallBackObj *toCall)
         // need to write at end of file, so that reads will not return EOF
         Lseek(fileno, DiskSize - sizeof(int), 0);
         WriteFile(fileno, (char *)&tmp, sizeof(int));
+        created = TRUE;
     }
-    active = FALSE;
+    OpenChangeMap(created);
+
+    this->sparse = sparse;
+    image = NULL;
+    if (mapImage)
+    {
+        image = MapFile(fileno, DiskSize);
+        if (image == NULL)
+        {
+            DEBUG(dbgDisk, "Could not map " << diskname << ", using pread/pwrite.");
+        }
+    }
+    active = 0;
 }
 
 //----------------------------------------------------------------------
 // Disk::~Disk()
-// 	Clean up disk simulation, by closing the UNIX file representing the
-//	disk.
+// 	Clean up disk simulation, by unmapping and closing the UNIX file
+//	representing the disk.
 //----------------------------------------------------------------------
 
 Disk::~Disk()
 {
+    if (image != NULL)
+        UnmapFile(image, DiskSize);
     Close(fileno);
+    Close(changeFile);
+    delete[] stamps;
+    delete model;
 }
 
 //----------------------------------------------------------------------
@@ -119,17 +181,22 @@ void Disk::ReadRequest(int sectorNumber, char *data)
 
     // DEBUG(dbgFile, "Reading from sector " << sectorNumber);
 
-    ASSERT(!active); // only one request at a time
+    ASSERT(active < QueueDepth()); // only so many requests at a time
     ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
 
     DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+    ReadRaw(sectorNumber, data, 1);
     if (debug->IsEnabled('d'))
         PrintSector(FALSE, sectorNumber, data);
 
-    active = TRUE;
-    UpdateLast(sectorNumber);
+    active++;
+    model->Accept(sectorNumber, FALSE, kernel->stats->totalTicks);
+    kernel->stats->RecordDiskRequest(abs(sectorNumber / SectorsPerTrack -
+                                         lastSector / SectorsPerTrack), ticks);
+    lastSector = sectorNumber;
+    if (kernel->diskTrace != NULL)
+        kernel->diskTrace->Record(kernel->stats->totalTicks, unit, sectorNumber,
+                                  FALSE, ticks, kernel->currentThread->getID());
     kernel->stats->numDiskReads++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
@@ -139,128 +206,394 @@ void Disk::WriteRequest(int sectorNumber, char *data)
     int ticks = ComputeLatency(sectorNumber, TRUE);
 
     // cout << sectorNumber << endl;
-    ASSERT(!active);
+    ASSERT(active < QueueDepth());
     ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
 
     DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+    Stamp(sectorNumber);
+    WriteRaw(sectorNumber, data);
     if (debug->IsEnabled('d'))
         PrintSector(TRUE, sectorNumber, data);
 
-    active = TRUE;
-    UpdateLast(sectorNumber);
+    active++;
+    model->Accept(sectorNumber, TRUE, kernel->stats->totalTicks);
+    kernel->stats->RecordDiskRequest(abs(sectorNumber / SectorsPerTrack -
+                                         lastSector / SectorsPerTrack), ticks);
+    lastSector = sectorNumber;
+    if (kernel->diskTrace != NULL)
+        kernel->diskTrace->Record(kernel->stats->totalTicks, unit, sectorNumber,
+                                  TRUE, ticks, kernel->currentThread->getID());
     kernel->stats->numDiskWrites++;
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
 
 //----------------------------------------------------------------------
-// Disk::CallBack()
-// 	Called by the machine simulation when the disk interrupt occurs.
+// IsZeroSector
+// 	Return TRUE if every byte of the sector at "data" is zero.
 //----------------------------------------------------------------------
 
-void Disk::CallBack()
+static bool
+IsZeroSector(char *data)
 {
-    active = FALSE;
-    callWhenDone->CallBack();
+    int *p = (int *)data;
+
+    for (unsigned int i = 0; i < (SectorSize / sizeof(int)); i++)
+        if (p[i] != 0)
+            return FALSE;
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
-// Disk::TimeToSeek()
-//	Returns how long it will take to position the disk head over the correct
-//	track on the disk.  Since when we finish seeking, we are likely
-//	to be in the middle of a sector that is rotating past the head,
-//	we also return how long until the head is at the next sector boundary.
+// Disk::ReadRaw/WriteRaw
+// 	Move "count" sectors (one, for WriteRaw) between "data" and the
+//	UNIX file, starting at "sectorNumber".  No simulated time passes;
+//	this is only the host side of a request.
 //
-//   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
-//   	and rotates at one sector per RotationTime ticks
+//	In sparse mode an all-zero sector is not stored: it stays a hole
+//	if it already reads as zeroes, and is punched out otherwise.
 //----------------------------------------------------------------------
 
-int Disk::TimeToSeek(int newSector, int *rotation)
+void Disk::ReadRaw(int sectorNumber, char *data, int count)
 {
-    int newTrack = newSector / SectorsPerTrack;
-    int oldTrack = lastSector / SectorsPerTrack;
-    int seek = abs(newTrack - oldTrack) * SeekTime;
-    // how long will seek take?
-    int over = (kernel->stats->totalTicks + seek) % RotationTime;
-    // will we be in the middle of a sector when
-    // we finish the seek?
-
-    *rotation = 0;
-    if (over > 0) // if so, need to round up to next full sector
-        *rotation = RotationTime - over;
-    return seek;
+    int offset = SectorSize * sectorNumber + MagicSize;
+
+    if (image != NULL)
+        bcopy(image + offset, data, SectorSize * count);
+    else
+        ReadAtOffset(fileno, data, SectorSize * count, offset);
+}
+
+void Disk::WriteRaw(int sectorNumber, char *data)
+{
+    int offset = SectorSize * sectorNumber + MagicSize;
+
+    if (sparse && IsZeroSector(data))
+    {
+        if (image != NULL)
+        {
+            if (!IsZeroSector(image + offset)) // don't dirty a hole
+                bzero(image + offset, SectorSize);
+            return;
+        }
+        if (PunchHole(fileno, offset, SectorSize))
+            return;
+    }
+    if (image != NULL)
+        bcopy(data, image + offset, SectorSize);
+    else
+        WriteAtOffset(fileno, data, SectorSize, offset);
 }
 
 //----------------------------------------------------------------------
-// Disk::ModuloDiff()
-// 	Return number of sectors of rotational delay between target sector
-//	"to" and current sector position "from"
+// Disk::SaveSnapshot
+// 	Write a compact copy of the disk to the UNIX file "name": only
+//	sectors that are not all zero are stored, along with an index
+//	of their sector numbers.  Holes in a sparse image are skipped
+//	without reading them.  Return the number of sectors saved.
+//
+//	This is a host-side archiving tool: no simulated time passes.
 //----------------------------------------------------------------------
 
-int Disk::ModuloDiff(int to, int from)
+int Disk::SaveSnapshot(char *name)
 {
-    int toOffset = to % SectorsPerTrack;
-    int fromOffset = from % SectorsPerTrack;
+    const int TrackSize = SectorsPerTrack * SectorSize;
+    int *index = new int[NumSectors];
+    char *track = new char[TrackSize];
+    SnapshotHeader header;
+    int fd, next;
+
+    header.magic = SnapshotMagic;
+    header.sectorSize = SectorSize;
+    header.numSectors = NumSectors;
+    header.count = 0;
+
+    // first pass: find the sectors worth saving, a track at a time
+    for (int t = 0; t < NumTracks; t++)
+    {
+        next = SeekData(fileno, MagicSize + t * TrackSize);
+        if (next == -1)
+            break; // only holes from here on
+        if (next >= MagicSize + (t + 1) * TrackSize)
+        {
+            t = (next - MagicSize) / TrackSize - 1; // skip a hole
+            continue;
+        }
+        ReadRaw(t * SectorsPerTrack, track, SectorsPerTrack);
+        for (int s = 0; s < SectorsPerTrack; s++)
+            if (!IsZeroSector(track + s * SectorSize))
+                index[header.count++] = t * SectorsPerTrack + s;
+    }
 
-    return ((toOffset - fromOffset) + SectorsPerTrack) % SectorsPerTrack;
+    // second pass: write the header, the index and the sectors
+    fd = OpenForWrite(name);
+    WriteFile(fd, (char *)&header, sizeof(header));
+    WriteFile(fd, (char *)index, header.count * sizeof(int));
+    for (int i = 0; i < header.count; i++)
+    {
+        ReadRaw(index[i], track, 1);
+        WriteFile(fd, track, SectorSize);
+    }
+    Close(fd);
+
+    DEBUG(dbgDisk, "Saved " << header.count << " sectors to snapshot " << name);
+    delete[] track;
+    delete[] index;
+    NextGeneration(); // the snapshot is a backup up to here
+    return header.count;
 }
 
 //----------------------------------------------------------------------
-// Disk::ComputeLatency()
-// 	Return how long will it take to read/write a disk sector, from
-//	the current position of the disk head.
+// Disk::LoadSnapshot
+// 	Replace the contents of the disk with the snapshot in the UNIX
+//	file "name".  Sectors missing from the snapshot become zero (and,
+//	since the image is truncated first, holes).  Return FALSE, leaving
+//	the disk alone, if "name" is not a snapshot of a disk like this one.
 //
-//   	Latency = seek time + rotational latency + transfer time
-//   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
-//   	and rotates at one sector per RotationTime ticks
+//	Must be done before the file system looks at the disk.
+//----------------------------------------------------------------------
+
+bool Disk::LoadSnapshot(char *name)
+{
+    SnapshotHeader header;
+    char buffer[SectorSize];
+    int magicNum = MagicNumber;
+    int *index;
+    int fd;
+
+    if ((fd = OpenForReadWrite(name, FALSE)) < 0)
+        return FALSE;
+    if (ReadPartial(fd, (char *)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != SnapshotMagic || header.sectorSize != SectorSize ||
+        header.numSectors != NumSectors)
+    {
+        Close(fd);
+        return FALSE;
+    }
+    index = new int[header.count];
+    Read(fd, (char *)index, header.count * sizeof(int));
+
+    Truncate(fileno, 0); // throw away the old contents
+    Truncate(fileno, DiskSize);
+    WriteAtOffset(fileno, (char *)&magicNum, MagicSize, 0);
+    for (int i = 0; i < header.count; i++)
+    {
+        ASSERT((index[i] >= 0) && (index[i] < NumSectors));
+        Read(fd, buffer, SectorSize);
+        WriteRaw(index[i], buffer);
+    }
+    Close(fd);
+    StampAll();
+
+    DEBUG(dbgDisk, "Loaded " << header.count << " sectors from snapshot " << name);
+    delete[] index;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Disk::OpenChangeMap
+// 	Read the changed-block map of this disk, or start a new one, in
+//	which nothing has been written yet, if there is none, or if the
+//	disk itself was just "created".
+//----------------------------------------------------------------------
+
+void Disk::OpenChangeMap(bool created)
+{
+    char name[40];
+    ChangeHeader header;
+
+    sprintf(name, "%s.cbt", diskname);
+    stamps = new int[NumSectors];
+    changeFile = created ? -1 : OpenForReadWrite(name, FALSE);
+    if (changeFile >= 0)
+    {
+        if (ReadPartial(changeFile, (char *)&header, sizeof(header)) ==
+                sizeof(header) && header.magic == ChangeMagic)
+        {
+            generation = header.generation;
+            ReadAtOffset(changeFile, (char *)stamps, NumSectors * sizeof(int),
+                         sizeof(header));
+            return;
+        }
+        Close(changeFile);
+    }
+
+    changeFile = OpenForWrite(name);
+    header.magic = ChangeMagic;
+    header.generation = generation = 1;
+    WriteAtOffset(changeFile, (char *)&header, sizeof(header), 0);
+    Truncate(changeFile, sizeof(header) + NumSectors * sizeof(int)); // zeroes
+    bzero(stamps, NumSectors * sizeof(int));
+}
+
+//----------------------------------------------------------------------
+// Disk::Stamp/StampAll
+// 	Note that sector "sectorNumber" (every sector) was written in the
+//	current generation.  The map is written through, so that it is
+//	right even if Nachos stops without cleaning up; only the first
+//	write of a sector in each generation touches it.
+//----------------------------------------------------------------------
+
+void Disk::Stamp(int sectorNumber)
+{
+    if (stamps[sectorNumber] == generation)
+        return;
+    stamps[sectorNumber] = generation;
+    WriteAtOffset(changeFile, (char *)&stamps[sectorNumber], sizeof(int),
+                  sizeof(ChangeHeader) + sectorNumber * sizeof(int));
+}
+
+void Disk::StampAll()
+{
+    for (int i = 0; i < NumSectors; i++)
+        stamps[i] = generation;
+    WriteAtOffset(changeFile, (char *)stamps, NumSectors * sizeof(int),
+                  sizeof(ChangeHeader));
+}
+
+//----------------------------------------------------------------------
+// Disk::NextGeneration
+// 	Close the current generation: a backup has everything written in
+//	it, so later writes are stamped with the next one.
+//----------------------------------------------------------------------
+
+void Disk::NextGeneration()
+{
+    ChangeHeader header;
+
+    generation++;
+    header.magic = ChangeMagic;
+    header.generation = generation;
+    WriteAtOffset(changeFile, (char *)&header, sizeof(header), 0);
+}
+
+//----------------------------------------------------------------------
+// Disk::SaveDelta
+// 	Write the sectors written after generation "since" to the delta
+//	file "name": a header, their sector numbers in increasing order,
+//	and their contents.  Only the changed-block map is scanned; only
+//	the sectors saved are read.  This closes the current generation.
 //
-//   	To find the rotational latency, we first must figure out where the
-//   	disk head will be after the seek (if any).  We then figure out
-//   	how long it will take to rotate completely past newSector after
-//	that point.
+//	Return the number of sectors saved, or -1 (saving nothing) if
+//	"since" is not a generation that is over.
 //
-//   	The disk also has a "track buffer"; the disk continuously reads
-//   	the contents of the current disk track into the buffer.  This allows
-//   	read requests to the current track to be satisfied more quickly.
-//   	The contents of the track buffer are discarded after every seek to
-//   	a new track.
+//	Like SaveSnapshot, this is a host-side tool: no simulated time
+//	passes.
 //----------------------------------------------------------------------
 
-int Disk::ComputeLatency(int newSector, bool writing)
+int Disk::SaveDelta(char *name, int since)
 {
-    int rotation;
-    int seek = TimeToSeek(newSector, &rotation);
-    int timeAfter = kernel->stats->totalTicks + seek + rotation;
+    int *index = new int[NumSectors];
+    char buffer[SectorSize];
+    DeltaHeader header;
+    int fd;
+
+    if (since < 0 || since >= generation)
+    {
+        delete[] index;
+        return -1;
+    }
+    header.magic = DeltaMagic;
+    header.sectorSize = SectorSize;
+    header.numSectors = NumSectors;
+    header.since = since;
+    header.upTo = generation;
+    header.count = 0;
+    for (int i = 0; i < NumSectors; i++)
+        if (stamps[i] > since)
+            index[header.count++] = i;
+
+    fd = OpenForWrite(name);
+    WriteFile(fd, (char *)&header, sizeof(header));
+    WriteFile(fd, (char *)index, header.count * sizeof(int));
+    for (int i = 0; i < header.count; i++)
+    {
+        ReadRaw(index[i], buffer, 1);
+        WriteFile(fd, buffer, SectorSize);
+    }
+    Close(fd);
+
+    DEBUG(dbgDisk, "Saved " << header.count << " sectors written since generation "
+                   << since << " to delta " << name);
+    delete[] index;
+    NextGeneration();
+    return header.count;
+}
+
+//----------------------------------------------------------------------
+// Disk::ApplyDelta
+// 	Write the sectors of the delta file "name" to the disk.  Return
+//	how many, or -1, leaving the disk alone, if "name" is not a delta
+//	of a disk like this one.
+//
+//	Deltas must be applied in the order they were saved, each to the
+//	disk the one before it left; nothing checks this.  Like
+//	LoadSnapshot, this must be done before the file system looks at
+//	the disk.
+//----------------------------------------------------------------------
 
-#ifndef NOTRACKBUF // turn this on if you don't want the track buffer stuff
-    // check if track buffer applies
-    if ((writing == FALSE) && (seek == 0) && (((timeAfter - bufferInit) / RotationTime) > ModuloDiff(newSector, bufferInit / RotationTime)))
+int Disk::ApplyDelta(char *name)
+{
+    DeltaHeader header;
+    char buffer[SectorSize];
+    int *index;
+    int fd;
+
+    if ((fd = OpenForReadWrite(name, FALSE)) < 0)
+        return -1;
+    if (ReadPartial(fd, (char *)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != DeltaMagic || header.sectorSize != SectorSize ||
+        header.numSectors != NumSectors)
     {
-        DEBUG(dbgDisk, "Request latency = " << RotationTime);
-        return RotationTime; // time to transfer sector from the track buffer
+        Close(fd);
+        return -1;
     }
-#endif
+    index = new int[header.count];
+    Read(fd, (char *)index, header.count * sizeof(int));
+    for (int i = 0; i < header.count; i++)
+    {
+        ASSERT((index[i] >= 0) && (index[i] < NumSectors));
+        Read(fd, buffer, SectorSize);
+        Stamp(index[i]);
+        WriteRaw(index[i], buffer);
+    }
+    Close(fd);
+
+    DEBUG(dbgDisk, "Applied delta " << name << ": " << header.count
+                   << " sectors, generations " << header.since + 1 << " to "
+                   << header.upTo);
+    delete[] index;
+    return header.count;
+}
 
-    rotation += ModuloDiff(newSector, timeAfter / RotationTime) * RotationTime;
+//----------------------------------------------------------------------
+// Disk::CallBack()
+// 	Called by the machine simulation when the disk interrupt occurs.
+//----------------------------------------------------------------------
 
-    DEBUG(dbgDisk, "Request latency = " << (seek + rotation + RotationTime));
-    return (seek + rotation + RotationTime);
+void Disk::CallBack()
+{
+    active--;
+    callWhenDone->CallBack();
 }
 
 //----------------------------------------------------------------------
-// Disk::UpdateLast
-//   	Keep track of the most recently requested sector.  So we can know
-//	what is in the track buffer.
+// Disk::ComputeLatency()
+// 	Return how long will it take to read/write a disk sector, if the
+//	request is sent now.  The latency model does the work.
 //----------------------------------------------------------------------
 
-void Disk::UpdateLast(int newSector)
+int Disk::ComputeLatency(int newSector, bool writing)
 {
-    int rotate;
-    int seek = TimeToSeek(newSector, &rotate);
+    return model->Latency(newSector, writing, kernel->stats->totalTicks);
+}
+
+//----------------------------------------------------------------------
+// Disk::QueueDepth()
+// 	Return how many requests the disk accepts before the first one
+//	finishes: one for a hard disk, one per channel for flash.
+//----------------------------------------------------------------------
 
-    if (seek != 0)
-        bufferInit = kernel->stats->totalTicks + seek + rotate;
-    lastSector = newSector;
-    DEBUG(dbgDisk, "Updating last sector = " << lastSector << " , " << bufferInit);
+int Disk::QueueDepth()
+{
+    return model->Channels();
 }
@@ -20,6 +20,7 @@
 #include "copyright.h"
 #include "utility.h"
 #include "callback.h"
+#include "diskmodel.h"
 
 // The following class defines a physical disk I/O device.  The disk
 // has a single surface, split up into "tracks", and each track split
@@ -34,6 +35,23 @@
 // and an interrupt is invoked later to signal that the operation completed.
 //
 // The physical disk is in fact simulated via operations on a UNIX file.
+// Each sector is moved with a single positional read/write, or, if the
+// file is mapped into memory, with a memcpy.  Neither changes the
+// simulated time a request takes.
+//
+// In "sparse" mode, sectors that are written as all zeroes are left
+// as (or turned back into) holes in the UNIX file, so a freshly
+// formatted 64MB disk takes almost no host storage.  A disk can also
+// be saved to and restored from a compact "snapshot" file: a header,
+// an index of the sectors that are not all zero, and their contents.
+//
+// For incremental backups, every disk keeps a changed-block map next
+// to its UNIX file (DISK_<machine id>.cbt): the generation each sector
+// was last written in.  Saving a snapshot or a delta closes the current
+// generation.  A "delta" holds the sectors written since a given
+// generation, and applying the deltas, in order, to a disk restored
+// from the snapshot they follow brings it up to date; so a backup
+// moves as many sectors as were written, whatever the size of the disk.
 //
 // To make life a little more realistic, the simulated time for
 // each operation reflects a "track buffer" -- RAM to store the contents
@@ -46,6 +64,12 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// All of the above is the default latency model, "hdd".  The timing of
+// requests is delegated to a DiskModel (see diskmodel.h), so the same
+// disk can also behave like a disk of another geometry, or like a flash
+// device that works on several requests at once.  With -trace, every
+// request is also recorded, to be replayed later (see disktrace.h).
 
 // MP4 Hint: DO NOT change the SectorSize, but other constants are allowed
 const int SectorSize = 128;		// number of bytes per disk sector
@@ -56,16 +80,26 @@ const int NumSectors = (SectorsPerTrack * NumTracks); // total # of sectors per
 
 class Disk : public CallBackObj {
   public:
-    Disk(CallBackObj *toCall);          // Create a simulated disk.  
+    Disk(CallBackObj *toCall, int unit = 0, char *modelSpec = "hdd",
+	 bool mapImage = FALSE, bool sparse = FALSE);
+					// Create a simulated disk.  
 					// Invoke toCall->CallBack() 
 					// when each request completes.
+					// "unit" numbers the disks of
+					// one machine; "modelSpec" names
+					// its latency model.
+					// If "mapImage", access the
+					// UNIX file through mmap.
+					// If "sparse", never store
+					// all-zero sectors in it.
     ~Disk();				// Deallocate the disk.
     
     void ReadRequest(int sectorNumber, char* data);
     					// Read/write an single disk sector.
 					// These routines send a request to 
     					// the disk and return immediately.
-    					// Only one request allowed at a time!
+    					// Only QueueDepth() requests
+					// allowed at a time!
     void WriteRequest(int sectorNumber, char* data);
 
     void CallBack();			// Invoked when disk request 
@@ -75,19 +109,53 @@ class Disk : public CallBackObj {
     					// Return how long a request to 
 					// newSector will take: 
 					// (seek + rotational delay + transfer)
+    int QueueDepth();			// How many requests may be in
+					// progress at once
+
+    int SaveSnapshot(char *name);	// Write the sectors that are not
+					// all zero to the compact snapshot
+					// file "name"; return how many
+    bool LoadSnapshot(char *name);	// Replace the whole disk with the
+					// contents of snapshot "name"
+    int SaveDelta(char *name, int since);
+					// Write the sectors written after
+					// generation "since" to the delta
+					// file "name"; return how many,
+					// or -1 if "since" is not over yet
+    int ApplyDelta(char *name);		// Write the sectors of delta "name"
+					// to the disk; return how many, or
+					// -1 if it is not a delta
+    int Generation() { return generation; }
+					// The generation being written
 
   private:
+    int unit;				// which of the machine's disks
     int fileno;				// UNIX file number for simulated disk 
     char diskname[32];			// name of simulated disk's file
+    char *image;			// the UNIX file mapped into memory,
+					// or NULL to use pread/pwrite
+    bool sparse;			// leave holes for all-zero sectors?
     CallBackObj *callWhenDone;		// Invoke when any disk request finishes
-    bool active;     			// Is a disk operation in progress?
-    int lastSector;			// The previous disk request 
-    int bufferInit;			// When the track buffer started 
-					// being loaded
+    int active;     			// How many disk operations
+					// are in progress?
+    int lastSector;			// The previous disk request, to
+					// measure seek distances
+    DiskModel *model;			// How long requests take
+    int changeFile;			// UNIX file of the changed-block map
+    int generation;			// Writes are stamped with this
+    int *stamps;			// Generation of the last write to
+					// each sector, 0 if never written
+
+    void OpenChangeMap(bool created);	// Read the changed-block map, or
+					// start one
+    void Stamp(int sectorNumber);	// Note a write of "sectorNumber"
+    void StampAll();			// Note that every sector changed
+    void NextGeneration();		// Close the current generation
 
-    int TimeToSeek(int newSector, int *rotate); // time to get to the new track
-    int ModuloDiff(int to, int from);        // # sectors between to and from
-    void UpdateLast(int newSector);
+    void ReadRaw(int sectorNumber, char *data, int count);
+    void WriteRaw(int sectorNumber, char *data);
+					// Move data between memory and the
+					// UNIX file, without simulating time
 };
 
 #endif // DISK_H
@@ -0,0 +1,215 @@
+// diskmodel.cc
+//	Routines to compute the latency of simulated disk requests.
+//	See diskmodel.h for the models and how they are named.
+//
+//	The hard disk model is the original Nachos disk timing, taken
+//	out of disk.cc so that its geometry can be changed.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "diskmodel.h"
+#include "disk.h"
+#include "debug.h"
+#include "stats.h"
+
+// Default costs of the flash model, in ticks.  Compare with a hard disk,
+// where a random request costs thousands of ticks (SeekTime and
+// RotationTime in stats.h).
+
+const int SSDReadTime = 25;
+const int SSDWriteTime = 100;
+const int SSDChannels = 4;
+
+//----------------------------------------------------------------------
+// DiskModel::Create
+// 	Build the latency model named by "spec" (see diskmodel.h).
+//	Return NULL if there is no such model, or its parameters are bad.
+//----------------------------------------------------------------------
+
+DiskModel *
+DiskModel::Create(char *spec)
+{
+    int a, b, c;
+    char extra;
+
+    if (strcmp(spec, "hdd") == 0)
+        return new HardDiskModel(SectorsPerTrack, SeekTime, RotationTime);
+    if (strcmp(spec, "ssd") == 0)
+        return new SolidStateModel(SSDReadTime, SSDWriteTime, SSDChannels);
+    if (sscanf(spec, "hdd,%d,%d,%d%c", &a, &b, &c, &extra) == 3 &&
+        a > 0 && b >= 0 && c > 0)
+        return new HardDiskModel(a, b, c);
+    if (sscanf(spec, "ssd,%d,%d,%d%c", &a, &b, &c, &extra) == 3 &&
+        a > 0 && b > 0 && c > 0)
+        return new SolidStateModel(a, b, c);
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// HardDiskModel::HardDiskModel
+// 	Initialize a rotating disk, with the head on sector 0.
+//----------------------------------------------------------------------
+
+HardDiskModel::HardDiskModel(int sectorsPerTrack, int seekTime, int rotationTime)
+{
+    this->sectorsPerTrack = sectorsPerTrack;
+    this->seekTime = seekTime;
+    this->rotationTime = rotationTime;
+    lastSector = 0;
+    bufferInit = 0;
+}
+
+//----------------------------------------------------------------------
+// HardDiskModel::TimeToSeek()
+//	Returns how long it will take to position the disk head over the correct
+//	track on the disk.  Since when we finish seeking, we are likely
+//	to be in the middle of a sector that is rotating past the head,
+//	we also return how long until the head is at the next sector boundary.
+//
+//   	Disk seeks at one track per seekTime ticks
+//   	and rotates at one sector per rotationTime ticks
+//----------------------------------------------------------------------
+
+int
+HardDiskModel::TimeToSeek(int newSector, int now, int *rotation)
+{
+    int newTrack = newSector / sectorsPerTrack;
+    int oldTrack = lastSector / sectorsPerTrack;
+    int seek = abs(newTrack - oldTrack) * seekTime;
+    // how long will seek take?
+    int over = (now + seek) % rotationTime;
+    // will we be in the middle of a sector when
+    // we finish the seek?
+
+    *rotation = 0;
+    if (over > 0) // if so, need to round up to next full sector
+        *rotation = rotationTime - over;
+    return seek;
+}
+
+//----------------------------------------------------------------------
+// HardDiskModel::ModuloDiff()
+// 	Return number of sectors of rotational delay between target sector
+//	"to" and current sector position "from"
+//----------------------------------------------------------------------
+
+int
+HardDiskModel::ModuloDiff(int to, int from)
+{
+    int toOffset = to % sectorsPerTrack;
+    int fromOffset = from % sectorsPerTrack;
+
+    return ((toOffset - fromOffset) + sectorsPerTrack) % sectorsPerTrack;
+}
+
+//----------------------------------------------------------------------
+// HardDiskModel::Latency()
+// 	Return how long will it take to read/write a disk sector, from
+//	the current position of the disk head.
+//
+//   	Latency = seek time + rotational latency + transfer time
+//
+//   	To find the rotational latency, we first must figure out where the
+//   	disk head will be after the seek (if any).  We then figure out
+//   	how long it will take to rotate completely past newSector after
+//	that point.
+//
+//   	The disk also has a "track buffer"; the disk continuously reads
+//   	the contents of the current disk track into the buffer.  This allows
+//   	read requests to the current track to be satisfied more quickly.
+//   	The contents of the track buffer are discarded after every seek to
+//   	a new track.
+//----------------------------------------------------------------------
+
+int
+HardDiskModel::Latency(int newSector, bool writing, int now)
+{
+    int rotation;
+    int seek = TimeToSeek(newSector, now, &rotation);
+    int timeAfter = now + seek + rotation;
+
+#ifndef NOTRACKBUF // turn this on if you don't want the track buffer stuff
+    // check if track buffer applies
+    if ((writing == FALSE) && (seek == 0) && (((timeAfter - bufferInit) / rotationTime) > ModuloDiff(newSector, bufferInit / rotationTime)))
+    {
+        DEBUG(dbgDisk, "Request latency = " << rotationTime);
+        return rotationTime; // time to transfer sector from the track buffer
+    }
+#endif
+
+    rotation += ModuloDiff(newSector, timeAfter / rotationTime) * rotationTime;
+
+    DEBUG(dbgDisk, "Request latency = " << (seek + rotation + rotationTime));
+    return (seek + rotation + rotationTime);
+}
+
+//----------------------------------------------------------------------
+// HardDiskModel::Accept
+//   	Keep track of the most recently requested sector.  So we can know
+//	what is in the track buffer.
+//----------------------------------------------------------------------
+
+void
+HardDiskModel::Accept(int newSector, bool writing, int now)
+{
+    int rotate;
+    int seek = TimeToSeek(newSector, now, &rotate);
+
+    if (seek != 0)
+        bufferInit = now + seek + rotate;
+    lastSector = newSector;
+    DEBUG(dbgDisk, "Updating last sector = " << lastSector << " , " << bufferInit);
+}
+
+//----------------------------------------------------------------------
+// SolidStateModel::SolidStateModel
+// 	Initialize a flash device with all chips idle.
+//----------------------------------------------------------------------
+
+SolidStateModel::SolidStateModel(int readTime, int writeTime, int channels)
+{
+    this->readTime = readTime;
+    this->writeTime = writeTime;
+    this->channels = channels;
+    busyUntil = new int[channels];
+    for (int i = 0; i < channels; i++)
+        busyUntil[i] = 0;
+}
+
+SolidStateModel::~SolidStateModel()
+{
+    delete[] busyUntil;
+}
+
+//----------------------------------------------------------------------
+// SolidStateModel::Latency
+// 	A request waits for its chip to finish earlier requests, then
+//	takes a fixed read or write time.
+//----------------------------------------------------------------------
+
+int
+SolidStateModel::Latency(int sector, bool writing, int now)
+{
+    int wait = busyUntil[sector % channels] - now;
+
+    if (wait < 0)
+        wait = 0;
+    DEBUG(dbgDisk, "Request latency = " << (wait + (writing ? writeTime : readTime)));
+    return wait + (writing ? writeTime : readTime);
+}
+
+//----------------------------------------------------------------------
+// SolidStateModel::Accept
+// 	The request's chip is busy until the request is done.
+//----------------------------------------------------------------------
+
+void
+SolidStateModel::Accept(int sector, bool writing, int now)
+{
+    int *chip = &busyUntil[sector % channels];
+
+    *chip = ((*chip > now) ? *chip : now) + (writing ? writeTime : readTime);
+}
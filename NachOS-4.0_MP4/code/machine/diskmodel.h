@@ -0,0 +1,96 @@
+// diskmodel.h
+//	Data structures to compute how long a simulated disk takes to
+//	serve a request.
+//
+//	The Disk moves the data right away; a DiskModel only decides how
+//	many ticks pass before the request's interrupt.  Each Disk owns its
+//	own model, since a model remembers where the device is (the head
+//	position, which channels are busy, ...).
+//
+//	Models are chosen by name, from the command line (see -dm in main.cc):
+//
+//	    hdd				the original Nachos disk (stats.h)
+//	    hdd,<sectorsPerTrack>,<seekTime>,<rotationTime>
+//					a disk with some other geometry
+//	    ssd				a flash device, default costs
+//	    ssd,<readTime>,<writeTime>,<channels>
+//					a flash device with given costs
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef DISKMODEL_H
+#define DISKMODEL_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines the interface every latency model
+// provides to the Disk.
+
+class DiskModel {
+  public:
+    static DiskModel *Create(char *spec);
+					// Build the model named by "spec",
+					// or return NULL if "spec" is bad
+    virtual ~DiskModel() {}
+
+    virtual int Latency(int sector, bool writing, int now) = 0;
+					// How long a request for "sector",
+					// sent at time "now", will take
+    virtual void Accept(int sector, bool writing, int now) = 0;
+					// The request was sent: update
+					// the state of the device
+    virtual int Channels() { return 1; }
+					// How many requests the device
+					// can work on at the same time
+};
+
+// A rotating disk with a single head and a track buffer, seeking at one
+// track per "seekTime" ticks and rotating one sector per "rotationTime"
+// ticks.  The sector layout is the same as the Disk's; only the timing
+// depends on the geometry.
+
+class HardDiskModel : public DiskModel {
+  public:
+    HardDiskModel(int sectorsPerTrack, int seekTime, int rotationTime);
+
+    int Latency(int sector, bool writing, int now);
+    void Accept(int sector, bool writing, int now);
+
+  private:
+    int sectorsPerTrack;		// sectors passing under the head
+    int seekTime;			// per track crossed
+    int rotationTime;			// per sector passing by
+    int lastSector;			// The previous disk request 
+    int bufferInit;			// When the track buffer started 
+					// being loaded
+
+    int TimeToSeek(int newSector, int now, int *rotate);
+    					// time to get to the new track
+    int ModuloDiff(int to, int from);	// # sectors between to and from
+};
+
+// A flash device.  There is no head, so a read or write costs the same
+// wherever it goes, but sectors are spread over "channels" independent
+// flash chips (sector s on chip s % channels); a request has to wait
+// only for earlier requests on its own chip.
+
+class SolidStateModel : public DiskModel {
+  public:
+    SolidStateModel(int readTime, int writeTime, int channels);
+    ~SolidStateModel();
+
+    int Latency(int sector, bool writing, int now);
+    void Accept(int sector, bool writing, int now);
+    int Channels() { return channels; }
+
+  private:
+    int readTime;			// ticks to read one sector
+    int writeTime;			// ticks to program one sector
+    int channels;			// number of chips
+    int *busyUntil;			// when each chip is free again
+};
+
+#endif // DISKMODEL_H
@@ -0,0 +1,437 @@
+// disktrace.cc
+//	Routines to record disk requests to a trace file, and to replay
+//	a trace through a latency model.  See disktrace.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "disktrace.h"
+#include "diskmodel.h"
+#include "disk.h"
+#include "debug.h"
+#include "sysdep.h"
+
+// First bytes of every trace file, so we do not replay garbage.
+
+class DiskTraceHeader {
+  public:
+    int magic;				// TraceMagic
+    int recordSize;			// sizeof(DiskTraceRecord)
+};
+
+const int TraceMagic = 0x4e545243;	// "NTRC"
+
+//----------------------------------------------------------------------
+// DiskTrace::DiskTrace
+// 	Create (or truncate) the trace file "fileName" and write its
+//	header.
+//----------------------------------------------------------------------
+
+DiskTrace::DiskTrace(char *fileName)
+{
+    DiskTraceHeader header;
+
+    fileno = OpenForWrite(fileName);
+    header.magic = TraceMagic;
+    header.recordSize = sizeof(DiskTraceRecord);
+    WriteFile(fileno, (char *)&header, sizeof(header));
+    buffer = new DiskTraceRecord[TraceBufferSize];
+    numBuffered = 0;
+}
+
+//----------------------------------------------------------------------
+// DiskTrace::~DiskTrace
+// 	Write out whatever is still buffered, and close the trace.
+//----------------------------------------------------------------------
+
+DiskTrace::~DiskTrace()
+{
+    Flush();
+    Close(fileno);
+    delete[] buffer;
+}
+
+//----------------------------------------------------------------------
+// DiskTrace::Record
+// 	Append one request to the trace.  Called by the Disk for every
+//	request it is sent, after the latency model has timed it.
+//
+//	"tick" -- when the request was sent
+//	"unit", "sector" -- where it goes
+//	"writing" -- is it a write?
+//	"latency" -- how many ticks it takes
+//	"thread" -- ID of the thread that sent it
+//----------------------------------------------------------------------
+
+void
+DiskTrace::Record(int tick, int unit, int sector, bool writing, int latency,
+                  int thread)
+{
+    DiskTraceRecord *record = &buffer[numBuffered++];
+
+    record->tick = tick;
+    record->sector = sector;
+    record->latency = latency;
+    record->thread = thread;
+    record->unit = unit;
+    record->writing = writing ? 1 : 0;
+    if (numBuffered == TraceBufferSize)
+        Flush();
+}
+
+//----------------------------------------------------------------------
+// DiskTrace::Flush
+// 	Write the buffered records to the trace file, in one go.
+//----------------------------------------------------------------------
+
+void
+DiskTrace::Flush()
+{
+    if (numBuffered > 0)
+        WriteFile(fileno, (char *)buffer,
+                  numBuffered * sizeof(DiskTraceRecord));
+    numBuffered = 0;
+}
+
+//----------------------------------------------------------------------
+// CacheEntryKey, CacheHash
+// 	Key extraction and hash functions for the replay cache's index.
+//	An entry is a pointer to the slot holding the key.
+//----------------------------------------------------------------------
+
+static int
+CacheEntryKey(int *slot)
+{
+    return *slot;
+}
+
+static unsigned
+CacheHash(int key)
+{
+    return (unsigned)key;
+}
+
+//----------------------------------------------------------------------
+// DiskReplayer::DiskReplayer
+// 	Set up a replay.
+//
+//	"modelSpec" -- latency model of each disk (see diskmodel.h)
+//	"scheduler" -- "fifo", "sstf" or "scan"
+//	"cacheSectors" -- how many sectors to cache, 0 for no cache
+//----------------------------------------------------------------------
+
+DiskReplayer::DiskReplayer(char *modelSpec, char *scheduler, int cacheSectors)
+{
+    this->modelSpec = modelSpec;
+    this->scheduler = scheduler;
+    this->cacheSectors = cacheSectors;
+    cacheKey = NULL;
+    cacheUsed = NULL;
+    cacheIndex = NULL;
+    cacheHand = 0;
+    remap = NULL;
+    remapDisks = 1;
+    totalLatency = 0;
+    if (cacheSectors > 0)
+    {
+        cacheKey = new int[cacheSectors];
+        cacheUsed = new bool[cacheSectors];
+        for (int i = 0; i < cacheSectors; i++)
+        {
+            cacheKey[i] = -1;
+            cacheUsed[i] = FALSE;
+        }
+        cacheIndex = new HashTable<int, int *>(CacheEntryKey, CacheHash);
+    }
+}
+
+DiskReplayer::~DiskReplayer()
+{
+    for (int i = 0; i < cacheSectors; i++)
+        if (cacheKey[i] != -1)
+            cacheIndex->Remove(cacheKey[i]);	// a table must be empty
+						// to be deleted
+    delete[] cacheKey;
+    delete[] cacheUsed;
+    delete cacheIndex;
+}
+
+//----------------------------------------------------------------------
+// DiskReplayer::CacheLookup
+// 	Return TRUE if "key" is in the cache, and mark it as referenced.
+//----------------------------------------------------------------------
+
+bool
+DiskReplayer::CacheLookup(int key)
+{
+    int *slot;
+
+    if (cacheIndex == NULL || !cacheIndex->Find(key, &slot))
+        return FALSE;
+    cacheUsed[slot - cacheKey] = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DiskReplayer::CacheInsert
+// 	Put "key" in the cache, unless it is there already.  The CLOCK
+//	hand sweeps over the slots, giving referenced ones a second
+//	chance, and evicts the first one that has not been used since
+//	the hand last passed it.
+//----------------------------------------------------------------------
+
+void
+DiskReplayer::CacheInsert(int key)
+{
+    if (cacheIndex == NULL || CacheLookup(key))
+        return;
+
+    while (cacheUsed[cacheHand])
+    {
+        cacheUsed[cacheHand] = FALSE;
+        cacheHand = (cacheHand + 1) % cacheSectors;
+    }
+    if (cacheKey[cacheHand] != -1)
+        cacheIndex->Remove(cacheKey[cacheHand]);
+    cacheKey[cacheHand] = key;
+    cacheUsed[cacheHand] = TRUE;
+    cacheIndex->Insert(&cacheKey[cacheHand]);
+    cacheHand = (cacheHand + 1) % cacheSectors;
+}
+
+//----------------------------------------------------------------------
+// DiskReplayer::Schedule
+// 	Reorder a window of requests to one disk into the order the
+//	scheduler would serve them in, starting with the head at
+//	sector "head".
+//----------------------------------------------------------------------
+
+void
+DiskReplayer::Schedule(DiskTraceRecord **window, int count, int head)
+{
+    DiskTraceRecord *tmp;
+    int i, j, best;
+
+    if (strcmp(scheduler, "sstf") == 0)
+    {
+        for (i = 0; i < count; i++)
+        {   // pick the nearest of the rest
+            best = i;
+            for (j = i + 1; j < count; j++)
+                if (abs(window[j]->sector - head) <
+                    abs(window[best]->sector - head))
+                    best = j;
+            tmp = window[i];
+            window[i] = window[best];
+            window[best] = tmp;
+            head = window[i]->sector;
+        }
+    }
+    else if (strcmp(scheduler, "scan") == 0)
+    {
+        // Sort ascending (windows are small), then serve the requests
+        // at or above the head first, and those below it on the way back.
+        for (i = 1; i < count; i++)
+        {
+            tmp = window[i];
+            for (j = i; j > 0 && window[j - 1]->sector > tmp->sector; j--)
+                window[j] = window[j - 1];
+            window[j] = tmp;
+        }
+        for (best = 0; best < count && window[best]->sector < head; best++)
+            ;
+        DiskTraceRecord **order = new DiskTraceRecord *[count];
+        for (i = 0, j = best; j < count; j++)
+            order[i++] = window[j];
+        for (j = best - 1; j >= 0; j--)
+            order[i++] = window[j];
+        for (i = 0; i < count; i++)
+            window[i] = order[i];
+        delete[] order;
+    }
+}
+
+//----------------------------------------------------------------------
+// DiskReplayer::Load
+// 	Read all the records of the trace "fileName" into a new array,
+//	and set "*numRecords" to how many there are.  Return NULL if the
+//	file can't be read or is not a trace.
+//----------------------------------------------------------------------
+
+DiskTraceRecord *
+DiskReplayer::Load(char *fileName, int *numRecords)
+{
+    DiskTraceHeader header;
+    DiskTraceRecord *records;
+    int fd;
+
+    if ((fd = OpenForReadWrite(fileName, FALSE)) < 0)
+    {
+        printf("Replay: couldn't open trace %s\n", fileName);
+        return NULL;
+    }
+    if (ReadPartial(fd, (char *)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != TraceMagic ||
+        header.recordSize != sizeof(DiskTraceRecord))
+    {
+        printf("Replay: %s is not a disk trace\n", fileName);
+        Close(fd);
+        return NULL;
+    }
+    Lseek(fd, 0, 2);
+    *numRecords = (Tell(fd) - sizeof(header)) / sizeof(DiskTraceRecord);
+    Lseek(fd, sizeof(header), 0);
+    records = new DiskTraceRecord[*numRecords + 1];
+    Read(fd, (char *)records, *numRecords * sizeof(DiskTraceRecord));
+    Close(fd);
+    return records;
+}
+
+//----------------------------------------------------------------------
+// DiskReplayer::SetRemap
+// 	Replay every request as if its sector had moved, eg. to see
+//	what relocating files would have saved.  Sectors are numbered
+//	as the file system sees them, striped over "numDisks" disks
+//	(see SynchDisk): sector s of the trace's unit u is file system
+//	sector s * numDisks + u, and it is replayed at remap[] of that.
+//----------------------------------------------------------------------
+
+void
+DiskReplayer::SetRemap(int *remap, int numDisks)
+{
+    this->remap = remap;
+    remapDisks = numDisks;
+}
+
+//----------------------------------------------------------------------
+// DiskReplayer::Replay
+// 	Replay the trace "fileName", one disk at a time, and print how
+//	the new configuration compares with the original run.  Return
+//	FALSE if the file is not a trace.
+//
+//	A request is sent as long after the previous one completes as it
+//	was in the original run.  If it was sent while the previous one
+//	was still in progress (several disks, or a device with several
+//	channels), it overlaps it by the same amount.
+//----------------------------------------------------------------------
+
+bool
+DiskReplayer::Replay(char *fileName)
+{
+    DiskTraceRecord *records;
+    DiskTraceRecord **window;
+    int numRecords, numUnits;
+    int reads = 0, writes = 0, hits = 0;
+    double oldLatency = 0, newLatency = 0;
+    int oldElapsed = 0, newElapsed = 0;
+
+    records = Load(fileName, &numRecords);
+    if (records == NULL)
+        return FALSE;
+    if (remap != NULL)
+        for (int i = 0; i < numRecords; i++)
+        {   // move the request to where its sector is now
+            int sector = remap[records[i].sector * remapDisks + records[i].unit];
+            records[i].unit = sector % remapDisks;
+            records[i].sector = sector / remapDisks;
+        }
+
+    numUnits = 0;
+    for (int i = 0; i < numRecords; i++)
+        if (records[i].unit >= numUnits)
+            numUnits = records[i].unit + 1;
+
+    window = new DiskTraceRecord *[ReplayWindow];
+    for (int unit = 0; unit < numUnits; unit++)
+    {
+        DiskModel *model = DiskModel::Create(modelSpec);
+        DiskTraceRecord *prev = NULL;
+        int first = -1, oldDone = 0;
+        int sent = 0, done = 0, head = 0;
+        int i = 0;
+
+        ASSERT(model != NULL);
+        while (i < numRecords)
+        {
+            // Gather the next window of requests to this disk, along with
+            // the gap before each (negative if it overlapped the last).
+            int gaps[ReplayWindow];
+            int count = 0;
+            for (; i < numRecords && count < ReplayWindow; i++)
+            {
+                DiskTraceRecord *r = &records[i];
+                if (r->unit != unit)
+                    continue;
+                if (first < 0)
+                    first = sent = done = r->tick;
+                gaps[count] = (prev == NULL) ? 0 :
+                                  r->tick - (prev->tick + prev->latency);
+                window[count++] = r;
+                oldLatency += r->latency;
+                if (r->tick + r->latency > oldDone)
+                    oldDone = r->tick + r->latency;
+                prev = r;
+            }
+            Schedule(window, count, head);
+
+            for (int k = 0; k < count; k++)
+            {
+                DiskTraceRecord *r = window[k];
+                int key = r->unit * NumSectors + r->sector;
+                int latency;
+
+                if (done + gaps[k] > sent)
+                    sent = done + gaps[k];
+                if (r->writing)
+                {
+                    writes++;
+                    latency = model->Latency(r->sector, TRUE, sent);
+                    model->Accept(r->sector, TRUE, sent);
+                    CacheInsert(key);
+                    head = r->sector;
+                }
+                else if (CacheLookup(key))
+                {
+                    reads++;
+                    hits++;
+                    latency = 0;
+                }
+                else
+                {
+                    reads++;
+                    latency = model->Latency(r->sector, FALSE, sent);
+                    model->Accept(r->sector, FALSE, sent);
+                    CacheInsert(key);
+                    head = r->sector;
+                }
+                newLatency += latency;
+                if (sent + latency > done)
+                    done = sent + latency;
+            }
+        }
+        if (first >= 0)
+        {
+            if (oldDone - first > oldElapsed)
+                oldElapsed = oldDone - first;
+            if (done - first > newElapsed)
+                newElapsed = done - first;
+        }
+        delete model;
+    }
+    delete[] window;
+    delete[] records;
+
+    totalLatency = newLatency;
+    printf("Replay of %s: model %s, scheduler %s, cache %d sectors\n",
+           fileName, modelSpec, scheduler, cacheSectors);
+    printf("Requests: %d (%d reads, %d writes) on %d disks, cache hits %d\n",
+           reads + writes, reads, writes, numUnits, hits);
+    printf("Latency: original %.0f ticks (mean %.1f), replayed %.0f ticks (mean %.1f)\n",
+           oldLatency, numRecords ? oldLatency / numRecords : 0.0,
+           newLatency, numRecords ? newLatency / numRecords : 0.0);
+    printf("Elapsed: original %d ticks, replayed %d ticks\n",
+           oldElapsed, newElapsed);
+    return TRUE;
+}
@@ -0,0 +1,117 @@
+// disktrace.h
+//	Data structures to record every request the simulated disks serve
+//	in a binary trace file, and to replay such a trace later on.
+//
+//	A trace is a small header followed by one fixed size record per
+//	request, in the order the requests were sent to the disks.  Records
+//	are buffered in memory, so tracing costs one host write per
+//	TraceBufferSize requests and never changes the simulated time.
+//
+//	The replayer runs a trace through a latency model (diskmodel.h),
+//	optionally reordering the requests with a disk scheduler and
+//	serving reads out of a sector cache, without running Nachos at
+//	all.  That makes it cheap to ask "what if" questions about a
+//	workload: how would it do on an SSD, with an elevator, with a
+//	bigger buffer cache, ...
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef DISKTRACE_H
+#define DISKTRACE_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "hash.h"
+
+// One disk request, as stored in the trace file: 16 bytes.
+
+class DiskTraceRecord {
+  public:
+    int tick;				// when the request was sent
+    int sector;				// which sector (of its disk)
+    int latency;			// how long the disk took
+    short thread;			// ID of the thread that sent it
+    char unit;				// which disk
+    char writing;			// 1 for a write, 0 for a read
+};
+
+const int TraceBufferSize = 512;	// records kept before a host write
+
+// The following class records requests to a trace file.
+
+class DiskTrace {
+  public:
+    DiskTrace(char *fileName);		// Start a new trace in "fileName"
+    ~DiskTrace();			// Flush the last records, and close
+
+    void Record(int tick, int unit, int sector, bool writing,
+		int latency, int thread);
+					// Append one request to the trace
+
+  private:
+    int fileno;				// UNIX file the trace goes to
+    DiskTraceRecord *buffer;		// records not yet written out
+    int numBuffered;			// how many of them there are
+
+    void Flush();			// write out the buffered records
+};
+
+// The following class replays a trace through a latency model.
+//
+// Each disk of the trace gets a model of its own.  Requests keep the gaps
+// between them that the original run had (the time the threads spent
+// computing), but take as long as the new model says.  Within a window
+// of ReplayWindow consecutive requests to one disk, the scheduler may
+// serve the sectors in another order:
+//
+//	fifo		in trace order (the Nachos disk driver)
+//	sstf		nearest sector to the head first
+//	scan		elevator: upwards from the head, then back down
+//
+// With a cache of "cacheSectors" sectors (managed with the CLOCK
+// approximation of LRU), reads that hit cost nothing; writes go
+// through to the disk and keep the cache up to date.
+
+const int ReplayWindow = 16;
+
+class DiskReplayer {
+  public:
+    DiskReplayer(char *modelSpec, char *scheduler, int cacheSectors);
+					// Set up a replay; "modelSpec" as
+					// in diskmodel.h
+    ~DiskReplayer();
+
+    bool Replay(char *fileName);	// Replay trace "fileName" and print
+					// a report; FALSE if it can't be read
+    void SetRemap(int *remap, int numDisks);
+					// Replay sectors at new locations
+    double TotalLatency() { return totalLatency; }
+					// Ticks the disks took, in the last
+					// replay
+
+    static DiskTraceRecord *Load(char *fileName, int *numRecords);
+					// Read a whole trace into memory
+
+  private:
+    char *modelSpec;			// latency model of each disk
+    char *scheduler;			// "fifo", "sstf" or "scan"
+    int cacheSectors;			// size of the cache, 0 for none
+    int *remap;				// new location of each sector, or NULL
+    int remapDisks;			// disks the sectors are striped over
+    double totalLatency;		// result of the last replay
+
+    int *cacheKey;			// which unit/sector each slot holds,
+					// or -1
+    bool *cacheUsed;			// referenced since the hand passed?
+    int cacheHand;			// next slot CLOCK looks at
+    HashTable<int, int *> *cacheIndex;	// key -> its entry in cacheKey
+
+    bool CacheLookup(int key);		// TRUE if "key" is cached
+    void CacheInsert(int key);		// cache "key", evicting if need be
+    void Schedule(DiskTraceRecord **window, int count, int head);
+					// put a window in service order
+};
+
+#endif // DISKTRACE_H
@@ -22,6 +22,41 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numSyscalls = 0;
+    for (int i = 0; i < NumDiskCategories; i++)
+        diskReads[i] = diskWrites[i] = 0;
+    for (int i = 0; i < NumHistogramBuckets; i++)
+        seekHistogram[i] = latencyHistogram[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// HistogramBucket
+// 	Return the histogram bucket "value" falls into.
+//----------------------------------------------------------------------
+
+static int
+HistogramBucket(int value)
+{
+    int bucket = 0;
+
+    while (value > 0 && bucket < NumHistogramBuckets - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+//----------------------------------------------------------------------
+// Statistics::RecordDiskRequest
+// 	Count a disk request that moved the head "seekDistance" tracks
+//	and took "latency" ticks.
+//----------------------------------------------------------------------
+
+void
+Statistics::RecordDiskRequest(int seekDistance, int latency)
+{
+    seekHistogram[HistogramBucket(seekDistance)]++;
+    latencyHistogram[HistogramBucket(latency)]++;
 }
 
 //----------------------------------------------------------------------
@@ -40,6 +75,73 @@ Statistics::Print()
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
     cout << "Paging: faults " << numPageFaults << "\n";
+    cout << "System calls: " << numSyscalls << "\n";
     cout << "Network I/O: packets received " << numPacketsRecvd;
 		cout << ", sent " << numPacketsSent << "\n";
 }
+
+static const char *categoryNames[NumDiskCategories] = {
+    "data", "header", "directory", "bitmap", "snapshot", "dedup", "orphan"
+};
+
+//----------------------------------------------------------------------
+// PrintHistogram
+// 	Print one histogram, as a table of non-empty buckets with their
+//	ranges, or as a JSON array of all bucket counts.
+//----------------------------------------------------------------------
+
+static void
+PrintHistogram(const char *title, int *histogram, bool json)
+{
+    int last = NumHistogramBuckets - 1;
+
+    if (json) {
+        cout << "\"" << title << "\": [";
+        for (int i = 0; i <= last; i++)
+            cout << (i > 0 ? ", " : "") << histogram[i];
+        cout << "]";
+        return;
+    }
+    cout << title << ":\n";
+    for (int i = 0; i <= last; i++) {
+        if (histogram[i] == 0)
+            continue;
+        if (i == 0)
+            cout << "  0";
+        else if (i == last)
+            cout << "  >= " << (1 << (i - 1));
+        else
+            cout << "  " << (1 << (i - 1)) << "-" << ((1 << i) - 1);
+        cout << ": " << histogram[i] << "\n";
+    }
+}
+
+//----------------------------------------------------------------------
+// Statistics::PrintDisk
+// 	Print where the disk requests went: reads and writes of each
+//	category, and the seek distance and latency histograms.
+//
+//	"json" -- print a JSON object instead of a table
+//----------------------------------------------------------------------
+
+void
+Statistics::PrintDisk(bool json)
+{
+    if (json) {
+        cout << "{\"reads\": " << numDiskReads << ", \"writes\": " << numDiskWrites;
+        for (int i = 0; i < NumDiskCategories; i++)
+            cout << ", \"" << categoryNames[i] << "\": {\"reads\": " << diskReads[i]
+                 << ", \"writes\": " << diskWrites[i] << "}";
+        cout << ", ";
+        PrintHistogram("seekTracks", seekHistogram, TRUE);
+        cout << ", ";
+        PrintHistogram("latencyTicks", latencyHistogram, TRUE);
+        cout << "}";
+        return;
+    }
+    printf("%-22s%10s %10s\n", "Disk I/O by category:", "reads", "writes");
+    for (int i = 0; i < NumDiskCategories; i++)
+        printf("  %-20s%10d %10d\n", categoryNames[i], diskReads[i], diskWrites[i]);
+    PrintHistogram("Seek distance (tracks)", seekHistogram, FALSE);
+    PrintHistogram("Latency (ticks)", latencyHistogram, FALSE);
+}
@@ -13,6 +13,23 @@
 
 #include "copyright.h"
 
+// Disk requests are counted separately by what they were for.
+
+enum DiskCategory { DataIO,		// contents of a file
+		    HeaderIO,		// file headers
+		    DirectoryIO,	// directory contents
+		    BitmapIO,		// the free map
+		    SnapshotIO,		// what filesystem snapshots keep
+		    DedupIO,		// sector reference counts and hashes
+		    OrphanIO,		// removed files still to free
+		    NumDiskCategories };
+
+// Seek distances (in tracks) and request latencies (in ticks) are kept
+// as histograms with power-of-two buckets: bucket 0 counts zeroes, and
+// bucket i counts values from 2^(i-1) up to 2^i - 1.
+
+const int NumHistogramBuckets = 24;
+
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
 // many user instructions executed, etc.
@@ -35,10 +52,22 @@ class Statistics {
     int numPageFaults;		// number of virtual memory page faults
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numSyscalls;		// number of system calls made by user programs
+
+    int diskReads[NumDiskCategories];	// disk reads and writes, by
+    int diskWrites[NumDiskCategories];	// what they were for
+    int seekHistogram[NumHistogramBuckets];	// disk requests by tracks
+						// moved since the last one
+    int latencyHistogram[NumHistogramBuckets];	// disk requests by ticks
+						// they took
 
     Statistics(); 		// initialize everything to zero
 
     void Print();		// print collected statistics
+    void PrintDisk(bool json);	// print the disk statistics above, as
+				// a table or as a JSON object
+    void RecordDiskRequest(int seekDistance, int latency);
+				// add a request to the histograms
 };
 
 // Constants used to reflect the relative time an operation would
@@ -0,0 +1,10 @@
+# Several opens of one file.  The append program opens /log three
+# times, and appends to it through each in turn; each write goes into
+# the file the opens before it grew, and closing an open must not cut
+# off what the others added.  Last, space is reserved for /log
+# (Fallocate) while it is open, and that open appends into it.  It prints
+# "passed" if all went as expected; /log then holds one to four.
+../build.linux/nachos -f
+../build.linux/nachos -cp append /append
+../build.linux/nachos -e /append
+../build.linux/nachos -p /log
@@ -0,0 +1,89 @@
+# File system benchmarks.  Run "make" here first, to build the bench_*
+# user programs.
+#
+# Each benchmark is set up by a few unmeasured Nachos runs (format,
+# copy the program in as /prog, write its parameters to /bench.cfg),
+# then measured by one run of the program with -bench.  Every measured
+# run prints one line of JSON:
+#
+#   {"bench": ..., "ticks": ..., "diskReads": ..., "diskWrites": ...,
+#    "syscalls": ..., "wallSeconds": ...}
+#
+# Those lines are collected in bench.json; extra Nachos flags (a disk
+# model, striping, ...) can be given as arguments, eg. "-dm ssd".
+NACHOS="../build.linux/nachos $*"
+rm -f bench.json
+
+setup() {	# setup <program> [format flags]: fresh disk with the program on it
+    $NACHOS -f $2 -cp $1 /prog > /dev/null
+}
+
+params() {	# params <numbers>: parameters of the next run
+    echo "$*" > bench.cfg
+    $NACHOS -r /bench.cfg -cp bench.cfg /bench.cfg > /dev/null
+}
+
+run() {		# run <name> [flags]: measure one run of /prog
+    $NACHOS $2 -bench $1 -e /prog | grep '^{"bench"' | tee -a bench.json
+}
+
+# Sequential and random writes, then reads, of a 64KB file
+for size in 128 1024 4096
+do
+    setup bench_io
+    params 1 0 65536 $size; run seqwrite_$size
+    params 0 0 65536 $size; run seqread_$size
+    params 1 1 65536 $size; run randwrite_$size
+    params 0 1 65536 $size; run randread_$size
+done
+
+# The same sequential runs, on a disk of 1KB (8-sector) clusters
+setup bench_io "-cs 8"
+params 1 0 65536 4096; run seqwrite_cluster8
+params 0 0 65536 4096; run seqread_cluster8
+
+# Create/open/remove many small files
+for size in 64 1024
+do
+    setup bench_small
+    params 50 $size; run smallfiles_$size
+done
+
+# Path lookup at the bottom of a deep tree, by full path and from a
+# directory handle
+for depth in 4 16
+do
+    setup bench_deep
+    dir=""
+    for i in $(seq $depth)
+    do
+        dir="$dir/d"
+        $NACHOS -mkdir $dir > /dev/null
+    done
+    echo deep > bench.cfg
+    $NACHOS -cp bench.cfg $dir/f > /dev/null
+    params $depth 100; run deeppath_$depth
+    params $depth 100 1; run deeppath_at_$depth
+done
+
+# A byte at a time, with a system call per byte, and through bufio
+# streams
+setup bench_bytes
+params 4096 0; run bytes_raw
+params 4096 1; run bytes_buffered
+
+# A long create/remove churn with each allocation policy, and how
+# fragmented it leaves the files and the free space
+for policy in first best nearest
+do
+    setup bench_churn
+    params 2000 50 16384; run churn_$policy "-alloc $policy"
+    $NACHOS -fragstat | grep '^Fragmentation' | sed "s/^/churn_$policy: /"
+done
+
+# Mixed metadata operations over two directories
+setup bench_meta
+$NACHOS -mkdir /a > /dev/null
+params 300 20; run metadata_mix
+
+rm -f bench.cfg
@@ -0,0 +1,8 @@
+# Clusters.  The disk is formatted with 8-sector (1KB) clusters, which
+# the next runs find from the free map's length: /a reads back whole,
+# and -D shows the cluster size, the file's blocks a cluster apart, and
+# a bit per cluster in the free map.  Deduplication is refused.
+../build.linux/nachos -f -cs 8 -cp num_1000.txt /a -cp num_100.txt /b
+../build.linux/nachos -p /a | cmp - num_1000.txt
+../build.linux/nachos -r /b -dedup on -l /
+../build.linux/nachos -D
@@ -0,0 +1,12 @@
+# Compressed files.  num_1000.txt is copied in twice: as it is, and
+# compressed.  Both must read back the same, and the -ios table shows
+# how many data sectors reading each of them takes; the compressed
+# copy should need about half as many.
+../build.linux/nachos -f -cp num_1000.txt /plain
+../build.linux/nachos -cpz num_1000.txt /packed
+../build.linux/nachos -p /packed | cmp - num_1000.txt
+../build.linux/nachos -ios table -cpout /plain plain.out
+../build.linux/nachos -ios table -cpout /packed packed.out
+cmp plain.out num_1000.txt
+cmp packed.out num_1000.txt
+rm -f plain.out packed.out
@@ -0,0 +1,13 @@
+# Sector deduplication.  With it on, a second copy of num_1000.txt finds
+# its blocks on disk already, and -dedupstat shows them shared; the copy
+# reads back whole.  Removing /a leaves /b as it was, and the sectors
+# with only one block left are no longer shared.  With it off, as it is
+# by default, a copy leaves the table alone: the dedup line of -ios
+# shows only its head read at mount, and 0 writes.
+../build.linux/nachos -f -dedup on -cp num_1000.txt /a -dedupstat
+../build.linux/nachos -cp num_1000.txt /b -dedupstat
+../build.linux/nachos -p /b | cmp - num_1000.txt
+../build.linux/nachos -r /a -dedupstat
+../build.linux/nachos -p /b | cmp - num_1000.txt
+../build.linux/nachos -f
+../build.linux/nachos -cp num_1000.txt /c -ios table | grep '^  dedup '
@@ -0,0 +1,27 @@
+# Deep directory trees.  /d nests 70 directories, more than a recursive
+# listing goes into: -lr / shows the first 64 levels, the last of them
+# listed but not entered.  /long nests 24 directories of the longest
+# names, whose paths come close to what a command can name; all 25
+# levels, down to the file at the bottom, are listed.
+mkdir -p deep_src/d long_src/long
+p=deep_src/d
+for i in $(seq 2 70)
+do
+    p=$p/d
+    mkdir $p
+done
+echo bottom > $p/f
+p=long_src/long
+for i in $(seq 1 24)
+do
+    p=$p/ddddddddd
+    mkdir $p
+done
+echo bottom > $p/f
+../build.linux/nachos -f -cpr deep_src /
+../build.linux/nachos -lr / | wc -l
+../build.linux/nachos -lr / | tail -1
+../build.linux/nachos -cpr long_src /
+../build.linux/nachos -lr /long | wc -l
+../build.linux/nachos -lr /long | tail -1
+rm -rf deep_src long_src
@@ -0,0 +1,17 @@
+# Defragmenter.  Run "make" here first, to build frag.
+#
+# frag grows two files in turns, so their blocks are interleaved.  A
+# trace of reading /a back is the workload: the defragmenter moves /a
+# first, reports the fragmentation score before and after, and how
+# much faster the trace replays with the files moved.  Both files
+# must read back the same afterwards.
+NACHOS="../build.linux/nachos $*"
+$NACHOS -f -cp frag /frag > /dev/null
+$NACHOS -e /frag > /dev/null
+$NACHOS -p /a > defrag_a.before
+$NACHOS -p /b > defrag_b.before
+$NACHOS -trace defrag.trace -p /a > /dev/null
+$NACHOS -defrag -dtrace defrag.trace
+$NACHOS -p /a | cmp - defrag_a.before
+$NACHOS -p /b | cmp - defrag_b.before
+rm -f defrag.trace defrag_a.before defrag_b.before
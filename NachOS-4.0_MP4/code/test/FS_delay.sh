@@ -0,0 +1,7 @@
+# Delayed allocation.  -cpa writes num_1000.txt into an empty file, a
+# little at a time; its blocks are only allocated when the write buffer
+# fills, and when the file is closed, so they are laid out in runs.
+# The file must read back whole, and be as long as a -cp copy.
+../build.linux/nachos -f -cpa num_1000.txt /a
+../build.linux/nachos -p /a | cmp - num_1000.txt
+../build.linux/nachos -cp num_1000.txt /b -l /
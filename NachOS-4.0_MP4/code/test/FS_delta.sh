@@ -0,0 +1,14 @@
+# Incremental backups.  A full snapshot is taken after the first file,
+# and a delta after each change after that; restoring the snapshot and
+# applying the deltas in order must bring back the same files.  The
+# deltas hold the few dozen sectors each change wrote, not the disk.
+# The changed-block map is started afresh, so the snapshot goes up to
+# generation 1, and the deltas to 2 and 3.
+rm -f DISK_0.cbt
+../build.linux/nachos -f -cp num_100.txt /a -snapshot full.snap
+../build.linux/nachos -cp num_1000.txt /b -delta 1 d1.delta
+../build.linux/nachos -r /a -delta 2 d2.delta
+../build.linux/nachos -restore full.snap -l /
+../build.linux/nachos -applydelta d1.delta -p /b | cmp - num_1000.txt
+../build.linux/nachos -applydelta d2.delta -l /
+rm -f full.snap d1.delta d2.delta
@@ -0,0 +1,9 @@
+# Directory handles.  The dirat program opens a handle on /dir, and
+# creates, opens and removes files through it, checking every return
+# code; /dir can't be removed while the handle is open, and once it
+# is closed the handle is refused.  It prints "passed" if all went as
+# expected; /dir is then left with only g in it.
+../build.linux/nachos -f -mkdir /dir
+../build.linux/nachos -cp dirat /dirat
+../build.linux/nachos -e /dirat
+../build.linux/nachos -l /dir
@@ -0,0 +1,17 @@
+# Indexed directories.  /big is a B+-tree directory (-mkdirb); 300
+# files are imported into it, more than a table directory can hold.
+# Every name must be listed once, and one must be found, read and
+# removed like in any other directory.
+mkdir -p index_src
+for i in $(seq 1 300)
+do
+    echo "file $i" > index_src/f$i
+done
+../build.linux/nachos -f -mkdirb /big
+../build.linux/nachos -cpr index_src /big
+../build.linux/nachos -l /big | sort | uniq | wc -l
+../build.linux/nachos -p /big/f123
+../build.linux/nachos -r /big/f123
+../build.linux/nachos -l /big | wc -l
+../build.linux/nachos -lr / | head -3
+rm -rf index_src
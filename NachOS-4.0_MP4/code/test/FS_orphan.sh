@@ -0,0 +1,8 @@
+# Background freeing.  Removing /a only takes it out of / and puts its
+# header on the orphan list; -d f shows the reclaiming thread freeing it
+# afterwards, a batch of headers at a time.  /b reads back whole, and
+# the free map (-D) has the sectors of /a clear again.
+../build.linux/nachos -f -cp num_1000.txt /a -cp num_1000.txt /b
+../build.linux/nachos -d f -r /a | grep -i orphan
+../build.linux/nachos -p /b | cmp - num_1000.txt
+../build.linux/nachos -l / -D
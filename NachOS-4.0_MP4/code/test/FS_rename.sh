@@ -0,0 +1,18 @@
+# Rename.  A file is renamed in its directory, moved to another
+# directory, and a directory is moved with everything below it; the
+# data must read back the same each time.  Renaming onto an existing
+# name, or a directory into itself, must fail and change nothing.
+../build.linux/nachos -f
+../build.linux/nachos -mkdir /d1
+../build.linux/nachos -mkdir /d2
+../build.linux/nachos -cp num_100.txt /d1/a
+../build.linux/nachos -mv /d1/a /d1/b
+../build.linux/nachos -p /d1/b
+../build.linux/nachos -mv /d1/b /d2/c
+../build.linux/nachos -p /d2/c
+../build.linux/nachos -mv /d2 /d1/d2
+../build.linux/nachos -lr /
+../build.linux/nachos -cp num_100.txt /e
+../build.linux/nachos -mv /e /d1/d2/c
+../build.linux/nachos -mv /d1 /d1/d2/x
+../build.linux/nachos -lr /
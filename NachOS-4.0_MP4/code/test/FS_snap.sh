@@ -0,0 +1,22 @@
+# Filesystem snapshots.  Snapshot s1 is taken with /a holding num_100.txt;
+# then /a is removed, and made again with num_1000.txt in it, which
+# rewrites the root directory; the sectors of the old /a stay with s1.
+# Viewing s1 must show the old /a, and no /b; the live file system the
+# new ones.  Removing a file while viewing s1 is refused, and /a is
+# still there after.  Deleting s1 gives back the sectors it kept.  Taking s2,
+# then removing /a and writing /c in the same run, takes and gives back
+# sectors of the snapshot pool; -fragstat, still in that run, must find
+# the free extents in step with the free map (no "out of step" line).
+../build.linux/nachos -f -cp num_100.txt /a
+../build.linux/nachos -snap s1 -cp num_1000.txt /b
+../build.linux/nachos -r /a
+../build.linux/nachos -cp num_1000.txt /a
+../build.linux/nachos -snapls -l /
+../build.linux/nachos -snapview s1 -l /
+../build.linux/nachos -snapview s1 -p /a | cmp - num_100.txt
+../build.linux/nachos -p /a | cmp - num_1000.txt
+../build.linux/nachos -snapview s1 -r /a
+../build.linux/nachos -p /a | cmp - num_1000.txt
+../build.linux/nachos -snaprm s1 -snapls
+../build.linux/nachos -snap s2 -r /a -cp num_100.txt /c -fragstat
+../build.linux/nachos -snaprm s2 -fragstat
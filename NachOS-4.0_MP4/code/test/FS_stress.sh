@@ -0,0 +1,18 @@
+# Concurrency.  -fsstress runs kernel threads that create, write, read
+# and remove files in one directory at the same time, write their own
+# blocks of one shared file and append more past its end, and race
+# each other to create and remove one name.  Each run prints one line with the ticks it took and the
+# errors it found, which must be 0 (and no "sectors leaked" line).
+#
+# With the disk striped, threads waiting for different disks overlap:
+# 4 threads should do their 4 times the work in well under 4 times
+# the ticks of 1.
+for disks in 1 4
+do
+    echo "=== $disks disk(s)"
+    for threads in 1 4 8
+    do
+        ../build.linux/nachos -disks $disks -sparse -f -fsstress $threads
+    done
+done
+rm -f DISK_0_*
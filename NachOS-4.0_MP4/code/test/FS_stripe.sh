@@ -0,0 +1,12 @@
+# Sequential bandwidth of a disk striped over 1, 2, 4 and 8 disks.
+# A 1MB file is imported and exported again on each configuration;
+# compare the "sectors per simulated second" that Nachos reports.
+head -c 1048576 /dev/urandom > stripe.bin
+for disks in 1 2 4 8
+do
+    echo "=== $disks disk(s)"
+    ../build.linux/nachos -disks $disks -sparse -f -cpr stripe.bin /big
+    ../build.linux/nachos -disks $disks -sparse -cpout /big stripe.out
+    cmp stripe.bin stripe.out
+done
+rm -f stripe.bin stripe.out DISK_0_*
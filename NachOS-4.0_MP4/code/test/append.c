@@ -0,0 +1,59 @@
+/* append.c
+ *	Three opens of one file, all made before any write, appending to
+ *	it in turn: each must see what the others added, and not cut it
+ *	off when it grows the file.  Then space is reserved for it while
+ *	it is open, and the open appends into that space.
+ *
+ *	FS_append.sh prints /log after the run: it should hold "one",
+ *	"two", "three" and "four", a line each.
+ */
+
+#include "syscall.h"
+
+int main(void)
+{
+	char buffer[20];
+	OpenFileId a, b, c;
+
+	if (Create("/log", 0) != 1)
+		MSG("Failed on creating /log");
+	a = Open("/log");
+	b = Open("/log");
+	c = Open("/log");
+	if (a < 0 || b < 0 || c < 0)
+		MSG("Failed on opening /log three times");
+
+	if (Write("one\n", 4, a) != 4)
+		MSG("Failed on writing one");
+	if (Close(a) != 1)
+		MSG("Failed on closing the first open");
+	if (Seek(4, b) != 1)
+		MSG("The second open didn't see one");
+	if (Write("two\n", 4, b) != 4)
+		MSG("Failed on writing two");
+	if (Close(b) != 1)
+		MSG("Failed on closing the second open");
+	if (Seek(8, c) != 1)
+		MSG("The third open didn't see two");
+	if (Write("three\n", 6, c) != 6)
+		MSG("Failed on writing three");
+	if (Close(c) != 1)
+		MSG("Failed on closing the third open");
+
+	/* space reserved while the file is open is written into */
+	a = Open("/log");
+	if (a < 0 || Fallocate("/log", 1024, 1) != 1)
+		MSG("Failed on reserving space for /log");
+	if (Seek(14, a) != 1 || Write("four\n", 5, a) != 5)
+		MSG("Failed on writing four");
+	if (Close(a) != 1)
+		MSG("Failed on closing the open of the reserved file");
+
+	a = Open("/log");
+	if (Read(buffer, 20, a) != 19 || buffer[0] != 'o' ||
+		buffer[4] != 't' || buffer[8] != 't' || buffer[14] != 'f' ||
+		buffer[18] != '\n')
+		MSG("Failed on reading back /log");
+	Close(a);
+	MSG("Appending through several opens: passed");
+}
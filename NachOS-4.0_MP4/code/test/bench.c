@@ -0,0 +1,58 @@
+/* bench.c
+ *	Helpers shared by the file system benchmarks.  See bench.h.
+ */
+
+#include "bench.h"
+
+int params[MaxParams];
+
+int ReadParams()
+{
+	char text[128];
+	OpenFileId fid;
+	int count, n, i;
+
+	fid = Open("/bench.cfg");
+	if (fid < 0)
+		MSG("Failed on opening /bench.cfg");
+	count = Read(text, sizeof(text) - 1, fid);
+	Close(fid);
+
+	n = 0;
+	i = 0;
+	while (i < count && n < MaxParams) {
+		while (i < count && (text[i] < '0' || text[i] > '9'))
+			i++;
+		if (i == count)
+			break;
+		params[n] = 0;
+		while (i < count && text[i] >= '0' && text[i] <= '9')
+			params[n] = params[n] * 10 + text[i++] - '0';
+		n++;
+	}
+	return n;
+}
+
+void MakeName(char *name, char *prefix, int number)
+{
+	char digits[12];
+	int n = 0;
+
+	while (*prefix)
+		*name++ = *prefix++;
+	do {
+		digits[n++] = '0' + number % 10;
+		number /= 10;
+	} while (number > 0);
+	while (n > 0)
+		*name++ = digits[--n];
+	*name = '\0';
+}
+
+static unsigned int seed = 12345;
+
+int Random(int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % range;
+}
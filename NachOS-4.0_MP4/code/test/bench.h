@@ -0,0 +1,33 @@
+/* bench.h
+ *	Helpers shared by the file system benchmarks (bench_*.c).
+ *
+ *	A benchmark takes its parameters from the Nachos file /bench.cfg,
+ *	a line of decimal numbers that FS_bench.sh copies in before each
+ *	run, so that one program can be run at several sizes.
+ *
+ *	Link bench.o in, next to start.o (see the Makefile).
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "syscall.h"
+
+#define MaxParams 8
+
+extern int params[MaxParams];
+
+/* Read up to MaxParams numbers from /bench.cfg into params[];
+ * return how many there were.
+ */
+int ReadParams();
+
+/* Store "prefix" followed by the decimal "number" in "name". */
+void MakeName(char *name, char *prefix, int number);
+
+/* A number from 0 to "range" - 1, from a small linear congruential
+ * generator, so runs are repeatable.
+ */
+int Random(int range);
+
+#endif /* BENCH_H */
@@ -0,0 +1,66 @@
+/* bench_bytes.c
+ *	A byte at a time writer and reader, like FS_test1: write /data one
+ *	byte per call, then read it back one byte per call.  With
+ *	<buffered> set the bytes go through a bufio stream, so the kernel
+ *	sees one Write (and one Read) per BufSize bytes; otherwise every
+ *	byte is a system call, and every Write changes a whole sector.
+ *
+ *	/bench.cfg: <bytes> <buffered>
+ */
+
+#include "bench.h"
+#include "bufio.h"
+
+int main(void)
+{
+	int bytes, buffered, i;
+	OpenFileId fid;
+	FILE *stream;
+	char c;
+
+	if (ReadParams() != 2)
+		MSG("Usage: <bytes> <buffered>");
+	bytes = params[0];
+	buffered = params[1];
+
+	if (buffered) {
+		stream = fopen("/data", "w");
+		if (stream == NULL)
+			MSG("Failed on opening /data");
+		for (i = 0; i < bytes; i++)
+			if (fputc('a' + i % 26, stream) < 0)
+				MSG("Failed on writing /data");
+		if (fclose(stream) < 0)
+			MSG("Failed on writing /data");
+
+		stream = fopen("/data", "r");
+		if (stream == NULL)
+			MSG("Failed on opening /data");
+		for (i = 0; i < bytes; i++)
+			if (fgetc(stream) != 'a' + i % 26)
+				MSG("Read back wrong data from /data");
+		fclose(stream);
+	} else {
+		Remove("/data");
+		if (Create("/data", 0) != 1)
+			MSG("Failed on creating /data");
+		fid = Open("/data");
+		if (fid < 0)
+			MSG("Failed on opening /data");
+		for (i = 0; i < bytes; i++) {
+			c = 'a' + i % 26;
+			if (Write(&c, 1, fid) != 1)
+				MSG("Failed on writing /data");
+		}
+		Close(fid);
+
+		fid = Open("/data");
+		if (fid < 0)
+			MSG("Failed on opening /data");
+		for (i = 0; i < bytes; i++)
+			if (Read(&c, 1, fid) != 1 || c != 'a' + i % 26)
+				MSG("Read back wrong data from /data");
+		Close(fid);
+	}
+	Halt();
+}
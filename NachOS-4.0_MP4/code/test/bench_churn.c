@@ -0,0 +1,59 @@
+/* bench_churn.c
+ *	A long create/remove churn: files of mixed sizes are created and
+ *	removed at random, and now and then one is grown instead, for
+ *	many rounds.  How fragmented that leaves the files and the free
+ *	space shows how well the allocator placed them (see -fragstat
+ *	in FS_bench.sh).
+ *
+ *	/bench.cfg: <rounds> <files> <max file size>
+ *
+ *	The files go in the root directory (/c0, /c1, ...), so <files>
+ *	must leave room there for /prog and /bench.cfg.
+ */
+
+#include "bench.h"
+
+#define MaxFiles 60
+
+int sizes[MaxFiles];	/* of each file, 0 if it doesn't exist */
+
+int main(void)
+{
+	char name[16];
+	int rounds, files, maxSize, size, i, r;
+
+	if (ReadParams() != 3)
+		MSG("Usage: <rounds> <files> <max file size>");
+	rounds = params[0];
+	files = params[1];
+	maxSize = params[2];
+	if (files <= 0 || files > MaxFiles || maxSize < 16)
+		MSG("Bad parameters");
+
+	for (i = 0; i < files; i++)
+		sizes[i] = 0;
+	for (r = 0; r < rounds; r++) {
+		i = Random(files);
+		MakeName(name, "/c", i);
+		if (sizes[i] == 0) {
+			/* mostly small files, and a few big ones */
+			if (Random(4) == 0)
+				size = Random(maxSize) + 1;
+			else
+				size = Random(maxSize / 16) + 1;
+			if (Create(name, size) != 1)
+				MSG("Failed on creating a file");
+			sizes[i] = size;
+		} else if (Random(4) == 0) {
+			size = sizes[i] + Random(maxSize / 16) + 1;
+			if (Fallocate(name, size, 0) != 1)
+				MSG("Failed on growing a file");
+			sizes[i] = size;
+		} else {
+			if (Remove(name) != 1)
+				MSG("Failed on removing a file");
+			sizes[i] = 0;
+		}
+	}
+	Halt();
+}
@@ -0,0 +1,57 @@
+/* bench_deep.c
+ *	Path lookup: open a file at the bottom of a deep directory tree
+ *	over and over, reading a few bytes each time.  With <at> set, the
+ *	bottom directory is opened once, and the file opened from it with
+ *	OpenAt, instead of by its full path.
+ *
+ *	/bench.cfg: <depth> <opens> [<at>]
+ *
+ *	FS_bench.sh builds the tree /d/d/.../d (<depth> levels) and puts
+ *	the file f at the bottom before the run.
+ */
+
+#include "bench.h"
+
+int main(void)
+{
+	char path[256];
+	char buffer[16];
+	int depth, opens, at, i, n;
+	OpenFileId fid;
+	DirId dir;
+
+	n = ReadParams();
+	if (n != 2 && n != 3)
+		MSG("Usage: <depth> <opens> [<at>]");
+	depth = params[0];
+	opens = params[1];
+	at = (n == 3) ? params[2] : 0;
+	if (depth * 2 + 3 > sizeof(path))
+		MSG("Too deep");
+
+	n = 0;
+	for (i = 0; i < depth; i++) {
+		path[n++] = '/';
+		path[n++] = 'd';
+	}
+	path[n] = '\0';
+	if (at) {
+		dir = OpenDir(path);
+		if (dir < 0)
+			MSG("Failed on opening the deep directory");
+	}
+	path[n++] = '/';
+	path[n++] = 'f';
+	path[n] = '\0';
+
+	for (i = 0; i < opens; i++) {
+		fid = at ? OpenAt(dir, "f") : Open(path);
+		if (fid < 0)
+			MSG("Failed on opening the deep file");
+		Read(buffer, sizeof(buffer), fid);
+		Close(fid);
+	}
+	if (at)
+		CloseDir(dir);
+	Halt();
+}
@@ -0,0 +1,51 @@
+/* bench_io.c
+ *	Sequential or random reads or writes of /data.
+ *
+ *	/bench.cfg: <write> <random> <file size> <I/O size>
+ *
+ *	A write run creates /data (if it is not there yet) and writes it
+ *	once over; a read run reads it once over.  Random runs move to an
+ *	I/O size aligned offset before each transfer.
+ */
+
+#include "bench.h"
+
+char buffer[4096];
+
+int main(void)
+{
+	int writing, random, fileSize, ioSize, count, i;
+	OpenFileId fid;
+
+	if (ReadParams() != 4)
+		MSG("Usage: <write> <random> <file size> <I/O size>");
+	writing = params[0];
+	random = params[1];
+	fileSize = params[2];
+	ioSize = params[3];
+	if (ioSize <= 0 || ioSize > sizeof(buffer) || fileSize < ioSize)
+		MSG("Bad I/O size");
+	count = fileSize / ioSize;
+
+	for (i = 0; i < ioSize; i++)
+		buffer[i] = 'a' + i % 26;
+	if (writing)
+		Create("/data", fileSize);
+	fid = Open("/data");
+	if (fid < 0)
+		MSG("Failed on opening /data");
+
+	for (i = 0; i < count; i++) {
+		if (random)
+			Seek(Random(count) * ioSize, fid);
+		if (writing) {
+			if (Write(buffer, ioSize, fid) != ioSize)
+				MSG("Failed on writing /data");
+		} else {
+			if (Read(buffer, ioSize, fid) != ioSize)
+				MSG("Failed on reading /data");
+		}
+	}
+	Close(fid);
+	Halt();
+}
@@ -0,0 +1,53 @@
+/* bench_meta.c
+ *	A mixed metadata workload, loosely after the small-file servers
+ *	of the classic benchmarks: files are created, written, reopened
+ *	and read, and removed again, in two directories, with a few of
+ *	them alive at any time.
+ *
+ *	/bench.cfg: <operations> <live files>
+ *
+ *	FS_bench.sh creates the directory /a before the run.
+ */
+
+#include "bench.h"
+
+char buffer[256];
+
+int main(void)
+{
+	char name[16];
+	int operations, live, i, n, size;
+	OpenFileId fid;
+
+	if (ReadParams() != 2)
+		MSG("Usage: <operations> <live files>");
+	operations = params[0];
+	live = params[1];
+	if (live <= 0 || live > 30)
+		MSG("Bad number of live files");
+
+	for (i = 0; i < sizeof(buffer); i++)
+		buffer[i] = 'a' + i % 26;
+	for (i = 0; i < operations; i++) {
+		n = Random(live);
+		MakeName(name, (n % 2) ? "/a/m" : "/m", n);
+		fid = Open(name);
+		if (fid < 0) {				/* create it */
+			size = 1 + Random(sizeof(buffer));
+			if (Create(name, size) != 1)
+				MSG("Failed on creating a file");
+			fid = Open(name);
+			if (fid < 0 || Write(buffer, size, fid) != size)
+				MSG("Failed on writing a file");
+			Close(fid);
+		} else if (Random(3) == 0) {		/* remove it */
+			Close(fid);
+			if (Remove(name) != 1)
+				MSG("Failed on removing a file");
+		} else {				/* read it */
+			Read(buffer, sizeof(buffer), fid);
+			Close(fid);
+		}
+	}
+	Halt();
+}
@@ -0,0 +1,52 @@
+/* bench_small.c
+ *	Many small files: create and write them all, open and read them
+ *	all, then remove them all.
+ *
+ *	/bench.cfg: <files> <file size>
+ *
+ *	The files go in the root directory (/f0, /f1, ...), so <files>
+ *	must leave room there for /prog, /bench.cfg and /data.
+ */
+
+#include "bench.h"
+
+char buffer[1024];
+
+int main(void)
+{
+	char name[16];
+	int files, size, i;
+	OpenFileId fid;
+
+	if (ReadParams() != 2)
+		MSG("Usage: <files> <file size>");
+	files = params[0];
+	size = params[1];
+	if (size <= 0 || size > sizeof(buffer))
+		MSG("Bad file size");
+
+	for (i = 0; i < size; i++)
+		buffer[i] = 'a' + i % 26;
+	for (i = 0; i < files; i++) {
+		MakeName(name, "/f", i);
+		if (Create(name, size) != 1)
+			MSG("Failed on creating a file");
+		fid = Open(name);
+		if (fid < 0 || Write(buffer, size, fid) != size)
+			MSG("Failed on writing a file");
+		Close(fid);
+	}
+	for (i = 0; i < files; i++) {
+		MakeName(name, "/f", i);
+		fid = Open(name);
+		if (fid < 0 || Read(buffer, size, fid) != size)
+			MSG("Failed on reading a file");
+		Close(fid);
+	}
+	for (i = 0; i < files; i++) {
+		MakeName(name, "/f", i);
+		if (Remove(name) != 1)
+			MSG("Failed on removing a file");
+	}
+	Halt();
+}
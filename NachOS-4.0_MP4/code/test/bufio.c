@@ -0,0 +1,138 @@
+/* bufio.c
+ *	Buffered file I/O for user programs.  See bufio.h.
+ */
+
+#include "bufio.h"
+
+static FILE streams[MaxStreams];
+static int streamsReady = 0;	/* streams[] initialized */
+
+/* Copy "n" bytes from "from" to "to". */
+static void CopyBytes(char *to, char *from, int n)
+{
+	while (n-- > 0)
+		*to++ = *from++;
+}
+
+FILE *fopen(char *name, char *mode)
+{
+	FILE *stream = NULL;
+	int i;
+
+	if (!streamsReady) {
+		for (i = 0; i < MaxStreams; i++)
+			streams[i].fid = -1;
+		streamsReady = 1;
+	}
+	for (i = 0; i < MaxStreams; i++)
+		if (streams[i].fid < 0) {
+			stream = &streams[i];
+			break;
+		}
+	if (stream == NULL || (mode[0] != 'r' && mode[0] != 'w'))
+		return NULL;
+
+	stream->writing = (mode[0] == 'w');
+	if (stream->writing) {		/* start from an empty file */
+		Remove(name);
+		if (Create(name, 0) != 1)
+			return NULL;
+	}
+	stream->fid = Open(name);
+	if (stream->fid < 0)
+		return NULL;
+	stream->count = stream->next = stream->eof = 0;
+	return stream;
+}
+
+int fflush(FILE *stream)
+{
+	int count = stream->count;
+
+	if (!stream->writing || count == 0)
+		return 0;
+	stream->count = 0;
+	return (Write(stream->buffer, count, stream->fid) == count) ? 0 : -1;
+}
+
+int fwrite(char *ptr, int size, int count, FILE *stream)
+{
+	int left = size * count;
+	int n;
+
+	if (!stream->writing || size <= 0)
+		return 0;
+	while (left > 0) {
+		if (stream->count == BufSize && fflush(stream) < 0)
+			break;
+		if (stream->count == 0 && left >= BufSize) {
+			/* a whole buffer's worth: no need to copy it */
+			n = left - left % BufSize;
+			if (Write(ptr, n, stream->fid) != n)
+				break;
+		} else {
+			n = BufSize - stream->count;
+			if (n > left)
+				n = left;
+			CopyBytes(stream->buffer + stream->count, ptr, n);
+			stream->count += n;
+		}
+		ptr += n;
+		left -= n;
+	}
+	return (size * count - left) / size;
+}
+
+int fread(char *ptr, int size, int count, FILE *stream)
+{
+	int left = size * count;
+	int n;
+
+	if (stream->writing || size <= 0)
+		return 0;
+	while (left > 0) {
+		if (stream->next == stream->count) {	/* refill */
+			if (stream->eof)
+				break;
+			stream->next = 0;
+			stream->count = Read(stream->buffer, BufSize, stream->fid);
+			if (stream->count <= 0) {
+				stream->count = 0;
+				stream->eof = 1;
+				break;
+			}
+		}
+		n = stream->count - stream->next;
+		if (n > left)
+			n = left;
+		CopyBytes(ptr, stream->buffer + stream->next, n);
+		stream->next += n;
+		ptr += n;
+		left -= n;
+	}
+	return (size * count - left) / size;
+}
+
+int fgetc(FILE *stream)
+{
+	char c;
+
+	return (fread(&c, 1, 1, stream) == 1) ? (unsigned char)c : -1;
+}
+
+int fputc(int c, FILE *stream)
+{
+	char byte = c;
+
+	return (fwrite(&byte, 1, 1, stream) == 1) ? (unsigned char)byte : -1;
+}
+
+int fclose(FILE *stream)
+{
+	int result = fflush(stream);
+
+	if (Close(stream->fid) != 1)
+		result = -1;
+	stream->fid = -1;
+	return result;
+}
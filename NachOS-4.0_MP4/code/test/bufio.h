@@ -0,0 +1,69 @@
+/* bufio.h
+ *	Buffered file I/O for user programs, after UNIX stdio.
+ *
+ *	Every Read or Write system call traps into the kernel, and a
+ *	Write of a few bytes makes OpenFile read, change and write back a
+ *	whole sector.  A program that writes a byte at a time through a
+ *	stream instead fills a buffer in its own memory, and the kernel
+ *	sees one Write per BufSize bytes; reads are batched the same way.
+ *
+ *	A stream is opened for reading ("r") or for writing ("w", which
+ *	creates the file, or empties it).  There is no malloc in Nachos
+ *	user programs, so streams come from a small static table.
+ *
+ *	Link bufio.o in, next to start.o (see the Makefile).
+ */
+
+#ifndef BUFIO_H
+#define BUFIO_H
+
+#include "syscall.h"
+
+#define BufSize 512	/* bytes buffered per stream: four sectors */
+#define MaxStreams 4	/* streams open at once */
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+typedef struct {
+	OpenFileId fid;		/* -1 if the stream is not in use */
+	int writing;		/* opened with "w" */
+	int count;		/* bytes in "buffer": waiting to be written,
+				 * or read ahead */
+	int next;		/* when reading, the next of them to return */
+	int eof;		/* a Read returned nothing */
+	char buffer[BufSize];
+} FILE;
+
+/* Open the file "name" for reading ("r") or writing ("w").  Return the
+ * stream, or NULL if the file can't be opened or all the streams are
+ * in use.
+ */
+FILE *fopen(char *name, char *mode);
+
+/* Read up to "count" items of "size" bytes from "stream" into "ptr";
+ * return how many whole items were read.
+ */
+int fread(char *ptr, int size, int count, FILE *stream);
+
+/* Write "count" items of "size" bytes from "ptr" to "stream"; return
+ * how many were written.
+ */
+int fwrite(char *ptr, int size, int count, FILE *stream);
+
+/* Read one byte from "stream", or return -1 at the end of the file. */
+int fgetc(FILE *stream);
+
+/* Write the byte "c" to "stream"; return it, or -1 on failure. */
+int fputc(int c, FILE *stream);
+
+/* Write what "stream" has buffered to its file.  Return 0, or -1 on
+ * failure.
+ */
+int fflush(FILE *stream);
+
+/* Flush and close "stream".  Return 0, or -1 on failure. */
+int fclose(FILE *stream);
+
+#endif /* BUFIO_H */
@@ -0,0 +1,65 @@
+/* dirat.c
+ *	Directory handles: create, write, open and remove files relative
+ *	to a handle on /dir, checking what each call returns, and then
+ *	make sure a closed handle is refused.
+ *
+ *	FS_dirat.sh makes /dir before the run, and lists it after: only
+ *	"g" should be left in it.
+ */
+
+#include "syscall.h"
+
+int main(void)
+{
+	char text[] = "relative\n";
+	char buffer[16];
+	OpenFileId fid;
+	DirId dir;
+
+	dir = OpenDir("/dir");
+	if (dir < 0)
+		MSG("Failed on opening /dir");
+	if (OpenDir("/nodir") >= 0)
+		MSG("Opened a directory that doesn't exist");
+
+	if (CreateAt(dir, "f", 0) != 1)
+		MSG("Failed on creating f");
+	if (CreateAt(dir, "f", 0) == 1)
+		MSG("Created f twice");
+	fid = OpenAt(dir, "f");
+	if (fid < 0)
+		MSG("Failed on opening f");
+	if (Write(text, 9, fid) != 9)
+		MSG("Failed on writing f");
+	if (Close(fid) != 1)
+		MSG("Failed on closing f");
+	fid = Open("/dir/f");
+	if (fid < 0)
+		MSG("Failed on opening /dir/f by its full path");
+	if (Read(buffer, 9, fid) != 9 || buffer[0] != 'r' || buffer[8] != '\n')
+		MSG("Failed on reading back /dir/f");
+	Close(fid);
+
+	if (Remove("/dir") == 1)
+		MSG("Removed /dir with a handle open on it");
+	if (RemoveAt(dir, "f") != 1)
+		MSG("Failed on removing f");
+	if (OpenAt(dir, "f") >= 0)
+		MSG("Opened f after removing it");
+	if (RemoveAt(dir, "f") == 1)
+		MSG("Removed f twice");
+	if (CreateAt(dir, "g", 0) != 1)
+		MSG("Failed on creating g");
+
+	if (CloseDir(dir) != 1)
+		MSG("Failed on closing the handle");
+	if (CloseDir(dir) >= 0)
+		MSG("Closed the handle twice");
+	if (OpenAt(dir, "g") >= 0)
+		MSG("Opened g through a closed handle");
+	if (CreateAt(dir, "h", 0) == 1)
+		MSG("Created h through a closed handle");
+	if (RemoveAt(dir, "g") == 1)
+		MSG("Removed g through a closed handle");
+	MSG("Directory handles: passed");
+}
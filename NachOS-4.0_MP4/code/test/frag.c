@@ -0,0 +1,44 @@
+/* frag.c
+ *	Fragment the disk on purpose: grow the files /a and /b by one
+ *	kilobyte at a time, taking turns, so that the blocks of each
+ *	end up interleaved with the other's.  Then fill them with text,
+ *	to check that the defragmenter keeps it (see FS_defrag.sh).
+ */
+
+#include "syscall.h"
+
+#define Steps 16
+#define Step 1024
+
+char buffer[Step];
+
+void Fill(char *name, char first)
+{
+	OpenFileId fid;
+	int i;
+
+	for (i = 0; i < Step; i++)
+		buffer[i] = (i % 64 == 63) ? '\n' : first + i % 26;
+	fid = Open(name);
+	if (fid < 0)
+		MSG("Failed on opening a file");
+	for (i = 0; i < Steps; i++)
+		if (Write(buffer, Step, fid) != Step)
+			MSG("Failed on writing a file");
+	Close(fid);
+}
+
+int main(void)
+{
+	int i;
+
+	if (Create("/a", 0) != 1 || Create("/b", 0) != 1)
+		MSG("Failed on creating a file");
+	for (i = 1; i <= Steps; i++)
+		if (Fallocate("/a", i * Step, 0) != 1 ||
+		    Fallocate("/b", i * Step, 0) != 1)
+			MSG("Failed on growing a file");
+	Fill("/a", 'a');
+	Fill("/b", 'A');
+	Halt();
+}
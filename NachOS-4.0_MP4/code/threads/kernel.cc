@@ -15,8 +15,12 @@
 #include "libtest.h"
 #include "string.h"
 #include "synchdisk.h"
+#include "diskmodel.h"
 #include "post.h"
 #include "synchconsole.h"
+#include "disktrace.h"
+#include "filelock.h"
+#include "pbitmap.h"
 
 //----------------------------------------------------------------------
 // Kernel::Kernel
@@ -32,7 +36,21 @@ Kernel::Kernel(int argc, char **argv)
     consoleOut = NULL;         // default is stdout
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
+    clusterSectors = 1;
 #endif
+    numDisks = 1;
+    diskModel = "hdd";
+    mapDiskFlag = FALSE;
+    sparseDiskFlag = FALSE;
+    restoreName = NULL;
+    deltaName = NULL;
+    traceName = NULL;
+    diskTrace = NULL;
+    fileLocks = NULL;
+    fileSystem = NULL;
+    benchName = NULL;
+    startTime = WallClock();
+    ioStatsFlag = ioStatsJson = FALSE;
     reliability = 1;            // network reliability, default is 1.0
     hostName = 0;               // machine id, also UNIX socket name
                                 // 0 is the default machine id
@@ -63,9 +81,55 @@ Kernel::Kernel(int argc, char **argv)
 #ifndef FILESYS_STUB
 		} else if (strcmp(argv[i], "-f") == 0) {
 	    	formatFlag = TRUE;
+        } else if (strcmp(argv[i], "-cs") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a power of two
+            clusterSectors = atoi(argv[i + 1]);
+            ASSERT(clusterSectors >= 1 && clusterSectors <= MaxClusterSectors &&
+                   (clusterSectors & (clusterSectors - 1)) == 0);
+            i++;
         // } else if (strcmp(argv[i], "-mkdir") == 0) {
 	    	// formatFlag = TRUE;
 #endif
+        } else if (strcmp(argv[i], "-disks") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            numDisks = atoi(argv[i + 1]);
+            ASSERT(numDisks >= 1 && numDisks <= MaxDisks);
+            i++;
+        } else if (strcmp(argv[i], "-dm") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a model name
+            diskModel = argv[i + 1];
+            DiskModel *model = DiskModel::Create(diskModel);
+            if (model == NULL) {
+                cerr << "Unknown disk model " << diskModel << "\n";
+                Exit(1);
+            }
+            delete model;
+            i++;
+        } else if (strcmp(argv[i], "-mmap") == 0) {
+            mapDiskFlag = TRUE;
+        } else if (strcmp(argv[i], "-sparse") == 0) {
+            sparseDiskFlag = TRUE;
+        } else if (strcmp(argv[i], "-restore") == 0) {
+            ASSERT(i + 1 < argc);
+            restoreName = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-applydelta") == 0) {
+            ASSERT(i + 1 < argc);
+            deltaName = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-bench") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is the benchmark name
+            benchName = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-trace") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is the trace file
+            traceName = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-ios") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is "table" or "json"
+            ioStatsFlag = TRUE;
+            ioStatsJson = (strcmp(argv[i + 1], "json") == 0);
+            i++;
         } else if (strcmp(argv[i], "-n") == 0) {
             ASSERT(i + 1 < argc);   // next argument is float
             reliability = atof(argv[i + 1]);
@@ -80,8 +144,13 @@ Kernel::Kernel(int argc, char **argv)
             cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
 #ifndef FILESYS_STUB
 	    	cout << "Partial usage: nachos [-nf]\n";
+	    	cout << "Partial usage: nachos [-f] [-cs clusterSectors]\n";
 #endif
             cout << "Partial usage: nachos [-n #] [-m #]\n";
+            cout << "Partial usage: nachos [-ios table|json]\n";
+            cout << "Partial usage: nachos [-trace traceFile]\n";
+            cout << "Partial usage: nachos [-bench benchmarkName]\n";
+            cout << "Partial usage: nachos [-disks #] [-dm diskModel] [-mmap] [-sparse] [-restore snapshotFile] [-applydelta deltaFile]\n";
 		}
     }
 }
@@ -111,11 +180,22 @@ Kernel::Initialize()
     machine = new Machine(debugUserProg);
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();    //
+    if (traceName != NULL)
+        diskTrace = new DiskTrace(traceName);	// record disk requests
+    synchDisk = new SynchDisk(numDisks, diskModel, mapDiskFlag, sparseDiskFlag);
+    if (restoreName != NULL && !synchDisk->LoadSnapshot(restoreName)) {
+        cerr << "Cannot restore the disk from snapshot " << restoreName << "\n";
+        Exit(1);
+    }
+    if (deltaName != NULL && synchDisk->ApplyDelta(deltaName) < 0) {
+        cerr << "Cannot apply delta " << deltaName << " to the disk\n";
+        Exit(1);
+    }
 #ifdef FILESYS_STUB
     fileSystem = new FileSystem();
 #else
-    fileSystem = new FileSystem(formatFlag);
+    fileLocks = new FileLockTable();	// before any file is opened
+    fileSystem = new FileSystem(formatFlag, clusterSectors);
 #endif // FILESYS_STUB
 
 	// MP4 mod tag
@@ -148,6 +228,17 @@ Kernel::PrepareToEnd()
 
 Kernel::~Kernel()
 {
+    if (ioStatsFlag)
+        PrintIOStats(ioStatsJson);
+    if (benchName != NULL)
+        PrintBenchmark();
+
+    // first, while the disk and interrupts still run: files left open
+    // flush their write buffers as they are deleted
+    delete fileSystem;
+#ifndef FILESYS_STUB
+    delete fileLocks;
+#endif
     delete stats;
     delete interrupt;
     delete scheduler;
@@ -156,7 +247,7 @@ Kernel::~Kernel()
     delete synchConsoleIn;
     delete synchConsoleOut;
     delete synchDisk;
-    delete fileSystem;
+    delete diskTrace;
 	
 	// Mp4 mod tag
 	/*
@@ -336,5 +427,272 @@ int Kernel::CreateFile(char *filename)
 {
 	return fileSystem->Create(filename);
 }
+#else
+
+// What the file system stress test shares between its threads.
+
+const int StressRounds = 16;		// files each thread creates
+const int StressFileSize = 600;		// bytes in each of them
+const int StressMaxThreads = 8;
+
+static Semaphore *stressDone;		// V'ed by each thread at the end
+static Lock *stressAppend;		// One append to /stress/shared at a time
+static int stressErrors;		// checks that failed
+static int stressOps;			// file system calls made
+static int stressRaceCreated;		// times /stress/race was created
+static int stressRaceRemoved;		// ... and removed
+
+static void
+StressError(int which, char *what, char *name)
+{
+    printf("FS stress: thread %d: %s %s\n", which, what, name);
+    stressErrors++;
+}
+
+//----------------------------------------------------------------------
+// StressFill/StressCheck
+// 	Fill a buffer with the contents thread "which" writes in round
+//	"round"; check that a buffer holds them.
+//----------------------------------------------------------------------
+
+static void
+StressFill(char *buffer, int size, int which, int round)
+{
+    for (int i = 0; i < size; i++)
+        buffer[i] = 'a' + (which * 7 + round * 3 + i) % 26;
+}
+
+static bool
+StressCheck(char *buffer, int size, int which, int round)
+{
+    char *expected = new char[size];
+    bool same;
+
+    StressFill(expected, size, which, round);
+    same = (memcmp(buffer, expected, size) == 0);
+    delete [] expected;
+    return same;
+}
+
+//----------------------------------------------------------------------
+// StressThread
+// 	The work of one thread of the stress test: create a file per
+//	round, write it and read it back, removing every other one;
+//	write its own block of a file all threads share, and append one
+//	past its end through another open, then read that back through
+//	the first; and race the other threads to create and remove the
+//	same name.
+//
+//	"arg" -- the number of the thread, from 0
+//----------------------------------------------------------------------
+
+static void
+StressThread(void *arg)
+{
+    int which = (int)(long) arg;
+    FileSystem *fs = kernel->fileSystem;
+    char name[32], buffer[StressFileSize];
+    OpenFile *file, *appender;
+    int position;
+
+    for (int round = 0; round < StressRounds; round++) {
+        sprintf(name, "/stress/t%d_%d", which, round);
+        StressFill(buffer, StressFileSize, which, round);
+        if (!fs->Create(name, StressFileSize, FALSE))
+            StressError(which, "can't create", name);
+        else if ((file = fs->Open(name)) == NULL)
+            StressError(which, "can't open", name);
+        else {
+            if (file->WriteAt(buffer, StressFileSize, 0) != StressFileSize)
+                StressError(which, "can't write", name);
+            delete file;
+        }
+        stressOps += 3;
+
+        file = fs->Open("/stress/shared");
+        StressFill(buffer, SectorSize, which, round);
+        file->WriteAt(buffer, SectorSize, which * SectorSize);
+        file->ReadAt(buffer, SectorSize, which * SectorSize);
+        if (!StressCheck(buffer, SectorSize, which, round))
+            StressError(which, "lost its block of", "/stress/shared");
+        stressAppend->Acquire();
+        appender = fs->Open("/stress/shared");
+        position = appender->Length();
+        if (appender->WriteAt(buffer, SectorSize, position) != SectorSize)
+            StressError(which, "can't append to", "/stress/shared");
+        delete appender; // grows the file, under the first open
+        stressAppend->Release();
+        if (file->ReadAt(buffer, SectorSize, position) != SectorSize ||
+            !StressCheck(buffer, SectorSize, which, round))
+            StressError(which, "lost its appended block of", "/stress/shared");
+        delete file;
+        stressOps += 7;
+
+        if (fs->Create("/stress/race", 0, FALSE))
+            stressRaceCreated++;
+        if (fs->Remove("/stress/race"))
+            stressRaceRemoved++;
+        stressOps += 2;
+
+        if (round % 2 == 1) {
+            sprintf(name, "/stress/t%d_%d", which, round - 1);
+            if (!fs->Remove(name))
+                StressError(which, "can't remove", name);
+            stressOps++;
+        }
+    }
+
+    for (int round = 1; round < StressRounds; round += 2) {
+        sprintf(name, "/stress/t%d_%d", which, round);
+        if ((file = fs->Open(name)) == NULL) {
+            StressError(which, "can't reopen", name);
+            continue;
+        }
+        if (file->ReadAt(buffer, StressFileSize, 0) != StressFileSize ||
+            !StressCheck(buffer, StressFileSize, which, round))
+            StressError(which, "read back wrong data from", name);
+        delete file;
+        stressOps += 2;
+    }
+    stressDone->V();
+}
+
+//----------------------------------------------------------------------
+// Kernel::FileSystemStress
+// 	Run "numThreads" threads that use the file system at once, in
+//	the indexed directory /stress, and check that:
+//
+//	   every file reads back what its thread wrote
+//	   /stress/shared holds every block the threads appended to it
+//	   no Create or Remove was lost: /stress holds exactly the files
+//	      the threads left there, and the name they raced for was
+//	      created once more than it was removed, or as many times
+//	   once everything is removed (and freed, rather than left to
+//	      the orphan list), the disk has as many free sectors as
+//	      before
+//
+//	Then print how long it took, in simulated ticks: with the disk
+//	striped (-disks), threads that wait for different disks make
+//	progress at the same time.
+//----------------------------------------------------------------------
+
+void
+Kernel::FileSystemStress(int numThreads)
+{
+    int freeBefore, start;
+    int expected, found, cursor;
+    Directory *directory;
+    DirectoryEntry entry;
+    OpenFile *shared;
+    char name[32];
+
+    ASSERT(numThreads >= 1 && numThreads <= StressMaxThreads);
+    fileSystem->ReclaimOrphans(); // files removed before must not be
+                                  // freed while we count
+    freeBefore = fileSystem->NumFreeSectors();
+    start = stats->totalTicks;
+    stressDone = new Semaphore("stress done", 0);
+    stressAppend = new Lock("stress append");
+    stressErrors = stressOps = 0;
+    stressRaceCreated = stressRaceRemoved = 0;
+    if (!fileSystem->Create("/stress", 0, TRUE, TRUE) ||
+        !fileSystem->Create("/stress/shared", numThreads * SectorSize, FALSE)) {
+        printf("FS stress: can't set up /stress\n");
+        delete stressDone;
+        delete stressAppend;
+        return;
+    }
+
+    for (int i = 0; i < numThreads; i++) {
+        Thread *t = new Thread("stress", threadNum++);
+        t->Fork(StressThread, (void *)(long) i);
+    }
+    for (int i = 0; i < numThreads; i++)
+        stressDone->P();
+    delete stressDone;
+    delete stressAppend;
+
+    expected = 1 + numThreads * StressRounds / 2 +
+               stressRaceCreated - stressRaceRemoved;
+    if (stressRaceCreated - stressRaceRemoved != 0 &&
+        stressRaceCreated - stressRaceRemoved != 1)
+        StressError(-1, "raced badly for", "/stress/race");
+    directory = fileSystem->FetchDirectory("/stress");
+    found = cursor = 0;
+    while (directory->NextEntry(&cursor, &entry))
+        found++;
+    delete directory;
+    if (found != expected)
+        StressError(-1, "found the wrong number of files in", "/stress");
+    shared = fileSystem->Open("/stress/shared");
+    if (shared->Length() != numThreads * (1 + StressRounds) * SectorSize)
+        StressError(-1, "lost appends to", "/stress/shared");
+    delete shared;
+
+    printf("FS stress: %d threads, %d operations in %d ticks, %d errors\n",
+           numThreads, stressOps, stats->totalTicks - start, stressErrors);
+
+    for (int i = 0; i < numThreads; i++)
+        for (int round = 1; round < StressRounds; round += 2) {
+            sprintf(name, "/stress/t%d_%d", i, round);
+            fileSystem->Remove(name);
+        }
+    fileSystem->Remove("/stress/race");
+    fileSystem->Remove("/stress/shared");
+    fileSystem->Remove("/stress");
+    fileSystem->ReclaimOrphans();
+    if (fileSystem->NumFreeSectors() != freeBefore)
+        printf("FS stress: %d sectors leaked\n",
+               freeBefore - fileSystem->NumFreeSectors());
+}
+#endif // FILESYS_STUB
+
+//----------------------------------------------------------------------
+// Kernel::PrintIOStats
+// 	Show where the disk I/O budget went: requests by category, seek
+//	distance and latency histograms, and the counters of every file
+//	opened by name.  Printed at halt when asked for with -ios.
+//
+//	"json" -- print one JSON object instead of tables
+//----------------------------------------------------------------------
+
+void
+Kernel::PrintIOStats(bool json)
+{
+    if (json) {
+        cout << "{\"disk\": ";
+        stats->PrintDisk(TRUE);
+#ifndef FILESYS_STUB
+        cout << ", \"files\": ";
+        cout.flush();
+        fileSystem->PrintStats(TRUE);
 #endif
+        cout << "}\n";
+        return;
+    }
+    stats->PrintDisk(FALSE);
+#ifndef FILESYS_STUB
+    cout << "File I/O:\n";
+    cout.flush();
+    fileSystem->PrintStats(FALSE);
+#endif
+}
 
+//----------------------------------------------------------------------
+// Kernel::PrintBenchmark
+// 	Print what this run cost, as one line of JSON, for the benchmark
+//	driver (test/FS_bench.sh) to collect: simulated ticks, disk
+//	requests, system calls, and host seconds.  Printed at halt when
+//	asked for with -bench.
+//----------------------------------------------------------------------
+
+void
+Kernel::PrintBenchmark()
+{
+    printf("{\"bench\": \"%s\", \"ticks\": %d, \"diskReads\": %d, "
+           "\"diskWrites\": %d, \"syscalls\": %d, \"wallSeconds\": %.6f}\n",
+           benchName, stats->totalTicks, stats->numDiskReads,
+           stats->numDiskWrites, stats->numSyscalls,
+           WallClock() - startTime);
+    fflush(stdout);
+}
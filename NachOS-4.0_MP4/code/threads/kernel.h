@@ -24,6 +24,8 @@ class PostOfficeOutput;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
+class DiskTrace;
+class FileLockTable;
 
 
 
@@ -45,7 +47,14 @@ class Kernel {
     void ThreadSelfTest();	// self test of threads and synchronization
 	
     void ConsoleTest();         // interactive console self test
+    void FileSystemStress(int numThreads);
+                                // many threads using the file system
+                                // at once; checks and times them
     void NetworkTest();         // interactive 2-machine network test
+    void PrintIOStats(bool json); // where the disk I/O went, by category
+                                // and by file
+    void PrintBenchmark();      // one JSON line of run costs, for the
+                                // benchmark driver
 	Thread* getThread(int threadID){return t[threadID];}    
 
 	#ifdef FILESYS_STUB	
@@ -64,18 +73,20 @@ class Kernel {
     SynchConsoleInput *synchConsoleIn;
     SynchConsoleOutput *synchConsoleOut;
     SynchDisk *synchDisk;
+    DiskTrace *diskTrace;	// where disk requests are recorded, or NULL
     FileSystem *fileSystem;     
+    FileLockTable *fileLocks;	// lock of every file in use
     PostOfficeInput *postOfficeIn;
     PostOfficeOutput *postOfficeOut;
 
     int hostName;               // machine identifier
+    int threadNum;		// ID for the next thread forked
 
   private:
 
 	Thread* t[10];
 	char*   execfile[10];
 	int execfileNum;
-	int threadNum;
     bool randomSlice;		// enable pseudo-random time slicing
     bool debugUserProg;         // single step user program
     double reliability;         // likelihood messages are dropped
@@ -83,7 +94,20 @@ class Kernel {
     char *consoleOut;           // file to send console output to
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
+    int clusterSectors;       // sectors per cluster, if formatting
 #endif
+    int numDisks;             // number of disks to stripe sectors over
+    char *diskModel;          // latency model of each disk
+    bool mapDiskFlag;         // mmap the disk image instead of
+                              // reading/writing it sector by sector
+    bool sparseDiskFlag;      // keep all-zero sectors out of the image
+    char *restoreName;        // snapshot to restore the disk from
+    char *deltaName;          // delta to apply to the disk after that
+    char *traceName;          // file to record disk requests in
+    bool ioStatsFlag;         // print I/O statistics at halt
+    bool ioStatsJson;         //  ... as JSON instead of a table
+    char *benchName;          // name of the benchmark being run, if any
+    double startTime;         // host time when Nachos started
 };
 
 
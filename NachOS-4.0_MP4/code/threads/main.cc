@@ -4,9 +4,23 @@
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
 //              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
-//              -f -cp <unix file> <nachos file>
+//              -f -cs <sectors> -cp <unix file> <nachos file>
+//              -cpz <unix file> <nachos file>
+//              -cpa <unix file> <nachos file>
+//              -cpr <unix file or directory> <nachos path>
+//              -cpout <nachos file or directory> <unix path>
 //              -p <nachos file> -r <nachos file> -l -D
 //              -n <network reliability> -m <machine id>
+//              -disks <#> -dm <disk model> -mmap
+//              -sparse -restore <snapshot file> -snapshot <snapshot file>
+//              -applydelta <delta file> -delta <generation> <delta file>
+//              -ios <table or json> -trace <trace file> -bench <name>
+//              -replay <trace file> -rsched <scheduler> -rcache <sectors>
+//              -defrag -dtrace <trace file> -alloc <policy> -fragstat
+//              -mkdir <nachos dir> -mkdirb <nachos dir>
+//              -mv <nachos path> <nachos path> -fsstress <threads>
+//              -snap <name> -snaprm <name> -snapview <name> -snapls
+//              -dedup <on or off> -dedupstat
 //              -z -K -C -N
 //
 //    -d causes certain debugging messages to be printed (see debug.h)
@@ -18,17 +32,83 @@
 //    -co specify file for console output (stdout is the default)
 //    -n sets the network reliability
 //    -m sets this machine's host id (needed for the network)
+//    -disks stripes the simulated disk over this many disks (1 to 8)
+//    -dm chooses how long disk requests take: hdd (the default),
+//       hdd,<sectors per track>,<seek time>,<rotation time>, ssd, or
+//       ssd,<read time>,<write time>,<channels> (see diskmodel.h)
+//    -mmap accesses the simulated disk's UNIX file through mmap
+//    -sparse keeps all-zero sectors out of the simulated disk's UNIX file
+//    -restore loads the whole disk from a snapshot before anything else
+//    -snapshot saves the disk to a compact snapshot after the file
+//       system commands below have run
+//    -applydelta writes the sectors of a delta to the disk, after
+//       -restore and before anything else
+//    -delta saves the sectors written since a generation to a delta,
+//       after the file system commands below have run; each snapshot
+//       or delta prints the generation it goes up to, for the next
+//       delta to start from (see machine/disk.h)
+//    -ios prints disk I/O statistics at halt, by category and by file
+//    -trace records every disk request to a binary trace file
+//    -bench prints the run's ticks, disk requests, system calls and host
+//       time at halt, as one line of JSON (see test/FS_bench.sh)
+//    -replay runs a trace through the -dm latency model instead of
+//       running Nachos, and compares the timing with the original run
+//    -rsched sets the replay's disk scheduler: fifo (the default),
+//       sstf or scan (see disktrace.h)
+//    -rcache gives the replay a cache of this many sectors
 //    -K run a simple self test of kernel threads and synchronization
 //    -C run an interactive console test
 //    -N run a two-machine network test (see Kernel::NetworkTest)
 //
 //    Filesystem-related flags:
 //    -f forces the Nachos disk to be formatted
+//    -cs sets the cluster size the disk is formatted with: how many
+//       sectors (1, the default, 2, 4, ... up to 32) are allocated at
+//       a time (see filesys/pbitmap.h).  A disk with clusters bigger
+//       than a sector can't have snapshots, deduplication or -defrag
 //    -cp copies a file from UNIX to Nachos
+//    -cpz copies a file from UNIX to Nachos, and stores it compressed
+//       (see filesys/compress.h)
+//    -cpa copies a file from UNIX to Nachos by appending to an empty
+//       file, as a program that doesn't know the size would; its blocks
+//       are allocated as the writes are flushed (see filesys/openfile.h)
+//    -cpr copies a UNIX file or directory tree into Nachos, in bulk
+//    -cpout copies a Nachos file or directory tree out to UNIX
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system
+//    -mkdir creates a Nachos directory, with room for 64 entries
+//    -mkdirb creates an indexed Nachos directory, for any number of
+//       entries (a B+-tree; see filesys/dirindex.h)
+//    -mv renames a Nachos file or directory, possibly into another
+//       directory, without copying its data
+//    -fsstress runs this many kernel threads (1 to 8) that use the file
+//       system at once, checks what they did, and prints how long it
+//       took (see Kernel::FileSystemStress)
+//    -defrag moves fragmented files into contiguous runs of sectors,
+//       after the commands above
+//    -dtrace gives -defrag a trace of a typical workload: the files it
+//       reads most are moved first, and the trace is replayed through
+//       the -dm latency model to show the time saved
+//    -alloc places the runs of clusters allocated by this run, before
+//       the commands above: first, best (the default) or nearest fit
+//       (see filesys/extent.h)
+//    -fragstat prints how fragmented the files and the free space
+//       are, after -defrag
+//    -snap takes a filesystem snapshot, before the commands above; its
+//       sectors are copied only as they are overwritten later (see
+//       filesys/snapshot.h)
+//    -snaprm deletes a filesystem snapshot, freeing what only it kept
+//    -snapview makes -p, -l, -lr and -cpout read a filesystem snapshot
+//       instead of the live file system; nothing may be written then,
+//       and commands that write are refused
+//    -snapls lists the filesystem snapshots, after the commands above
+//    -dedup turns deduplication of the data blocks written from now on
+//       on or off, before the commands above; the setting stays on the
+//       disk (see filesys/dedup.h)
+//    -dedupstat prints how many blocks share sectors, and the disk and
+//       cache space that saves, after the commands above
 //
 //  Note: the file system flags are not used if the stub filesystem
 //        is being used
@@ -45,6 +125,10 @@
 #include "filesys.h"
 #include "openfile.h"
 #include "sysdep.h"
+#include "disk.h"
+#include "synchdisk.h"
+#include "disktrace.h"
+#include "compress.h"
 
 // global variables
 Kernel *kernel;
@@ -72,14 +156,19 @@ static const int TransferSize = 128;
 #ifndef FILESYS_STUB
 //----------------------------------------------------------------------
 // Copy
-//      Copy the contents of the UNIX file "from" to the Nachos file "to"
+//      Copy the contents of the UNIX file "from" to the Nachos file "to",
+//      compressing it if "compressed".  A compressed file is written a
+//      whole chunk at a time, so each chunk is compressed only once.
+//      If "append", the Nachos file starts empty, and grows as it is
+//      written.
 //----------------------------------------------------------------------
 
-static void Copy(char *from, char *to)
+static void Copy(char *from, char *to, bool compressed, bool append)
 {
     int fd;
     OpenFile *openFile;
     int amountRead, fileLength;
+    int transferSize = compressed ? CompressChunk : TransferSize;
     char *buffer;
 
     // Open UNIX file
@@ -94,9 +183,10 @@ static void Copy(char *from, char *to)
     fileLength = Tell(fd);
     Lseek(fd, 0, 0);
 
-    // Create a Nachos file of the same length
+    // Create a Nachos file of the same length (or an empty one)
     DEBUG('f', "Copying file " << from << " of size " << fileLength << " to file " << to);
-    if (!kernel->fileSystem->Create(to, fileLength, false))
+    if (!kernel->fileSystem->Create(to, append ? 0 : fileLength, false, false,
+                                    compressed))
     { // Create Nachos file
         printf("Copy: couldn't create output file %s\n", to);
         Close(fd);
@@ -108,9 +198,9 @@ static void Copy(char *from, char *to)
     ASSERT(openFile != NULL);
 
     DEBUG('f', "Start transfering");
-    // Copy the data in TransferSize chunks
-    buffer = new char[TransferSize];
-    while ((amountRead = ReadPartial(fd, buffer, sizeof(char) * TransferSize)) > 0)
+    // Copy the data in TransferSize (or CompressChunk) chunks
+    buffer = new char[transferSize];
+    while ((amountRead = ReadPartial(fd, buffer, sizeof(char) * transferSize)) > 0)
         openFile->Write(buffer, amountRead);
     delete[] buffer;
 
@@ -119,6 +209,306 @@ static void Copy(char *from, char *to)
     Close(fd);
 }
 
+//-------------------------------------------------------------------
+// Constant used by "Import"
+//   Bulk imports read the UNIX side in much larger chunks than Copy,
+//   so that every Nachos write covers many whole sectors and never
+//   has to read-modify-write a partial one.
+//-------------------------------------------------------------------
+static const int BulkTransferSize = 64 * SectorSize;
+
+static int importedFiles, importedDirs; // totals for the import report
+
+//----------------------------------------------------------------------
+// MakeNachosPath
+//      Build the Nachos path of entry "name" inside directory "parent"
+//      into "path".  Return FALSE (and complain) if the result cannot be
+//      represented in the Nachos file system.
+//----------------------------------------------------------------------
+
+static bool MakeNachosPath(char *parent, char *name, char *path)
+{
+    if (strlen(name) > FileNameMaxLen)
+    {
+        printf("Import: skipping %s, name longer than %d characters\n", name, FileNameMaxLen);
+        return FALSE;
+    }
+    if (strlen(parent) + strlen(name) + 2 > 256)
+    {
+        printf("Import: skipping %s, path too long\n", name);
+        return FALSE;
+    }
+    if (strcmp(parent, "/") == 0)
+        sprintf(path, "/%s", name);
+    else
+        sprintf(path, "%s/%s", parent, name);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// ImportFile
+//      Copy the UNIX file "from" to the new Nachos file "to".  The Nachos
+//      file is created at its final size up front, so its sectors are
+//      laid out contiguously if the disk has room for that.
+//----------------------------------------------------------------------
+
+static void ImportFile(char *from, char *to)
+{
+    int fd;
+    OpenFile *openFile;
+    int amountRead, fileLength;
+    char *buffer;
+
+    if ((fd = OpenForReadWrite(from, FALSE)) < 0)
+    {
+        printf("Import: couldn't open input file %s\n", from);
+        return;
+    }
+    Lseek(fd, 0, 2);
+    fileLength = Tell(fd);
+    Lseek(fd, 0, 0);
+
+    DEBUG('f', "Importing file " << from << " of size " << fileLength << " to file " << to);
+    if (!kernel->fileSystem->Create(to, fileLength, false))
+    {
+        printf("Import: couldn't create output file %s\n", to);
+        Close(fd);
+        return;
+    }
+    openFile = kernel->fileSystem->Open(to);
+    ASSERT(openFile != NULL);
+
+    buffer = new char[BulkTransferSize];
+    while ((amountRead = ReadPartial(fd, buffer, BulkTransferSize)) > 0)
+        openFile->Write(buffer, amountRead);
+    delete[] buffer;
+
+    delete openFile;
+    Close(fd);
+    importedFiles++;
+}
+
+//----------------------------------------------------------------------
+// ImportDirectories
+//      First pass of a tree import: create every directory under the
+//      UNIX directory "from" inside the Nachos directory "to", parents
+//      before children.
+//----------------------------------------------------------------------
+
+static void ImportDirectories(char *from, char *to)
+{
+    void *dir = OpenDirectory(from);
+    char *name;
+    char unixPath[1024], nachosPath[256];
+
+    if (dir == NULL)
+    {
+        printf("Import: couldn't open input directory %s\n", from);
+        return;
+    }
+    while ((name = ReadDirectory(dir)) != NULL)
+    {
+        sprintf(unixPath, "%s/%s", from, name);
+        if (!IsDirectory(unixPath) || !MakeNachosPath(to, name, nachosPath))
+            continue;
+        if (!kernel->fileSystem->Create(nachosPath, DirectoryFileSize, true))
+        {
+            printf("Import: couldn't create directory %s\n", nachosPath);
+            continue;
+        }
+        importedDirs++;
+        ImportDirectories(unixPath, nachosPath);
+    }
+    CloseDirectory(dir);
+}
+
+//----------------------------------------------------------------------
+// ImportFiles
+//      Second pass of a tree import: copy every regular file under the
+//      UNIX directory "from" into the matching Nachos directory.
+//----------------------------------------------------------------------
+
+static void ImportFiles(char *from, char *to)
+{
+    void *dir = OpenDirectory(from);
+    char *name;
+    char unixPath[1024], nachosPath[256];
+
+    if (dir == NULL)
+        return; // already reported by ImportDirectories
+    while ((name = ReadDirectory(dir)) != NULL)
+    {
+        sprintf(unixPath, "%s/%s", from, name);
+        if (!MakeNachosPath(to, name, nachosPath))
+            continue;
+        if (IsDirectory(unixPath))
+            ImportFiles(unixPath, nachosPath);
+        else
+            ImportFile(unixPath, nachosPath);
+    }
+    CloseDirectory(dir);
+}
+
+//----------------------------------------------------------------------
+// Import
+//      Copy the UNIX file or directory tree "from" to the Nachos path
+//      "to", then report how fast the simulated disk absorbed it.
+//
+//      All directories are created in one pass before any file data is
+//      written, and the whole import runs as a single metadata batch, so
+//      the free map and root directory are read and written only once.
+//----------------------------------------------------------------------
+
+static void Import(char *from, char *to)
+{
+    int startTicks = kernel->stats->totalTicks;
+    int startWrites = kernel->stats->numDiskWrites;
+    int ticks, sectors;
+    OpenFile *target;
+
+    importedFiles = importedDirs = 0;
+    kernel->fileSystem->BeginBatch();
+    if (!IsDirectory(from))
+        ImportFile(from, to);
+    else
+    {
+        if (strcmp(to, "/") != 0)
+        {
+            if ((target = kernel->fileSystem->Open(to)) != NULL)
+                delete target;
+            else if (kernel->fileSystem->Create(to, DirectoryFileSize, true))
+                importedDirs++;
+        }
+        ImportDirectories(from, to);
+        ImportFiles(from, to);
+    }
+    kernel->fileSystem->EndBatch();
+
+    ticks = kernel->stats->totalTicks - startTicks;
+    sectors = kernel->stats->numDiskWrites - startWrites;
+    printf("Import: %d files, %d directories, %d sectors written in %d ticks",
+           importedFiles, importedDirs, sectors, ticks);
+    if (ticks > 0)
+        printf(" (%.0f sectors per simulated second)", sectors * 1000000.0 / ticks);
+    printf("\n");
+}
+
+static int exportedFiles, exportedDirs, exportedBytes; // totals for the export report
+
+//----------------------------------------------------------------------
+// ExportFile
+//      Copy the Nachos file "from" to the UNIX file "to", byte for byte,
+//      in BulkTransferSize chunks.
+//----------------------------------------------------------------------
+
+static void ExportFile(char *from, char *to)
+{
+    int fd;
+    OpenFile *openFile;
+    int amountRead;
+    char *buffer;
+
+    if ((openFile = kernel->fileSystem->Open(from)) == NULL)
+    {
+        printf("Export: unable to open file %s\n", from);
+        return;
+    }
+    if ((fd = OpenForWrite(to, FALSE)) < 0)
+    {
+        printf("Export: couldn't create output file %s\n", to);
+        delete openFile;
+        return;
+    }
+
+    DEBUG('f', "Exporting file " << from << " to file " << to);
+    buffer = new char[BulkTransferSize];
+    while ((amountRead = openFile->Read(buffer, BulkTransferSize)) > 0)
+    {
+        WriteFile(fd, buffer, amountRead);
+        exportedBytes += amountRead;
+    }
+    delete[] buffer;
+
+    delete openFile;
+    Close(fd);
+    exportedFiles++;
+}
+
+//----------------------------------------------------------------------
+// ExportTree
+//      Copy everything in the Nachos directory "from" into the UNIX
+//      directory "to", creating UNIX directories as needed.  Entries
+//      whose paths don't fit are skipped, with a complaint.
+//----------------------------------------------------------------------
+
+static void ExportTree(char *from, char *to)
+{
+    Directory *directory = kernel->fileSystem->FetchDirectory(from);
+    DirectoryEntry entry;
+    int cursor = 0;
+    char nachosPath[256], unixPath[1024];
+
+    ASSERT(directory != NULL);
+    if (!MakeDirectory(to))
+    {
+        printf("Export: couldn't create output directory %s\n", to);
+        delete directory;
+        return;
+    }
+    exportedDirs++;
+    while (directory->NextEntry(&cursor, &entry))
+    {
+        int nachosLength = snprintf(nachosPath, sizeof(nachosPath), "%s/%s",
+                                    strcmp(from, "/") == 0 ? "" : from,
+                                    entry.name);
+        int unixLength = snprintf(unixPath, sizeof(unixPath), "%s/%s",
+                                  to, entry.name);
+
+        if (nachosLength < 0 || nachosLength >= (int) sizeof(nachosPath) ||
+            unixLength < 0 || unixLength >= (int) sizeof(unixPath))
+        {
+            printf("Export: skipping %s, path too long\n", entry.name);
+            continue;
+        }
+        if (entry.isDir)
+            ExportTree(nachosPath, unixPath);
+        else
+            ExportFile(nachosPath, unixPath);
+    }
+    delete directory;
+}
+
+//----------------------------------------------------------------------
+// Export
+//      Copy the Nachos file or directory tree "from" to the UNIX path
+//      "to".  This is the fast way to back up the contents of the disk;
+//      unlike Print, binary data comes out unchanged.
+//----------------------------------------------------------------------
+
+static void Export(char *from, char *to)
+{
+    Directory *directory = kernel->fileSystem->FetchDirectory(from);
+    int startTicks = kernel->stats->totalTicks;
+    int startReads = kernel->stats->numDiskReads;
+    int ticks, sectors;
+
+    exportedFiles = exportedDirs = exportedBytes = 0;
+    if (directory == NULL)
+        ExportFile(from, to);
+    else
+    {
+        delete directory;
+        ExportTree(from, to);
+    }
+    ticks = kernel->stats->totalTicks - startTicks;
+    sectors = kernel->stats->numDiskReads - startReads;
+    printf("Export: %d files, %d directories, %d bytes, %d sectors read in %d ticks",
+           exportedFiles, exportedDirs, exportedBytes, sectors, ticks);
+    if (ticks > 0)
+        printf(" (%.0f sectors per simulated second)", sectors * 1000000.0 / ticks);
+    printf("\n");
+}
+
 #endif // FILESYS_STUB
 
 //----------------------------------------------------------------------
@@ -129,7 +519,7 @@ static void Copy(char *from, char *to)
 void Print(char *name)
 {
     OpenFile *openFile;
-    int i, amountRead;
+    int amountRead;
     char *buffer;
 
     if ((openFile = kernel->fileSystem->Open(name)) == NULL)
@@ -140,8 +530,7 @@ void Print(char *name)
 
     buffer = new char[TransferSize];
     while ((amountRead = openFile->Read(buffer, TransferSize)) > 0)
-        for (i = 0; i < amountRead; i++)
-            printf("%c", buffer[i]);
+        fwrite(buffer, sizeof(char), amountRead, stdout);
     delete[] buffer;
 
     delete openFile; // close the Nachos file
@@ -151,12 +540,12 @@ void Print(char *name)
 //----------------------------------------------------------------------
 // MP4 mod tag
 // CreateDirectory
-//      Create a new directory with "name"
+//      Create a new directory with "name"; an indexed one if "indexed"
 //----------------------------------------------------------------------
-static void CreateDirectory(char *name)
+static void CreateDirectory(char *name, bool indexed)
 {
     // MP4 Assignment
-    kernel->fileSystem->Create(name, DirectoryFileSize, true);
+    kernel->fileSystem->Create(name, DirectoryFileSize, true, indexed);
     //此 function 在使用 -mkdir 指令時呼叫。
     //將 isDir 設定為 true 代表建立的是 directory，而非 file。
 }
@@ -183,9 +572,23 @@ int main(int argc, char **argv)
     bool threadTestFlag = false;
     bool consoleTestFlag = false;
     bool networkTestFlag = false;
+    char *replayName = NULL;         // disk trace to replay
+    char *replayModel = "hdd";       // ... through this latency model
+    char *replayScheduler = "fifo";  // ... in the order of this scheduler
+    int replayCache = 0;             // ... with a cache of this many sectors
 #ifndef FILESYS_STUB
     char *copyUnixFileName = NULL;   // UNIX file to be copied into Nachos
     char *copyNachosFileName = NULL; // name of copied file in Nachos
+    bool copyCompressed = false;     // compress it (-cpz)
+    bool copyAppend = false;         // grow it as it is written (-cpa)
+    char *importUnixName = NULL;     // UNIX file or tree to bulk import
+    char *importNachosName = NULL;   // where to put it in Nachos
+    char *exportNachosName = NULL;   // Nachos file or tree to export
+    char *exportUnixName = NULL;     // where to put it in UNIX
+    char *snapshotName = NULL;       // where to save a disk snapshot
+    char *deltaName = NULL;          // where to save a delta ...
+    int deltaSince = 0;              // ... of the writes after this
+                                     //  generation
     char *printFileName = NULL;
     char *removeFileName = NULL;
     bool dirListFlag = false;
@@ -194,8 +597,24 @@ int main(int argc, char **argv)
     char *createDirectoryName = NULL;
     char *listDirectoryName = NULL;
     bool mkdirFlag = false;
+    bool indexedFlag = false;
     bool recursiveListFlag = false;
     bool recursiveRemoveFlag = false;
+    bool defragFlag = false;
+    char *defragTraceName = NULL;    // workload to defragment for
+    char *renameFrom = NULL;         // Nachos path to rename ...
+    char *renameTo = NULL;           // ... and its new name
+    int stressThreads = 0;           // threads for -fsstress, 0 for none
+    char *takeSnapshotName = NULL;   // filesystem snapshot to take,
+    char *deleteSnapshotName = NULL; // ... to delete,
+    char *viewSnapshotName = NULL;   // ... and to read from
+    bool execFlag = false;           // user programs to run (-e, which
+                                     //  the Kernel constructor handles)
+    bool listSnapshotsFlag = false;
+    char *dedupMode = NULL;          // "on" or "off", NULL to leave it
+    bool dedupStatFlag = false;
+    char *allocPolicy = NULL;        // "first", "best" or "nearest"
+    bool fragStatFlag = false;
 #endif //FILESYS_STUB
 
     // some command line arguments are handled here.
@@ -231,6 +650,34 @@ int main(int argc, char **argv)
         {
             networkTestFlag = TRUE;
         }
+        else if (strcmp(argv[i], "-replay") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            replayName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-dm") == 0)
+        {
+            ASSERT(i + 1 < argc); // also checked by the Kernel
+            replayModel = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-rsched") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            replayScheduler = argv[i + 1];
+            ASSERT(strcmp(replayScheduler, "fifo") == 0 ||
+                   strcmp(replayScheduler, "sstf") == 0 ||
+                   strcmp(replayScheduler, "scan") == 0);
+            i++;
+        }
+        else if (strcmp(argv[i], "-rcache") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            replayCache = atoi(argv[i + 1]);
+            ASSERT(replayCache >= 0);
+            i++;
+        }
 #ifndef FILESYS_STUB
         else if (strcmp(argv[i], "-cp") == 0)
         {
@@ -239,6 +686,49 @@ int main(int argc, char **argv)
             copyNachosFileName = argv[i + 2];
             i += 2;
         }
+        else if (strcmp(argv[i], "-cpz") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            copyUnixFileName = argv[i + 1];
+            copyNachosFileName = argv[i + 2];
+            copyCompressed = true;
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-cpa") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            copyUnixFileName = argv[i + 1];
+            copyNachosFileName = argv[i + 2];
+            copyAppend = true;
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-cpr") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            importUnixName = argv[i + 1];
+            importNachosName = argv[i + 2];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-cpout") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            exportNachosName = argv[i + 1];
+            exportUnixName = argv[i + 2];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-snapshot") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            snapshotName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-delta") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            deltaSince = atoi(argv[i + 1]);
+            deltaName = argv[i + 2];
+            i += 2;
+        }
         else if (strcmp(argv[i], "-p") == 0)
         {
             ASSERT(i + 1 < argc);
@@ -285,20 +775,117 @@ int main(int argc, char **argv)
             mkdirFlag = true;
             i++;
         }
+        else if (strcmp(argv[i], "-mkdirb") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            createDirectoryName = argv[i + 1];
+            mkdirFlag = true;
+            indexedFlag = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "-mv") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            renameFrom = argv[i + 1];
+            renameTo = argv[i + 2];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-fsstress") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            stressThreads = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-snap") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            takeSnapshotName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-snaprm") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            deleteSnapshotName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-snapview") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            viewSnapshotName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-snapls") == 0)
+        {
+            listSnapshotsFlag = true;
+        }
+        else if (strcmp(argv[i], "-e") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            execFlag = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "-dedup") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            dedupMode = argv[i + 1];
+            ASSERT(strcmp(dedupMode, "on") == 0 || strcmp(dedupMode, "off") == 0);
+            i++;
+        }
+        else if (strcmp(argv[i], "-dedupstat") == 0)
+        {
+            dedupStatFlag = true;
+        }
         else if (strcmp(argv[i], "-D") == 0)
         {
             dumpFlag = true;
         }
+        else if (strcmp(argv[i], "-defrag") == 0)
+        {
+            defragFlag = true;
+        }
+        else if (strcmp(argv[i], "-dtrace") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            defragTraceName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-alloc") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            allocPolicy = argv[i + 1];
+            ASSERT(strcmp(allocPolicy, "first") == 0 ||
+                   strcmp(allocPolicy, "best") == 0 ||
+                   strcmp(allocPolicy, "nearest") == 0);
+            i++;
+        }
+        else if (strcmp(argv[i], "-fragstat") == 0)
+        {
+            fragStatFlag = true;
+        }
 #endif //FILESYS_STUB
         else if (strcmp(argv[i], "-u") == 0)
         {
             cout << "Partial usage: nachos [-z -d debugFlags]\n";
             cout << "Partial usage: nachos [-x programName]\n";
             cout << "Partial usage: nachos [-K] [-C] [-N]\n";
+            cout << "Partial usage: nachos [-replay traceFile] [-dm diskModel] [-rsched fifo|sstf|scan] [-rcache #]\n";
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cpz UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cpa UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cpr UnixPath NachosPath]\n";
+            cout << "Partial usage: nachos [-cpout NachosPath UnixPath]\n";
+            cout << "Partial usage: nachos [-snapshot snapshotFile]\n";
+            cout << "Partial usage: nachos [-delta generation deltaFile]\n";
             cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
             cout << "Partial usage: nachos [-l] [-D]\n";
+            cout << "Partial usage: nachos [-mkdir dirName] [-mkdirb dirName]\n";
+            cout << "Partial usage: nachos [-mv fromName toName]\n";
+            cout << "Partial usage: nachos [-fsstress #]\n";
+            cout << "Partial usage: nachos [-defrag] [-dtrace traceFile]\n";
+            cout << "Partial usage: nachos [-alloc first|best|nearest] [-fragstat]\n";
+            cout << "Partial usage: nachos [-snap name] [-snaprm name] [-snapview name] [-snapls]\n";
+            cout << "Partial usage: nachos [-dedup on|off] [-dedupstat]\n";
 #endif //FILESYS_STUB
         }
     }
@@ -308,6 +895,17 @@ int main(int argc, char **argv)
 
     kernel = new Kernel(argc, argv);
 
+    // Replaying a disk trace needs no machine at all: no disk, no
+    // threads, no user programs.
+    if (replayName != NULL)
+    {
+        DiskReplayer *replayer =
+            new DiskReplayer(replayModel, replayScheduler, replayCache);
+        bool ok = replayer->Replay(replayName);
+        delete replayer;
+        Exit(ok ? 0 : 1);
+    }
+
     kernel->Initialize();
 
     CallOnUserAbort(Cleanup); // if user hits ctl-C
@@ -328,13 +926,62 @@ int main(int argc, char **argv)
     }
 
 #ifndef FILESYS_STUB
+    if (allocPolicy != NULL)
+    {
+        if (strcmp(allocPolicy, "first") == 0)
+            kernel->fileSystem->SetAllocation(FirstFit);
+        else if (strcmp(allocPolicy, "nearest") == 0)
+            kernel->fileSystem->SetAllocation(NearestFit);
+        else
+            kernel->fileSystem->SetAllocation(BestFit);
+    }
+    if (viewSnapshotName != NULL &&
+        (deleteSnapshotName != NULL || takeSnapshotName != NULL ||
+         dedupMode != NULL || removeFileName != NULL ||
+         copyUnixFileName != NULL || importUnixName != NULL || mkdirFlag ||
+         renameFrom != NULL || stressThreads > 0 || defragFlag || execFlag))
+    {   // a snapshot is read-only: nothing may be written while viewing it
+        printf("Snapshot %s is read-only: -snapview can't be used with "
+               "-snap, -snaprm, -dedup, -r, -cp, -cpr, -mkdir, -mv, "
+               "-fsstress, -defrag or -e\n", viewSnapshotName);
+        Exit(1);
+    }
+    if (viewSnapshotName != NULL &&
+        !kernel->fileSystem->ViewSnapshot(viewSnapshotName))
+    {
+        printf("No snapshot %s\n", viewSnapshotName);
+        Exit(1);
+    }
+    if (deleteSnapshotName != NULL &&
+        !kernel->fileSystem->DeleteSnapshot(deleteSnapshotName))
+    {
+        printf("No snapshot %s\n", deleteSnapshotName);
+    }
+    if (takeSnapshotName != NULL &&
+        !kernel->fileSystem->TakeSnapshot(takeSnapshotName))
+    {
+        printf("Can't take snapshot %s\n", takeSnapshotName);
+    }
+    if (dedupMode != NULL)
+    {
+        if (!kernel->fileSystem->SetDedup(strcmp(dedupMode, "on") == 0))
+            printf("Can't deduplicate with clusters bigger than a sector\n");
+    }
     if (removeFileName != NULL)
     {
         kernel->fileSystem->Remove(removeFileName);
     }
     if (copyUnixFileName != NULL && copyNachosFileName != NULL)
     {
-        Copy(copyUnixFileName, copyNachosFileName);
+        Copy(copyUnixFileName, copyNachosFileName, copyCompressed, copyAppend);
+    }
+    if (importUnixName != NULL && importNachosName != NULL)
+    {
+        Import(importUnixName, importNachosName);
+    }
+    if (exportNachosName != NULL && exportUnixName != NULL)
+    {
+        Export(exportNachosName, exportUnixName);
     }
     if (dumpFlag)
     {
@@ -349,12 +996,55 @@ int main(int argc, char **argv)
     if (mkdirFlag)
     {
         // MP4 mod tag
-        CreateDirectory(createDirectoryName);
+        CreateDirectory(createDirectoryName, indexedFlag);
+    }
+    if (renameFrom != NULL)
+    {
+        if (!kernel->fileSystem->Rename(renameFrom, renameTo))
+            printf("Can't rename %s to %s\n", renameFrom, renameTo);
+    }
+    if (stressThreads > 0)
+    {
+        kernel->FileSystemStress(stressThreads);
+    }
+    if (defragFlag)
+    {
+        kernel->fileSystem->Defragment(defragTraceName, replayModel);
+    }
+    if (fragStatFlag)
+    {
+        kernel->fileSystem->FragmentationReport();
     }
     if (printFileName != NULL)
     {
         Print(printFileName);
     }
+    if (listSnapshotsFlag)
+    {
+        kernel->fileSystem->ListSnapshots();
+    }
+    if (dedupStatFlag)
+    {
+        kernel->fileSystem->DedupReport();
+    }
+    if (deltaName != NULL)
+    {
+        int upTo = kernel->synchDisk->Generation();
+        int saved = kernel->synchDisk->SaveDelta(deltaName, deltaSince);
+
+        if (saved < 0)
+            printf("Delta: no generation %d to start from\n", deltaSince);
+        else
+            printf("Delta: %d sectors written since generation %d saved to %s, "
+                   "up to generation %d\n", saved, deltaSince, deltaName, upTo);
+    }
+    if (snapshotName != NULL)
+    {
+        int upTo = kernel->synchDisk->Generation();
+        int saved = kernel->synchDisk->SaveSnapshot(snapshotName);
+        printf("Snapshot: %d sectors saved to %s, up to generation %d\n",
+               saved, snapshotName, upTo);
+    }
 #endif // FILESYS_STUB
 
     // finally, run an initial user program if requested to do so
@@ -295,3 +295,148 @@ void Condition::Broadcast(Lock* conditionLock)
         Signal(conditionLock);
     }
 }
+
+// The following class records how many times a thread acquired a
+// RWLock for reading, so it can acquire it again while writers wait.
+
+class RWLockReader {
+  public:
+    Thread *thread;
+    int depth;
+};
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader-writer lock, so that it can be used for
+//	synchronization.  Initially, no one holds it.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName)
+{
+    name = debugName;
+    lock = new Lock("rwlock");
+    readersOK = new Condition("rwlock readers");
+    writerOK = new Condition("rwlock writer");
+    readers = new List<RWLockReader *>;
+    waitingWriters = writerDepth = 0;
+    writer = NULL;
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	Deallocate a reader-writer lock.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    ASSERT(readers->IsEmpty() && writer == NULL);
+    delete readers;
+    delete writerOK;
+    delete readersOK;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// RWLock::FindReader
+// 	Return the record of the current thread holding the lock for
+//	reading, or NULL if it doesn't.  Called with "lock" held.
+//----------------------------------------------------------------------
+
+RWLockReader *RWLock::FindReader()
+{
+    ListIterator<RWLockReader *> it(readers);
+
+    for (; !it.IsDone(); it.Next())
+        if (it.Item()->thread == kernel->currentThread)
+            return it.Item();
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireRead/ReleaseRead
+// 	Hold (let go of) the lock for reading.  If the current thread
+//	holds it for writing already, this just counts as one more
+//	acquire (release) of the write lock; if it holds it for reading
+//	already, it doesn't wait for the writers.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireRead()
+{
+    RWLockReader *reader;
+
+    lock->Acquire();
+    if (writer == kernel->currentThread)
+        writerDepth++;
+    else if ((reader = FindReader()) != NULL)
+        reader->depth++;
+    else {
+        while (writer != NULL || waitingWriters > 0)
+            readersOK->Wait(lock);
+        reader = new RWLockReader;
+        reader->thread = kernel->currentThread;
+        reader->depth = 1;
+        readers->Append(reader);
+    }
+    lock->Release();
+}
+
+void RWLock::ReleaseRead()
+{
+    RWLockReader *reader;
+
+    lock->Acquire();
+    if (writer == kernel->currentThread) {
+        ASSERT(writerDepth > 1);
+        writerDepth--;
+    } else {
+        reader = FindReader();
+        ASSERT(reader != NULL);
+        if (--reader->depth == 0) {
+            readers->Remove(reader);
+            delete reader;
+            if (readers->IsEmpty())
+                writerOK->Signal(lock);
+        }
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite/ReleaseWrite
+// 	Hold (let go of) the lock for writing.  When the writer lets go
+//	for the last time, the next waiting writer gets the lock; if
+//	there is none, every waiting reader does.
+//
+//	A thread holding the lock for reading must not ask to write:
+//	it would wait for itself.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireWrite()
+{
+    lock->Acquire();
+    if (writer != kernel->currentThread) {
+        ASSERT(FindReader() == NULL);
+        waitingWriters++;
+        while (writer != NULL || !readers->IsEmpty())
+            writerOK->Wait(lock);
+        waitingWriters--;
+        writer = kernel->currentThread;
+    }
+    writerDepth++;
+    lock->Release();
+}
+void RWLock::ReleaseWrite()
+{
+    lock->Acquire();
+    ASSERT(writer == kernel->currentThread && writerDepth > 0);
+    if (--writerDepth == 0) {
+        writer = NULL;
+        if (waitingWriters > 0)
+            writerOK->Signal(lock);
+        else
+            readersOK->Broadcast(lock);
+    }
+    lock->Release();
+}
@@ -5,7 +5,8 @@
 //	locks, and condition variables.  The implementation for
 //	semaphores is given; for the latter two, only the procedure
 //	interface is given -- they are to be implemented as part of 
-//	the first assignment.
+//	the first assignment.  Reader-writer locks are built out of a
+//	lock and two condition variables.
 //
 //	Note that all the synchronization objects take a "name" as
 //	part of the initialization.  This is solely for debugging purposes.
@@ -141,4 +142,49 @@ class Condition {
     char* name;
     List<Semaphore *> *waitQueue;	// list of waiting threads
 };
+
+// The following class defines a "reader-writer lock": any number of
+// threads may hold it for reading at once, or one thread for writing.
+//
+//	AcquireRead() -- wait until no thread holds or waits for the lock
+//		for writing, then hold it for reading
+//
+//	AcquireWrite() -- wait until no thread holds the lock, then hold
+//		it for writing
+//
+// Waiting writers keep new readers out, so a stream of readers can't
+// starve them.  A thread that holds the lock may acquire it again, for
+// reading, or for writing if it is the writer, as long as it releases
+// it as many times; that lets code that reads or updates a file call
+// the routines that read and write it.
+
+class RWLockReader;	// a thread holding a RWLock for reading
+
+class RWLock {
+  public:
+    RWLock(char* debugName);		// initialize the lock to be FREE
+    ~RWLock();				// deallocate the lock
+    char* getName() { return name; }
+
+    void AcquireRead();			// these are the only operations
+    void ReleaseRead();			// on a reader-writer lock
+    void AcquireWrite();
+    void ReleaseWrite();
+
+    bool IsWriter() { return writer == kernel->currentThread; }
+					// does the current thread hold
+					// the lock for writing?
+
+  private:
+    char *name;				// debugging assist
+    Lock *lock;				// protects the fields below
+    Condition *readersOK;		// signaled when readers may enter
+    Condition *writerOK;		// signaled when a writer may enter
+    List<RWLockReader *> *readers;	// threads holding it for reading
+    int waitingWriters;			// threads waiting to write
+    Thread *writer;			// thread holding it for writing
+    int writerDepth;			// times the writer acquired it
+
+    RWLockReader *FindReader();		// the current thread, if it reads
+};
 #endif // SYNCH_H
@@ -53,6 +53,56 @@ int SysClose(OpenFileId id)
 {
   return kernel->fileSystem->CloseFile(id);
 }
+
+int SysRemove(char *name)
+{
+  return kernel->fileSystem->Remove(name);
+}
+
+int SysSeek(int position, OpenFileId id)
+{
+  return kernel->fileSystem->SeekFile(position, id);
+}
+
+int SysFallocate(char *name, int length, int keepSize)
+{
+  return kernel->fileSystem->Fallocate(name, length, keepSize != 0);
+}
+
+int SysRename(char *from, char *to)
+{
+  return kernel->fileSystem->Rename(from, to);
+}
+
+int SysReadDir(char *name, DirectoryInfo *entries, int count, int *cursor)
+{
+  return kernel->fileSystem->ReadDir(name, entries, count, cursor);
+}
+
+int SysOpenDir(char *name)
+{
+  return kernel->fileSystem->OpenDirectory(name);
+}
+
+int SysCloseDir(int id)
+{
+  return kernel->fileSystem->CloseDirectory(id);
+}
+
+OpenFileId SysOpenAt(int dir, char *name)
+{
+  return kernel->fileSystem->OpenAt(dir, name);
+}
+
+int SysCreateAt(int dir, char *name, int size)
+{
+  return kernel->fileSystem->CreateAt(dir, name, size);
+}
+
+int SysRemoveAt(int dir, char *name)
+{
+  return kernel->fileSystem->RemoveAt(dir, name);
+}
 // #endif
 
 #endif /* ! __USERPROG_KSYSCALL_H__ */
@@ -34,6 +34,14 @@
 #define SC_ExecV	13
 #define SC_ThreadExit   14
 #define SC_ThreadJoin   15
+#define SC_ReadDir      16
+#define SC_Fallocate    17
+#define SC_Rename       18
+#define SC_OpenDir      19
+#define SC_CloseDir     20
+#define SC_OpenAt       21
+#define SC_CreateAt     22
+#define SC_RemoveAt     23
 #define SC_Add		42
 #define SC_MSG		100
 
@@ -121,6 +129,20 @@ int Create(char *name, int size); // FILE_SYS
 /* Remove a Nachos file, with name "name" */
 int Remove(char *name);
 
+/* Reserve disk space, contiguous if possible, for the first "length"
+ * bytes of the existing file "name".  The file grows to "length" bytes,
+ * unless "keepSize" is set: then the space stays reserved past the end
+ * of the file, and writes that append to the file grow it into that
+ * space.  Return 1 on success, 0 on failure.
+ */
+int Fallocate(char *name, int length, int keepSize);
+
+/* Give the file or directory "from" the new name "to", possibly in
+ * another directory, without copying its data.  "to" must not exist.
+ * Return 1 on success, 0 on failure.
+ */
+int Rename(char *from, char *to);
+
 /* Open the Nachos file "name", and return an "OpenFileId" that can 
  * be used to read and write to the file.
  */
@@ -150,6 +172,48 @@ int Seek(int position, OpenFileId id);
  */
 int Close(OpenFileId id);
 
+/* One entry of a directory, as returned by ReadDir.  (The kernel's
+ * DirectoryInfo, in filesys/directory.h, has the same layout.)
+ */
+typedef struct {
+    char name[12];	/* '\0' terminated */
+    int sector;		/* where its file header is */
+    int isDir;		/* 1 for a directory, 0 for a file */
+    int size;		/* length in bytes */
+} DirEntry;
+
+/* Read up to "count" entries of the directory "name" into "entries",
+ * starting at "*cursor" (0 for the first call), and advance "*cursor"
+ * past them.  Return the number of entries read, 0 once the whole
+ * directory has been read, or a negative error code if "name" is not
+ * a directory.
+ */
+int ReadDir(char *name, DirEntry *entries, int count, int *cursor);
+
+/* A handle on an open Nachos directory. */
+typedef int DirId;
+
+/* Open a handle on the directory "name", to give OpenAt, CreateAt and
+ * RemoveAt paths relative to it: a program working inside a deep
+ * directory then doesn't have the kernel walk down to it from the
+ * root on every call.  The directory can't be removed while the
+ * handle is open.  Return the handle, or a negative error code.
+ */
+DirId OpenDir(char *name);
+
+/* Close a directory handle.  Return 1 on success, negative error code
+ * on failure.
+ */
+int CloseDir(DirId dir);
+
+/* Open, Create and Remove, with "name" a path relative to the directory
+ * "dir" (an absolute "name" ignores "dir", as with UNIX openat).  They
+ * return what Open, Create and Remove do.
+ */
+OpenFileId OpenAt(DirId dir, char *name);
+int CreateAt(DirId dir, char *name, int size);
+int RemoveAt(DirId dir, char *name);
+
 
 /* User-level thread operations: Fork and Yield.  To allow multiple
  * threads to run within a user program. 